@@ -0,0 +1,349 @@
+#include "av_sync.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define AV_SYNC_CHUNKS 128             // Queued chunks remembered for the audio clock (>1 s of 10 ms chunks)
+#define AV_SYNC_MAX_BACKLOG_US 100000  // Queue above target + this is cut by dropping chunks
+#define AV_SYNC_QUEUE_SMOOTHING 16     // Depth samples averaged by the drift controller
+#define AV_SYNC_KP 50.0                // ppm per ms of depth error (20 s time constant)
+#define AV_SYNC_KI 1.0                 // ppm per ms of depth error per second
+
+typedef struct {
+    uint64_t out_start;  // First output frame of the chunk
+    uint32_t out_frames;
+    uint32_t in_frames;
+    uint64_t stream_us;  // Capture time of its first sample
+} queued_chunk_t;
+
+struct av_sync {
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint32_t target_us;
+
+    // Output frames and the stream time each chunk of them carries
+    queued_chunk_t chunks[AV_SYNC_CHUNKS];
+    uint32_t chunk_head;  // Oldest
+    uint32_t chunk_count;
+    uint64_t out_total;
+
+    // Last output position report
+    bool have_position;
+    uint64_t played;
+    uint64_t position_local_us;
+
+    // Drift controller
+    double queue_us;     // Smoothed depth
+    int64_t backlog_frames;  // Depth at the last report plus output queued since
+    double integral_ppm;
+    double correction_ppm;
+
+    // Linear-interpolating resampler: next output position in input frames, where 0 is
+    // the last frame of the previous chunk (prev) and 1 the first frame of the next
+    double resample_pos;
+    int16_t prev[AV_SYNC_MAX_CHANNELS];
+
+    // Lip-sync error of presented frames
+    uint64_t frames;
+    int64_t error_sum_us;
+    uint64_t error_abs_sum_us;
+    uint64_t error_abs_max_us;
+    uint64_t late_frames;
+    uint64_t dropped_chunks;
+    uint64_t underruns;
+};
+
+av_sync_t *av_sync_create(uint32_t sample_rate, uint16_t channels, uint32_t target_ms)
+{
+    if (sample_rate == 0 || channels == 0 || channels > AV_SYNC_MAX_CHANNELS)
+        return NULL;
+
+    av_sync_t *sync = calloc(1, sizeof(av_sync_t));
+    if (!sync)
+        return NULL;
+
+    sync->sample_rate = sample_rate;
+    sync->channels = channels;
+    sync->target_us = (target_ms ? target_ms : AV_SYNC_DEFAULT_TARGET_MS) * 1000;
+    av_sync_reset(sync);
+    return sync;
+}
+
+void av_sync_destroy(av_sync_t *sync)
+{
+    free(sync);
+}
+
+void av_sync_reset(av_sync_t *sync)
+{
+    if (!sync)
+        return;
+
+    sync->chunk_head = 0;
+    sync->chunk_count = 0;
+    sync->out_total = 0;
+    sync->have_position = false;
+    sync->played = 0;
+    sync->queue_us = -1;  // No depth measured yet
+    sync->backlog_frames = 0;
+    sync->integral_ppm = 0;
+    sync->correction_ppm = 0;
+    sync->resample_pos = 1.0;  // Start exactly on the first input frame
+    memset(sync->prev, 0, sizeof(sync->prev));
+}
+
+static uint32_t prefill_frames(const av_sync_t *sync)
+{
+    return (uint32_t)((uint64_t)sync->target_us * sync->sample_rate / 1000000);
+}
+
+uint32_t av_sync_max_output_frames(const av_sync_t *sync, uint32_t in_frames)
+{
+    // (1 + AV_SYNC_MAX_PPM) times the input, plus the frame carried between chunks
+    return in_frames + in_frames / 100 + 2 + (sync && sync->out_total == 0 ? prefill_frames(sync) : 0);
+}
+
+static void record_chunk(av_sync_t *sync, uint64_t stream_us, uint32_t in_frames, uint32_t out_frames)
+{
+    if (sync->chunk_count == AV_SYNC_CHUNKS) {
+        sync->chunk_head = (sync->chunk_head + 1) % AV_SYNC_CHUNKS;
+        sync->chunk_count--;
+    }
+    queued_chunk_t *chunk = &sync->chunks[(sync->chunk_head + sync->chunk_count) % AV_SYNC_CHUNKS];
+    chunk->out_start = sync->out_total;
+    chunk->out_frames = out_frames;
+    chunk->in_frames = in_frames;
+    chunk->stream_us = stream_us;
+    sync->chunk_count++;
+    sync->out_total += out_frames;
+    sync->backlog_frames += out_frames;
+}
+
+// Too far behind for the resampler to catch up in reasonable time: skip audio instead
+static bool drop_for_backlog(av_sync_t *sync, uint32_t frames)
+{
+    int64_t backlog_us = sync->backlog_frames * 1000000 / sync->sample_rate;
+    if (!sync->have_position || backlog_us <= (int64_t)(sync->target_us + AV_SYNC_MAX_BACKLOG_US))
+        return false;
+
+    uint32_t chunk_us = (uint32_t)((uint64_t)frames * 1000000 / sync->sample_rate);
+    sync->backlog_frames -= frames;
+    if (sync->queue_us > chunk_us)
+        sync->queue_us -= chunk_us;
+    sync->dropped_chunks++;
+    return true;
+}
+
+int av_sync_push_audio(av_sync_t *sync, uint64_t stream_us, const int16_t *in, uint32_t in_frames,
+                       int16_t *out, uint32_t out_capacity)
+{
+    if (!sync || !in || !out)
+        return -1;
+    if (in_frames == 0 || drop_for_backlog(sync, in_frames))
+        return 0;
+
+    uint16_t channels = sync->channels;
+    if (sync->out_total == 0) {
+        // Silence standing in for the audio before the stream started
+        uint32_t silence = prefill_frames(sync);
+        if (silence > out_capacity)
+            return -1;
+        memset(out, 0, (size_t)silence * channels * sizeof(int16_t));
+        record_chunk(sync, stream_us - sync->target_us, silence, silence);
+        out += (size_t)silence * channels;
+        out_capacity -= silence;
+        int ret = av_sync_push_audio(sync, stream_us, in, in_frames, out, out_capacity);
+        return ret < 0 ? ret : ret + (int)silence;
+    }
+
+    double step = 1.0 / (1.0 + sync->correction_ppm / 1e6);  // Input frames per output frame
+    double pos = sync->resample_pos;
+    uint32_t produced = 0;
+
+    while (pos < in_frames && produced < out_capacity) {
+        uint32_t index = (uint32_t)pos;
+        double frac = pos - index;
+        const int16_t *a = index == 0 ? sync->prev : in + (size_t)(index - 1) * channels;
+        const int16_t *b = in + (size_t)index * channels;
+        int16_t *dst = out + (size_t)produced * channels;
+        for (uint16_t c = 0; c < channels; c++) {
+            double v = a[c] + (b[c] - a[c]) * frac;
+            dst[c] = (int16_t)(v < 0 ? v - 0.5 : v + 0.5);
+        }
+        produced++;
+        pos += step;
+    }
+
+    sync->resample_pos = pos >= in_frames ? pos - in_frames : 0;
+    memcpy(sync->prev, in + (size_t)(in_frames - 1) * channels, channels * sizeof(int16_t));
+    record_chunk(sync, stream_us, in_frames, produced);
+    return (int)produced;
+}
+
+uint32_t av_sync_queue_audio(av_sync_t *sync, uint64_t stream_us, uint32_t frames)
+{
+    if (!sync || frames == 0 || drop_for_backlog(sync, frames))
+        return 0;
+    uint32_t silence = 0;
+    if (sync->out_total == 0) {
+        silence = prefill_frames(sync);
+        record_chunk(sync, stream_us - sync->target_us, silence, silence);
+    }
+    record_chunk(sync, stream_us, frames, frames);
+    return silence + frames;
+}
+
+void av_sync_audio_position(av_sync_t *sync, uint64_t frames_played, uint64_t local_us)
+{
+    if (!sync)
+        return;
+    if (frames_played > sync->out_total)
+        frames_played = sync->out_total;
+
+    double dt_s = sync->have_position && local_us > sync->position_local_us
+                      ? (local_us - sync->position_local_us) / 1e6 : 0;
+    if (dt_s > 1.0)
+        dt_s = 1.0;
+
+    sync->have_position = true;
+    sync->played = frames_played;
+    sync->position_local_us = local_us;
+    sync->backlog_frames = (int64_t)(sync->out_total - frames_played);
+
+    // Forget chunks that have finished playing (keeping the newest)
+    while (sync->chunk_count > 1) {
+        const queued_chunk_t *oldest = &sync->chunks[sync->chunk_head];
+        if (oldest->out_start + oldest->out_frames > frames_played)
+            break;
+        sync->chunk_head = (sync->chunk_head + 1) % AV_SYNC_CHUNKS;
+        sync->chunk_count--;
+    }
+
+    // PI controller on the smoothed queue depth: a deeper queue than the target means
+    // the stream's clock runs fast against the DAC, so play it slightly faster
+    double depth_us = (double)sync->backlog_frames * 1e6 / sync->sample_rate;
+    if (sync->queue_us < 0)
+        sync->queue_us = depth_us;
+    else
+        sync->queue_us += (depth_us - sync->queue_us) / AV_SYNC_QUEUE_SMOOTHING;
+
+    double error_ms = (sync->queue_us - sync->target_us) / 1000.0;
+    sync->integral_ppm += AV_SYNC_KI * error_ms * dt_s;
+    if (sync->integral_ppm > AV_SYNC_MAX_PPM)
+        sync->integral_ppm = AV_SYNC_MAX_PPM;
+    else if (sync->integral_ppm < -AV_SYNC_MAX_PPM)
+        sync->integral_ppm = -AV_SYNC_MAX_PPM;
+
+    double ppm = -(AV_SYNC_KP * error_ms + sync->integral_ppm);
+    if (ppm > AV_SYNC_MAX_PPM)
+        ppm = AV_SYNC_MAX_PPM;
+    else if (ppm < -AV_SYNC_MAX_PPM)
+        ppm = -AV_SYNC_MAX_PPM;
+    sync->correction_ppm = ppm;
+}
+
+void av_sync_underrun(av_sync_t *sync)
+{
+    if (sync)
+        sync->underruns++;
+}
+
+// Stream time carried by output frame `frame`
+static uint64_t stream_time_at(const av_sync_t *sync, uint64_t frame)
+{
+    const queued_chunk_t *oldest = &sync->chunks[sync->chunk_head];
+    if (frame < oldest->out_start)
+        return oldest->stream_us - (oldest->out_start - frame) * 1000000 / sync->sample_rate;
+
+    for (uint32_t i = 0; i < sync->chunk_count; i++) {
+        const queued_chunk_t *chunk = &sync->chunks[(sync->chunk_head + i) % AV_SYNC_CHUNKS];
+        if (frame < chunk->out_start + chunk->out_frames) {
+            // Resampled frames span the chunk's input duration
+            uint64_t offset = frame - chunk->out_start;
+            return chunk->stream_us + offset * chunk->in_frames * 1000000 /
+                                          ((uint64_t)chunk->out_frames * sync->sample_rate);
+        }
+    }
+
+    // Everything queued has played (underrun): the clock stops at the end of the audio
+    const queued_chunk_t *newest = &sync->chunks[(sync->chunk_head + sync->chunk_count - 1) % AV_SYNC_CHUNKS];
+    return newest->stream_us + (uint64_t)newest->in_frames * 1000000 / sync->sample_rate;
+}
+
+int av_sync_audio_clock(const av_sync_t *sync, uint64_t local_us, uint64_t *stream_us)
+{
+    if (!sync || !stream_us || !sync->have_position || sync->chunk_count == 0)
+        return -1;
+
+    // Extrapolate the reported position at the nominal rate
+    int64_t elapsed_us = (int64_t)(local_us - sync->position_local_us);
+    int64_t frame = (int64_t)sync->played + elapsed_us * (int64_t)sync->sample_rate / 1000000;
+    if (frame < 0)
+        frame = 0;
+    if ((uint64_t)frame > sync->out_total)
+        frame = (int64_t)sync->out_total;
+
+    *stream_us = stream_time_at(sync, (uint64_t)frame);
+    return 0;
+}
+
+int av_sync_schedule_frame(av_sync_t *sync, uint64_t stream_us, uint64_t local_now_us,
+                           uint64_t *present_local_us)
+{
+    if (present_local_us)
+        *present_local_us = local_now_us;
+
+    uint64_t heard_us;
+    if (!sync || !present_local_us || av_sync_audio_clock(sync, local_now_us, &heard_us) < 0)
+        return AV_SYNC_NO_CLOCK;
+
+    int64_t ahead_us = (int64_t)(stream_us - heard_us);
+    if (ahead_us < -AV_SYNC_LATE_US) {
+        sync->late_frames++;
+        return AV_SYNC_LATE;
+    }
+    if (ahead_us > AV_SYNC_MAX_HOLD_US)
+        return AV_SYNC_NO_CLOCK;  // Audio and video clocks disagree (stream restart?)
+    if (ahead_us > 0)
+        *present_local_us = local_now_us + (uint64_t)ahead_us;
+    return AV_SYNC_PRESENT;
+}
+
+int av_sync_frame_presented(av_sync_t *sync, uint64_t stream_us, uint64_t local_us, int64_t *error_us)
+{
+    uint64_t heard_us;
+    if (!sync || av_sync_audio_clock(sync, local_us, &heard_us) < 0)
+        return -1;
+
+    int64_t error = (int64_t)(stream_us - heard_us);
+    uint64_t error_abs = error < 0 ? (uint64_t)-error : (uint64_t)error;
+    sync->frames++;
+    sync->error_sum_us += error;
+    sync->error_abs_sum_us += error_abs;
+    if (error_abs > sync->error_abs_max_us)
+        sync->error_abs_max_us = error_abs;
+    if (error_us)
+        *error_us = error;
+    return 0;
+}
+
+void av_sync_get_stats(const av_sync_t *sync, av_sync_stats_t *stats)
+{
+    if (!stats)
+        return;
+    memset(stats, 0, sizeof(*stats));
+    if (!sync)
+        return;
+
+    stats->frames = sync->frames;
+    if (sync->frames) {
+        stats->error_avg_us = sync->error_sum_us / (int64_t)sync->frames;
+        stats->error_abs_avg_us = sync->error_abs_sum_us / sync->frames;
+    }
+    stats->error_abs_max_us = sync->error_abs_max_us;
+    stats->late_frames = sync->late_frames;
+    stats->queue_us = sync->queue_us > 0 ? (uint32_t)sync->queue_us : 0;
+    stats->target_us = sync->target_us;
+    stats->correction_ppm = (int32_t)sync->correction_ppm;
+    stats->dropped_chunks = sync->dropped_chunks;
+    stats->underruns = sync->underruns;
+}
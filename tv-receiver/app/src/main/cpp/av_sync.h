@@ -0,0 +1,98 @@
+#ifndef AV_SYNC_H
+#define AV_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Receiver-side A/V sync. The audio output is the master clock: every audio chunk
+// carries the streamer's capture time of its first sample, so knowing how many
+// frames the output has played tells us which stream time is being heard right now.
+// Frames are scheduled against that clock, and audio is micro-resampled (at most
+// AV_SYNC_MAX_PPM, an inaudible pitch change) to hold the output queue at its target
+// depth, which absorbs drift between the streamer's capture clock and our DAC.
+//
+// Two clocks are involved and never compared directly:
+//   stream_us - streamer timestamps (AUDIO/FRAME timestamp_us)
+//   local_us  - this device's CLOCK_MONOTONIC (System.nanoTime() / 1000 on Android)
+// Audio is interleaved signed 16-bit.
+
+#define AV_SYNC_DEFAULT_TARGET_MS 40   // Audio queued ahead of the DAC
+#define AV_SYNC_MAX_PPM 2000           // Resampling correction limit (0.2%)
+#define AV_SYNC_MAX_CHANNELS 8
+#define AV_SYNC_LATE_US 20000          // A frame this far behind the audio is late
+#define AV_SYNC_MAX_HOLD_US 500000     // Further ahead than this is a clock jump, not a wait
+
+typedef struct av_sync av_sync_t;
+
+// av_sync_schedule_frame() results
+#define AV_SYNC_PRESENT 0   // Present at *present_local_us
+#define AV_SYNC_LATE 1      // Behind the audio: present now (or skip it if the picture allows)
+#define AV_SYNC_NO_CLOCK 2  // No audio playing yet: present now
+
+typedef struct {
+    uint64_t frames;            // Frames measured with av_sync_frame_presented()
+    int64_t error_avg_us;       // Lip-sync error: video minus audio stream time (>0 = video early)
+    uint64_t error_abs_avg_us;
+    uint64_t error_abs_max_us;
+    uint64_t late_frames;
+    uint32_t queue_us;          // Smoothed audio output queue depth
+    uint32_t target_us;
+    int32_t correction_ppm;     // Current resampling correction (<0 = playing the stream faster)
+    uint64_t dropped_chunks;    // Discarded to cut a backlog the resampler could not absorb
+    uint64_t underruns;         // Output ran dry (reported by the caller)
+} av_sync_stats_t;
+
+// target_ms: audio to keep queued ahead of the DAC (0 = AV_SYNC_DEFAULT_TARGET_MS)
+av_sync_t *av_sync_create(uint32_t sample_rate, uint16_t channels, uint32_t target_ms);
+void av_sync_destroy(av_sync_t *sync);
+
+// Forget the audio clock and resampler state (stream restarted or format changed)
+void av_sync_reset(av_sync_t *sync);
+
+// Largest output av_sync_push_audio() can produce for in_frames of input
+uint32_t av_sync_max_output_frames(const av_sync_t *sync, uint32_t in_frames);
+
+// Resample a chunk for output and record it as queued
+// stream_us: capture time of the chunk's first sample
+// The first chunk after create/reset is preceded by the target depth of silence, so
+// playback starts with its jitter buffer full
+// Returns frames written to out (0 if the chunk was dropped to cut a backlog), -1 on error
+int av_sync_push_audio(av_sync_t *sync, uint64_t stream_us, const int16_t *in, uint32_t in_frames,
+                       int16_t *out, uint32_t out_capacity);
+
+// Record a chunk played without resampling (e.g. audio this side cannot decode)
+// As with av_sync_push_audio(), the first chunk is preceded by the target depth of silence
+// Returns the frames to play (silence included), 0 if the chunk was dropped
+uint32_t av_sync_queue_audio(av_sync_t *sync, uint64_t stream_us, uint32_t frames);
+
+// Output position: frames the device had played (since the first push) at local_us
+// Drives the drift controller; call every chunk or so (AudioTrack.getTimestamp())
+void av_sync_audio_position(av_sync_t *sync, uint64_t frames_played, uint64_t local_us);
+
+// Count an output underrun
+void av_sync_underrun(av_sync_t *sync);
+
+// Stream time being heard at local_us
+// Returns 0 on success, -1 if no audio has played yet
+int av_sync_audio_clock(const av_sync_t *sync, uint64_t local_us, uint64_t *stream_us);
+
+// When to show a frame captured at stream_us, given the local time now
+// Returns AV_SYNC_PRESENT, AV_SYNC_LATE or AV_SYNC_NO_CLOCK; *present_local_us is always set
+int av_sync_schedule_frame(av_sync_t *sync, uint64_t stream_us, uint64_t local_now_us,
+                           uint64_t *present_local_us);
+
+// Record the lip-sync error of a frame shown at local_us
+// Returns 0 and the error (video minus audio stream time), or -1 if there is no audio clock
+int av_sync_frame_presented(av_sync_t *sync, uint64_t stream_us, uint64_t local_us, int64_t *error_us);
+
+void av_sync_get_stats(const av_sync_t *sync, av_sync_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AV_SYNC_H
@@ -0,0 +1,93 @@
+#include <jni.h>
+#include <cstdio>
+#include <cstdint>
+#include "av_sync.h"
+
+// JNI glue for AvSync.java. PCM arrives as byte[] of little-endian 16-bit samples,
+// which every Android ABI can use in place as int16_t.
+
+static av_sync_t *from_handle(jlong handle) {
+    return reinterpret_cast<av_sync_t *>(static_cast<intptr_t>(handle));
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_framebuffer_client_AvSync_nativeCreate(JNIEnv *env, jclass clazz, jint sampleRate, jint channels,
+                                                jint targetMs) {
+    if (sampleRate <= 0 || channels <= 0 || targetMs < 0) {
+        return 0;
+    }
+    av_sync_t *sync = av_sync_create((uint32_t)sampleRate, (uint16_t)channels, (uint32_t)targetMs);
+    return static_cast<jlong>(reinterpret_cast<intptr_t>(sync));
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_framebuffer_client_AvSync_nativeDestroy(JNIEnv *env, jclass clazz, jlong handle) {
+    av_sync_destroy(from_handle(handle));
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_framebuffer_client_AvSync_nativeMaxOutputFrames(JNIEnv *env, jclass clazz, jlong handle, jint inFrames) {
+    return (jint)av_sync_max_output_frames(from_handle(handle), (uint32_t)inFrames);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_framebuffer_client_AvSync_nativePushAudio(JNIEnv *env, jclass clazz, jlong handle, jlong streamUs,
+                                                   jbyteArray in, jint inFrames, jbyteArray out, jint outCapacity) {
+    if (!in || !out || inFrames < 0 || outCapacity < 0) {
+        return -1;
+    }
+    void *inData = env->GetPrimitiveArrayCritical(in, nullptr);
+    void *outData = env->GetPrimitiveArrayCritical(out, nullptr);
+    int frames = -1;
+    if (inData && outData) {
+        frames = av_sync_push_audio(from_handle(handle), (uint64_t)streamUs, static_cast<const int16_t *>(inData),
+                                    (uint32_t)inFrames, static_cast<int16_t *>(outData), (uint32_t)outCapacity);
+    }
+    if (outData) {
+        env->ReleasePrimitiveArrayCritical(out, outData, 0);
+    }
+    if (inData) {
+        env->ReleasePrimitiveArrayCritical(in, inData, JNI_ABORT);
+    }
+    return frames;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_framebuffer_client_AvSync_nativeAudioPosition(JNIEnv *env, jclass clazz, jlong handle, jlong framesPlayed,
+                                                       jlong localUs) {
+    av_sync_audio_position(from_handle(handle), (uint64_t)framesPlayed, (uint64_t)localUs);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_framebuffer_client_AvSync_nativeUnderrun(JNIEnv *env, jclass clazz, jlong handle) {
+    av_sync_underrun(from_handle(handle));
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_framebuffer_client_AvSync_nativeScheduleFrame(JNIEnv *env, jclass clazz, jlong handle, jlong streamUs,
+                                                       jlong localNowUs) {
+    uint64_t presentUs;
+    av_sync_schedule_frame(from_handle(handle), (uint64_t)streamUs, (uint64_t)localNowUs, &presentUs);
+    return (jlong)presentUs;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_framebuffer_client_AvSync_nativeFramePresented(JNIEnv *env, jclass clazz, jlong handle, jlong streamUs,
+                                                        jlong localUs) {
+    av_sync_frame_presented(from_handle(handle), (uint64_t)streamUs, (uint64_t)localUs, nullptr);
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_framebuffer_client_AvSync_nativeStats(JNIEnv *env, jclass clazz, jlong handle) {
+    av_sync_stats_t stats;
+    av_sync_get_stats(from_handle(handle), &stats);
+    char text[256];
+    snprintf(text, sizeof(text),
+             "lip-sync avg %+.1f ms, |avg| %.1f ms, max %.1f ms over %llu frames (%llu late); "
+             "audio queue %.1f/%.1f ms, correction %+d ppm, %llu dropped, %llu underruns",
+             stats.error_avg_us / 1000.0, stats.error_abs_avg_us / 1000.0, stats.error_abs_max_us / 1000.0,
+             (unsigned long long)stats.frames, (unsigned long long)stats.late_frames, stats.queue_us / 1000.0,
+             stats.target_us / 1000.0, stats.correction_ppm, (unsigned long long)stats.dropped_chunks,
+             (unsigned long long)stats.underruns);
+    return env->NewStringUTF(text);
+}
@@ -2,20 +2,48 @@ package com.framebuffer.client;
 
 import android.media.AudioAttributes;
 import android.media.AudioFormat;
+import android.media.AudioManager;
+import android.media.AudioTimestamp;
 import android.media.AudioTrack;
+import android.media.MediaCodec;
+import android.media.MediaCodecList;
+import android.media.MediaFormat;
+import java.io.ByteArrayOutputStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.concurrent.BlockingQueue;
 import java.util.concurrent.LinkedBlockingQueue;
 
 public class AudioReceiver {
+    private static final String TAG = "AudioReceiver";
+    private static final long POSITION_INTERVAL_US = 10000;   // AudioTrack position polls (drift control)
+    private static final long STATS_INTERVAL_US = 10000000;   // Lip-sync log cadence
+
     private AudioTrack audioTrack;
     private int sampleRate;
     private int channels;
     private int format;
     private boolean running = false;
     private Thread playbackThread;
-    private BlockingQueue<byte[]> audioQueue;
-    private long baseTimestampUs = 0;
-    private long basePlaybackTimeUs = 0;
+    private BlockingQueue<AudioChunk> audioQueue;
+    private MediaCodec opusDecoder;  // Non-null when the stream is Opus (decoded to 16-bit PCM)
+    private long decodedTimestampUs;  // Capture time of the PCM decodeOpus() last returned
+    private volatile AvSync avSync;  // Null if unavailable (native library missing, or float PCM)
+    private byte[] syncBuffer;
+    private final AudioTimestamp audioTimestamp = new AudioTimestamp();
+    private long lastPositionUs;
+    private long lastStatsUs;
+    private int underrunCount;
+
+    private static class AudioChunk {
+        final byte[] data;
+        final long timestampUs;  // Streamer capture time of the first sample
+
+        AudioChunk(byte[] data, long timestampUs) {
+            this.data = data;
+            this.timestampUs = timestampUs;
+        }
+    }
 
     public AudioReceiver(int sampleRate, int channels, int format) {
         this.sampleRate = sampleRate;
@@ -24,14 +52,42 @@ public class AudioReceiver {
         this.audioQueue = new LinkedBlockingQueue<>();
     }
 
+    // True if this device has an Opus decoder (advertised to the streamer in CAPABILITIES)
+    public static boolean isOpusSupported() {
+        MediaFormat opus = MediaFormat.createAudioFormat(MediaFormat.MIMETYPE_AUDIO_OPUS, 48000, 2);
+        return new MediaCodecList(MediaCodecList.REGULAR_CODECS).findDecoderForFormat(opus) != null;
+    }
+
+    // Rate the audio output mixes at; PCM sent at this rate skips the platform resampler
+    // (advertised in CAPABILITIES, the streamer resamples to it)
+    public static int nativeSampleRate() {
+        int rate = AudioTrack.getNativeOutputSampleRate(AudioManager.STREAM_MUSIC);
+        return rate > 0 ? rate : 48000;
+    }
+
+    // TV audio outputs mix in stereo
+    public static int nativeChannels() {
+        return 2;
+    }
+
+    public boolean matches(int sampleRate, int channels, int format) {
+        return this.sampleRate == sampleRate && this.channels == channels && this.format == format;
+    }
+
     public void start() {
         if (running) return;
 
         this.running = true;
 
+        if (format == Protocol.AUDIO_FORMAT_OPUS && !startOpusDecoder()) {
+            running = false;
+            return;
+        }
+
         // Create AudioTrack for low-latency playback
         int channelConfig = (channels == 2) ? AudioFormat.CHANNEL_OUT_STEREO : AudioFormat.CHANNEL_OUT_MONO;
-        int audioFormat = (format == 0) ? AudioFormat.ENCODING_PCM_16BIT : AudioFormat.ENCODING_PCM_FLOAT;
+        int audioFormat = (format == Protocol.AUDIO_FORMAT_PCM_S16LE || opusDecoder != null)
+            ? AudioFormat.ENCODING_PCM_16BIT : AudioFormat.ENCODING_PCM_FLOAT;
 
         int bufferSize = AudioTrack.getMinBufferSize(sampleRate, channelConfig, audioFormat);
         // Use a small buffer for low latency (about 20ms)
@@ -59,6 +115,9 @@ public class AudioReceiver {
             .build();
 
         if (audioTrack.getState() == AudioTrack.STATE_INITIALIZED) {
+            if (audioFormat == AudioFormat.ENCODING_PCM_16BIT) {
+                avSync = AvSync.create(sampleRate, channels, 0);
+            }
             audioTrack.play();
             playbackThread = new Thread(this::playbackLoop);
             playbackThread.start();
@@ -84,20 +143,146 @@ public class AudioReceiver {
             audioTrack.release();
             audioTrack = null;
         }
+        if (avSync != null) {
+            android.util.Log.i(TAG, "A/V sync: " + avSync.stats());
+            avSync.release();
+            avSync = null;
+        }
+        if (opusDecoder != null) {
+            opusDecoder.stop();
+            opusDecoder.release();
+            opusDecoder = null;
+        }
     }
 
-    public void addAudioData(byte[] audioData) {
+    // The streamer's packets are raw Opus frames, so the decoder is given the
+    // OpusHead header and delays an Ogg demuxer would normally supply
+    private boolean startOpusDecoder() {
+        ByteBuffer head = ByteBuffer.allocate(19).order(ByteOrder.LITTLE_ENDIAN);
+        head.put("OpusHead".getBytes(java.nio.charset.StandardCharsets.US_ASCII));
+        head.put((byte)1);              // Version
+        head.put((byte)channels);
+        head.putShort((short)0);        // Pre-skip (nothing to trim mid-stream)
+        head.putInt(sampleRate);
+        head.putShort((short)0);        // Output gain
+        head.put((byte)0);              // Mapping family 0 (mono/stereo)
+        head.flip();
+        ByteBuffer codecDelayNs = ByteBuffer.allocate(8).order(ByteOrder.LITTLE_ENDIAN).putLong(0, 0);
+        ByteBuffer seekPrerollNs = ByteBuffer.allocate(8).order(ByteOrder.LITTLE_ENDIAN).putLong(0, 80000000L);
+
+        MediaFormat mediaFormat = MediaFormat.createAudioFormat(MediaFormat.MIMETYPE_AUDIO_OPUS, sampleRate, channels);
+        mediaFormat.setByteBuffer("csd-0", head);
+        mediaFormat.setByteBuffer("csd-1", codecDelayNs);
+        mediaFormat.setByteBuffer("csd-2", seekPrerollNs);
+        try {
+            opusDecoder = MediaCodec.createDecoderByType(MediaFormat.MIMETYPE_AUDIO_OPUS);
+            opusDecoder.configure(mediaFormat, null, null, 0);
+            opusDecoder.start();
+            return true;
+        } catch (Exception e) {
+            android.util.Log.e("AudioReceiver", "Failed to start Opus decoder", e);
+            if (opusDecoder != null) {
+                opusDecoder.release();
+                opusDecoder = null;
+            }
+            return false;
+        }
+    }
+
+    // Decode one Opus packet; returns whatever PCM the decoder has ready (may be empty),
+    // with its capture time in decodedTimestampUs
+    private byte[] decodeOpus(byte[] packet, long timestampUs) {
+        int inIndex = opusDecoder.dequeueInputBuffer(10000);
+        if (inIndex >= 0) {
+            ByteBuffer input = opusDecoder.getInputBuffer(inIndex);
+            input.clear();
+            input.put(packet);
+            opusDecoder.queueInputBuffer(inIndex, 0, packet.length, timestampUs, 0);
+        }
+
+        ByteArrayOutputStream pcm = new ByteArrayOutputStream();
+        MediaCodec.BufferInfo info = new MediaCodec.BufferInfo();
+        int outIndex;
+        while ((outIndex = opusDecoder.dequeueOutputBuffer(info, 0)) != MediaCodec.INFO_TRY_AGAIN_LATER) {
+            if (outIndex < 0) {
+                continue;  // Output format or buffers changed
+            }
+            ByteBuffer output = opusDecoder.getOutputBuffer(outIndex);
+            if (output != null && info.size > 0) {
+                if (pcm.size() == 0) {
+                    decodedTimestampUs = info.presentationTimeUs;
+                }
+                byte[] chunk = new byte[info.size];
+                output.position(info.offset);
+                output.get(chunk);
+                pcm.write(chunk, 0, chunk.length);
+            }
+            opusDecoder.releaseOutputBuffer(outIndex, false);
+        }
+        return pcm.toByteArray();
+    }
+
+    // The sync controller frames are scheduled against (null without audio sync)
+    public AvSync getAvSync() {
+        return avSync;
+    }
+
+    public void addAudioData(byte[] audioData, long timestampUs) {
         if (running && audioQueue != null) {
-            audioQueue.offer(audioData);
+            audioQueue.offer(new AudioChunk(audioData, timestampUs));
+        }
+    }
+
+    // Hand the sync controller the DAC's position (and any underruns since the last call)
+    private void reportPosition(AvSync sync) {
+        long now = AvSync.nowUs();
+        if (now - lastPositionUs < POSITION_INTERVAL_US) {
+            return;
+        }
+        lastPositionUs = now;
+        if (audioTrack.getTimestamp(audioTimestamp)) {
+            sync.audioPosition(audioTimestamp.framePosition, audioTimestamp.nanoTime / 1000);
+        }
+        int underruns = audioTrack.getUnderrunCount();
+        for (; underrunCount < underruns; underrunCount++) {
+            sync.underrun();
+        }
+        if (now - lastStatsUs >= STATS_INTERVAL_US) {
+            if (lastStatsUs != 0) {
+                android.util.Log.i(TAG, "A/V sync: " + sync.stats());
+            }
+            lastStatsUs = now;
         }
     }
 
     private void playbackLoop() {
         while (running) {
             try {
-                // Get audio data from queue (blocking with timeout)
-                byte[] audioData = audioQueue.poll();
-                if (audioData != null && audioTrack != null && audioTrack.getState() == AudioTrack.STATE_INITIALIZED) {
+                AudioChunk chunk = audioQueue.poll();
+                byte[] audioData = chunk != null ? chunk.data : null;
+                long timestampUs = chunk != null ? chunk.timestampUs : 0;
+                if (audioData != null && opusDecoder != null) {
+                    audioData = decodeOpus(audioData, timestampUs);
+                    timestampUs = decodedTimestampUs;
+                }
+                AvSync sync = avSync;
+                if (sync != null && audioTrack != null) {
+                    reportPosition(sync);
+                }
+                if (audioData != null && audioData.length > 0 && sync != null) {
+                    // Resampled to hold the output queue at its target against drift
+                    int needed = sync.maxOutputBytes(audioData.length);
+                    if (syncBuffer == null || syncBuffer.length < needed) {
+                        syncBuffer = new byte[needed];
+                    }
+                    int length = sync.pushAudio(timestampUs, audioData, audioData.length, syncBuffer);
+                    if (length < 0) {
+                        break;
+                    }
+                    if (length > 0 && audioTrack.write(syncBuffer, 0, length) < 0) {
+                        break;
+                    }
+                } else if (audioData != null && audioTrack != null && audioTrack.getState() == AudioTrack.STATE_INITIALIZED) {
                     int written = audioTrack.write(audioData, 0, audioData.length);
                     if (written < 0) {
                         // Error writing to AudioTrack
@@ -115,18 +300,4 @@ public class AudioReceiver {
             }
         }
     }
-
-    // Synchronize audio with video using timestamps
-    public void syncWithTimestamp(long audioTimestampUs, long videoTimestampUs) {
-        if (baseTimestampUs == 0) {
-            baseTimestampUs = audioTimestampUs;
-            basePlaybackTimeUs = System.nanoTime() / 1000; // Convert to microseconds
-        }
-
-        // Calculate when this audio should be played
-        long delayUs = audioTimestampUs - videoTimestampUs;
-        // For now, we'll just play immediately (simple sync)
-        // In a more sophisticated implementation, we'd buffer and schedule playback
-    }
 }
-
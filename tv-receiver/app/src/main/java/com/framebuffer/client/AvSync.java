@@ -0,0 +1,95 @@
+package com.framebuffer.client;
+
+import android.util.Log;
+
+// Audio-master A/V sync (native av_sync.c). AudioReceiver feeds it the PCM it plays
+// and the AudioTrack position; frames are scheduled against the stream time being
+// heard, and the audio is micro-resampled to absorb drift between the streamer's
+// capture clock and this device's DAC. Times are System.nanoTime() / 1000.
+public class AvSync {
+    private static final String TAG = "AvSync";
+
+    private static boolean nativeLibraryLoaded = false;
+    static {
+        try {
+            System.loadLibrary("avsync");
+            nativeLibraryLoaded = true;
+        } catch (UnsatisfiedLinkError e) {
+            Log.w(TAG, "Failed to load native avsync library (audio and video will play unsynchronized): " + e.getMessage());
+        }
+    }
+
+    private long handle;
+    private final int channels;
+
+    private AvSync(long handle, int channels) {
+        this.handle = handle;
+        this.channels = channels;
+    }
+
+    // Returns null if the native library is unavailable or the format is unsupported
+    public static AvSync create(int sampleRate, int channels, int targetMs) {
+        if (!nativeLibraryLoaded) {
+            return null;
+        }
+        long handle = nativeCreate(sampleRate, channels, targetMs);
+        return handle != 0 ? new AvSync(handle, channels) : null;
+    }
+
+    public static long nowUs() {
+        return System.nanoTime() / 1000;
+    }
+
+    // Output buffer size needed for a chunk of this many bytes of 16-bit PCM
+    public synchronized int maxOutputBytes(int inBytes) {
+        if (handle == 0) return inBytes;
+        return nativeMaxOutputFrames(handle, inBytes / (2 * channels)) * 2 * channels;
+    }
+
+    // Resample 16-bit PCM captured at streamUs into out; returns the bytes to play
+    public synchronized int pushAudio(long streamUs, byte[] pcm, int length, byte[] out) {
+        if (handle == 0) return -1;
+        int frames = nativePushAudio(handle, streamUs, pcm, length / (2 * channels), out, out.length / (2 * channels));
+        return frames < 0 ? frames : frames * 2 * channels;
+    }
+
+    public synchronized void audioPosition(long framesPlayed, long localUs) {
+        if (handle != 0) nativeAudioPosition(handle, framesPlayed, localUs);
+    }
+
+    public synchronized void underrun() {
+        if (handle != 0) nativeUnderrun(handle);
+    }
+
+    // Local time (us) to present a frame captured at streamUs; now if it is late or there is no audio
+    public synchronized long scheduleFrame(long streamUs, long localNowUs) {
+        if (handle == 0) return localNowUs;
+        return nativeScheduleFrame(handle, streamUs, localNowUs);
+    }
+
+    // Measure the lip-sync error of a frame shown at localUs
+    public synchronized void framePresented(long streamUs, long localUs) {
+        if (handle != 0) nativeFramePresented(handle, streamUs, localUs);
+    }
+
+    public synchronized String stats() {
+        return handle != 0 ? nativeStats(handle) : "released";
+    }
+
+    public synchronized void release() {
+        if (handle != 0) {
+            nativeDestroy(handle);
+            handle = 0;
+        }
+    }
+
+    private static native long nativeCreate(int sampleRate, int channels, int targetMs);
+    private static native void nativeDestroy(long handle);
+    private static native int nativeMaxOutputFrames(long handle, int inFrames);
+    private static native int nativePushAudio(long handle, long streamUs, byte[] in, int inFrames, byte[] out, int outCapacity);
+    private static native void nativeAudioPosition(long handle, long framesPlayed, long localUs);
+    private static native void nativeUnderrun(long handle);
+    private static native long nativeScheduleFrame(long handle, long streamUs, long localNowUs);
+    private static native void nativeFramePresented(long handle, long streamUs, long localUs);
+    private static native String nativeStats(long handle);
+}
@@ -34,6 +34,10 @@ public class FrameReceiver extends Thread {
     private float savedBrightness = -1.0f;  // Store original brightness
     private Bitmap currentFrameBitmap;  // Store current frame for dirty rectangle compositing
     private H264Decoder h264Decoder;  // H.264 decoder for encoded frames
+    private UdpFrameReceiver udpReceiver;  // UDP video channel (null = frames arrive over TCP)
+    private long connectedAtMs = 0;  // elapsedRealtime() of the connection, until the first frame is shown
+    private byte[] sessionTicket;  // From SESSION_TICKET (null = the session ends with the connection)
+    private int sessionGraceMs = 0;  // How long the streamer keeps trying to resume a dropped session
 
     public FrameReceiver(Socket socket, SurfaceHolder surfaceHolder, android.content.Context context, NoiseEncryption noiseEncryption) {
         this.socket = socket;
@@ -46,6 +50,54 @@ public class FrameReceiver extends Thread {
         this.configCallback = callback;
     }
 
+    // Receive MSG_FRAME payloads on this UDP socket (negotiated in HELLO)
+    public void setUdpSocket(java.net.DatagramSocket udpSocket) {
+        this.udpReceiver = new UdpFrameReceiver(udpSocket, this, socket.getInetAddress());
+    }
+
+    // Time the streamer connected; the delay to the first complete frame is logged
+    public void setConnectedAt(long elapsedRealtimeMs) {
+        this.connectedAtMs = elapsedRealtimeMs;
+    }
+
+    // Ticket the streamer presents to resume this session after the connection drops
+    public byte[] getSessionTicket() {
+        return sessionTicket;
+    }
+
+    public int getSessionGraceMs() {
+        return sessionGraceMs;
+    }
+
+    // True once the connection has dropped (not stopped) and the session can be resumed
+    public boolean isResumable() {
+        return running && sessionTicket != null;
+    }
+
+    // Take over a dropped session: decoder, last picture, audio and UDP channel carry on,
+    // so the stream continues without a new HELLO or output setup on the streamer
+    public void resumeFrom(FrameReceiver previous) {
+        synchronized (previous) {
+            h264Decoder = previous.h264Decoder;
+            currentFrameBitmap = previous.currentFrameBitmap;
+            audioReceiver = previous.audioReceiver;
+            udpReceiver = previous.udpReceiver;
+            currentWidth = previous.currentWidth;
+            currentHeight = previous.currentHeight;
+            savedBrightness = previous.savedBrightness;
+            sessionTicket = previous.sessionTicket;
+            sessionGraceMs = previous.sessionGraceMs;
+            configCallback = previous.configCallback;
+            previous.h264Decoder = null;
+            previous.audioReceiver = null;
+            previous.udpReceiver = null;
+            previous.running = false;
+        }
+        if (udpReceiver != null) {
+            udpReceiver.setFrameReceiver(this);
+        }
+    }
+
     public void updateSurfaceHolder(SurfaceHolder newSurfaceHolder) {
         // Update the SurfaceHolder when surface is recreated (e.g., app comes back to foreground)
         synchronized (this) {
@@ -60,6 +112,10 @@ public class FrameReceiver extends Thread {
 
     public void stopReceiving() {
         running = false;
+        if (udpReceiver != null) {
+            udpReceiver.stopReceiving();
+            udpReceiver = null;
+        }
         if (audioReceiver != null) {
             audioReceiver.stop();
             audioReceiver = null;
@@ -75,6 +131,9 @@ public class FrameReceiver extends Thread {
     public void run() {
         running = true;
         connected = true;  // Assume connected initially until we receive a CONFIG message saying otherwise
+        if (udpReceiver != null && !udpReceiver.isAlive()) {
+            udpReceiver.start();  // Already running if this session was resumed
+        }
         try {
             InputStream in = socket.getInputStream();
 
@@ -110,34 +169,7 @@ public class FrameReceiver extends Thread {
                     }
 
                     Protocol.FrameMessage frame = Protocol.parseFrameMessage(frameData);
-
-                    // Only process frames if display is connected
-                    if (connected && frame.width > 0 && frame.height > 0) {
-                        if (frame.encodingMode == Protocol.ENCODING_MODE_H264) {
-                            // Handle H.264 encoded frame
-                            drawH264Frame(frame, in);
-                        } else if (frame.encodingMode == Protocol.ENCODING_MODE_DIRTY_RECTS && frame.numRegions > 0) {
-                            // Handle dirty rectangles
-                            drawDirtyRectangles(frame, in);
-                        } else {
-                            // Handle full frame (backward compatible)
-                            byte[] pixels = new byte[frame.size];
-                            int read = 0;
-                            while (read < frame.size) {
-                                int n = in.read(pixels, read, frame.size - read);
-                                if (n < 0) break;
-                                read += n;
-                            }
-
-                            // Draw to surface
-                            drawFrame(frame, pixels);
-                        }
-                    } else {
-                        // Skip frame data if display is disconnected
-                        if (frame.size > 0) {
-                            in.skip(frame.size);
-                        }
-                    }
+                    handleFrame(frame, in);
 
                 } else if (header.type == Protocol.MSG_CONFIG) {
                     // Read config message
@@ -185,7 +217,11 @@ public class FrameReceiver extends Thread {
 
                     Protocol.AudioMessage audio = Protocol.parseAudioMessage(audioData);
 
-                    // Initialize audio receiver if needed
+                    // Initialize audio receiver if needed (again if the streamer changes format)
+                    if (audioReceiver != null && !audioReceiver.matches(audio.sampleRate, audio.channels, audio.format)) {
+                        audioReceiver.stop();
+                        audioReceiver = null;
+                    }
                     if (audioReceiver == null && audio.sampleRate > 0 && audio.channels > 0) {
                         audioReceiver = new AudioReceiver(audio.sampleRate, audio.channels, audio.format);
                         audioReceiver.start();
@@ -201,16 +237,43 @@ public class FrameReceiver extends Thread {
                             audioRead += n;
                         }
                         if (audioRead == audio.dataSize) {
-                            audioReceiver.addAudioData(audioBytes);
+                            audioReceiver.addAudioData(audioBytes, audio.timestampUs);
                         }
                     } else if (audio.dataSize > 0) {
                         // Skip if audio receiver not initialized
                         in.skip(audio.dataSize);
                     }
 
+                } else if (header.type == Protocol.MSG_SESSION_TICKET) {
+                    byte[] ticketData;
+                    if (noiseEncryption != null && noiseEncryption.isReady()) {
+                        ticketData = noiseEncryption.recv(socket, header.length);
+                        if (ticketData == null || ticketData.length != header.length) {
+                            break; // Connection closed
+                        }
+                    } else {
+                        ticketData = new byte[header.length];
+                        int read = 0;
+                        while (read < header.length) {
+                            int n = in.read(ticketData, read, header.length - read);
+                            if (n < 0) break;
+                            read += n;
+                        }
+                    }
+                    if (ticketData.length >= Protocol.SESSION_TICKET_SIZE + 4) {
+                        ByteBuffer buf = ByteBuffer.wrap(ticketData).order(ByteOrder.BIG_ENDIAN);
+                        byte[] ticket = new byte[Protocol.SESSION_TICKET_SIZE];
+                        buf.get(ticket);
+                        sessionGraceMs = buf.getInt();
+                        sessionTicket = ticket;
+                    }
+
                 } else if (header.type == Protocol.MSG_PING) {
                     // Respond to ping
-                    socket.getOutputStream().write(new byte[]{Protocol.MSG_PONG, 0, 0, 0, 0, 0, 0, 0, 0});
+                    java.io.OutputStream out = socket.getOutputStream();
+                    synchronized (out) {
+                        out.write(new byte[]{Protocol.MSG_PONG, 0, 0, 0, 0, 0, 0, 0, 0});
+                    }
                 } else {
                     // Skip unknown message
                     if (header.length > 0) {
@@ -220,6 +283,83 @@ public class FrameReceiver extends Thread {
             }
         } catch (IOException e) {
             e.printStackTrace();
+        } finally {
+            // A resumable session keeps its UDP channel until it is resumed or stopped
+            if (udpReceiver != null && !isResumable()) {
+                udpReceiver.stopReceiving();
+            }
+        }
+    }
+
+    // Decode/draw one frame whose payload is read from in (TCP stream or a reassembled UDP frame)
+    private synchronized void handleFrame(Protocol.FrameMessage frame, InputStream in) throws IOException {
+        // Only process frames if display is connected
+        if (connected && frame.width > 0 && frame.height > 0) {
+            if (frame.encodingMode == Protocol.ENCODING_MODE_H264) {
+                // Handle H.264 encoded frame
+                drawH264Frame(frame, in);
+            } else if (frame.encodingMode == Protocol.ENCODING_MODE_DIRTY_RECTS && frame.numRegions > 0) {
+                // Handle dirty rectangles
+                drawDirtyRectangles(frame, in);
+            } else {
+                // Handle full frame (backward compatible)
+                byte[] pixels = new byte[frame.size];
+                int read = 0;
+                while (read < frame.size) {
+                    int n = in.read(pixels, read, frame.size - read);
+                    if (n < 0) break;
+                    read += n;
+                }
+
+                // Draw to surface
+                drawFrame(frame, pixels);
+            }
+
+            // Pixel frames are drawn on arrival (this thread also carries the audio), so
+            // their lip-sync error is only measured; H.264 frames are scheduled by the decoder
+            AvSync sync = audioReceiver != null ? audioReceiver.getAvSync() : null;
+            if (sync != null && frame.encodingMode != Protocol.ENCODING_MODE_H264) {
+                sync.framePresented(frame.timestampUs, AvSync.nowUs());
+            }
+
+            // Dirty rectangles only patch a picture; the first full frame or H.264 frame
+            // (an IDR, or the start of the streamer's catch-up chain) is a complete one
+            if (connectedAtMs > 0 && !(frame.encodingMode == Protocol.ENCODING_MODE_DIRTY_RECTS && frame.numRegions > 0)) {
+                android.util.Log.i("FrameReceiver", "First complete frame " +
+                        (android.os.SystemClock.elapsedRealtime() - connectedAtMs) + " ms after connecting (" +
+                        (frame.encodingMode == Protocol.ENCODING_MODE_H264 ? "H.264" : "full frame") + ", " +
+                        frame.size / 1024 + " KB)");
+                connectedAtMs = 0;
+            }
+        } else {
+            // Skip frame data if display is disconnected
+            if (frame.size > 0) {
+                in.skip(frame.size);
+            }
+        }
+    }
+
+    // Called by UdpFrameReceiver with a complete frame (frame message + payload)
+    void onUdpFrame(byte[] data, int length) {
+        if (length < 34) return;
+        Protocol.FrameMessage frame = Protocol.parseFrameMessage(Arrays.copyOf(data, 34));
+        if (frame.size > length - 34) return;
+        try {
+            handleFrame(frame, new java.io.ByteArrayInputStream(data, 34, length - 34));
+        } catch (IOException e) {
+            e.printStackTrace();
+        }
+    }
+
+    // Called by UdpFrameReceiver with a VIDEO_FEEDBACK payload (5 big-endian uint32 counters)
+    void sendVideoFeedback(byte[] payload) {
+        try {
+            java.io.OutputStream out = socket.getOutputStream();
+            synchronized (out) {
+                Protocol.sendMessage(out, Protocol.MSG_VIDEO_FEEDBACK, payload);
+            }
+        } catch (IOException e) {
+            // Connection closing; the TCP receive loop will notice
         }
     }
 
@@ -262,8 +402,9 @@ public class FrameReceiver extends Thread {
             }
 
             if (read == frame.size && h264Decoder != null) {
-                // Decode and display
-                h264Decoder.decode(h264Data, 0, frame.size);
+                // Decode and display (in time with the audio when it plays)
+                h264Decoder.setAvSync(audioReceiver != null ? audioReceiver.getAvSync() : null);
+                h264Decoder.decode(h264Data, 0, frame.size, frame.timestampUs);
             }
         } catch (Exception e) {
             e.printStackTrace();
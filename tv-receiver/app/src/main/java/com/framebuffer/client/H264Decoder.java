@@ -12,9 +12,11 @@ public class H264Decoder {
     private int width;
     private int height;
     private Surface surface;
+    private volatile AvSync avSync;  // Schedules output against the audio clock (null = show at once)
 
     public int getWidth() { return width; }
     public int getHeight() { return height; }
+    public void setAvSync(AvSync avSync) { this.avSync = avSync; }
 
     public H264Decoder(int width, int height, Surface surface) {
         this.width = width;
@@ -39,7 +41,8 @@ public class H264Decoder {
         }
     }
 
-    public void decode(byte[] h264Data, int offset, int length) {
+    // timestampUs: the frame's capture time, handed back with the decoded picture
+    public void decode(byte[] h264Data, int offset, int length, long timestampUs) {
         if (!initialized || decoder == null)
             return;
 
@@ -50,14 +53,22 @@ public class H264Decoder {
                 if (inputBuffer != null) {
                     inputBuffer.clear();
                     inputBuffer.put(h264Data, offset, length);
-                    decoder.queueInputBuffer(inputBufferIndex, 0, length, 0, 0);
+                    decoder.queueInputBuffer(inputBufferIndex, 0, length, timestampUs, 0);
                 }
             }
 
             MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
             int outputBufferIndex = decoder.dequeueOutputBuffer(bufferInfo, 0);
             if (outputBufferIndex >= 0) {
-                decoder.releaseOutputBuffer(outputBufferIndex, true);
+                AvSync sync = avSync;
+                if (sync != null) {
+                    // The surface shows it at the first vsync after presentUs (System.nanoTime() clock)
+                    long presentUs = sync.scheduleFrame(bufferInfo.presentationTimeUs, AvSync.nowUs());
+                    decoder.releaseOutputBuffer(outputBufferIndex, presentUs * 1000);
+                    sync.framePresented(bufferInfo.presentationTimeUs, presentUs);
+                } else {
+                    decoder.releaseOutputBuffer(outputBufferIndex, true);
+                }
             }
         } catch (Exception e) {
             e.printStackTrace();
@@ -25,6 +25,9 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
     private int currentDisplayPort = 4321;     // Store current port for redrawing
     private Thread serverThread;
     private NoiseEncryption currentNoiseEncryption;  // Current Noise encryption context for active connection
+    private final Object sessionLock = new Object();
+    private FrameReceiver suspendedReceiver;  // Dropped session the streamer may still resume (guarded by sessionLock)
+    private long suspendedUntilMs;  // elapsedRealtime() after which it can no longer be resumed
     private android.hardware.display.DisplayManager displayManager;
     private android.hardware.display.DisplayManager.DisplayListener displayListener;
     private android.app.Presentation tvPresentation;
@@ -202,6 +205,7 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                         // Wait for X11 server to connect
                         android.util.Log.d("MainActivity", "Waiting for connection on " + serverSocket.getLocalSocketAddress());
                         acceptedSocket = serverSocket.accept();
+                        long acceptedAtMs = android.os.SystemClock.elapsedRealtime();
                         android.util.Log.i("MainActivity", "Connection accepted from " + acceptedSocket.getRemoteSocketAddress());
                         clientSocket = acceptedSocket;
 
@@ -224,7 +228,9 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                         // Parse version/flags/PIN
                         int version = helloPayload[0] & 0xFF;
                         int flags = helloPayload[1] & 0xFF;
-                        boolean streamerWantsEncryption = (flags & 0x01) != 0;
+                        boolean streamerWantsEncryption = (flags & Protocol.CLIENT_HELLO_FLAG_ENCRYPT) != 0;
+                        boolean streamerOffersUdp = (flags & Protocol.CLIENT_HELLO_FLAG_UDP_VIDEO) != 0;
+                        boolean streamerResumes = (flags & Protocol.CLIENT_HELLO_FLAG_RESUME) != 0;
                         boolean requiresPin = shouldRequirePin(acceptedSocket);
                         int plaintextPin = -1;
                         if (!streamerWantsEncryption && requiresPin && helloPayload.length >= 4) {
@@ -265,9 +271,9 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                                 continue; // Continue listening for next connection
                             }
 
-                            // Now verify PIN over encrypted channel
+                            // Now verify PIN over encrypted channel (a resumed session presents its ticket instead)
                             boolean pinValid = true;
-                            if (requiresPin) {
+                            if (requiresPin && !streamerResumes) {
                                 if (!verifyPinFromClient(acceptedSocket, noiseEncryption)) {
                                     android.util.Log.w("MainActivity", "PIN verification failed, closing connection");
                                     noiseEncryption.cleanup();
@@ -280,7 +286,7 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                             // proceed
                         } else {
                             // Not encrypted. If PIN required, validate immediately from helloPayload.
-                            if (requiresPin) {
+                            if (requiresPin && !streamerResumes) {
                                 if (plaintextPin < 0) {
                                     android.util.Log.e("MainActivity", "PIN required but not provided in HELLO, closing connection.");
                                     acceptedSocket.close();
@@ -296,6 +302,31 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                             currentNoiseEncryption = null;  // No encryption for plaintext
                         }
 
+                        // Show up to 3 IPs when the listening screen comes back
+                        java.util.List<String> displayIpsRestore = new java.util.ArrayList<>();
+                        for (int i = 0; i < Math.min(3, localIps.size()); i++) {
+                            displayIpsRestore.add(localIps.get(i));
+                        }
+                        final String displayIpTextRestore = String.join(", ", displayIpsRestore);
+
+                        if (streamerResumes) {
+                            // The streamer lost its connection and is resuming the session:
+                            // no PIN, HELLO or new output - the picture and decoder carry on
+                            FrameReceiver resumed = resumeSession(acceptedSocket, noiseEncryption);
+                            if (resumed == null) {
+                                acceptedSocket.close();
+                                continue;
+                            }
+                            android.util.Log.i("MainActivity", "Session resumed from " + acceptedSocket.getRemoteSocketAddress());
+                            frameReceiver = resumed;
+                            frameReceiver.setConnectedAt(acceptedAtMs);
+                            runSession(port, displayIpTextRestore);
+                            continue;
+                        }
+
+                        // A new session replaces any dropped one
+                        discardSuspendedSession(null);
+
                         new Handler(Looper.getMainLooper()).post(() -> {
                             // Connection status is shown on SurfaceView, no need for TextView
                             Toast.makeText(MainActivity.this, "X11 server connected", Toast.LENGTH_SHORT).show();
@@ -394,6 +425,19 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                             modes[0].refreshRate = refreshRateInt;
                         }
 
+                        // Accept the UDP video channel if offered (only offered on unencrypted sessions)
+                        java.net.DatagramSocket videoUdpSocket = null;
+                        if (streamerOffersUdp && noiseEncryption == null) {
+                            try {
+                                videoUdpSocket = new java.net.DatagramSocket(0, acceptedSocket.getLocalAddress());
+                                videoUdpSocket.setReceiveBufferSize(8 * 1024 * 1024);
+                                android.util.Log.i("MainActivity", "UDP video channel on port " + videoUdpSocket.getLocalPort());
+                            } catch (IOException e) {
+                                android.util.Log.w("MainActivity", "Failed to open UDP video socket, using TCP", e);
+                                videoUdpSocket = null;
+                            }
+                        }
+
                         // Send HELLO with display name and modes
                         // Use encryption if PIN was required (and Noise handshake succeeded)
                         android.util.Log.i("MainActivity", "Sending HELLO message...");
@@ -407,21 +451,31 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                         } else {
                             android.util.Log.i("MainActivity", "Sending HELLO unencrypted");
                             // Unencrypted (for trusted interfaces: USB tethering)
-                            Protocol.sendHello(acceptedSocket.getOutputStream(), displayName, modes);
+                            Protocol.sendHello(acceptedSocket.getOutputStream(), displayName, modes,
+                                    videoUdpSocket != null ? videoUdpSocket.getLocalPort() : 0);
                         }
                         android.util.Log.i("MainActivity", "HELLO message sent");
 
-                        // Start frame receiver - use appropriate SurfaceHolder
-                        // If TV is connected, use TV's SurfaceView; otherwise use phone's SurfaceView
-                        SurfaceHolder targetHolder;
-                        if (tvSurfaceView != null && tvSurfaceView.getHolder() != null) {
-                            // TV is connected - use TV SurfaceView
-                            targetHolder = tvSurfaceView.getHolder();
+                        // Ask for Opus audio if this device can decode it (streamers that can't send PCM),
+                        // and for PCM at the output's native rate so it is not resampled again here
+                        int audioCodecs = AudioReceiver.isOpusSupported() ? Protocol.CAPABILITY_AUDIO_OPUS : 0;
+                        int audioRate = AudioReceiver.nativeSampleRate();
+                        int audioChannels = AudioReceiver.nativeChannels();
+                        if (noiseEncryption != null && noiseEncryption.isReady()) {
+                            java.io.ByteArrayOutputStream baos = new java.io.ByteArrayOutputStream();
+                            Protocol.sendCapabilities(baos, true, audioCodecs, audioRate, audioChannels);
+                            noiseEncryption.send(acceptedSocket, baos.toByteArray());
                         } else {
-                            // No TV - use phone SurfaceView
-                            targetHolder = surfaceView.getHolder();
+                            Protocol.sendCapabilities(acceptedSocket.getOutputStream(), false, audioCodecs,
+                                    audioRate, audioChannels);
+                        }
+
+                        // Start frame receiver - use appropriate SurfaceHolder
+                        frameReceiver = new FrameReceiver(acceptedSocket, getTargetSurfaceHolder(), MainActivity.this, noiseEncryption);
+                        frameReceiver.setConnectedAt(acceptedAtMs);
+                        if (videoUdpSocket != null) {
+                            frameReceiver.setUdpSocket(videoUdpSocket);
                         }
-                        frameReceiver = new FrameReceiver(acceptedSocket, targetHolder, MainActivity.this, noiseEncryption);
                         frameReceiver.setConfigCallback(config -> {
                             // Handle config changes on main thread
                             new Handler(Looper.getMainLooper()).post(() -> {
@@ -439,29 +493,7 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
                                 }
                             });
                         });
-                        frameReceiver.start();
-
-                        // Wait for frame receiver to finish (connection closed)
-                        try {
-                            frameReceiver.join();
-                        } catch (InterruptedException e) {
-                            android.util.Log.w("MainActivity", "Frame receiver thread interrupted");
-                        }
-
-                        // Connection ended - clean up and continue listening
-                        frameReceiver = null;
-                        clientSocket = null;
-
-                        // Restore listening display
-                        // Show up to 3 IPs
-                        java.util.List<String> displayIpsRestore = new java.util.ArrayList<>();
-                        for (int i = 0; i < Math.min(3, localIps.size()); i++) {
-                            displayIpsRestore.add(localIps.get(i));
-                        }
-                        final String displayIpTextRestore = String.join(", ", displayIpsRestore);
-                        new Handler(Looper.getMainLooper()).post(() -> {
-                            displayConnectionInfoOnTV(port, displayIpTextRestore, pinCode);
-                        });
+                        runSession(port, displayIpTextRestore);
 
                     } catch (IOException e) {
                         android.util.Log.e("MainActivity", "Error accepting connection", e);
@@ -505,6 +537,135 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
         serverThread.start();
     }
 
+    // Run frameReceiver until its connection ends, then either keep the session for the
+    // streamer to resume or go back to the listening screen
+    private void runSession(int port, String displayIpText) {
+        FrameReceiver receiver = frameReceiver;
+        receiver.start();
+
+        // Wait for frame receiver to finish (connection closed)
+        try {
+            receiver.join();
+        } catch (InterruptedException e) {
+            android.util.Log.w("MainActivity", "Frame receiver thread interrupted");
+        }
+
+        // Connection ended - clean up and continue listening
+        frameReceiver = null;
+        clientSocket = null;
+
+        if (listening && receiver.isResumable()) {
+            // Leave the last picture up while the streamer reconnects
+            suspendSession(receiver, port, displayIpText);
+            return;
+        }
+
+        // Restore listening display
+        new Handler(Looper.getMainLooper()).post(() -> {
+            displayConnectionInfoOnTV(port, displayIpText, pinCode);
+        });
+    }
+
+    // Keep a dropped session (decoder, picture, audio, UDP channel) for as long as the streamer
+    // keeps trying to resume it, then fall back to the listening screen
+    private void suspendSession(FrameReceiver receiver, int port, String displayIpText) {
+        int graceMs = receiver.getSessionGraceMs();
+        synchronized (sessionLock) {
+            suspendedReceiver = receiver;
+            suspendedUntilMs = android.os.SystemClock.elapsedRealtime() + graceMs;
+        }
+        android.util.Log.i("MainActivity", "Connection lost, keeping session for " + graceMs + " ms");
+        new Handler(Looper.getMainLooper()).postDelayed(() -> {
+            if (discardSuspendedSession(receiver)) {
+                android.util.Log.i("MainActivity", "Session was not resumed");
+                displayConnectionInfoOnTV(port, displayIpText, pinCode);
+            }
+        }, graceMs);
+    }
+
+    // Release the suspended session (only if it is still receiver, when given)
+    // Returns true if a session was released
+    private boolean discardSuspendedSession(FrameReceiver receiver) {
+        synchronized (sessionLock) {
+            if (suspendedReceiver == null || (receiver != null && suspendedReceiver != receiver)) {
+                return false;
+            }
+            suspendedReceiver.stopReceiving();
+            suspendedReceiver = null;
+        }
+        return true;
+    }
+
+    // Read SESSION_RESUME and answer it: SESSION_RESUMED and a receiver that carries on the
+    // suspended session if the ticket matches, otherwise MSG_ERROR and null
+    private FrameReceiver resumeSession(Socket socket, NoiseEncryption noiseEncryption) throws IOException {
+        byte[] headerBytes = readExactly(socket, noiseEncryption, 9);
+        if (headerBytes == null) {
+            return null;
+        }
+        Protocol.MessageHeader header = Protocol.parseHeader(headerBytes);
+        if (header.type != Protocol.MSG_SESSION_RESUME || header.length < Protocol.SESSION_TICKET_SIZE) {
+            android.util.Log.w("MainActivity", "Expected SESSION_RESUME, got type " + header.type);
+            return null;
+        }
+        byte[] resumeData = readExactly(socket, noiseEncryption, header.length);
+        if (resumeData == null) {
+            return null;
+        }
+        byte[] ticket = java.util.Arrays.copyOf(resumeData, Protocol.SESSION_TICKET_SIZE);
+
+        FrameReceiver previous = null;
+        synchronized (sessionLock) {
+            if (suspendedReceiver != null &&
+                android.os.SystemClock.elapsedRealtime() <= suspendedUntilMs &&
+                java.security.MessageDigest.isEqual(ticket, suspendedReceiver.getSessionTicket())) {
+                previous = suspendedReceiver;
+                suspendedReceiver = null;
+            }
+        }
+
+        java.io.ByteArrayOutputStream baos = new java.io.ByteArrayOutputStream();
+        Protocol.sendMessage(baos, previous != null ? Protocol.MSG_SESSION_RESUMED : Protocol.MSG_ERROR, null);
+        if (noiseEncryption != null && noiseEncryption.isReady()) {
+            noiseEncryption.send(socket, baos.toByteArray());
+        } else {
+            socket.getOutputStream().write(baos.toByteArray());
+        }
+
+        if (previous == null) {
+            android.util.Log.w("MainActivity", "SESSION_RESUME for unknown or expired session");
+            return null;
+        }
+        FrameReceiver receiver = new FrameReceiver(socket, getTargetSurfaceHolder(), MainActivity.this, noiseEncryption);
+        receiver.resumeFrom(previous);
+        return receiver;
+    }
+
+    // Read len bytes (decrypted if the Noise session is up); null if the connection closed
+    private byte[] readExactly(Socket socket, NoiseEncryption noiseEncryption, int len) throws IOException {
+        if (noiseEncryption != null && noiseEncryption.isReady()) {
+            byte[] data = noiseEncryption.recv(socket, len);
+            return (data != null && data.length == len) ? data : null;
+        }
+        byte[] data = new byte[len];
+        InputStream in = socket.getInputStream();
+        int read = 0;
+        while (read < len) {
+            int n = in.read(data, read, len - read);
+            if (n < 0) return null;
+            read += n;
+        }
+        return data;
+    }
+
+    // If TV is connected, use TV's SurfaceView; otherwise use phone's SurfaceView
+    private SurfaceHolder getTargetSurfaceHolder() {
+        if (tvSurfaceView != null && tvSurfaceView.getHolder() != null) {
+            return tvSurfaceView.getHolder();
+        }
+        return surfaceView.getHolder();
+    }
+
     private void sendPauseMessage() {
         if (clientSocket == null || clientSocket.isClosed()) {
             return;
@@ -557,6 +718,7 @@ public class MainActivity extends AppCompatActivity implements SurfaceHolder.Cal
             frameReceiver.stopReceiving();
             frameReceiver = null;
         }
+        discardSuspendedSession(null);
 
         if (clientSocket != null) {
             try {
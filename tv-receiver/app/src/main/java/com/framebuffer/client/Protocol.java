@@ -20,9 +20,32 @@ public class Protocol {
     public static final byte MSG_DISCOVERY_RESPONSE = 0x11;  // UDP broadcast discovery response
     public static final byte MSG_PIN_VERIFY = 0x12;         // PIN verification request
     public static final byte MSG_PIN_VERIFIED = 0x13;        // PIN verification success
-    public static final byte MSG_CAPABILITIES = 0x14;       // Capabilities message (sent immediately after connection)
+    public static final byte MSG_CAPABILITIES = 0x14;       // Capabilities message (receiver -> streamer, after HELLO)
+    public static final byte MSG_VIDEO_FEEDBACK = 0x15;     // UDP video loss report (receiver -> streamer)
+    public static final byte MSG_SESSION_TICKET = 0x16;     // Ticket for resuming this session (streamer -> receiver)
+    public static final byte MSG_SESSION_RESUME = 0x17;     // Resume a dropped session (streamer -> receiver)
+    public static final byte MSG_SESSION_RESUMED = 0x18;    // Session resumed (receiver -> streamer)
     public static final byte MSG_ERROR = (byte)0xFF;
 
+    // CLIENT_HELLO flags
+    public static final int CLIENT_HELLO_FLAG_ENCRYPT = 0x01;
+    public static final int CLIENT_HELLO_FLAG_UDP_VIDEO = 0x02;  // Streamer can send frames over UDP
+    public static final int CLIENT_HELLO_FLAG_RESUME = 0x04;  // SESSION_RESUME follows instead of PIN/HELLO
+
+    public static final int SESSION_TICKET_SIZE = 16;
+
+    // AUDIO formats
+    public static final int AUDIO_FORMAT_PCM_S16LE = 0;
+    public static final int AUDIO_FORMAT_OPUS = 2;  // One 10 ms Opus packet per AUDIO message
+
+    // CAPABILITIES audio_codecs bits (PCM is always supported)
+    public static final int CAPABILITY_AUDIO_OPUS = 0x01;
+
+    // UDP video packet header: frame_seq(4) + frame_size(4) + offset(4) + packet_index(2) +
+    // packet_count(2) + packet_data(2) + fec_group(1) + reserved(1)
+    public static final int UDP_VIDEO_HEADER_SIZE = 20;
+    public static final int UDP_VIDEO_MAX_DATAGRAM = 1472;
+
     public static class MessageHeader {
         public byte type;
         public int length;
@@ -87,12 +110,31 @@ public class Protocol {
         return 9 + (data != null ? data.length : 0);
     }
 
+    // CAPABILITIES: sent right after HELLO; audioCodecs is CAPABILITY_AUDIO_* bits,
+    // audioSampleRate/audioChannels the output's native format for PCM (0 = no preference)
+    public static int sendCapabilities(OutputStream out, boolean requiresEncryption, int audioCodecs,
+                                       int audioSampleRate, int audioChannels) throws IOException {
+        ByteBuffer payload = ByteBuffer.allocate(12).order(ByteOrder.BIG_ENDIAN);
+        payload.put((byte)(requiresEncryption ? 1 : 0));
+        payload.put((byte)audioCodecs);
+        payload.putShort((short)0);  // reserved
+        payload.putInt(audioSampleRate);
+        payload.putShort((short)audioChannels);
+        payload.putShort((short)0);  // reserved
+        return sendMessage(out, MSG_CAPABILITIES, payload.array());
+    }
+
     public static int sendHello(OutputStream out, String displayName, DisplayMode[] modes) throws IOException {
+        return sendHello(out, displayName, modes, 0);
+    }
+
+    // udpPort: UDP video port to advertise (0 = TCP only, transport extension omitted)
+    public static int sendHello(OutputStream out, String displayName, DisplayMode[] modes, int udpPort) throws IOException {
         // Build HELLO message
         byte[] displayNameBytes = displayName.getBytes("UTF-8");
         int displayNameLen = displayNameBytes.length + 1; // Include null terminator
 
-        int payloadSize = 4 + displayNameLen + (modes != null ? modes.length * 12 : 0);
+        int payloadSize = 6 + displayNameLen + (modes != null ? modes.length * 12 : 0) + (udpPort != 0 ? 4 : 0);
         ByteBuffer payload = ByteBuffer.allocate(payloadSize).order(ByteOrder.BIG_ENDIAN);
 
         // Protocol version
@@ -112,6 +154,11 @@ public class Protocol {
                 payload.putInt(mode.refreshRate);
             }
         }
+        // Transport extension
+        if (udpPort != 0) {
+            payload.putShort((short)udpPort);
+            payload.putShort((short)0);  // Reserved
+        }
 
         return sendMessage(out, MSG_HELLO, payload.array());
     }
@@ -144,10 +191,17 @@ public class Protocol {
         return msg;
     }
 
+    // The streamer sends 64-bit timestamps as two big-endian halves, low half first
+    private static long getTimestamp(ByteBuffer buf) {
+        long low = buf.getInt() & 0xFFFFFFFFL;
+        long high = buf.getInt() & 0xFFFFFFFFL;
+        return (high << 32) | low;
+    }
+
     public static FrameMessage parseFrameMessage(byte[] data) {
         ByteBuffer buf = ByteBuffer.wrap(data).order(ByteOrder.BIG_ENDIAN);
         FrameMessage frame = new FrameMessage();
-        frame.timestampUs = buf.getLong();
+        frame.timestampUs = getTimestamp(buf);
         frame.outputId = buf.getInt();
         frame.width = buf.getInt();
         frame.height = buf.getInt();
@@ -179,7 +233,7 @@ public class Protocol {
     public static AudioMessage parseAudioMessage(byte[] data) {
         ByteBuffer buf = ByteBuffer.wrap(data).order(ByteOrder.BIG_ENDIAN);
         AudioMessage audio = new AudioMessage();
-        audio.timestampUs = buf.getLong();
+        audio.timestampUs = getTimestamp(buf);
         audio.sampleRate = buf.getInt();
         audio.channels = buf.getShort() & 0xFFFF;
         audio.format = buf.getShort() & 0xFFFF;
@@ -0,0 +1,328 @@
+package com.framebuffer.client;
+
+import java.io.IOException;
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.net.InetAddress;
+import java.net.SocketTimeoutException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+// Receives MSG_FRAME payloads over the UDP video channel and reassembles them.
+// Each datagram is a 20-byte header (frame_seq, frame_size, offset, packet_index,
+// packet_count, packet_data, fec_group) plus a slice of the frame. With FEC, every
+// fec_group data packets are followed by an XOR parity packet, so one lost packet
+// per group can be rebuilt. A frame is complete once every data packet is present;
+// incomplete frames older than a completed one are dropped. Loss statistics are
+// sent back as VIDEO_FEEDBACK so the streamer can adapt the amount of parity.
+public class UdpFrameReceiver extends Thread {
+    private static final int SLOTS = 4;  // Frames being reassembled at once
+    private static final int MAX_FRAME_SIZE = 64 * 1024 * 1024;
+    private static final int FEEDBACK_INTERVAL_MS = 500;
+
+    private static class Slot {
+        boolean inUse;
+        int frameSeq;
+        int frameSize;
+        int packetCount;
+        int packetData;
+        int fecGroup;
+        int packetsReceived;
+        int packetsRecovered;
+        boolean[] received = new boolean[0];
+        int[] groupReceived = new int[0];
+        boolean[] parityReceived = new boolean[0];
+        byte[] data = new byte[0];
+        byte[] parity = new byte[0];
+    }
+
+    private final DatagramSocket socket;
+    private volatile FrameReceiver frameReceiver;  // Replaced when a dropped session is resumed
+    private final InetAddress streamerAddress;  // Only accept packets from the TCP peer
+    private final Slot[] slots = new Slot[SLOTS];
+    private volatile boolean running = false;
+    private boolean haveCompleted = false;
+    private int lastCompletedSeq;
+    private long completedFrames = 0;
+    private long lostFrames = 0;
+    private long recoveredFrames = 0;
+
+    // VIDEO_FEEDBACK counters since the last report
+    private int fbPacketsExpected = 0;
+    private int fbPacketsLost = 0;
+    private int fbFramesCompleted = 0;
+    private int fbFramesLost = 0;
+    private int fbFramesRecovered = 0;
+
+    public UdpFrameReceiver(DatagramSocket socket, FrameReceiver frameReceiver, InetAddress streamerAddress) {
+        this.socket = socket;
+        this.frameReceiver = frameReceiver;
+        this.streamerAddress = streamerAddress;
+        for (int i = 0; i < SLOTS; i++) {
+            slots[i] = new Slot();
+        }
+    }
+
+    // Hand completed frames to the receiver of a resumed session
+    public void setFrameReceiver(FrameReceiver frameReceiver) {
+        this.frameReceiver = frameReceiver;
+    }
+
+    public void stopReceiving() {
+        running = false;
+        socket.close();
+        interrupt();
+    }
+
+    public long getCompletedFrames() {
+        return completedFrames;
+    }
+
+    public long getLostFrames() {
+        return lostFrames;
+    }
+
+    public long getRecoveredFrames() {
+        return recoveredFrames;
+    }
+
+    @Override
+    public void run() {
+        running = true;
+        byte[] buf = new byte[65536];
+        DatagramPacket packet = new DatagramPacket(buf, buf.length);
+        long lastFeedback = System.currentTimeMillis();
+
+        try {
+            // Wake up periodically so feedback goes out even when nothing completes
+            socket.setSoTimeout(FEEDBACK_INTERVAL_MS);
+        } catch (IOException e) {
+            // Feedback is then only sent when packets arrive
+        }
+
+        while (running && !isInterrupted()) {
+            long now = System.currentTimeMillis();
+            if (now - lastFeedback >= FEEDBACK_INTERVAL_MS) {
+                sendFeedback();
+                lastFeedback = now;
+            }
+
+            try {
+                packet.setLength(buf.length);
+                socket.receive(packet);
+            } catch (SocketTimeoutException e) {
+                continue;
+            } catch (IOException e) {
+                break;  // Socket closed
+            }
+
+            if (streamerAddress != null && !streamerAddress.equals(packet.getAddress())) {
+                continue;
+            }
+
+            Slot complete = addPacket(buf, packet.getLength());
+            if (complete != null) {
+                frameReceiver.onUdpFrame(complete.data, complete.frameSize);
+            }
+        }
+
+        android.util.Log.i("UdpFrameReceiver", "UDP video stopped: " + completedFrames +
+                " frames completed (" + recoveredFrames + " using FEC), " + lostFrames + " lost");
+    }
+
+    private void sendFeedback() {
+        if (fbPacketsExpected == 0 && fbFramesLost == 0) return;
+
+        ByteBuffer payload = ByteBuffer.allocate(20).order(ByteOrder.BIG_ENDIAN);
+        payload.putInt(fbPacketsExpected);
+        payload.putInt(fbPacketsLost);
+        payload.putInt(fbFramesCompleted);
+        payload.putInt(fbFramesLost);
+        payload.putInt(fbFramesRecovered);
+        frameReceiver.sendVideoFeedback(payload.array());
+
+        fbPacketsExpected = 0;
+        fbPacketsLost = 0;
+        fbFramesCompleted = 0;
+        fbFramesLost = 0;
+        fbFramesRecovered = 0;
+    }
+
+    private static int numGroups(int packetCount, int fecGroup) {
+        return fecGroup > 0 ? (packetCount + fecGroup - 1) / fecGroup : 0;
+    }
+
+    // Bytes of the frame a data packet carries (0 for an index past the end)
+    private static int packetLength(Slot slot, int index) {
+        long start = (long)index * slot.packetData;
+        if (start >= slot.frameSize) return 0;
+        return (int)Math.min(slot.packetData, slot.frameSize - start);
+    }
+
+    // Release a slot and account its packets in the feedback report
+    private void retireSlot(Slot slot) {
+        fbPacketsExpected += slot.packetCount;
+        fbPacketsLost += slot.packetCount - slot.packetsReceived + slot.packetsRecovered;
+        slot.inUse = false;
+    }
+
+    // Returns the completed slot (data valid until the next call), or null
+    private Slot addPacket(byte[] buf, int length) {
+        if (length < Protocol.UDP_VIDEO_HEADER_SIZE) return null;
+
+        ByteBuffer header = ByteBuffer.wrap(buf, 0, Protocol.UDP_VIDEO_HEADER_SIZE).order(ByteOrder.BIG_ENDIAN);
+        int frameSeq = header.getInt();
+        int frameSize = header.getInt();
+        int offset = header.getInt();
+        int packetIndex = header.getShort() & 0xFFFF;
+        int packetCount = header.getShort() & 0xFFFF;
+        int packetData = header.getShort() & 0xFFFF;
+        int fecGroup = header.get() & 0xFF;
+        int sliceLen = length - Protocol.UDP_VIDEO_HEADER_SIZE;
+        int groups = numGroups(packetCount, fecGroup);
+        boolean isParity = packetIndex >= packetCount;
+
+        // Exactly as many data packets as the frame needs, each but the last one full, so
+        // every packet (and every one parity rebuilds) lies inside the frame
+        if (frameSize < 0 || frameSize > MAX_FRAME_SIZE || packetCount == 0 || packetData == 0 ||
+            packetCount != ((long)frameSize + packetData - 1) / packetData || packetIndex >= packetCount + groups) {
+            return null;
+        }
+        if (isParity ? sliceLen != packetData
+                     : (offset != packetIndex * packetData || offset >= frameSize ||
+                        sliceLen != Math.min(frameSize - offset, packetData))) {
+            return null;
+        }
+
+        // Late packet for a frame that is already complete or superseded
+        if (haveCompleted && frameSeq - lastCompletedSeq <= 0) return null;
+
+        Slot slot = getSlot(frameSeq, frameSize, packetCount, packetData, fecGroup);
+        if (slot == null) return null;
+
+        int group;
+        if (isParity) {
+            group = packetIndex - packetCount;
+            if (slot.parityReceived[group]) return null;
+            System.arraycopy(buf, Protocol.UDP_VIDEO_HEADER_SIZE, slot.parity, group * packetData, packetData);
+            slot.parityReceived[group] = true;
+        } else {
+            if (slot.received[packetIndex]) return null;
+            System.arraycopy(buf, Protocol.UDP_VIDEO_HEADER_SIZE, slot.data, offset, sliceLen);
+            slot.received[packetIndex] = true;
+            slot.packetsReceived++;
+            group = fecGroup > 0 ? packetIndex / fecGroup : -1;
+            if (group >= 0) slot.groupReceived[group]++;
+        }
+        if (group >= 0) tryRecover(slot, group);
+
+        if (slot.packetsReceived < slot.packetCount) return null;
+
+        // Frame complete: frames in between that never completed are lost
+        if (haveCompleted) {
+            int gap = frameSeq - lastCompletedSeq - 1;
+            lostFrames += gap;
+            fbFramesLost += gap;
+        }
+        haveCompleted = true;
+        lastCompletedSeq = frameSeq;
+        completedFrames++;
+        fbFramesCompleted++;
+        if (slot.packetsRecovered > 0) {
+            recoveredFrames++;
+            fbFramesRecovered++;
+        }
+
+        for (Slot other : slots) {
+            if (other.inUse && other != slot && other.frameSeq - frameSeq < 0) {
+                retireSlot(other);
+            }
+        }
+        retireSlot(slot);  // Data stays valid until the slot is claimed again
+        return slot;
+    }
+
+    // Rebuild the single missing data packet of a group from the parity and the others
+    private void tryRecover(Slot slot, int group) {
+        int first = group * slot.fecGroup;
+        int last = Math.min(first + slot.fecGroup, slot.packetCount);
+        if (!slot.parityReceived[group] || slot.groupReceived[group] + 1 != last - first) return;
+
+        int missing = -1;
+        int parityBase = group * slot.packetData;
+        for (int i = first; i < last; i++) {
+            if (!slot.received[i]) {
+                missing = i;
+                continue;
+            }
+            int base = i * slot.packetData;
+            int len = packetLength(slot, i);
+            for (int j = 0; j < len; j++) {
+                slot.parity[parityBase + j] ^= slot.data[base + j];
+            }
+        }
+
+        int missingLen = missing >= 0 ? packetLength(slot, missing) : 0;
+        if (missingLen == 0) return;
+        System.arraycopy(slot.parity, parityBase, slot.data, missing * slot.packetData, missingLen);
+        slot.received[missing] = true;
+        slot.groupReceived[group]++;
+        slot.packetsReceived++;
+        slot.packetsRecovered++;
+    }
+
+    private Slot getSlot(int frameSeq, int frameSize, int packetCount, int packetData, int fecGroup) {
+        Slot freeSlot = null;
+        Slot oldest = null;
+        for (Slot slot : slots) {
+            if (!slot.inUse) {
+                if (freeSlot == null) freeSlot = slot;
+                continue;
+            }
+            if (slot.frameSeq == frameSeq) {
+                return (slot.frameSize == frameSize && slot.packetCount == packetCount &&
+                        slot.packetData == packetData && slot.fecGroup == fecGroup) ? slot : null;
+            }
+            if (oldest == null || slot.frameSeq - oldest.frameSeq < 0) {
+                oldest = slot;
+            }
+        }
+
+        Slot slot = freeSlot;
+        if (slot == null) {
+            // Don't let a straggler from an old frame evict a newer one
+            if (frameSeq - oldest.frameSeq < 0) return null;
+            slot = oldest;
+            retireSlot(slot);
+        }
+
+        int groups = numGroups(packetCount, fecGroup);
+        if (slot.received.length < packetCount) {
+            slot.received = new boolean[packetCount];
+        } else {
+            java.util.Arrays.fill(slot.received, 0, packetCount, false);
+        }
+        if (slot.groupReceived.length < groups) {
+            slot.groupReceived = new int[groups];
+            slot.parityReceived = new boolean[groups];
+        } else {
+            java.util.Arrays.fill(slot.groupReceived, 0, groups, 0);
+            java.util.Arrays.fill(slot.parityReceived, 0, groups, false);
+        }
+        if (slot.data.length < frameSize) {
+            slot.data = new byte[frameSize];
+        }
+        if (slot.parity.length < groups * packetData) {
+            slot.parity = new byte[groups * packetData];
+        }
+        slot.inUse = true;
+        slot.frameSeq = frameSeq;
+        slot.frameSize = frameSize;
+        slot.packetCount = packetCount;
+        slot.packetData = packetData;
+        slot.fecGroup = fecGroup;
+        slot.packetsReceived = 0;
+        slot.packetsRecovered = 0;
+        return slot;
+    }
+}
@@ -0,0 +1,226 @@
+/*
+ * Quality and CPU cost of the audio resampler against a reference implementation.
+ *
+ * Usage: audio-resampler-bench [seconds]
+ *
+ * The input is four tones inside the passband, generated at the input rate; the ideal
+ * output is the same tones evaluated at the output sample times (less the filter delay),
+ * so every implementation is scored against exact values:
+ *   reference  direct windowed sinc in double precision, kernel rebuilt for every sample
+ *              (no phase table), 4x the taps of the resampler: the quality ceiling
+ *   scalar     audio_resampler_process() with the portable dot product
+ *   simd       audio_resampler_process() with the SIMD dot product (AVX/SSE/NEON as built)
+ * Reported per rate pair: ns per output frame, CPU per stereo stream in real time,
+ * SNR against the ideal output (16-bit samples cap it near 90 dB for these tones) and,
+ * when downsampling, how far a tone between the two Nyquist frequencies is attenuated.
+ * Audio is fed in 10 ms chunks, as the streamer does.
+ */
+#define _GNU_SOURCE
+#include "audio_resampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define REF_TAPS (4 * AUDIO_RESAMPLER_TAPS)
+#define REF_BETA 12.0
+#define WARMUP_SEC 0.05  // Excluded from the SNR (filter start-up)
+
+static const double tone_fraction[] = { 0.004, 0.05, 0.21, 0.38 };  // Of the lower rate
+#define NUM_TONES (sizeof(tone_fraction) / sizeof(tone_fraction[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double signal_at(double t, double min_rate)
+{
+    double v = 0;
+    for (size_t i = 0; i < NUM_TONES; i++)
+        v += 0.2 * sin(2 * M_PI * tone_fraction[i] * min_rate * t + i);
+    return v;
+}
+
+static int16_t *make_input(uint32_t rate, uint16_t channels, uint32_t frames, double freq_hz, double min_rate)
+{
+    int16_t *pcm = malloc((size_t)frames * channels * sizeof(int16_t));
+    for (uint32_t i = 0; i < frames; i++) {
+        double t = (double)i / rate;
+        double v = freq_hz > 0 ? 0.5 * sin(2 * M_PI * freq_hz * t) : signal_at(t, min_rate);
+        for (int c = 0; c < channels; c++)
+            pcm[(size_t)i * channels + c] = (int16_t)lrint(v * 32767);
+    }
+    return pcm;
+}
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 60; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Reference: output k is the input interpolated at k * in / out frames (no delay)
+static uint32_t reference_resample(const int16_t *in, uint32_t in_frames, uint16_t channels,
+                                   uint32_t in_rate, uint32_t out_rate, int16_t *out)
+{
+    double ratio = (double)in_rate / out_rate;
+    double cutoff = 0.455 * (out_rate < in_rate ? (double)out_rate / in_rate : 1.0);
+    double half = REF_TAPS / 2.0 * (out_rate < in_rate ? ratio : 1.0);
+    double i0_beta = bessel_i0(REF_BETA);
+    uint32_t out_frames = (uint32_t)((uint64_t)in_frames * out_rate / in_rate);
+
+    for (uint32_t k = 0; k < out_frames; k++) {
+        double t = k * ratio;
+        long first = (long)ceil(t - half), last = (long)floor(t + half);
+        double sum[8] = { 0 };
+        for (long n = first; n <= last; n++) {
+            if (n < 0 || n >= (long)in_frames)
+                continue;
+            double x = t - n;
+            double w = x / half;
+            double kernel = 2 * cutoff * (x == 0 ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x)) *
+                            bessel_i0(REF_BETA * sqrt(fmax(0, 1 - w * w))) / i0_beta;
+            for (int c = 0; c < channels; c++)
+                sum[c] += kernel * in[(size_t)n * channels + c];
+        }
+        for (int c = 0; c < channels; c++) {
+            double v = fmax(-32768, fmin(32767, sum[c]));
+            out[(size_t)k * channels + c] = (int16_t)lrint(v);
+        }
+    }
+    return out_frames;
+}
+
+static uint32_t resampler_run(audio_resampler_t *r, const int16_t *in, uint32_t in_frames, uint16_t in_channels,
+                              uint32_t in_rate, int16_t *out, uint16_t out_channels, uint32_t out_cap)
+{
+    uint32_t chunk = in_rate / 100;
+    uint32_t n = 0;
+    audio_resampler_reset(r);
+    for (uint32_t i = 0; i + chunk <= in_frames; i += chunk) {
+        int got = audio_resampler_process(r, in + (size_t)i * in_channels, chunk, 0, out + (size_t)n * out_channels,
+                                          out_cap - n, NULL);
+        if (got < 0) {
+            fprintf(stderr, "audio_resampler_process failed\n");
+            exit(1);
+        }
+        n += (uint32_t)got;
+    }
+    return n;
+}
+
+// SNR of out (first channel) against the tones at the output times, shifted by delay_sec
+static double snr_db(const int16_t *out, uint32_t frames, uint16_t channels, uint32_t out_rate,
+                     double delay_sec, double min_rate)
+{
+    double signal = 0, noise = 0;
+    for (uint32_t k = (uint32_t)((WARMUP_SEC + delay_sec) * out_rate); k < frames; k++) {
+        double ideal = signal_at((double)k / out_rate - delay_sec, min_rate) * 32767;
+        double e = out[(size_t)k * channels] - ideal;
+        signal += ideal * ideal;
+        noise += e * e;
+    }
+    return noise > 0 ? 10 * log10(signal / noise) : 200;
+}
+
+static double rms(const int16_t *pcm, uint32_t from, uint32_t frames, uint16_t channels)
+{
+    double sum = 0;
+    for (uint32_t k = from; k < frames; k++)
+        sum += (double)pcm[(size_t)k * channels] * pcm[(size_t)k * channels];
+    return frames > from ? sqrt(sum / (frames - from)) : 0;
+}
+
+static void print_row(const char *name, const char *impl, double sec, uint32_t out_frames, uint32_t out_rate,
+                      double snr, double alias)
+{
+    double ns_per_frame = sec / out_frames * 1e9;
+    double cpu_pct = ns_per_frame * out_rate / 1e9 * 100;
+    printf("%-18s %-10s %9.1f %8.3f%% %8.1f", name, impl, ns_per_frame, cpu_pct, snr);
+    if (alias != 0)
+        printf(" %9.1f", alias);
+    printf("\n");
+}
+
+static void bench_pair(uint32_t in_rate, uint16_t in_channels, uint32_t out_rate, uint16_t out_channels,
+                       double seconds)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%u->%u %u->%uch", in_rate, out_rate, in_channels, out_channels);
+    audio_resampler_t *r = audio_resampler_create(in_rate, in_channels, out_rate, out_channels);
+    if (!r) {
+        printf("%-18s (unsupported ratio)\n", name);
+        return;
+    }
+
+    double min_rate = in_rate < out_rate ? in_rate : out_rate;
+    uint32_t in_frames = (uint32_t)(seconds * in_rate);
+    uint32_t out_cap = audio_resampler_max_output(r, in_frames) + out_rate / 100;
+    int16_t *in = make_input(in_rate, in_channels, in_frames, 0, min_rate);
+    int16_t *out = malloc((size_t)out_cap * out_channels * sizeof(int16_t));
+    double delay_sec = (double)audio_resampler_delay_frames(r) / in_rate;
+
+    // A tone above the output Nyquist must not fold back into the band
+    double alias = 0;
+    if (out_rate < in_rate) {
+        double freq = 0.5 * (out_rate / 2.0 + 0.455 * in_rate);  // Between the two Nyquists, above the cutoff
+        int16_t *tone = make_input(in_rate, in_channels, in_frames, freq, min_rate);
+        uint32_t n = resampler_run(r, tone, in_frames, in_channels, in_rate, out, out_channels, out_cap);
+        double level = rms(out, (uint32_t)(WARMUP_SEC * out_rate), n, out_channels);
+        alias = 20 * log10(fmax(level, 1e-3) / (0.5 * 32767 / sqrt(2)));
+        free(tone);
+    }
+
+    // Reference over a shorter stretch (it is slow); its output is not delayed
+    if (in_channels == out_channels) {
+        uint32_t ref_in = in_frames < in_rate ? in_frames : in_rate;
+        double start = now_sec();
+        uint32_t n = reference_resample(in, ref_in, in_channels, in_rate, out_rate, out);
+        double sec = now_sec() - start;
+        // Skip the tail too: the kernel runs off the end of the input
+        uint32_t tail = (uint32_t)((double)REF_TAPS * out_rate / in_rate);
+        print_row(name, "reference", sec, n, out_rate, snr_db(out, n - tail, out_channels, out_rate, 0, min_rate),
+                  0);
+    }
+
+    for (int simd = 0; simd <= 1; simd++) {
+        audio_resampler_set_simd(r, simd);
+        resampler_run(r, in, in_frames, in_channels, in_rate, out, out_channels, out_cap);  // Warm the caches
+        double start = now_sec();
+        uint32_t n = resampler_run(r, in, in_frames, in_channels, in_rate, out, out_channels, out_cap);
+        double sec = now_sec() - start;
+        print_row(name, simd ? "simd" : "scalar", sec, n, out_rate,
+                  snr_db(out, n, out_channels, out_rate, delay_sec, min_rate), alias);
+    }
+
+    free(in);
+    free(out);
+    audio_resampler_destroy(r);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 10;
+    if (seconds <= 0.1) {
+        fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    printf("Audio resampler, %.0f s of 10 ms chunks, SIMD: %s, %d taps per phase\n",
+           seconds, audio_resampler_simd_name(), AUDIO_RESAMPLER_TAPS);
+    printf("%-18s %-10s %9s %9s %8s %9s\n", "rates", "impl", "ns/frame", "cpu", "SNR dB", "alias dB");
+    bench_pair(44100, 2, 48000, 2, seconds);
+    bench_pair(48000, 2, 44100, 2, seconds);
+    bench_pair(48000, 2, 32000, 2, seconds);
+    bench_pair(96000, 2, 48000, 2, seconds);
+    bench_pair(48000, 2, 48000, 1, seconds);
+    return 0;
+}
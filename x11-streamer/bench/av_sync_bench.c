@@ -0,0 +1,218 @@
+/*
+ * Simulated A/V sync benchmark: lip-sync error of the receiver's sync controller
+ * (tv-receiver/app/src/main/cpp/av_sync.c) under clock drift and network jitter.
+ *
+ * Usage: av-sync-bench [seconds] [drift_list] [jitter_ms]
+ *   drift_list: comma-separated drift of the streamer's audio clock against the
+ *               receiver's DAC in ppm (default -1000,-200,0,50,200,1000)
+ *
+ * Runs in simulated time with 1 ms ticks (both sides' monotonic clocks are taken to
+ * agree; the drift is in the audio sample clocks). The streamer sends 10 ms audio
+ * chunks and 60 fps frames, both stamped with their capture time; each arrives after
+ * 5 ms plus up to jitter_ms (default 20) of delay, in order as over TCP. The DAC
+ * plays at its own rate and the sync controller is told its position every chunk,
+ * the way AudioReceiver polls AudioTrack.getTimestamp().
+ *
+ * "arrival" is the lip-sync error if frames are shown as they arrive, "scheduled"
+ * when they are held until the audio clock reaches them. Errors are video minus
+ * audio stream time at the moment a frame is shown (>0 = video early).
+ */
+#include "av_sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SAMPLE_RATE 48000
+#define CHANNELS 2
+#define CHUNK_FRAMES 480       // 10 ms
+#define FRAME_INTERVAL_US 16667
+#define BASE_DELAY_US 5000
+#define MAX_PENDING 64
+
+typedef struct {
+    double *abs_ms;
+    size_t count;
+    size_t cap;
+    double sum_ms;
+} error_list_t;
+
+typedef struct {
+    uint64_t stream_us;
+    uint64_t present_us;
+} pending_frame_t;
+
+static void error_add(error_list_t *list, int64_t error_us)
+{
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 4096;
+        list->abs_ms = realloc(list->abs_ms, list->cap * sizeof(double));
+        if (!list->abs_ms) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    list->abs_ms[list->count++] = llabs(error_us) / 1000.0;
+    list->sum_ms += error_us / 1000.0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double error_percentile(error_list_t *list, double p)
+{
+    if (list->count == 0)
+        return 0.0;
+    qsort(list->abs_ms, list->count, sizeof(double), compare_double);
+    return list->abs_ms[(size_t)(p * (list->count - 1) + 0.5)];
+}
+
+// Delivery time of the next message: base delay plus jitter, never before the previous one
+static uint64_t deliver_at(uint64_t sent_us, int jitter_ms, uint64_t *last_delivery_us)
+{
+    uint64_t at = sent_us + BASE_DELAY_US + (jitter_ms > 0 ? (uint64_t)(rand() % (jitter_ms * 1000)) : 0);
+    if (at < *last_delivery_us)
+        at = *last_delivery_us;
+    *last_delivery_us = at;
+    return at;
+}
+
+static void run(double drift_ppm, int seconds, int jitter_ms)
+{
+    av_sync_t *sync = av_sync_create(SAMPLE_RATE, CHANNELS, 0);
+    if (!sync) {
+        fprintf(stderr, "av_sync_create failed\n");
+        exit(1);
+    }
+    srand(1);
+
+    int16_t in[CHUNK_FRAMES * CHANNELS];
+    int16_t *out = malloc(av_sync_max_output_frames(sync, CHUNK_FRAMES) * CHANNELS * sizeof(int16_t));
+    if (!out) {
+        perror("malloc");
+        exit(1);
+    }
+
+    // The streamer's clock: a 10 ms chunk of its samples lasts this long on the DAC's clock
+    double chunk_us = CHUNK_FRAMES * 1e6 / SAMPLE_RATE / (1 + drift_ppm / 1e6);
+    uint64_t last_delivery_us = 0;
+    uint64_t next_chunk = 0, next_frame = 0;
+    uint64_t chunk_arrival = deliver_at(0, jitter_ms, &last_delivery_us);
+    uint64_t frame_arrival = deliver_at(0, jitter_ms, &last_delivery_us);
+
+    uint64_t queued = 0;     // Output frames handed to the DAC
+    double played = 0;       // DAC position
+    bool playing = false, dry = false;
+    uint64_t next_report_us = 0;
+    pending_frame_t pending[MAX_PENDING];
+    int num_pending = 0;
+    error_list_t arrival = {0}, scheduled = {0};
+
+    for (uint64_t t = 0; t < (uint64_t)seconds * 1000000; t += 1000) {
+        // DAC consumes 1 ms of output, stalling (and counting an underrun) if dry
+        if (playing) {
+            played += SAMPLE_RATE / 1000.0;
+            if (played > queued) {
+                played = (double)queued;
+                if (!dry)
+                    av_sync_underrun(sync);
+                dry = true;
+            } else {
+                dry = false;
+            }
+        }
+        if (playing && t >= next_report_us) {
+            av_sync_audio_position(sync, (uint64_t)played, t);
+            next_report_us = t + CHUNK_FRAMES * 1000000ULL / SAMPLE_RATE;
+        }
+
+        // Messages delivered by now, audio and video interleaved in send order
+        while (chunk_arrival <= t || frame_arrival <= t) {
+            uint64_t chunk_sent = (uint64_t)(next_chunk * chunk_us);
+            uint64_t frame_sent = next_frame * FRAME_INTERVAL_US;
+            if (chunk_arrival <= t && (chunk_sent <= frame_sent || frame_arrival > t)) {
+                for (int i = 0; i < CHUNK_FRAMES; i++) {
+                    int16_t v = (int16_t)(8000 * sin(2 * M_PI * 440 * (next_chunk * CHUNK_FRAMES + i) / SAMPLE_RATE));
+                    in[i * CHANNELS] = in[i * CHANNELS + 1] = v;
+                }
+                // The streamer stamps capture time, so its chunks are chunk_us apart
+                uint64_t stream_us = chunk_sent;
+                int n = av_sync_push_audio(sync, stream_us, in, CHUNK_FRAMES, out,
+                                           av_sync_max_output_frames(sync, CHUNK_FRAMES));
+                if (n > 0)
+                    queued += (uint64_t)n;
+                playing = true;
+                next_chunk++;
+                chunk_arrival = deliver_at((uint64_t)(next_chunk * chunk_us), jitter_ms, &last_delivery_us);
+            } else {
+                uint64_t stream_us = frame_sent;
+                int64_t error_us;
+                uint64_t heard_us;
+                if (av_sync_audio_clock(sync, t, &heard_us) == 0) {
+                    error_us = (int64_t)(stream_us - heard_us);
+                    error_add(&arrival, error_us);
+                }
+                uint64_t present_us;
+                av_sync_schedule_frame(sync, stream_us, t, &present_us);
+                if (num_pending < MAX_PENDING)
+                    pending[num_pending++] = (pending_frame_t){ stream_us, present_us };
+                next_frame++;
+                frame_arrival = deliver_at(next_frame * FRAME_INTERVAL_US, jitter_ms, &last_delivery_us);
+            }
+        }
+
+        // Show frames that are due
+        for (int i = 0; i < num_pending; ) {
+            if (pending[i].present_us > t) {
+                i++;
+                continue;
+            }
+            int64_t error_us;
+            if (av_sync_frame_presented(sync, pending[i].stream_us, t, &error_us) == 0)
+                error_add(&scheduled, error_us);
+            pending[i] = pending[--num_pending];
+        }
+    }
+
+    av_sync_stats_t stats;
+    av_sync_get_stats(sync, &stats);
+    printf("%+7.0f %6d   %7.2f %7.2f %7.2f   %7.2f %7.2f %7.2f   %6llu %6.1f %+6d %5llu %5llu\n",
+           drift_ppm, jitter_ms,
+           arrival.count ? arrival.sum_ms / arrival.count : 0.0, error_percentile(&arrival, 0.95),
+           error_percentile(&arrival, 1.0),
+           scheduled.count ? scheduled.sum_ms / scheduled.count : 0.0, error_percentile(&scheduled, 0.95),
+           error_percentile(&scheduled, 1.0),
+           (unsigned long long)stats.late_frames, stats.queue_us / 1000.0, stats.correction_ppm,
+           (unsigned long long)stats.dropped_chunks, (unsigned long long)stats.underruns);
+
+    free(arrival.abs_ms);
+    free(scheduled.abs_ms);
+    free(out);
+    av_sync_destroy(sync);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 120;
+    const char *drift_list = argc > 2 ? argv[2] : "-1000,-200,0,50,200,1000";
+    int jitter_ms = argc > 3 ? atoi(argv[3]) : 20;
+
+    if (seconds <= 0 || jitter_ms < 0) {
+        fprintf(stderr, "Usage: %s [seconds] [drift_list] [jitter_ms]\n", argv[0]);
+        return 1;
+    }
+
+    printf("A/V sync over %d s simulated, target queue %d ms (errors in ms: avg, p95 |e|, max |e|)\n",
+           seconds, AV_SYNC_DEFAULT_TARGET_MS);
+    printf("  drift jitter   arrival avg     p95     max   sched avg     p95     max     late  queue    ppm  drop under\n");
+
+    char *list = strdup(drift_list);
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+        run(atof(tok), seconds, jitter_ms);
+    free(list);
+    return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * Micro-benchmark: sender CPU per receiver when one frame goes to several TVs.
+ *
+ * Usage: fanout-bench [frame_kb] [frames]
+ *
+ * Each receiver is a loopback TCP connection drained by its own thread, so only
+ * the sending side is measured (CPU time of the pushing thread).
+ *   copy:   send_queue_push() per receiver - the frame is copied into every queue
+ *   shared: send_message_create() once, send_queue_push_message() per receiver
+ * With the shared message the cost of an added receiver is just its send.
+ *
+ * First the encrypted queue is checked under congestion: the socket refuses a frame
+ * right after the queue sealed it, then a replacing frame and a control message are
+ * pushed. The receiver must decrypt every record in order and see both. Exits 1 if not.
+ */
+#define _GNU_SOURCE
+#include "send_queue.h"
+#include "noise_encryption.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define MAX_RECEIVERS 8
+#define CHECK_FRAME_SIZE 2048  // Small enough that a unix socket takes each send whole or not at all
+
+static double cpu_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *drain_thread(void *arg)
+{
+    int fd = *(int *)arg;
+    static __thread char buf[256 * 1024];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+// Connected loopback TCP pair: *send_fd is the streamer side
+static void tcp_pair(int *send_fd, int *recv_fd)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, len) < 0 ||
+        listen(listen_fd, 1) < 0 || getsockname(listen_fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen");
+        exit(1);
+    }
+    *send_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(*send_fd, (struct sockaddr *)&addr, len) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    *recv_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+}
+
+// Wait until every queue has handed its data to the kernel
+static void flush_all(send_queue_t **queues, int *fds, int n)
+{
+    for (;;) {
+        struct pollfd pfds[MAX_RECEIVERS];
+        int npfds = 0;
+        for (int i = 0; i < n; i++) {
+            if (send_queue_has_pending(queues[i])) {
+                pfds[npfds].fd = fds[i];
+                pfds[npfds].events = POLLOUT;
+                npfds++;
+            }
+        }
+        if (npfds == 0)
+            return;
+        poll(pfds, npfds, 100);
+        for (int i = 0; i < n; i++)
+            send_queue_flush(queues[i]);
+    }
+}
+
+static double run(const uint8_t *frame, size_t frame_size, int receivers, int frames, bool shared)
+{
+    int send_fds[MAX_RECEIVERS];
+    int recv_fds[MAX_RECEIVERS];
+    pthread_t threads[MAX_RECEIVERS];
+    send_queue_t *queues[MAX_RECEIVERS];
+
+    for (int i = 0; i < receivers; i++) {
+        tcp_pair(&send_fds[i], &recv_fds[i]);
+        queues[i] = send_queue_create(send_fds[i], NULL, 0);
+        pthread_create(&threads[i], NULL, drain_thread, &recv_fds[i]);
+    }
+
+    frame_message_t fm = {0};
+    struct iovec iov = { .iov_base = (void *)frame, .iov_len = frame_size };
+
+    double start = cpu_sec();
+    for (int f = 0; f < frames; f++) {
+        fm.timestamp_us = f;
+        if (shared) {
+            send_message_t *msg = send_message_create(MSG_FRAME, &fm, sizeof(fm), &iov, 1);
+            for (int i = 0; i < receivers; i++)
+                send_queue_push_message(queues[i], msg, false);
+            send_message_unref(msg);
+        } else {
+            for (int i = 0; i < receivers; i++)
+                send_queue_push(queues[i], MSG_FRAME, &fm, sizeof(fm), &iov, 1, false);
+        }
+        flush_all(queues, send_fds, receivers);
+    }
+    double elapsed = cpu_sec() - start;
+
+    for (int i = 0; i < receivers; i++) {
+        send_queue_destroy(queues[i]);
+        shutdown(send_fds[i], SHUT_WR);
+        pthread_join(threads[i], NULL);
+        close(send_fds[i]);
+        close(recv_fds[i]);
+    }
+    return elapsed;
+}
+
+// Wait until the queue has handed its data to the kernel
+static void flush_one(send_queue_t *queue, int fd)
+{
+    while (send_queue_has_pending(queue)) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        poll(&pfd, 1, 100);
+        if (send_queue_flush(queue) < 0)
+            return;
+    }
+}
+
+typedef struct {
+    noise_encryption_context_t *noise;
+    int fd;
+    int frames;           // MSG_FRAME messages received
+    int pings;
+    uint32_t last_frame;  // Marker (first bytes) of the last frame received
+    bool failed;          // A record did not decrypt or a message was malformed
+} check_receiver_t;
+
+// Decrypt messages (a header record, then a record with the fixed struct) up to MSG_PAUSE
+static void *check_receive_thread(void *arg)
+{
+    check_receiver_t *r = arg;
+    uint8_t buf[CHECK_FRAME_SIZE];
+    message_header_t header;
+    for (;;) {
+        if (noise_encryption_recv(r->noise, r->fd, &header, sizeof(header)) != sizeof(header)) {
+            r->failed = true;
+            break;
+        }
+        uint32_t length = ntohl(header.length);
+        if (length > sizeof(buf) ||
+            (length > 0 && noise_encryption_recv(r->noise, r->fd, buf, sizeof(buf)) != (ssize_t)length)) {
+            r->failed = true;
+            break;
+        }
+        if (header.type == MSG_PAUSE)
+            break;
+        if (header.type == MSG_PING) {
+            r->pings++;
+        } else if (header.type == MSG_FRAME && length >= sizeof(r->last_frame)) {
+            r->frames++;
+            memcpy(&r->last_frame, buf, sizeof(r->last_frame));
+        }
+    }
+    return NULL;
+}
+
+static void *check_handshake_thread(void *arg)
+{
+    check_receiver_t *r = arg;
+    r->failed = noise_encryption_handshake(r->noise, r->fd) < 0;
+    return NULL;
+}
+
+static bool check_congested_replace(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        perror("socketpair");
+        return false;
+    }
+    int size = 32 * 1024;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    check_receiver_t receiver = { .noise = noise_encryption_init(false), .fd = fds[1] };
+    noise_encryption_context_t *noise = noise_encryption_init(true);
+    pthread_t thread;
+    bool ok = false;
+    if (!noise || !receiver.noise || pthread_create(&thread, NULL, check_handshake_thread, &receiver) != 0) {
+        fprintf(stderr, "check: Noise setup failed\n");
+        goto out;
+    }
+    int rc = noise_encryption_handshake(noise, fds[0]);
+    if (rc < 0)
+        shutdown(fds[0], SHUT_RDWR);  // Unblock the responder
+    pthread_join(thread, NULL);
+    if (rc < 0 || receiver.failed) {
+        fprintf(stderr, "check: Noise handshake failed\n");
+        goto out;
+    }
+
+    send_queue_t *queue = send_queue_create(fds[0], noise, 0);
+    if (!queue)
+        goto out;
+
+    // Nobody reads yet: push frames until one is sealed but refused by the socket
+    uint8_t frame[CHECK_FRAME_SIZE] = { 0 };
+    uint32_t marker = 0;
+    while (!send_queue_has_pending(queue) && marker < 100000) {
+        marker++;
+        memcpy(frame, &marker, sizeof(marker));
+        send_queue_push(queue, MSG_FRAME, frame, sizeof(frame), NULL, 0, false);
+    }
+
+    // That frame must still go out first: a newer frame may not replace it, nor may a
+    // control message overtake it
+    uint32_t replacing = ++marker;
+    memcpy(frame, &replacing, sizeof(replacing));
+    uint64_t ping = 1;
+    bool pushed = send_queue_push(queue, MSG_FRAME, frame, sizeof(frame), NULL, 0, true) == 0 &&
+                  send_queue_push(queue, MSG_PING, &ping, sizeof(ping), NULL, 0, false) == 0;
+
+    if (pthread_create(&thread, NULL, check_receive_thread, &receiver) != 0) {
+        send_queue_destroy(queue);
+        goto out;
+    }
+    flush_one(queue, fds[0]);
+    send_queue_push(queue, MSG_PAUSE, NULL, 0, NULL, 0, false);  // Ends the receiver
+    flush_one(queue, fds[0]);
+    shutdown(fds[0], SHUT_RDWR);
+    pthread_join(thread, NULL);
+    send_queue_destroy(queue);
+
+    ok = pushed && !receiver.failed && receiver.pings == 1 && receiver.last_frame == replacing &&
+         receiver.frames == (int)marker;
+    printf("check: congested encrypted queue, %d of %u frames, %d ping, last frame %u of %u: %s\n",
+           receiver.frames, marker, receiver.pings, receiver.last_frame, replacing, ok ? "ok" : "FAILED");
+
+out:
+    noise_encryption_cleanup(noise);
+    noise_encryption_cleanup(receiver.noise);
+    close(fds[0]);
+    close(fds[1]);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t frame_kb = argc > 1 ? (size_t)atoi(argv[1]) : 512;
+    int frames = argc > 2 ? atoi(argv[2]) : 500;
+
+    if (frame_kb == 0 || frames <= 0) {
+        fprintf(stderr, "Usage: %s [frame_kb] [frames]\n", argv[0]);
+        return 1;
+    }
+
+    if (!check_congested_replace())
+        return 1;
+
+    size_t frame_size = frame_kb * 1024;
+    uint8_t *frame = malloc(frame_size);
+    memset(frame, 0x5a, frame_size);
+
+    printf("%zu KB frames, %d frames, sender CPU per frame\n", frame_kb, frames);
+    printf("receivers       copy     shared   shared/receiver\n");
+    static const int counts[] = { 1, 2, 4, 8 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        int n = counts[c];
+        double copy = run(frame, frame_size, n, frames, false);
+        double shared = run(frame, frame_size, n, frames, true);
+        printf("%-9d  %7.1f us  %7.1f us  %7.1f us\n", n,
+               copy / frames * 1e6, shared / frames * 1e6, shared / frames / n * 1e6);
+    }
+
+    free(frame);
+    return 0;
+}
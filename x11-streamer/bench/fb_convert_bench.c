@@ -0,0 +1,378 @@
+/*
+ * Framebuffer detile/convert kernels: correctness on synthetic tiled buffers, then speed.
+ *
+ * Usage: fb-convert-bench [iterations [fb-id]]
+ *
+ * For every supported format and layout (linear, X-tiled, Y-tiled) a random picture is
+ * laid out the way the GPU would store it, using a per-pixel address function written
+ * independently of the kernels, and converted with the scalar and the SIMD kernels.
+ * Every output pixel is compared with a per-channel reference conversion; sizes that
+ * end mid-tile and mid-vector are included. The streaming-load capture is checked the
+ * same way, along with the dirty tiles it reports against a previous frame with a few
+ * pixels changed. Exits 1 on any mismatch.
+ * Speed is measured at 1080p and 4K: ms per frame and GB/s of XRGB8888 written.
+ *
+ * With a framebuffer id (see drm_info or the streamer's log; needs access to the DRM
+ * device) the real mapping is read each way the DRM frame source can read it, followed by
+ * the three passes the consumers make over a frame (dirty compare, encoder, send), and
+ * the mode the probe picks is shown. Write-combined mappings are where this matters.
+ */
+#define _GNU_SOURCE
+#include "fb_convert.h"
+#include "drm_fb.h"
+#include "dirty_rect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <drm/drm_fourcc.h>
+
+typedef struct {
+    uint32_t format;
+    const char *name;
+} format_t;
+
+typedef struct {
+    uint64_t modifier;
+    const char *name;
+    uint32_t tile_width;   // Bytes (1 = linear)
+    uint32_t tile_height;
+} layout_t;
+
+static const format_t formats[] = {
+    { DRM_FORMAT_XRGB8888, "XRGB8888" },
+    { DRM_FORMAT_ABGR8888, "ABGR8888" },
+    { DRM_FORMAT_XRGB2101010, "XRGB2101010" },
+    { DRM_FORMAT_RGB565, "RGB565" },
+};
+
+static const layout_t layouts[] = {
+    { DRM_FORMAT_MOD_LINEAR, "linear", 1, 1 },
+    { I915_FORMAT_MOD_X_TILED, "X-tiled", 512, 8 },
+    { I915_FORMAT_MOD_Y_TILED, "Y-tiled", 128, 32 },
+};
+
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+#define NUM_LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t rng32(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+// Where byte bx of pixel row y lives (bx counted from the row start)
+static size_t tiled_offset(const layout_t *layout, uint32_t pitch, uint32_t bx, uint32_t y)
+{
+    if (layout->modifier == DRM_FORMAT_MOD_LINEAR)
+        return (size_t)y * pitch + bx;
+    size_t tile = (size_t)(y / layout->tile_height) * (pitch / layout->tile_width) + bx / layout->tile_width;
+    uint32_t tx = bx % layout->tile_width, ty = y % layout->tile_height;
+    if (layout->modifier == I915_FORMAT_MOD_X_TILED)
+        return tile * 4096 + ty * 512 + tx;
+    // Y: 16-byte wide columns of 32 rows, left to right
+    return tile * 4096 + (tx / 16) * (16 * 32) + ty * 16 + tx % 16;
+}
+
+// Per-channel reference for one source pixel
+static uint32_t reference_pixel(uint32_t format, uint32_t p)
+{
+    uint32_t r, g, b;
+    switch (format) {
+    case DRM_FORMAT_XRGB8888:
+        return p;
+    case DRM_FORMAT_ABGR8888:
+        r = p & 0xFF;
+        g = (p >> 8) & 0xFF;
+        b = (p >> 16) & 0xFF;
+        break;
+    case DRM_FORMAT_XRGB2101010:
+        r = ((p >> 20) & 0x3FF) >> 2;
+        g = ((p >> 10) & 0x3FF) >> 2;
+        b = (p & 0x3FF) >> 2;
+        break;
+    default: {  // RGB565, widened by repeating the top bits
+        uint32_t r5 = (p >> 11) & 31, g6 = (p >> 5) & 63, b5 = p & 31;
+        r = (r5 << 3) | (r5 >> 2);
+        g = (g6 << 2) | (g6 >> 4);
+        b = (b5 << 3) | (b5 >> 2);
+        break;
+    }
+    }
+    return 0xFF000000u | (r << 16) | (g << 8) | b;
+}
+
+typedef struct {
+    uint8_t *buffer;   // As the GPU stores it
+    uint32_t pitch;
+    uint32_t *expected;
+} picture_t;
+
+static int make_picture(const format_t *format, const layout_t *layout, uint32_t width, uint32_t height,
+                        picture_t *pic)
+{
+    uint32_t cpp = fb_convert_format_cpp(format->format);
+    uint32_t align = layout->tile_width > 64 ? layout->tile_width : 64;
+    pic->pitch = (width * cpp + align - 1) / align * align;
+    size_t size = (size_t)pic->pitch * fb_convert_aligned_height(layout->modifier, height);
+    pic->buffer = malloc(size);
+    pic->expected = malloc((size_t)width * height * 4);
+    if (!pic->buffer || !pic->expected)
+        return -1;
+    memset(pic->buffer, 0xA5, size);  // Padding must not leak into the output
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t p = rng32();
+            if (cpp == 2)
+                p &= 0xFFFF;
+            for (uint32_t i = 0; i < cpp; i++)
+                pic->buffer[tiled_offset(layout, pic->pitch, x * cpp + i, y)] = (uint8_t)(p >> (8 * i));
+            pic->expected[(size_t)y * width + x] = reference_pixel(format->format, p);
+        }
+    }
+    return 0;
+}
+
+static void free_picture(picture_t *pic)
+{
+    free(pic->buffer);
+    free(pic->expected);
+}
+
+// Returns the number of wrong pixels
+static size_t check(const format_t *format, const layout_t *layout, uint32_t width, uint32_t height, bool simd)
+{
+    picture_t pic;
+    uint32_t *out = malloc((size_t)width * height * 4);
+    if (!out || make_picture(format, layout, width, height, &pic) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    fb_convert_set_simd(simd);
+    size_t wrong = 0;
+    if (fb_convert_to_xrgb8888(pic.buffer, pic.pitch, format->format, layout->modifier, width, height,
+                               out, width * 4) < 0) {
+        wrong = (size_t)width * height;
+    } else {
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            if (out[i] == pic.expected[i])
+                continue;
+            if (wrong == 0)
+                printf("  %s %s %s %ux%u: pixel (%zu,%zu) is %08x, expected %08x\n", format->name, layout->name,
+                       simd ? "simd" : "scalar", width, height, i % width, i / width, out[i], pic.expected[i]);
+            wrong++;
+        }
+    }
+
+    free_picture(&pic);
+    free(out);
+    return wrong;
+}
+
+// Streaming-load capture with the dirty compare: previous is the expected picture with a
+// few pixels changed, so exactly the tiles holding them must be flagged
+static size_t check_capture(const format_t *format, const layout_t *layout, uint32_t width, uint32_t height)
+{
+    picture_t pic;
+    uint32_t *out = malloc((size_t)width * height * 4);
+    uint32_t *previous = malloc((size_t)width * height * 4);
+    uint32_t tiles_x = (width + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    uint32_t tiles_y = (height + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    bool *tiles = malloc((size_t)tiles_x * tiles_y * sizeof(bool));
+    bool *expected_tiles = calloc((size_t)tiles_x * tiles_y, sizeof(bool));
+    if (!out || !previous || !tiles || !expected_tiles || make_picture(format, layout, width, height, &pic) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    memcpy(previous, pic.expected, (size_t)width * height * 4);
+    for (int i = 0; i < 5; i++) {
+        uint32_t x = rng32() % width, y = rng32() % height;
+        previous[(size_t)y * width + x] ^= 0x00010101;
+        expected_tiles[(y / DIRTY_RECT_TILE_SIZE) * tiles_x + x / DIRTY_RECT_TILE_SIZE] = true;
+    }
+
+    fb_convert_set_simd(true);
+    fb_convert_dirty_t dirty = { .previous = previous, .tile_size = DIRTY_RECT_TILE_SIZE, .tiles = tiles };
+    size_t wrong = 0;
+    if (fb_convert_frame(pic.buffer, pic.pitch, format->format, layout->modifier, width, height,
+                         out, width * 4, true, &dirty) < 0) {
+        wrong = (size_t)width * height;
+    } else {
+        for (size_t i = 0; i < (size_t)width * height; i++)
+            wrong += out[i] != pic.expected[i];
+        for (size_t i = 0; i < (size_t)tiles_x * tiles_y; i++)
+            wrong += tiles[i] != expected_tiles[i];
+        if (wrong)
+            printf("  %s %s streaming %ux%u: %zu wrong pixels or tiles\n", format->name, layout->name,
+                   width, height, wrong);
+    }
+
+    free_picture(&pic);
+    free(out);
+    free(previous);
+    free(tiles);
+    free(expected_tiles);
+    return wrong;
+}
+
+static void bench(const format_t *format, const layout_t *layout, uint32_t width, uint32_t height, int iterations)
+{
+    picture_t pic;
+    uint32_t *out = malloc((size_t)width * height * 4);
+    if (!out || make_picture(format, layout, width, height, &pic) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    printf("%-12s %-8s %4ux%-5u", format->name, layout->name, width, height);
+    for (int simd = 0; simd <= 1; simd++) {
+        fb_convert_set_simd(simd);
+        fb_convert_to_xrgb8888(pic.buffer, pic.pitch, format->format, layout->modifier, width, height,
+                               out, width * 4);  // Warm up
+        double start = now_sec();
+        for (int i = 0; i < iterations; i++)
+            fb_convert_to_xrgb8888(pic.buffer, pic.pitch, format->format, layout->modifier, width, height,
+                                   out, width * 4);
+        double sec = (now_sec() - start) / iterations;
+        printf("  %8.2f ms %6.1f GB/s", sec * 1e3, (double)width * height * 4 / sec / 1e9);
+    }
+    printf("\n");
+
+    free_picture(&pic);
+    free(out);
+}
+
+static volatile uint64_t sink;
+
+// One consumer pass over a frame
+static void read_pass(const uint8_t *frame, uint32_t pitch, uint32_t row_bytes, uint32_t height)
+{
+    uint64_t sum = 0;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *row = frame + (size_t)y * pitch;
+        for (uint32_t x = 0; x + 8 <= row_bytes; x += 8) {
+            uint64_t v;
+            memcpy(&v, row + x, 8);
+            sum += v;
+        }
+    }
+    sink += sum;
+}
+
+static int bench_framebuffer(uint32_t fb_id, int iterations)
+{
+    drm_fb_t *fb = drm_fb_open(fb_id);
+    if (!fb || drm_fb_map(fb) < 0) {
+        fprintf(stderr, "Cannot map framebuffer %u\n", fb_id);
+        drm_fb_close(fb);
+        return 1;
+    }
+
+    const uint8_t *pixels = (const uint8_t *)fb->map + fb->offset;
+    uint32_t pitch = fb->width * FB_CONVERT_BPP;
+    uint32_t tiles_x = (fb->width + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    uint32_t tiles_y = (fb->height + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    uint8_t *staging = malloc((size_t)pitch * fb->height);
+    uint8_t *previous = calloc(fb->height, pitch);
+    bool *tiles = malloc((size_t)tiles_x * tiles_y * sizeof(bool));
+    if (!staging || !previous || !tiles) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    printf("\nFramebuffer %u: %ux%u %.4s, modifier 0x%016llx, probe picks: %s\n", fb_id, fb->width, fb->height,
+           (const char *)&fb->format, (unsigned long long)fb->modifier,
+           fb_convert_read_mode_name(fb_convert_probe_read_mode(fb->map, fb->size)));
+    printf("%-16s %12s %12s %12s\n", "read mode", "capture ms", "consumers ms", "total ms");
+    for (int mode = FB_READ_IN_PLACE; mode <= FB_READ_STREAM; mode++) {
+        const char *name = fb_convert_read_mode_name((fb_read_mode_t)mode);
+        if (mode == FB_READ_IN_PLACE && !fb_convert_is_passthrough(fb->format, fb->modifier)) {
+            printf("%-16s (format needs converting)\n", name);
+            continue;
+        }
+        if (mode == FB_READ_STREAM && !fb_convert_has_streaming_loads()) {
+            printf("%-16s (build has no streaming loads)\n", name);
+            continue;
+        }
+
+        const uint8_t *frame = pixels;
+        uint32_t frame_pitch = fb->pitch;
+        double start = now_sec();
+        if (mode != FB_READ_IN_PLACE) {
+            fb_convert_dirty_t dirty = { .previous = previous, .tile_size = DIRTY_RECT_TILE_SIZE, .tiles = tiles };
+            for (int i = 0; i < iterations; i++)
+                fb_convert_frame(pixels, fb->pitch, fb->format, fb->modifier, fb->width, fb->height,
+                                 staging, pitch, mode == FB_READ_STREAM, &dirty);
+            frame = staging;
+            frame_pitch = pitch;
+        }
+        double capture = (now_sec() - start) / iterations;
+
+        start = now_sec();
+        for (int i = 0; i < iterations; i++)
+            for (int pass = 0; pass < 3; pass++)
+                read_pass(frame, frame_pitch, fb->width * FB_CONVERT_BPP, fb->height);
+        double consume = (now_sec() - start) / iterations;
+        printf("%-16s %12.2f %12.2f %12.2f\n", name, capture * 1e3, consume * 1e3, (capture + consume) * 1e3);
+    }
+
+    free(staging);
+    free(previous);
+    free(tiles);
+    drm_fb_close(fb);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations [fb-id]]\n", argv[0]);
+        return 1;
+    }
+
+    // Odd sizes end mid-tile and mid-vector
+    static const uint32_t sizes[][2] = { { 1, 1 }, { 37, 9 }, { 131, 33 }, { 1000, 70 }, { 1921, 65 } };
+    size_t checks = 0, failures = 0;
+    for (size_t f = 0; f < NUM_FORMATS; f++) {
+        for (size_t l = 0; l < NUM_LAYOUTS; l++) {
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                for (int simd = 0; simd <= 1; simd++) {
+                    checks++;
+                    if (check(&formats[f], &layouts[l], sizes[s][0], sizes[s][1], simd))
+                        failures++;
+                }
+                checks++;
+                if (check_capture(&formats[f], &layouts[l], sizes[s][0], sizes[s][1]))
+                    failures++;
+            }
+        }
+    }
+    printf("Correctness: %zu/%zu conversions pixel-exact (SIMD: %s, streaming loads: %s)\n\n",
+           checks - failures, checks, fb_convert_simd_name(), fb_convert_has_streaming_loads() ? "yes" : "no");
+    if (argc > 2)
+        return bench_framebuffer((uint32_t)strtoul(argv[2], NULL, 0), iterations) || failures ? 1 : 0;
+
+    printf("%-12s %-8s %-10s %20s %20s\n", "format", "layout", "size", "scalar", "simd");
+    for (size_t f = 0; f < NUM_FORMATS; f++) {
+        for (size_t l = 0; l < NUM_LAYOUTS; l++) {
+            bench(&formats[f], &layouts[l], 1920, 1080, iterations);
+            bench(&formats[f], &layouts[l], 3840, 2160, iterations / 4 > 0 ? iterations / 4 : 1);
+        }
+    }
+    return failures ? 1 : 0;
+}
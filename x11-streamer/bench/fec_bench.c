@@ -0,0 +1,204 @@
+/*
+ * Micro-benchmark: XOR parity throughput for the UDP video channel.
+ *
+ * Usage: fec-bench [frame_kb] [iterations]
+ *
+ * encode: fec_encode() over one frame, MB of frame data per second
+ * decode: udp_video_reassembler_push() of a whole frame with one data packet
+ *         dropped per group, so every group is rebuilt from parity
+ * "none" is the same reassembly with no FEC and nothing dropped, for reference.
+ *
+ * Before timing, headers that claim more packets than the frame needs, or slices
+ * shorter than their packet, must be rejected; the bench exits 1 if any is accepted.
+ */
+#define _GNU_SOURCE
+#include "udp_video.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Build the datagrams the sender would emit for one frame
+// Returns the packet count (data + parity); packets[i] points into storage
+static size_t build_packets(const uint8_t *frame, size_t frame_size, int group,
+                            uint8_t *storage, uint8_t **packets, size_t *packet_len)
+{
+    size_t packet_data = UDP_VIDEO_MAX_PACKET_DATA;
+    size_t packet_count = (frame_size + packet_data - 1) / packet_data;
+    size_t num_groups = fec_num_groups(packet_count, group);
+    uint8_t *parity = malloc(num_groups * packet_data + 1);
+    fec_encode(frame, frame_size, packet_data, group, parity);
+
+    size_t n = 0;
+    for (size_t i = 0; i < packet_count + num_groups; i++) {
+        bool is_parity = i >= packet_count;
+        size_t offset = is_parity ? 0 : i * packet_data;
+        size_t len = is_parity ? packet_data
+                     : (frame_size - offset < packet_data ? frame_size - offset : packet_data);
+        udp_video_header_t h = {
+            .frame_size = htonl(frame_size),
+            .offset = htonl(offset),
+            .packet_index = htons(i),
+            .packet_count = htons(packet_count),
+            .packet_data = htons(packet_data),
+            .fec_group = group,
+        };
+        packets[n] = storage + i * UDP_VIDEO_MAX_DATAGRAM;
+        memcpy(packets[n], &h, sizeof(h));
+        memcpy(packets[n] + sizeof(h),
+               is_parity ? parity + (i - packet_count) * packet_data : frame + offset, len);
+        packet_len[n] = sizeof(h) + len;
+        n++;
+    }
+    free(parity);
+    return n;
+}
+
+static void bench_encode(const uint8_t *frame, size_t frame_size, int group, int iterations)
+{
+    size_t packet_data = UDP_VIDEO_MAX_PACKET_DATA;
+    size_t packet_count = (frame_size + packet_data - 1) / packet_data;
+    uint8_t *parity = malloc(fec_num_groups(packet_count, group) * packet_data);
+
+    double start = now_sec();
+    for (int i = 0; i < iterations; i++)
+        fec_encode(frame, frame_size, packet_data, group, parity);
+    double elapsed = now_sec() - start;
+
+    printf("encode group=%-2d  %8.0f MB/s  %6.1f us/frame\n", group,
+           (double)frame_size * iterations / elapsed / 1e6, elapsed / iterations * 1e6);
+    free(parity);
+}
+
+static void bench_decode(const uint8_t *frame, size_t frame_size, int group, int iterations)
+{
+    size_t max_packets = frame_size / UDP_VIDEO_MAX_PACKET_DATA + 2;
+    max_packets += fec_num_groups(max_packets, group);
+    uint8_t *storage = malloc(max_packets * UDP_VIDEO_MAX_DATAGRAM);
+    uint8_t **packets = malloc(max_packets * sizeof(uint8_t *));
+    size_t *packet_len = malloc(max_packets * sizeof(size_t));
+    size_t n = build_packets(frame, frame_size, group, storage, packets, packet_len);
+    size_t packet_count = (frame_size + UDP_VIDEO_MAX_PACKET_DATA - 1) / UDP_VIDEO_MAX_PACKET_DATA;
+    udp_video_reassembler_t *reasm = udp_video_reassembler_create(frame_size);
+
+    int completed = 0;
+    double start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        for (size_t p = 0; p < n; p++) {
+            uint32_t seq = htonl(i);
+            memcpy(packets[p], &seq, sizeof(seq));
+            // Drop the first data packet of every group
+            if (group > 0 && p < packet_count && p % group == 0)
+                continue;
+            const void *out;
+            size_t out_len;
+            if (udp_video_reassembler_push(reasm, packets[p], packet_len[p], &out, &out_len) == 1) {
+                if (out_len != frame_size || memcmp(out, frame, frame_size) != 0) {
+                    fprintf(stderr, "decode mismatch at frame %d\n", i);
+                    exit(1);
+                }
+                completed++;
+            }
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    if (group > 0)
+        printf("decode group=%-2d  %8.0f MB/s  %6.1f us/frame  recovered=%llu/%d\n", group,
+               (double)frame_size * iterations / elapsed / 1e6, elapsed / iterations * 1e6,
+               (unsigned long long)udp_video_reassembler_get_recovered_frames(reasm), completed);
+    else
+        printf("decode none      %8.0f MB/s  %6.1f us/frame  completed=%d\n",
+               (double)frame_size * iterations / elapsed / 1e6, elapsed / iterations * 1e6, completed);
+
+    udp_video_reassembler_destroy(reasm);
+    free(packet_len);
+    free(packets);
+    free(storage);
+}
+
+// Push one hand-built datagram; returns what the reassembler made of it
+static int push_crafted(udp_video_reassembler_t *reasm, uint32_t frame_size, uint32_t offset,
+                        uint16_t index, uint16_t count, uint16_t packet_data, uint8_t group,
+                        size_t slice_len)
+{
+    static uint8_t packet[UDP_VIDEO_MAX_DATAGRAM];
+    udp_video_header_t h = {
+        .frame_seq = htonl(1),
+        .frame_size = htonl(frame_size),
+        .offset = htonl(offset),
+        .packet_index = htons(index),
+        .packet_count = htons(count),
+        .packet_data = htons(packet_data),
+        .fec_group = group,
+    };
+    memcpy(packet, &h, sizeof(h));
+    memset(packet + sizeof(h), 0xAA, slice_len);
+    const void *out;
+    size_t out_len;
+    return udp_video_reassembler_push(reasm, packet, sizeof(h) + slice_len, &out, &out_len);
+}
+
+// A 2000-byte frame announced as four 1000-byte packets: parity for the second group
+// would rebuild packet 3 at offset 3000, past the end of the slot
+static int check_malformed(void)
+{
+    udp_video_reassembler_t *reasm = udp_video_reassembler_create(2000);
+    int accepted = 0;
+
+    accepted += push_crafted(reasm, 2000, 0, 0, 4, 1000, 2, 1000) >= 0;
+    accepted += push_crafted(reasm, 2000, 1000, 1, 4, 1000, 2, 1000) >= 0;
+    accepted += push_crafted(reasm, 2000, 2000, 2, 4, 1000, 2, 0) >= 0;
+    accepted += push_crafted(reasm, 2000, 0, 5, 4, 1000, 2, 1000) >= 0;
+    // Right packet count, but a short slice before the last packet
+    accepted += push_crafted(reasm, 2000, 0, 0, 2, 1000, 0, 500) >= 0;
+    udp_video_reassembler_destroy(reasm);
+
+    if (accepted > 0) {
+        fprintf(stderr, "malformed headers: %d accepted - FAILED\n", accepted);
+        return -1;
+    }
+    printf("malformed headers rejected\n");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t frame_kb = argc > 1 ? (size_t)atoi(argv[1]) : 256;
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+
+    if (frame_kb == 0 || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [frame_kb] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    if (check_malformed() < 0)
+        return 1;
+
+    size_t frame_size = frame_kb * 1024;
+    uint8_t *frame = malloc(frame_size);
+    srand(1);
+    for (size_t i = 0; i < frame_size; i++)
+        frame[i] = rand();
+
+    printf("%zu KB frames, %d iterations, %zu-byte packets\n",
+           frame_kb, iterations, (size_t)UDP_VIDEO_MAX_PACKET_DATA);
+
+    static const int groups[] = { 2, 4, 8, 16, 32 };
+    for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+        bench_encode(frame, frame_size, groups[g], iterations);
+    bench_decode(frame, frame_size, FEC_GROUP_OFF, iterations);
+    for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+        bench_decode(frame, frame_size, groups[g], iterations);
+
+    free(frame);
+    return 0;
+}
@@ -0,0 +1,953 @@
+/*
+ * Micro-benchmarks for the per-frame hot paths, at common screen sizes.
+ *
+ * Usage: streamer-bench [--json FILE|-] [--filter TEXT] [--sizes 720p,1080p,1440p,4k] [--min-ms MS]
+ *
+ * Every case is one call per frame:
+ *   dirty_rect_detect/idle|sparse|full  frame unchanged / cursor+text line changed / every pixel changed
+ *   dirty_rect_merge                    tile grid to rectangles (the second half of detect)
+ *   argb_to_i420                        colour conversion in front of x264
+ *   frame_multipass/idle|sparse|full    dirty_rect_detect, then argb_to_i420 of the whole frame
+ *                                       (x264 builds), each a pass over the frame
+ *   frame_pipeline/idle|sparse|full     the same work in frame_pipeline_process()'s one pass,
+ *                                       plus dirty_rect_merge
+ *   h264_encode                         h264_encoder_encode_frame() on a sparsely changing desktop
+ *   noise_send / noise_recv             a full frame through the Noise session over a socketpair
+ *   protocol_send                       protocol_send_message() of a full frame over a socketpair
+ *   encoding_metrics_record             encoding_metrics_record_frame()
+ * Reported per case: ns/frame (median of 5 batches), GB/s of picture data, heap
+ * allocations per call (malloc and friends are counted by this binary, all threads) and,
+ * where perf_event_open() offers hardware counters, CPU cycles per pixel and last level
+ * cache misses per frame (user space of the calling thread, over all batches).
+ * Inputs are generated deterministically, so runs on the same box compare directly;
+ * --json writes the results for scripts (- = stdout, the table then goes to stderr).
+ */
+#define _GNU_SOURCE
+#include "dirty_rect.h"
+#include "encoding_metrics.h"
+#include "frame_pipeline.h"
+#include "noise_encryption.h"
+#include "protocol.h"
+#ifdef HAVE_X264
+#include "h264_encoder.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/perf_event.h>
+
+#define BATCHES 5
+#define MAX_RECTS 256
+#define SOCKET_BUFFER (4 * 1024 * 1024)
+
+// Allocation counting: these override the C library's allocator entry points
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long alloc_count;
+
+static void count_alloc(void)
+{
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    count_alloc();
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count_alloc();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    count_alloc();
+    void *p = __libc_memalign(alignment, size);
+    if (!p)
+        return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static unsigned long allocs(void)
+{
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    const char *name;
+    uint32_t width;
+    uint32_t height;
+} screen_size_t;
+
+static const screen_size_t screen_sizes[] = {
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4k", 3840, 2160 },
+};
+#define NUM_SIZES (sizeof(screen_sizes) / sizeof(screen_sizes[0]))
+
+// State shared by the cases; each setup fills in what its run needs
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    size_t frame_size;
+    uint8_t *desktop;   // Base picture
+    uint8_t *sparse;    // Desktop with a cursor, a text line and a clock changed
+    uint8_t *noise;     // Every pixel different from the desktop
+    const uint8_t *frames[2];  // Alternated between calls
+    uint64_t call;
+    size_t bytes;       // Picture bytes one call processes (0 = not meaningful)
+
+    dirty_rect_context_t *dirty;
+    dirty_rect_t rects[MAX_RECTS];
+    bool *tiles;
+    uint32_t tiles_x, tiles_y;
+
+    uint8_t *planes;    // I420 output
+    h264_i420_planes_t i420;  // Views of planes
+
+    frame_pipeline_t *pipeline;
+    frame_buffer_t frame;     // Wraps frames[] for the pipeline
+
+#ifdef HAVE_X264
+    h264_encoder_t *encoder;
+#endif
+
+    encoding_metrics_t *metrics;
+
+    int fds[2];         // [0] = sending side
+    pthread_t thread;
+    bool thread_running;
+    volatile bool stop;
+    noise_encryption_context_t *noise_send;
+    noise_encryption_context_t *noise_recv;
+    uint8_t *recv_buf;
+} bench_ctx_t;
+
+typedef struct {
+    const char *name;
+    const char *(*setup)(bench_ctx_t *ctx);  // Returns NULL, or why the case is skipped
+    void (*run)(bench_ctx_t *ctx);
+    void (*teardown)(bench_ctx_t *ctx);
+} bench_case_t;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static void fill_rect(uint8_t *frame, uint32_t width, uint32_t height,
+                      uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+    for (uint32_t row = y; row < y + h && row < height; row++) {
+        uint32_t *line = (uint32_t *)(frame + (size_t)row * width * 4);
+        for (uint32_t col = x; col < x + w && col < width; col++)
+            line[col] = color;
+    }
+}
+
+static int make_frames(bench_ctx_t *ctx, uint32_t width, uint32_t height)
+{
+    ctx->width = width;
+    ctx->height = height;
+    ctx->frame_size = (size_t)width * height * 4;
+    ctx->desktop = malloc(ctx->frame_size);
+    ctx->sparse = malloc(ctx->frame_size);
+    ctx->noise = malloc(ctx->frame_size);
+    if (!ctx->desktop || !ctx->sparse || !ctx->noise)
+        return -1;
+
+    // Gradient desktop with a window of pseudo-text
+    for (uint32_t y = 0; y < height; y++) {
+        uint32_t *line = (uint32_t *)(ctx->desktop + (size_t)y * width * 4);
+        for (uint32_t x = 0; x < width; x++)
+            line[x] = ((0x20 + x * 0x40 / width) << 16) | ((0x30 + y * 0x50 / height) << 8) | 0x90;
+    }
+    fill_rect(ctx->desktop, width, height, width / 8, height / 8, width * 3 / 4, height * 3 / 4, 0xF0F0F0);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t y = height / 8 + 8; y + 12 < height * 7 / 8; y += 16) {
+        for (uint32_t x = width / 8 + 8; x + 8 < width * 7 / 8; x += 8) {
+            if (xorshift64(&rng) % 5 == 0)
+                continue;
+            fill_rect(ctx->desktop, width, height, x, y, 6, 10, 0x202020);
+        }
+    }
+
+    // A cursor, one line of new text and a clock
+    memcpy(ctx->sparse, ctx->desktop, ctx->frame_size);
+    fill_rect(ctx->sparse, width, height, width / 2, height / 2, 16, 24, 0x000000);
+    fill_rect(ctx->sparse, width, height, width / 8 + 8, height * 3 / 4, width / 3, 12, 0x2040A0);
+    fill_rect(ctx->sparse, width, height, width - 80, 4, 64, 16, 0xFFFFFF);
+
+    uint64_t *words = (uint64_t *)ctx->noise;
+    for (size_t i = 0; i < ctx->frame_size / 8; i++)
+        words[i] = xorshift64(&rng);
+    return 0;
+}
+
+static void free_frames(bench_ctx_t *ctx)
+{
+    free(ctx->desktop);
+    free(ctx->sparse);
+    free(ctx->noise);
+}
+
+// Dirty rectangles
+
+static const char *setup_dirty(bench_ctx_t *ctx, const uint8_t *other)
+{
+    ctx->dirty = dirty_rect_create(ctx->width, ctx->height, 4);
+    if (!ctx->dirty)
+        return "dirty_rect_create failed";
+    ctx->frames[0] = ctx->desktop;
+    ctx->frames[1] = other;
+    ctx->bytes = ctx->frame_size;
+    dirty_rect_detect(ctx->dirty, ctx->desktop, ctx->rects, MAX_RECTS);
+    return NULL;
+}
+
+static const char *setup_dirty_idle(bench_ctx_t *ctx)
+{
+    return setup_dirty(ctx, ctx->desktop);
+}
+
+static const char *setup_dirty_sparse(bench_ctx_t *ctx)
+{
+    return setup_dirty(ctx, ctx->sparse);
+}
+
+static const char *setup_dirty_full(bench_ctx_t *ctx)
+{
+    return setup_dirty(ctx, ctx->noise);
+}
+
+static void run_dirty(bench_ctx_t *ctx)
+{
+    dirty_rect_detect(ctx->dirty, ctx->frames[++ctx->call & 1], ctx->rects, MAX_RECTS);
+}
+
+static void teardown_dirty(bench_ctx_t *ctx)
+{
+    dirty_rect_destroy(ctx->dirty);
+}
+
+static const char *setup_merge(bench_ctx_t *ctx)
+{
+    ctx->tiles_x = (ctx->width + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    ctx->tiles_y = (ctx->height + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    ctx->tiles = calloc((size_t)ctx->tiles_x * ctx->tiles_y, sizeof(bool));
+    if (!ctx->tiles)
+        return "out of memory";
+
+    // Tiles where desktop and sparse frames differ, plus a dragged window's outline
+    for (uint32_t ty = 0; ty < ctx->tiles_y; ty++) {
+        for (uint32_t tx = 0; tx < ctx->tiles_x; tx++) {
+            bool edge = (ty == ctx->tiles_y / 4 || ty == ctx->tiles_y / 2) && tx > ctx->tiles_x / 5 &&
+                        tx < ctx->tiles_x * 3 / 5;
+            edge |= (tx == ctx->tiles_x / 5 || tx == ctx->tiles_x * 3 / 5) && ty >= ctx->tiles_y / 4 &&
+                    ty <= ctx->tiles_y / 2;
+            size_t offset = ((size_t)ty * DIRTY_RECT_TILE_SIZE * ctx->width + tx * DIRTY_RECT_TILE_SIZE) * 4;
+            ctx->tiles[ty * ctx->tiles_x + tx] = edge || memcmp(ctx->desktop + offset, ctx->sparse + offset, 4) != 0;
+        }
+    }
+    ctx->bytes = 0;
+    return NULL;
+}
+
+static void run_merge(bench_ctx_t *ctx)
+{
+    dirty_rect_merge_tiles(ctx->tiles, ctx->tiles_x, ctx->tiles_y, DIRTY_RECT_TILE_SIZE,
+                           ctx->width, ctx->height, ctx->rects, MAX_RECTS);
+}
+
+static void teardown_merge(bench_ctx_t *ctx)
+{
+    free(ctx->tiles);
+}
+
+// H.264
+
+#ifdef HAVE_X264
+static const char *setup_i420(bench_ctx_t *ctx)
+{
+    ctx->planes = malloc(ctx->frame_size);  // More than the 1.5 bytes per pixel needed
+    if (!ctx->planes)
+        return "out of memory";
+    size_t y_size = (size_t)ctx->width * ctx->height;
+    ctx->i420.y = ctx->planes;
+    ctx->i420.u = ctx->planes + y_size;
+    ctx->i420.v = ctx->planes + y_size + y_size / 4;
+    ctx->i420.y_stride = ctx->width;
+    ctx->i420.uv_stride = ctx->width / 2;
+    ctx->bytes = ctx->frame_size;
+    return NULL;
+}
+
+static void run_i420(bench_ctx_t *ctx)
+{
+    h264_encoder_argb_to_i420(ctx->desktop, ctx->width * 4, &ctx->i420, 0, 0, ctx->width, ctx->height);
+}
+
+static void teardown_i420(bench_ctx_t *ctx)
+{
+    free(ctx->planes);
+}
+
+static const char *setup_h264(bench_ctx_t *ctx)
+{
+    ctx->encoder = h264_encoder_create(ctx->width, ctx->height, 60, 0);
+    if (!ctx->encoder)
+        return "h264_encoder_create failed";
+    ctx->frames[0] = ctx->desktop;
+    ctx->frames[1] = ctx->sparse;
+    ctx->bytes = ctx->frame_size;
+    return NULL;
+}
+
+static void run_h264(bench_ctx_t *ctx)
+{
+    void *out = NULL;
+    size_t out_size = 0;
+    if (h264_encoder_encode_frame(ctx->encoder, ctx->frames[++ctx->call & 1], &out, &out_size) == 0)
+        free(out);
+}
+
+static void teardown_h264(bench_ctx_t *ctx)
+{
+    h264_encoder_destroy(ctx->encoder);
+}
+#endif
+
+// Whole frame: multi-pass against the stripe pipeline
+
+static const char *setup_frame(bench_ctx_t *ctx, const uint8_t *other, bool pipeline)
+{
+#ifdef HAVE_X264
+    const char *skip = setup_i420(ctx);
+    if (skip)
+        return skip;
+#else
+    ctx->planes = NULL;
+#endif
+    ctx->frames[0] = ctx->desktop;
+    ctx->frames[1] = other;
+    ctx->bytes = ctx->frame_size;
+
+    if (!pipeline) {
+        ctx->pipeline = NULL;
+        ctx->dirty = dirty_rect_create(ctx->width, ctx->height, 4);
+        if (!ctx->dirty) {
+            free(ctx->planes);
+            return "dirty_rect_create failed";
+        }
+        dirty_rect_detect(ctx->dirty, ctx->desktop, ctx->rects, MAX_RECTS);
+        return NULL;
+    }
+
+    ctx->dirty = NULL;
+    ctx->pipeline = frame_pipeline_create(ctx->width, ctx->height);
+    if (!ctx->pipeline) {
+        free(ctx->planes);
+        return "frame_pipeline_create failed";
+    }
+    memset(&ctx->frame, 0, sizeof(ctx->frame));
+    ctx->frame.data = (void *)ctx->desktop;
+    ctx->frame.width = ctx->width;
+    ctx->frame.height = ctx->height;
+    ctx->frame.pitch = ctx->width * 4;
+    ctx->frame.bpp = 4;
+    ctx->frame.sequence = 1;
+    frame_pipeline_process(ctx->pipeline, &ctx->frame, ctx->planes ? &ctx->i420 : NULL);
+    return NULL;
+}
+
+static const char *setup_multipass_idle(bench_ctx_t *ctx)
+{
+    return setup_frame(ctx, ctx->desktop, false);
+}
+
+static const char *setup_multipass_sparse(bench_ctx_t *ctx)
+{
+    return setup_frame(ctx, ctx->sparse, false);
+}
+
+static const char *setup_multipass_full(bench_ctx_t *ctx)
+{
+    return setup_frame(ctx, ctx->noise, false);
+}
+
+static const char *setup_pipeline_idle(bench_ctx_t *ctx)
+{
+    return setup_frame(ctx, ctx->desktop, true);
+}
+
+static const char *setup_pipeline_sparse(bench_ctx_t *ctx)
+{
+    return setup_frame(ctx, ctx->sparse, true);
+}
+
+static const char *setup_pipeline_full(bench_ctx_t *ctx)
+{
+    return setup_frame(ctx, ctx->noise, true);
+}
+
+static void run_multipass(bench_ctx_t *ctx)
+{
+    const uint8_t *frame = ctx->frames[++ctx->call & 1];
+    dirty_rect_detect(ctx->dirty, frame, ctx->rects, MAX_RECTS);
+#ifdef HAVE_X264
+    h264_encoder_argb_to_i420(frame, ctx->width * 4, &ctx->i420, 0, 0, ctx->width, ctx->height);
+#endif
+}
+
+static void run_pipeline(bench_ctx_t *ctx)
+{
+    ctx->frame.data = (void *)ctx->frames[++ctx->call & 1];
+    ctx->frame.sequence++;
+    frame_pipeline_process(ctx->pipeline, &ctx->frame, ctx->planes ? &ctx->i420 : NULL);
+
+    uint32_t tiles_x, tiles_y;
+    const bool *tiles = frame_pipeline_get_dirty_tiles(ctx->pipeline, &tiles_x, &tiles_y);
+    dirty_rect_merge_tiles(tiles, tiles_x, tiles_y, DIRTY_RECT_TILE_SIZE, ctx->width, ctx->height,
+                           ctx->rects, MAX_RECTS);
+}
+
+static void teardown_frame(bench_ctx_t *ctx)
+{
+    dirty_rect_destroy(ctx->dirty);
+    frame_pipeline_destroy(ctx->pipeline);
+    free(ctx->planes);
+}
+
+// Socket cases
+
+static int make_socketpair(bench_ctx_t *ctx)
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, ctx->fds) < 0)
+        return -1;
+    int size = SOCKET_BUFFER;
+    setsockopt(ctx->fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(ctx->fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    return 0;
+}
+
+static void close_socketpair(bench_ctx_t *ctx)
+{
+    ctx->stop = true;
+    shutdown(ctx->fds[0], SHUT_RDWR);
+    shutdown(ctx->fds[1], SHUT_RDWR);
+    if (ctx->thread_running)
+        pthread_join(ctx->thread, NULL);
+    ctx->thread_running = false;
+    ctx->stop = false;
+    close(ctx->fds[0]);
+    close(ctx->fds[1]);
+}
+
+static void *drain_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    static char buf[256 * 1024];
+    while (read(ctx->fds[1], buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+static const char *setup_protocol(bench_ctx_t *ctx)
+{
+    if (make_socketpair(ctx) < 0)
+        return "socketpair failed";
+    if (pthread_create(&ctx->thread, NULL, drain_thread, ctx) != 0) {
+        close(ctx->fds[0]);
+        close(ctx->fds[1]);
+        return "pthread_create failed";
+    }
+    ctx->thread_running = true;
+    ctx->bytes = ctx->frame_size;
+    return NULL;
+}
+
+static void run_protocol(bench_ctx_t *ctx)
+{
+    protocol_send_message(ctx->fds[0], MSG_FRAME, ctx->desktop, ctx->frame_size);
+}
+
+static void teardown_protocol(bench_ctx_t *ctx)
+{
+    close_socketpair(ctx);
+}
+
+static void *handshake_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    intptr_t rc = noise_encryption_handshake(ctx->noise_recv, ctx->fds[1]);
+    return (void *)rc;
+}
+
+// Noise session between the two ends of a socketpair
+static const char *setup_noise_session(bench_ctx_t *ctx)
+{
+    if (make_socketpair(ctx) < 0)
+        return "socketpair failed";
+
+    ctx->noise_send = noise_encryption_init(true);
+    ctx->noise_recv = noise_encryption_init(false);
+    pthread_t responder;
+    void *responder_rc = (void *)(intptr_t)-1;
+    int rc = -1;
+    if (ctx->noise_send && ctx->noise_recv && pthread_create(&responder, NULL, handshake_thread, ctx) == 0) {
+        rc = noise_encryption_handshake(ctx->noise_send, ctx->fds[0]);
+        if (rc < 0)
+            shutdown(ctx->fds[0], SHUT_RDWR);  // Unblock the responder
+        pthread_join(responder, &responder_rc);
+    }
+    if (rc < 0 || (intptr_t)responder_rc < 0) {
+        noise_encryption_cleanup(ctx->noise_send);
+        noise_encryption_cleanup(ctx->noise_recv);
+        close(ctx->fds[0]);
+        close(ctx->fds[1]);
+        return "Noise handshake failed";
+    }
+    ctx->bytes = ctx->frame_size;
+    return NULL;
+}
+
+static void teardown_noise(bench_ctx_t *ctx)
+{
+    close_socketpair(ctx);
+    noise_encryption_cleanup(ctx->noise_send);
+    noise_encryption_cleanup(ctx->noise_recv);
+    free(ctx->recv_buf);
+    ctx->recv_buf = NULL;
+}
+
+static void *noise_drain_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    while (noise_encryption_recv(ctx->noise_recv, ctx->fds[1], ctx->recv_buf, ctx->frame_size) > 0) {
+    }
+    return NULL;
+}
+
+static void *noise_feed_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    while (!ctx->stop && noise_encryption_send(ctx->noise_send, ctx->fds[0], ctx->desktop, ctx->frame_size) == 0) {
+    }
+    return NULL;
+}
+
+static const char *setup_noise(bench_ctx_t *ctx, void *(*thread)(void *))
+{
+    const char *skip = setup_noise_session(ctx);
+    if (skip)
+        return skip;
+    ctx->recv_buf = malloc(ctx->frame_size);
+    if (!ctx->recv_buf || pthread_create(&ctx->thread, NULL, thread, ctx) != 0) {
+        teardown_noise(ctx);
+        return "out of memory";
+    }
+    ctx->thread_running = true;
+    return NULL;
+}
+
+static const char *setup_noise_send(bench_ctx_t *ctx)
+{
+    return setup_noise(ctx, noise_drain_thread);
+}
+
+static const char *setup_noise_recv(bench_ctx_t *ctx)
+{
+    return setup_noise(ctx, noise_feed_thread);
+}
+
+static void run_noise_send(bench_ctx_t *ctx)
+{
+    noise_encryption_send(ctx->noise_send, ctx->fds[0], ctx->desktop, ctx->frame_size);
+}
+
+static void run_noise_recv(bench_ctx_t *ctx)
+{
+    // One record per call, so read until a whole frame has arrived
+    size_t received = 0;
+    while (received < ctx->frame_size) {
+        ssize_t n = noise_encryption_recv(ctx->noise_recv, ctx->fds[1], ctx->recv_buf, ctx->frame_size);
+        if (n <= 0)
+            break;
+        received += n;
+    }
+}
+
+// Metrics
+
+static const char *setup_metrics(bench_ctx_t *ctx)
+{
+    ctx->metrics = encoding_metrics_create(30);
+    if (!ctx->metrics)
+        return "encoding_metrics_create failed";
+    ctx->bytes = 0;
+    return NULL;
+}
+
+static void run_metrics(bench_ctx_t *ctx)
+{
+    uint64_t pixels = (uint64_t)ctx->width * ctx->height;
+    encoding_metrics_record_frame(ctx->metrics, pixels / 8, pixels / 20, pixels, 1500, 60);
+}
+
+static void teardown_metrics(bench_ctx_t *ctx)
+{
+    encoding_metrics_destroy(ctx->metrics);
+}
+
+static const bench_case_t bench_cases[] = {
+    { "dirty_rect_detect/idle", setup_dirty_idle, run_dirty, teardown_dirty },
+    { "dirty_rect_detect/sparse", setup_dirty_sparse, run_dirty, teardown_dirty },
+    { "dirty_rect_detect/full", setup_dirty_full, run_dirty, teardown_dirty },
+    { "dirty_rect_merge", setup_merge, run_merge, teardown_merge },
+#ifdef HAVE_X264
+    { "argb_to_i420", setup_i420, run_i420, teardown_i420 },
+    { "h264_encode", setup_h264, run_h264, teardown_h264 },
+#endif
+    { "frame_multipass/idle", setup_multipass_idle, run_multipass, teardown_frame },
+    { "frame_multipass/sparse", setup_multipass_sparse, run_multipass, teardown_frame },
+    { "frame_multipass/full", setup_multipass_full, run_multipass, teardown_frame },
+    { "frame_pipeline/idle", setup_pipeline_idle, run_pipeline, teardown_frame },
+    { "frame_pipeline/sparse", setup_pipeline_sparse, run_pipeline, teardown_frame },
+    { "frame_pipeline/full", setup_pipeline_full, run_pipeline, teardown_frame },
+    { "noise_send", setup_noise_send, run_noise_send, teardown_noise },
+    { "noise_recv", setup_noise_recv, run_noise_recv, teardown_noise },
+    { "protocol_send", setup_protocol, run_protocol, teardown_protocol },
+    { "encoding_metrics_record", setup_metrics, run_metrics, teardown_metrics },
+};
+#define NUM_CASES (sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+typedef struct {
+    const char *name;
+    const screen_size_t *size;
+    const char *skipped;
+    uint64_t iterations;
+    double ns_per_frame;
+    double gb_per_s;
+    double allocs_per_call;
+    double cycles_per_pixel;      // Negative if there is no cycle counter
+    double llc_misses_per_frame;  // Negative if there is no cache miss counter
+} bench_result_t;
+
+// Hardware counters for the calling thread, user space only
+typedef struct {
+    int cycles;      // -1 if unavailable (no PMU, e.g. in many VMs, or perf_event_paranoid)
+    int llc_misses;
+} perf_counters_t;
+
+static int perf_counter_open(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void perf_counter_start(int fd)
+{
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Returns the count, -1 if unavailable
+static double perf_counter_stop(int fd)
+{
+    uint64_t count;
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return (double)count;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(const bench_case_t *bench, bench_ctx_t *ctx, double min_ms, const perf_counters_t *counters,
+                    bench_result_t *result)
+{
+    // Warm up, then size the batches so each takes about min_ms / BATCHES
+    uint64_t batch = 1;
+    for (;;) {
+        double start = now_ns();
+        for (uint64_t i = 0; i < batch; i++)
+            bench->run(ctx);
+        double elapsed = now_ns() - start;
+        if (elapsed >= min_ms * 1e6 / BATCHES / 4 || batch >= (1ULL << 30)) {
+            double per_call = elapsed / batch;
+            batch = (uint64_t)(min_ms * 1e6 / BATCHES / (per_call > 1 ? per_call : 1));
+            if (batch < 1)
+                batch = 1;
+            break;
+        }
+        batch *= 4;
+    }
+
+    double batch_ns[BATCHES];
+    unsigned long allocs_before = allocs();
+    perf_counter_start(counters->cycles);
+    perf_counter_start(counters->llc_misses);
+    for (int b = 0; b < BATCHES; b++) {
+        double start = now_ns();
+        for (uint64_t i = 0; i < batch; i++)
+            bench->run(ctx);
+        batch_ns[b] = (now_ns() - start) / batch;
+    }
+    double cycles = perf_counter_stop(counters->cycles);
+    double llc_misses = perf_counter_stop(counters->llc_misses);
+    unsigned long allocs_after = allocs();
+
+    qsort(batch_ns, BATCHES, sizeof(double), compare_double);
+    result->iterations = batch * BATCHES;
+    result->ns_per_frame = batch_ns[BATCHES / 2];
+    result->gb_per_s = ctx->bytes ? ctx->bytes / result->ns_per_frame : 0;
+    result->allocs_per_call = (double)(allocs_after - allocs_before) / result->iterations;
+    double pixels = (double)ctx->width * ctx->height;
+    result->cycles_per_pixel = cycles >= 0 ? cycles / result->iterations / pixels : -1;
+    result->llc_misses_per_frame = llc_misses >= 0 ? llc_misses / result->iterations : -1;
+}
+
+static void cpu_model(char *buf, size_t len)
+{
+    snprintf(buf, len, "unknown");
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            colon += 2;
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(buf, len, "%s", colon);
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static void write_json(FILE *out, const bench_result_t *results, int count, double min_ms)
+{
+    char cpu[128];
+    struct utsname uts;
+    cpu_model(cpu, sizeof(cpu));
+    uname(&uts);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"streamer-bench\",\n");
+    fprintf(out, "  \"cpu\": \"%s\",\n", cpu);
+    fprintf(out, "  \"kernel\": \"%s\",\n", uts.release);
+    fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(out, "  \"min_ms\": %.0f,\n", min_ms);
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"size\": \"%s\", \"width\": %u, \"height\": %u, ",
+                r->name, r->size->name, r->size->width, r->size->height);
+        if (r->skipped) {
+            fprintf(out, "\"skipped\": \"%s\"}", r->skipped);
+        } else {
+            fprintf(out, "\"iterations\": %llu, \"ns_per_frame\": %.1f, ",
+                    (unsigned long long)r->iterations, r->ns_per_frame);
+            if (r->gb_per_s > 0)
+                fprintf(out, "\"gb_per_s\": %.3f, ", r->gb_per_s);
+            else
+                fprintf(out, "\"gb_per_s\": null, ");
+            fprintf(out, "\"allocs_per_call\": %.2f, ", r->allocs_per_call);
+            if (r->cycles_per_pixel >= 0)
+                fprintf(out, "\"cycles_per_pixel\": %.3f, ", r->cycles_per_pixel);
+            else
+                fprintf(out, "\"cycles_per_pixel\": null, ");
+            if (r->llc_misses_per_frame >= 0)
+                fprintf(out, "\"llc_misses_per_frame\": %.0f}", r->llc_misses_per_frame);
+            else
+                fprintf(out, "\"llc_misses_per_frame\": null}");
+        }
+        fprintf(out, "%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--json FILE|-] [--filter TEXT] [--sizes 720p,1080p,1440p,4k] [--min-ms MS]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *json_path = NULL;
+    const char *filter = NULL;
+    const char *sizes = "720p,1080p,1440p,4k";
+    double min_ms = 500;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = argv[++i];
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+            if (min_ms <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // With the JSON on stdout, keep the table out of its way
+    FILE *table = json_path && strcmp(json_path, "-") == 0 ? stderr : stdout;
+
+    bench_result_t *results = calloc(NUM_SIZES * NUM_CASES, sizeof(bench_result_t));
+    if (!results)
+        return 1;
+    int count = 0;
+
+    perf_counters_t counters = {
+        .cycles = perf_counter_open(PERF_COUNT_HW_CPU_CYCLES),
+        .llc_misses = perf_counter_open(PERF_COUNT_HW_CACHE_MISSES),
+    };
+
+    fprintf(table, "%-26s %6s %14s %9s %11s %9s %12s\n", "case", "size", "ns/frame", "GB/s", "allocs/call",
+            "cyc/px", "LLC miss/fr");
+    for (size_t s = 0; s < NUM_SIZES; s++) {
+        const screen_size_t *size = &screen_sizes[s];
+        const char *listed = strstr(sizes, size->name);
+        size_t name_len = strlen(size->name);
+        if (!listed || (listed != sizes && listed[-1] != ',') || (listed[name_len] && listed[name_len] != ','))
+            continue;
+
+        bench_ctx_t ctx = { 0 };
+        if (make_frames(&ctx, size->width, size->height) < 0) {
+            fprintf(stderr, "Out of memory for %s frames\n", size->name);
+            free_frames(&ctx);
+            continue;
+        }
+
+        for (size_t c = 0; c < NUM_CASES; c++) {
+            const bench_case_t *bench = &bench_cases[c];
+            if (filter && !strstr(bench->name, filter))
+                continue;
+
+            bench_result_t *result = &results[count++];
+            result->name = bench->name;
+            result->size = size;
+            ctx.call = 0;
+            result->skipped = bench->setup(&ctx);
+            if (result->skipped) {
+                fprintf(table, "%-26s %6s   skipped: %s\n", bench->name, size->name, result->skipped);
+                continue;
+            }
+            measure(bench, &ctx, min_ms, &counters, result);
+            bench->teardown(&ctx);
+
+            fprintf(table, "%-26s %6s %14.0f ", bench->name, size->name, result->ns_per_frame);
+            if (result->gb_per_s > 0)
+                fprintf(table, "%9.2f", result->gb_per_s);
+            else
+                fprintf(table, "%9s", "-");
+            fprintf(table, " %11.2f", result->allocs_per_call);
+            if (result->cycles_per_pixel >= 0)
+                fprintf(table, " %9.3f", result->cycles_per_pixel);
+            else
+                fprintf(table, " %9s", "-");
+            if (result->llc_misses_per_frame >= 0)
+                fprintf(table, " %12.0f\n", result->llc_misses_per_frame);
+            else
+                fprintf(table, " %12s\n", "-");
+            fflush(table);
+        }
+        free_frames(&ctx);
+    }
+
+    if (json_path) {
+        FILE *out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!out) {
+            perror(json_path);
+            free(results);
+            return 1;
+        }
+        write_json(out, results, count, min_ms);
+        if (out != stdout)
+            fclose(out);
+    }
+
+    if (counters.cycles >= 0)
+        close(counters.cycles);
+    if (counters.llc_misses >= 0)
+        close(counters.llc_misses);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,391 @@
+/*
+ * Loopback benchmark: frame latency and delivery under packet loss for the UDP
+ * video channel (udp_video_sender -> lossy proxy -> udp_video_reassembler)
+ * versus TCP through a proxy that models retransmission stalls. The UDP channel
+ * runs twice per loss rate: without FEC ("udp") and with adaptive XOR parity
+ * ("fec"), where the sink reports loss back to the sender every 100ms the way
+ * the receiver's VIDEO_FEEDBACK does.
+ *
+ * Usage: udp-loss-bench [frame_kb] [frames] [loss_list] [tcp_stall_ms]
+ *   loss_list: comma-separated loss percentages (default 0,0.1,0.5,1,2,5)
+ *
+ * Latency is measured from the frame timestamp to frame completion at the
+ * receiver. The TCP proxy can't drop packets itself (the kernel would just
+ * retransmit on loopback), so each "lost" 1448-byte segment instead holds the
+ * stream for tcp_stall_ms (default 40ms, roughly a fast retransmit on Wi-Fi),
+ * which is what head-of-line blocking looks like to the receiver.
+ */
+#define _GNU_SOURCE
+#include "udp_video.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#define BENCH_FPS 60
+#define TCP_SEGMENT 1448
+
+typedef struct {
+    double loss;           // Drop probability (0..1)
+    int tcp_stall_ms;
+    int in_fd;             // Proxy input socket
+    int out_fd;            // Proxy output socket (UDP: unconnected, uses out_addr)
+    struct sockaddr_in out_addr;
+    volatile bool stop;
+} proxy_t;
+
+typedef struct {
+    int fd;
+    size_t frame_size;
+    int frames;
+    double *latency_ms;    // Indexed by frame number
+    int received;
+    uint64_t recovered;    // Frames completed using parity
+    udp_video_sender_t *feedback_to;  // Sender to report loss to (NULL = no feedback)
+    volatile bool stop;
+} sink_t;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static bool drop_packet(double loss)
+{
+    return loss > 0 && (double)rand() / RAND_MAX < loss;
+}
+
+static int bind_loopback(int type, struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, type, 0);
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(a);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0 ||
+        getsockname(fd, (struct sockaddr *)&a, &len) < 0) {
+        perror("bind");
+        exit(1);
+    }
+    if (type == SOCK_STREAM)
+        listen(fd, 1);
+    if (addr)
+        *addr = a;
+    return fd;
+}
+
+static void set_timeout(int fd, int ms)
+{
+    struct timeval tv = { .tv_sec = ms / 1000, .tv_usec = (ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// Frame number and send time are carried in the frame_message_t fields
+static void record_frame(sink_t *sink, const void *frame, size_t len)
+{
+    if (len < sizeof(frame_message_t))
+        return;
+    frame_message_t msg;
+    memcpy(&msg, frame, sizeof(msg));
+    uint32_t index = ntohl(msg.output_id);
+    uint64_t sent_us = ((uint64_t)ntohl(msg.width) << 32) | ntohl(msg.height);
+    if ((int)index < sink->frames && sink->latency_ms[index] < 0) {
+        sink->latency_ms[index] = (now_us() - sent_us) / 1000.0;
+        sink->received++;
+    }
+}
+
+static void *udp_proxy_thread(void *arg)
+{
+    proxy_t *proxy = arg;
+    static uint8_t packet[65536];
+    while (!proxy->stop) {
+        ssize_t n = recv(proxy->in_fd, packet, sizeof(packet), 0);
+        if (n <= 0 || drop_packet(proxy->loss))
+            continue;
+        sendto(proxy->out_fd, packet, n, 0, (struct sockaddr *)&proxy->out_addr, sizeof(proxy->out_addr));
+    }
+    return NULL;
+}
+
+static void *udp_sink_thread(void *arg)
+{
+    sink_t *sink = arg;
+    udp_video_reassembler_t *reasm = udp_video_reassembler_create(sink->frame_size + sizeof(frame_message_t));
+    static uint8_t packet[65536];
+    uint64_t last_feedback = now_us();
+    while (!sink->stop) {
+        if (sink->feedback_to && now_us() - last_feedback >= 100000) {
+            video_feedback_message_t feedback;
+            udp_video_reassembler_take_feedback(reasm, &feedback);
+            udp_video_sender_report_feedback(sink->feedback_to, &feedback);
+            last_feedback = now_us();
+        }
+        ssize_t n = recv(sink->fd, packet, sizeof(packet), 0);
+        if (n <= 0)
+            continue;
+        const void *frame;
+        size_t frame_len;
+        if (udp_video_reassembler_push(reasm, packet, n, &frame, &frame_len) == 1)
+            record_frame(sink, frame, frame_len);
+    }
+    sink->recovered = udp_video_reassembler_get_recovered_frames(reasm);
+    udp_video_reassembler_destroy(reasm);
+    return NULL;
+}
+
+static void *tcp_proxy_thread(void *arg)
+{
+    proxy_t *proxy = arg;
+    int in = accept(proxy->in_fd, NULL, NULL);
+    static uint8_t segment[TCP_SEGMENT];
+    ssize_t n;
+    while ((n = recv(in, segment, sizeof(segment), 0)) > 0) {
+        // A lost segment holds back everything behind it until it is retransmitted
+        if (drop_packet(proxy->loss)) {
+            struct timespec stall = { .tv_sec = 0, .tv_nsec = proxy->tcp_stall_ms * 1000000L };
+            nanosleep(&stall, NULL);
+        }
+        if (send(proxy->out_fd, segment, n, MSG_NOSIGNAL) != n)
+            break;
+    }
+    close(in);
+    shutdown(proxy->out_fd, SHUT_WR);
+    return NULL;
+}
+
+static bool recv_all(int fd, void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, (uint8_t *)buf + got, len - got, 0);
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+    return true;
+}
+
+static void *tcp_sink_thread(void *arg)
+{
+    sink_t *sink = arg;
+    int fd = accept(sink->fd, NULL, NULL);
+    size_t frame_len = sizeof(frame_message_t) + sink->frame_size;
+    uint8_t *frame = malloc(frame_len);
+    message_header_t header;
+    while (recv_all(fd, &header, sizeof(header)) && recv_all(fd, frame, frame_len))
+        record_frame(sink, frame, frame_len);
+    free(frame);
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *transport, double loss_pct, sink_t *sink)
+{
+    double *sorted = malloc(sink->frames * sizeof(double));
+    int n = 0;
+    for (int i = 0; i < sink->frames; i++) {
+        if (sink->latency_ms[i] >= 0)
+            sorted[n++] = sink->latency_ms[i];
+    }
+    qsort(sorted, n, sizeof(double), compare_double);
+
+    printf("%-4s loss=%5.1f%%  delivered=%5.1f%%  p50=%7.2fms  p99=%7.2fms  max=%7.2fms\n",
+           transport, loss_pct, 100.0 * n / sink->frames,
+           n ? sorted[n / 2] : 0, n ? sorted[(n * 99) / 100] : 0, n ? sorted[n - 1] : 0);
+    free(sorted);
+}
+
+static void fill_frame(frame_message_t *msg, int index)
+{
+    uint64_t t = now_us();
+    memset(msg, 0, sizeof(*msg));
+    msg->output_id = htonl(index);
+    msg->width = htonl((uint32_t)(t >> 32));
+    msg->height = htonl((uint32_t)t);
+}
+
+static void pace(uint64_t start_us, int index)
+{
+    uint64_t due = start_us + (uint64_t)index * 1000000ULL / BENCH_FPS;
+    uint64_t t = now_us();
+    if (due > t)
+        usleep(due - t);
+}
+
+static void run_udp(size_t frame_size, int frames, double loss_pct, int fec_group, uint8_t *payload)
+{
+    sink_t sink = { .frame_size = frame_size, .frames = frames };
+    proxy_t proxy = { .loss = loss_pct / 100.0 };
+    struct sockaddr_in sink_addr, proxy_addr;
+
+    sink.latency_ms = malloc(frames * sizeof(double));
+    for (int i = 0; i < frames; i++)
+        sink.latency_ms[i] = -1;
+
+    sink.fd = bind_loopback(SOCK_DGRAM, &sink_addr);
+    proxy.in_fd = bind_loopback(SOCK_DGRAM, &proxy_addr);
+    proxy.out_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    proxy.out_addr = sink_addr;
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(sink.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(proxy.in_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    set_timeout(sink.fd, 50);
+    set_timeout(proxy.in_fd, 50);
+
+    udp_video_sender_t *sender = udp_video_sender_create((struct sockaddr *)&proxy_addr, sizeof(proxy_addr),
+                                                         0, fec_group);
+    if (fec_group == FEC_GROUP_AUTO)
+        sink.feedback_to = sender;
+
+    pthread_t sink_thread, proxy_thread;
+    pthread_create(&sink_thread, NULL, udp_sink_thread, &sink);
+    pthread_create(&proxy_thread, NULL, udp_proxy_thread, &proxy);
+
+    struct iovec iov = { .iov_base = payload, .iov_len = frame_size };
+    uint64_t start = now_us();
+    for (int i = 0; i < frames; i++) {
+        pace(start, i);
+        frame_message_t msg;
+        fill_frame(&msg, i);
+        // Like the streamer's main loop: what the socket can't take goes out once it is writable
+        int ret = udp_video_sender_send_frame(sender, &msg, sizeof(msg), &iov, 1);
+        while (ret == 1) {
+            struct pollfd pfd = { .fd = udp_video_sender_get_fd(sender), .events = POLLOUT };
+            poll(&pfd, 1, -1);
+            ret = udp_video_sender_flush(sender);
+        }
+    }
+
+    usleep(200000);
+    proxy.stop = true;
+    sink.stop = true;
+    pthread_join(proxy_thread, NULL);
+    pthread_join(sink_thread, NULL);
+
+    report(fec_group == FEC_GROUP_OFF ? "udp" : "fec", loss_pct, &sink);
+    if (fec_group != FEC_GROUP_OFF)
+        printf("     recovered=%llu frames, final group=%d\n",
+               (unsigned long long)sink.recovered, udp_video_sender_get_fec_group(sender));
+
+    udp_video_sender_destroy(sender);
+    close(sink.fd);
+    close(proxy.in_fd);
+    close(proxy.out_fd);
+    free(sink.latency_ms);
+}
+
+static void run_tcp(size_t frame_size, int frames, double loss_pct, int stall_ms, uint8_t *payload)
+{
+    sink_t sink = { .frame_size = frame_size, .frames = frames };
+    proxy_t proxy = { .loss = loss_pct / 100.0, .tcp_stall_ms = stall_ms };
+    struct sockaddr_in sink_addr, proxy_addr;
+
+    sink.latency_ms = malloc(frames * sizeof(double));
+    for (int i = 0; i < frames; i++)
+        sink.latency_ms[i] = -1;
+
+    sink.fd = bind_loopback(SOCK_STREAM, &sink_addr);
+    proxy.in_fd = bind_loopback(SOCK_STREAM, &proxy_addr);
+
+    pthread_t sink_thread, proxy_thread;
+    pthread_create(&sink_thread, NULL, tcp_sink_thread, &sink);
+
+    proxy.out_fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(proxy.out_fd, (struct sockaddr *)&sink_addr, sizeof(sink_addr));
+    pthread_create(&proxy_thread, NULL, tcp_proxy_thread, &proxy);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    connect(fd, (struct sockaddr *)&proxy_addr, sizeof(proxy_addr));
+
+    uint64_t start = now_us();
+    for (int i = 0; i < frames; i++) {
+        pace(start, i);
+        frame_message_t msg;
+        fill_frame(&msg, i);
+        message_header_t header = { .type = MSG_FRAME, .length = htonl(sizeof(msg)) };
+        struct iovec iov[3] = {
+            { &header, sizeof(header) }, { &msg, sizeof(msg) }, { payload, frame_size }
+        };
+        struct msghdr mh = { .msg_iov = iov, .msg_iovlen = 3 };
+        size_t left = sizeof(header) + sizeof(msg) + frame_size;
+        while (left > 0) {
+            ssize_t n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            left -= n;
+            // Advance past what was written
+            while (n > 0 && mh.msg_iovlen > 0) {
+                if ((size_t)n >= mh.msg_iov->iov_len) {
+                    n -= mh.msg_iov->iov_len;
+                    mh.msg_iov++;
+                    mh.msg_iovlen--;
+                } else {
+                    mh.msg_iov->iov_base = (uint8_t *)mh.msg_iov->iov_base + n;
+                    mh.msg_iov->iov_len -= n;
+                    n = 0;
+                }
+            }
+        }
+    }
+
+    close(fd);
+    pthread_join(proxy_thread, NULL);
+    pthread_join(sink_thread, NULL);
+
+    report("tcp", loss_pct, &sink);
+
+    close(sink.fd);
+    close(proxy.in_fd);
+    close(proxy.out_fd);
+    free(sink.latency_ms);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t frame_kb = argc > 1 ? (size_t)atoi(argv[1]) : 256;
+    int frames = argc > 2 ? atoi(argv[2]) : 300;
+    const char *loss_list = argc > 3 ? argv[3] : "0,0.1,0.5,1,2,5";
+    int stall_ms = argc > 4 ? atoi(argv[4]) : 40;
+
+    if (frame_kb == 0 || frames <= 0) {
+        fprintf(stderr, "Usage: %s [frame_kb] [frames] [loss_list] [tcp_stall_ms]\n", argv[0]);
+        return 1;
+    }
+
+    size_t frame_size = frame_kb * 1024;
+    uint8_t *payload = malloc(frame_size);
+    memset(payload, 0x5A, frame_size);
+    srand(1);
+
+    printf("%zu KB frames, %d frames at %d fps, TCP stall per lost segment %d ms\n",
+           frame_kb, frames, BENCH_FPS, stall_ms);
+
+    char *list = strdup(loss_list);
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        double loss_pct = atof(tok);
+        run_udp(frame_size, frames, loss_pct, FEC_GROUP_OFF, payload);
+        run_udp(frame_size, frames, loss_pct, FEC_GROUP_AUTO, payload);
+        run_tcp(frame_size, frames, loss_pct, stall_ms, payload);
+    }
+
+    free(list);
+    free(payload);
+    return 0;
+}
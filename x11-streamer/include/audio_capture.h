@@ -10,23 +10,52 @@ typedef struct audio_capture audio_capture_t;
 // Audio format constants
 #define AUDIO_FORMAT_PCM_S16LE 0
 #define AUDIO_FORMAT_PCM_S32LE 1
+#define AUDIO_FORMAT_OPUS 2  // AUDIO messages only: one Opus packet per message (not a capture format)
+
+// PulseAudio fragment size: how much audio the server batches per delivery
+#define AUDIO_CAPTURE_DEFAULT_FRAGMENT_MS 10
+#define AUDIO_CAPTURE_MIN_FRAGMENT_MS 5
+#define AUDIO_CAPTURE_MAX_FRAGMENT_MS 20
 
 // Create audio capture instance
-// sample_rate: e.g., 48000
+// sample_rate: e.g., 48000, or 0 to record at the source's own rate (looked up on the
+//              first start, so PulseAudio does not resample before we do)
 // channels: e.g., 2 (stereo)
 // format: AUDIO_FORMAT_PCM_S16LE or AUDIO_FORMAT_PCM_S32LE
 audio_capture_t *audio_capture_create(uint32_t sample_rate, uint16_t channels, uint16_t format);
 
+// Set the fragment size (takes effect on the next start)
+// Returns 0 on success, -1 if outside AUDIO_CAPTURE_MIN/MAX_FRAGMENT_MS
+int audio_capture_set_fragment_ms(audio_capture_t *capture, uint32_t fragment_ms);
+
+// Record a specific PulseAudio source (takes effect on the next start)
+// NULL (the default) records the monitor of the default sink, i.e. what the desktop plays
+int audio_capture_set_source(audio_capture_t *capture, const char *source);
+
 // Start capturing audio
 int audio_capture_start(audio_capture_t *capture);
 
 // Stop capturing audio
 void audio_capture_stop(audio_capture_t *capture);
 
-// Get captured audio data
-// Returns number of bytes captured, or -1 on error
+// Get the next 10 ms of captured audio without blocking
+// timestamp_us (optional) receives the capture time of its first sample on the
+// audio_get_timestamp_us() clock: the sample position, anchored with PulseAudio's
+// latency measurements, so chunks are exactly their length apart and jitter-free
+// Returns number of bytes captured, 0 if no full chunk is buffered yet, or -1 on error
 // Caller must free the returned buffer
-int audio_capture_read(audio_capture_t *capture, void **data, uint32_t *size);
+int audio_capture_read(audio_capture_t *capture, void **data, uint32_t *size, uint64_t *timestamp_us);
+
+// Sample rate of the chunks audio_capture_read() returns (0 before the first start
+// when recording at the source's rate; fixed from then on)
+uint32_t audio_capture_get_sample_rate(audio_capture_t *capture);
+
+// File descriptor that polls readable while audio_capture_read() has data
+int audio_capture_get_fd(audio_capture_t *capture);
+
+// Latest capture latency reported by pa_stream_get_latency() (source to our read pointer)
+// Returns 0 on success, -1 if not running or no measurement yet
+int audio_capture_get_latency_us(audio_capture_t *capture, uint64_t *latency_us);
 
 // Destroy audio capture instance
 void audio_capture_destroy(audio_capture_t *capture);
@@ -0,0 +1,31 @@
+#ifndef AUDIO_ENCODER_H
+#define AUDIO_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct audio_encoder audio_encoder_t;
+
+// Largest packet audio_encoder_encode() produces (one Opus frame)
+#define AUDIO_ENCODER_MAX_PACKET 1276
+
+// Default Opus bitrate for 48 kHz stereo (about 1/24 of the PCM rate)
+#define AUDIO_ENCODER_DEFAULT_BITRATE 64000
+
+// Create an Opus encoder for interleaved 16-bit PCM
+// Low-delay mode, 10 ms frames and DTX (silence is not sent)
+// sample_rate: 48000 (or another Opus rate), channels: 1 or 2, bitrate: bits per second
+audio_encoder_t *audio_encoder_create(uint32_t sample_rate, uint16_t channels, uint32_t bitrate);
+
+// Destroy encoder
+void audio_encoder_destroy(audio_encoder_t *encoder);
+
+// Samples per channel that audio_encoder_encode() takes (10 ms)
+uint32_t audio_encoder_get_frame_samples(audio_encoder_t *encoder);
+
+// Encode one frame of audio_encoder_get_frame_samples() samples per channel into packet
+// Returns the packet size, 0 if DTX left nothing to send (silence), -1 on error
+int audio_encoder_encode(audio_encoder_t *encoder, const int16_t *pcm, uint32_t samples,
+                         uint8_t *packet, size_t packet_size);
+
+#endif // AUDIO_ENCODER_H
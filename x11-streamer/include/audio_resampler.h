@@ -0,0 +1,50 @@
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Polyphase windowed-sinc resampler for interleaved 16-bit PCM, used to send each
+// receiver audio at its native output rate (so the TV does not resample again).
+// The ratio out/in is reduced to up/down and the Kaiser-windowed low-pass is split
+// into `up` phases; every output sample is one dot product of a phase with the
+// input history (AVX/FMA, SSE or NEON when the build targets them).
+// Channels are converted on the way in: mono output averages the input channels,
+// otherwise output channel c takes input channel c % in_channels.
+
+#define AUDIO_RESAMPLER_TAPS 64          // Taps per phase when upsampling (more when downsampling)
+#define AUDIO_RESAMPLER_MAX_TAPS 256
+#define AUDIO_RESAMPLER_MAX_PHASES 1024  // Largest reduced `up` (e.g. 44100 -> 48000 is 160/147)
+#define AUDIO_RESAMPLER_MAX_CHANNELS 8
+
+typedef struct audio_resampler audio_resampler_t;
+
+// Returns NULL if the ratio needs more than AUDIO_RESAMPLER_MAX_PHASES phases
+audio_resampler_t *audio_resampler_create(uint32_t in_rate, uint16_t in_channels,
+                                          uint32_t out_rate, uint16_t out_channels);
+void audio_resampler_destroy(audio_resampler_t *resampler);
+
+// Forget the input history (next chunk starts a new stream)
+void audio_resampler_reset(audio_resampler_t *resampler);
+
+// Largest output audio_resampler_process() produces for in_frames of input
+uint32_t audio_resampler_max_output(const audio_resampler_t *resampler, uint32_t in_frames);
+
+// Resample one chunk
+// in_timestamp_us: time of the chunk's first input sample; *out_timestamp_us (optional)
+// receives the time of the first output sample, which accounts for the filter delay
+// Returns output frames written, -1 if out_capacity is too small
+int audio_resampler_process(audio_resampler_t *resampler, const int16_t *in, uint32_t in_frames,
+                            uint64_t in_timestamp_us, int16_t *out, uint32_t out_capacity,
+                            uint64_t *out_timestamp_us);
+
+// Filter delay in input frames (output lags the input by this much)
+uint32_t audio_resampler_delay_frames(const audio_resampler_t *resampler);
+
+// Use the portable dot product instead of the SIMD one (benchmarks compare the two)
+void audio_resampler_set_simd(audio_resampler_t *resampler, bool enabled);
+
+// Instruction set of the SIMD dot product ("scalar" if the build targets none)
+const char *audio_resampler_simd_name(void);
+
+#endif // AUDIO_RESAMPLER_H
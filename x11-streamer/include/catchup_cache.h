@@ -0,0 +1,46 @@
+#ifndef CATCHUP_CACHE_H
+#define CATCHUP_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>  // For ssize_t
+#include "send_queue.h"
+
+// Join-in-progress cache for the H.264 stream.
+// Holds the last IDR frame and every frame encoded after it, as the same shared
+// messages the live receivers were sent. A receiver that joins (or has to resync)
+// gets the whole chain in one burst, after which it decodes the live stream like
+// everyone else - no forced keyframe for the receivers already watching.
+// The chain is dropped once it grows past its limits; the next joiner then needs a
+// fresh IDR, which starts a new chain.
+typedef struct catchup_cache catchup_cache_t;
+
+#define CATCHUP_CACHE_MAX_FRAMES 120                // Two seconds at 60 FPS (one keyint)
+#define CATCHUP_CACHE_MAX_BYTES (8 * 1024 * 1024)   // About one raw 1080p frame
+
+// Create cache (0 = default limit)
+catchup_cache_t *catchup_cache_create(int max_frames, size_t max_bytes);
+
+// Destroy cache (drops its message references)
+void catchup_cache_destroy(catchup_cache_t *cache);
+
+// Forget the chain (encoder recreated, or the stream left H.264 mode)
+void catchup_cache_clear(catchup_cache_t *cache);
+
+// Record an encoded frame (the cache takes its own reference)
+// keyframe: msg is an IDR and starts a new chain; other frames extend the current one
+void catchup_cache_add(catchup_cache_t *cache, send_message_t *msg, bool keyframe);
+
+// True if a chain starting at an IDR is available
+bool catchup_cache_is_ready(catchup_cache_t *cache);
+
+// Frames / bytes in the current chain
+int catchup_cache_get_frames(catchup_cache_t *cache);
+size_t catchup_cache_get_bytes(catchup_cache_t *cache);
+
+// Queue the whole chain on a receiver, replacing video it hasn't started sending
+// Returns bytes queued, 0 if no chain is available, -1 on error
+ssize_t catchup_cache_send(catchup_cache_t *cache, send_queue_t *queue);
+
+#endif // CATCHUP_CACHE_H
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#define DIRTY_RECT_TILE_SIZE 32  // Frames are compared in squares of this many pixels
+
 // Dirty rectangle
 typedef struct {
 	uint32_t x, y;
@@ -28,6 +30,13 @@ int dirty_rect_detect(dirty_rect_context_t *ctx,
 					  dirty_rect_t *rectangles,
 					  int max_rects);
 
+// Merge a grid of dirty tiles (tiles_x * tiles_y flags, row by row) into rectangles
+// covering them, clamped to width x height (the second half of dirty_rect_detect)
+// Returns number of rectangles, or -1 on allocation failure
+int dirty_rect_merge_tiles(const bool *dirty_tiles, uint32_t tiles_x, uint32_t tiles_y,
+						   uint32_t tile_size, uint32_t width, uint32_t height,
+						   dirty_rect_t *rectangles, int max_rects);
+
 // Get total dirty pixel count (for metrics)
 uint64_t dirty_rect_get_dirty_pixel_count(dirty_rect_context_t *ctx);
 
@@ -12,9 +12,12 @@ typedef struct drm_fb {
     uint32_t height;
     uint32_t pitch;
     uint32_t bpp;
-    uint32_t format;
-    void *map;
-    size_t size;
+    uint32_t format;    // DRM fourcc (from drmModeGetFB2, else guessed from depth/bpp)
+    uint64_t modifier;  // Tiling layout (DRM_FORMAT_MOD_LINEAR if the framebuffer has none)
+    uint32_t handle;    // GEM handle of the first plane
+    uint32_t offset;    // Offset of the first plane in its buffer
+    void *map;          // Whole buffer; the pixels start at map + offset
+    size_t size;        // Mapped bytes: offset + pitch * height rounded up to whole tiles
 } drm_fb_t;
 
 typedef struct drm_device {
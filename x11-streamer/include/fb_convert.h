@@ -0,0 +1,79 @@
+#ifndef FB_CONVERT_H
+#define FB_CONVERT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Turns a scanout framebuffer into the linear XRGB8888 the rest of the pipeline reads
+// (dirty rects, H.264, the wire format). Tiled layouts are detiled a row at a time and
+// the row converted while it is in cache (AVX2, SSE2 or NEON when the build targets them).
+//
+// Layouts: DRM_FORMAT_MOD_LINEAR, I915_FORMAT_MOD_X_TILED (512 B x 8 row tiles) and
+// I915_FORMAT_MOD_Y_TILED (128 B x 32 row tiles of 16 B columns), without bit-6
+// swizzling (which modifier-based framebuffers do not use).
+// Formats: ARGB8888, XRGB8888, ABGR8888, XBGR8888, XRGB2101010, ARGB2101010, RGB565.
+// Converted pixels are opaque (alpha 0xFF); 10-bit channels keep their top 8 bits.
+//
+// Scanout buffers are often mapped write-combined or uncached, where every CPU read is an
+// order of magnitude slower than from cached memory. Such a mapping is read exactly once,
+// into a cached staging buffer, optionally with non-temporal streaming loads (MOVNTDQA,
+// SSE4.1 builds), and compared with the previous frame in the same pass.
+
+#define FB_CONVERT_BPP 4  // Output bytes per pixel
+
+// How a framebuffer mapping is best read (see fb_convert_probe_read_mode())
+typedef enum {
+    FB_READ_IN_PLACE,  // Cached memory: linear ARGB/XRGB8888 is handed out where it is
+    FB_READ_COPY,      // Slow to read: copied once into staging with ordinary loads
+    FB_READ_STREAM     // Slow to read: copied once into staging with streaming loads
+} fb_read_mode_t;
+
+// Dirty tiles found while converting
+typedef struct {
+    const void *previous;  // Previous output (same size and pitch as dst), NULL if there is none
+    uint32_t tile_size;    // Pixels per tile side
+    bool *tiles;           // tiles_x * tiles_y flags, row by row: set where dst differs from previous
+                           // (all set without previous)
+} fb_convert_dirty_t;
+
+// True if fb_convert_to_xrgb8888() handles this format and modifier
+bool fb_convert_supported(uint32_t format, uint64_t modifier);
+
+// True if the buffer already is linear ARGB8888/XRGB8888 and can be read in place
+bool fb_convert_is_passthrough(uint32_t format, uint64_t modifier);
+
+// Bytes per pixel of a supported format (0 if unsupported)
+uint32_t fb_convert_format_cpp(uint32_t format);
+
+// Rows a buffer with this modifier covers: height rounded up to whole tiles
+uint32_t fb_convert_aligned_height(uint64_t modifier, uint32_t height);
+
+// Detile and convert width x height pixels of src (src_pitch bytes per pixel row, as
+// DRM reports it) into dst (dst_pitch bytes per row, at least width * FB_CONVERT_BPP)
+// Returns 0 on success, -1 if the format, modifier or pitch is not supported
+int fb_convert_to_xrgb8888(const void *src, uint32_t src_pitch, uint32_t format, uint64_t modifier,
+                           uint32_t width, uint32_t height, void *dst, uint32_t dst_pitch);
+
+// fb_convert_to_xrgb8888() reading src with streaming loads (ignored if the build has
+// none) and, if dirty is not NULL, comparing each output row with previous while it is in cache
+int fb_convert_frame(const void *src, uint32_t src_pitch, uint32_t format, uint64_t modifier,
+                     uint32_t width, uint32_t height, void *dst, uint32_t dst_pitch,
+                     bool streaming_loads, fb_convert_dirty_t *dirty);
+
+// Time plain and streaming reads of the start of a mapping (size bytes long) against
+// reads of ordinary memory, and pick the cheapest way to read it
+fb_read_mode_t fb_convert_probe_read_mode(const void *src, size_t size);
+
+const char *fb_convert_read_mode_name(fb_read_mode_t mode);
+
+// True if the build has streaming loads (FB_READ_STREAM is never picked otherwise)
+bool fb_convert_has_streaming_loads(void);
+
+// Use the portable kernels instead of the SIMD ones (benchmarks compare the two)
+void fb_convert_set_simd(bool enabled);
+
+// Instruction set of the SIMD kernels ("scalar" if the build targets none)
+const char *fb_convert_simd_name(void);
+
+#endif // FB_CONVERT_H
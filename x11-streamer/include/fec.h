@@ -0,0 +1,32 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// XOR parity forward error correction for the UDP video channel.
+// A frame's data packets are split into groups of `group` packets, each followed by
+// one parity packet (XOR of the group's slices, zero-padded to the packet size).
+// Any single lost packet in a group can be rebuilt from the others plus the parity.
+
+#define FEC_GROUP_AUTO  -1  // Pick the group size from receiver loss reports
+#define FEC_GROUP_OFF    0  // No parity packets
+#define FEC_GROUP_MIN    2  // Most redundancy (50% overhead)
+#define FEC_GROUP_MAX   32  // Least redundancy (~3% overhead)
+
+// dst ^= src (SSE2 when available)
+void fec_xor(uint8_t *dst, const uint8_t *src, size_t len);
+
+// Compute parity for a whole frame
+// data/data_len: Frame bytes, sliced into packet_data-byte packets
+// group: Data packets per parity packet
+// parity: Output, one packet_data-byte block per group (fec_num_groups() blocks)
+void fec_encode(const uint8_t *data, size_t data_len, size_t packet_data, int group, uint8_t *parity);
+
+// Number of parity packets for packet_count data packets
+size_t fec_num_groups(size_t packet_count, int group);
+
+// Group size that keeps two losses in one group unlikely at the given packet loss rate (0..1)
+int fec_group_for_loss(double loss_rate);
+
+#endif // FEC_H
@@ -0,0 +1,41 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include "frame_source.h"
+#include "h264_encoder.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// The per-frame work on a captured picture, done in one pass over it.
+// The frame is walked a stripe of DIRTY_RECT_TILE_SIZE rows at a time (a few hundred KB
+// with its history, which stays in L2). The stripe's tiles are compared with the history
+// (the last frame), then the runs of changed tiles are copied into it and, for H.264,
+// converted into the encoder's I420 input before the next stripe is read. Unchanged tiles
+// are read once from the frame and once from the history and written nowhere;
+// dirty_rect_detect(), its history memcpy and a full-frame h264_encoder_argb_to_i420()
+// each stream the whole frame instead.
+typedef struct frame_pipeline frame_pipeline_t;
+
+frame_pipeline_t *frame_pipeline_create(uint32_t width, uint32_t height);
+void frame_pipeline_destroy(frame_pipeline_t *pipeline);
+
+// Process one XRGB8888 frame of the pipeline's size. Every tile counts as changed if the
+// frame before this one (by frame->sequence) was not processed here. Tiles the source
+// already found changed (frame->dirty_tiles) are used instead of comparing.
+// i420: encoder input to bring up to date with this frame, NULL for none
+// Returns 0 on success, -1 on error (frame of another size or format, out of memory)
+int frame_pipeline_process(frame_pipeline_t *pipeline, const frame_buffer_t *frame,
+                           const h264_i420_planes_t *i420);
+
+// Tiles (DIRTY_RECT_TILE_SIZE squares, row by row) that changed in the last processed frame
+// (all of them in the first frame)
+const bool *frame_pipeline_get_dirty_tiles(frame_pipeline_t *pipeline, uint32_t *tiles_x, uint32_t *tiles_y);
+
+// The I420 planes passed next do not hold the last frame, even at the same address
+// (e.g. a new encoder)
+void frame_pipeline_reset_i420(frame_pipeline_t *pipeline);
+
+uint32_t frame_pipeline_get_width(frame_pipeline_t *pipeline);
+uint32_t frame_pipeline_get_height(frame_pipeline_t *pipeline);
+
+#endif // FRAME_PIPELINE_H
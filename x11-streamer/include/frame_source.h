@@ -0,0 +1,90 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Where the streamer gets its pictures from.
+// The DRM source reads the virtual output's framebuffer; the synthetic, file and replay
+// sources produce frames without a GPU or X server, so the whole pipeline (dirty
+// rects, H.264, protocol, encryption) can run and be measured on a build box.
+typedef struct frame_source frame_source_t;
+
+#define FRAME_SOURCE_FORMAT_XRGB8888 0x34325258  // DRM_FORMAT_XRGB8888 ('XR24')
+#define FRAME_SOURCE_DEFAULT_WIDTH 1920
+#define FRAME_SOURCE_DEFAULT_HEIGHT 1080
+#define FRAME_SOURCE_DEFAULT_REFRESH 60
+#define FRAME_SOURCE_REPLAY_MAX_RATE 1000  // Capture rate asked for when replaying at maximum speed
+
+// One captured frame, valid until frame_source_release()
+typedef struct frame_buffer {
+    const void *data;
+    size_t size;        // height * pitch
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;     // Bytes per row
+    uint32_t bpp;       // Bytes per pixel
+    uint32_t format;    // DRM fourcc
+    uint64_t sequence;        // Counts acquire calls on the source
+    const bool *dirty_tiles;  // Changed since frame sequence - 1, per DIRTY_RECT_TILE_SIZE square
+                              // (row by row), if the source compared them while copying; else NULL
+} frame_buffer_t;
+
+typedef enum {
+    SYNTHETIC_PATTERN_SCROLL_TEXT,     // Terminal output scrolling a line per frame
+    SYNTHETIC_PATTERN_MOVING_WINDOWS,  // A few windows dragged across a static desktop
+    SYNTHETIC_PATTERN_VIDEO_NOISE,     // Every pixel changes every frame
+    SYNTHETIC_PATTERN_IDLE             // Nothing changes after the first frame
+} synthetic_pattern_t;
+
+// Framebuffer of a DRM output (opened and mapped for each frame, as the id can change).
+// A mapping that is slow to read (write-combined or uncached) is copied once per frame
+// into staging, and the copy reports its dirty tiles.
+frame_source_t *frame_source_create_drm(uint32_t fb_id);
+
+// Generated XRGB8888 frames (0 = default size/rate)
+frame_source_t *frame_source_create_synthetic(synthetic_pattern_t pattern, uint32_t width,
+                                              uint32_t height, uint32_t refresh_rate);
+
+// Headerless file of back-to-back XRGB8888 frames (width * height * 4 bytes each),
+// memory-mapped and played in a loop
+frame_source_t *frame_source_create_file(const char *path, uint32_t width, uint32_t height,
+                                         uint32_t refresh_rate);
+
+// Frames of a session recording (see session_recording.h), played in a loop either
+// with their original timing or one recorded frame per captured frame (max_speed)
+frame_source_t *frame_source_create_replay(const char *path, bool max_speed);
+
+// Create from a command-line spec:
+//   synthetic:PATTERN[:WxH[@HZ]]  PATTERN = scroll-text, moving-windows, video-noise, idle
+//   file:PATH:WxH[@HZ]
+//   replay:PATH[:max]
+frame_source_t *frame_source_create_from_spec(const char *spec);
+
+void frame_source_destroy(frame_source_t *source);
+
+// Draw each frame's acquire time into its top-left corner (see latency_stamp.h)
+// Not available for DRM framebuffers
+// Returns 0 on success, -1 on error
+int frame_source_enable_latency_stamp(frame_source_t *source);
+
+// Get the next frame
+// Returns: 0 on success, -1 on error (e.g. the framebuffer went away)
+int frame_source_acquire(frame_source_t *source, frame_buffer_t *frame);
+
+// Give the frame back (the DRM source unmaps it)
+void frame_source_release(frame_source_t *source, frame_buffer_t *frame);
+
+// Framebuffer id the DRM source reads (0 for other sources)
+uint32_t frame_source_get_fb_id(frame_source_t *source);
+
+// Frame size and rate for sources that decide them themselves (0 for DRM, where the output does)
+uint32_t frame_source_get_width(frame_source_t *source);
+uint32_t frame_source_get_height(frame_source_t *source);
+uint32_t frame_source_get_refresh_rate(frame_source_t *source);
+
+// Short description for logs ("drm", "synthetic:idle", "file:capture.raw", "replay:ide.rec")
+const char *frame_source_get_name(frame_source_t *source);
+
+#endif // FRAME_SOURCE_H
@@ -7,6 +7,15 @@
 
 typedef struct h264_encoder h264_encoder_t;
 
+// I420 picture: y is one byte per pixel, u and v one per 2x2 block
+typedef struct {
+	uint8_t *y;
+	uint8_t *u;
+	uint8_t *v;
+	uint32_t y_stride;   // Bytes per row
+	uint32_t uv_stride;
+} h264_i420_planes_t;
+
 // Create H.264 encoder
 // width, height: Frame dimensions
 // fps: Target frame rate
@@ -26,6 +35,25 @@ int h264_encoder_encode_frame(h264_encoder_t *encoder,
 							  void **output,
 							  size_t *output_size);
 
+// The encoder's input picture, for callers that convert into it themselves
+// (see frame_pipeline.h) and then call h264_encoder_encode_input()
+void h264_encoder_get_input(h264_encoder_t *encoder, h264_i420_planes_t *planes);
+
+// Encode what the input picture holds, like h264_encoder_encode_frame()
+int h264_encoder_encode_input(h264_encoder_t *encoder, void **output, size_t *output_size);
+
+// Convert the width x height rectangle at (x, y) of an ARGB8888 picture (pitch bytes
+// per row, argb pointing at its origin) into the same rectangle of planes.
+// x and y must be even. Done for the whole frame by h264_encoder_encode_frame().
+void h264_encoder_argb_to_i420(const uint8_t *argb, uint32_t pitch, const h264_i420_planes_t *planes,
+							   uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+// Make the next encoded frame an IDR (self-contained) frame
+void h264_encoder_force_keyframe(h264_encoder_t *encoder);
+
+// True if the last encoded frame was an IDR (a decoder can start from it)
+bool h264_encoder_is_keyframe(h264_encoder_t *encoder);
+
 // Get encoder parameters (for debugging)
 uint32_t h264_encoder_get_width(h264_encoder_t *encoder);
 uint32_t h264_encoder_get_height(h264_encoder_t *encoder);
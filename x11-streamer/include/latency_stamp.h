@@ -0,0 +1,29 @@
+#ifndef LATENCY_STAMP_H
+#define LATENCY_STAMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Capture timestamp drawn into the top-left corner of a frame, so a receiver can
+// measure capture-to-picture ("glass-to-glass") latency from the pixels themselves.
+// The stamp is a 16x4 grid of 8x8 black/white cells: a marker, the low 48 bits of the
+// CLOCK_MONOTONIC timestamp in microseconds, a CRC-8 and a closing marker. Cells are
+// big enough to survive H.264 and chroma subsampling, so decoded luma can be read too.
+#define LATENCY_STAMP_CELL 8
+#define LATENCY_STAMP_WIDTH (16 * LATENCY_STAMP_CELL)
+#define LATENCY_STAMP_HEIGHT (4 * LATENCY_STAMP_CELL)
+#define LATENCY_STAMP_MASK ((1ULL << 48) - 1)
+
+// Draw the stamp into 4-byte pixels (XRGB8888)
+// Returns 0 on success, -1 if the frame is smaller than the stamp
+int latency_stamp_write(void *pixels, uint32_t width, uint32_t height, uint32_t pitch, uint64_t timestamp_us);
+
+// Read a stamp from 4-byte pixels (XRGB8888)
+// Returns 0 and the stamped timestamp (low 48 bits), or -1 if there is no valid stamp
+int latency_stamp_read(const void *pixels, uint32_t width, uint32_t height, uint32_t pitch, uint64_t *timestamp_us);
+
+// Read a stamp from an 8-bit luma plane (e.g. a decoded H.264 picture)
+int latency_stamp_read_luma(const uint8_t *luma, uint32_t width, uint32_t height, uint32_t stride,
+                            uint64_t *timestamp_us);
+
+#endif // LATENCY_STAMP_H
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>  // For ssize_t
+#include <sys/uio.h>    // For struct iovec
 
 // Noise Protocol Framework encryption context
 typedef struct noise_encryption_context noise_encryption_context_t;
@@ -25,11 +26,37 @@ int noise_encryption_handshake(noise_encryption_context_t *ctx, int fd);
 int noise_encryption_send(noise_encryption_context_t *ctx, int fd,
 						  const void *data, size_t data_len);
 
+// Encrypt and send a gather list
+// Each iovec becomes its own record (split if larger than one Noise message);
+// records are batched so a typical message goes out in a single write
+// Returns 0 on success, -1 on error
+int noise_encryption_sendv(noise_encryption_context_t *ctx, int fd,
+						   const struct iovec *iov, int iovcnt);
+
+// Encrypt a gather list into out without sending (same record framing as
+// noise_encryption_sendv). Used by the send queue, which writes the result later.
+// Returns bytes written to out, or -1 on error
+ssize_t noise_encryption_seal(noise_encryption_context_t *ctx,
+							  const struct iovec *iov, int iovcnt,
+							  void *out, size_t out_size);
+
+// Size of the sealed output for a gather list (plaintext + per-record overhead)
+size_t noise_encryption_sealed_size(const struct iovec *iov, int iovcnt);
+
 // Receive and decrypt data
 // Returns number of bytes received (>0), 0 on connection close, -1 on error
 ssize_t noise_encryption_recv(noise_encryption_context_t *ctx, int fd,
 							   void *buf, size_t buf_len);
 
+// Derive a session ticket bound to this session: SHA-256(handshake hash || nonce),
+// truncated to ticket_len (at most 32). The handshake hash is unique per session but
+// visible to an observer of the handshake, so the caller supplies a random nonce and
+// only ever sends the ticket over the encrypted channel.
+// Returns 0 on success, -1 on error (handshake not complete)
+int noise_encryption_derive_ticket(noise_encryption_context_t *ctx,
+								   const uint8_t *nonce, size_t nonce_len,
+								   uint8_t *ticket, size_t ticket_len);
+
 // Check if handshake is complete
 bool noise_encryption_is_ready(noise_encryption_context_t *ctx);
 
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/uio.h>  // For struct iovec
 
 // Message types
 typedef enum {
@@ -21,6 +22,10 @@ typedef enum {
     MSG_PIN_VERIFY = 0x12,
     MSG_PIN_VERIFIED = 0x13,
     MSG_CAPABILITIES = 0x14,
+    MSG_VIDEO_FEEDBACK = 0x15,
+    MSG_SESSION_TICKET = 0x16,
+    MSG_SESSION_RESUME = 0x17,
+    MSG_SESSION_RESUMED = 0x18,
     MSG_ERROR = 0xFF
 } message_type_t;
 
@@ -34,10 +39,15 @@ typedef struct __attribute__((packed)) {
 // Client HELLO message as sent by the streamer (NEW)
 typedef struct __attribute__((packed)) {
     uint8_t protocol_version; // 1
-    uint8_t flags; // Bit 0: encryption requested
-    // Optional: If encryption_requested==0 and PIN required: uint16_t pin (little-endian)
+    uint8_t flags; // Bit 0: encryption requested, bit 1: UDP video offered
+    // Optional: If encryption_requested==0 and PIN required: uint16_t pin (big-endian)
 } client_hello_t;
 
+// client_hello_t flags
+#define CLIENT_HELLO_FLAG_ENCRYPT    0x01
+#define CLIENT_HELLO_FLAG_UDP_VIDEO  0x02  // Streamer can send MSG_FRAME payloads over UDP
+#define CLIENT_HELLO_FLAG_RESUME     0x04  // SESSION_RESUME follows instead of PIN/HELLO
+
 // Display mode capability
 typedef struct __attribute__((packed)) {
     uint32_t width;
@@ -53,8 +63,15 @@ typedef struct __attribute__((packed)) {
     // Followed by:
     // 1. Display name string (display_name_len bytes, null-terminated)
     // 2. display_mode_t array (num_modes entries)
+    // 3. Optional hello_transport_t (only if the streamer offered UDP video and the receiver accepts)
 } hello_message_t;
 
+// Receiver HELLO transport extension
+typedef struct __attribute__((packed)) {
+    uint16_t udp_port;  // UDP port for video packets on the receiver's address (0 = TCP only)
+    uint16_t reserved;
+} hello_transport_t;
+
 // Encoding modes
 #define ENCODING_MODE_FULL_FRAME    0
 #define ENCODING_MODE_DIRTY_RECTS   1
@@ -84,6 +101,53 @@ typedef struct __attribute__((packed)) {
     // - For H.264: encoded video data
 } frame_message_t;
 
+// UDP video packet (MSG_FRAME over the UDP data channel)
+// Each datagram carries one slice of a frame: frame_message_t followed by its payload,
+// exactly as it would appear after the message header on TCP.
+// With FEC, each group of fec_group data packets is followed by one parity packet
+// (XOR of the group's slices, zero-padded to packet_data bytes).
+typedef struct __attribute__((packed)) {
+    uint32_t frame_seq;     // Frame sequence number (increments per frame)
+    uint32_t frame_size;    // Total frame bytes (frame_message_t + payload)
+    uint32_t offset;        // Data: byte offset of this slice within the frame; parity: 0
+    uint16_t packet_index;  // Data: 0..packet_count-1; parity: packet_count + group index
+    uint16_t packet_count;  // Number of data packets in the frame
+    uint16_t packet_data;   // Frame bytes per data packet (all but the last are full)
+    uint8_t fec_group;      // Data packets per parity packet (0 = no FEC)
+    uint8_t reserved;
+} udp_video_header_t;
+
+// Largest UDP datagram that fits a 1500-byte Ethernet/Wi-Fi MTU without IP fragmentation
+#define UDP_VIDEO_MAX_DATAGRAM 1472
+#define UDP_VIDEO_MAX_PACKET_DATA (UDP_VIDEO_MAX_DATAGRAM - sizeof(udp_video_header_t))
+
+// VIDEO_FEEDBACK message (TCP, receiver -> streamer, about twice a second while UDP video is active)
+// Counts cover frames finished since the previous report
+typedef struct __attribute__((packed)) {
+    uint32_t packets_expected;  // Data packets in those frames
+    uint32_t packets_lost;      // Data packets that never arrived (including ones rebuilt by FEC)
+    uint32_t frames_completed;
+    uint32_t frames_lost;
+    uint32_t frames_recovered;  // Completed frames that needed FEC
+} video_feedback_message_t;
+
+// SESSION_TICKET message (streamer -> receiver, after HELLO, over the session's own channel)
+// Lets the streamer reconnect after the TCP connection drops without repeating PIN/HELLO;
+// the receiver keeps the session (decoder, surface, UDP channel) for grace_ms after a drop
+#define SESSION_TICKET_SIZE 16
+typedef struct __attribute__((packed)) {
+    uint8_t ticket[SESSION_TICKET_SIZE];
+    uint32_t grace_ms;
+} session_ticket_message_t;
+
+// SESSION_RESUME message (streamer -> receiver, right after CLIENT_HELLO with
+// CLIENT_HELLO_FLAG_RESUME, or after the Noise handshake on encrypted sessions)
+// The receiver answers SESSION_RESUMED (empty payload) and the stream continues;
+// anything else (or a close) means the session is gone
+typedef struct __attribute__((packed)) {
+    uint8_t ticket[SESSION_TICKET_SIZE];
+} session_resume_message_t;
+
 // CONFIG message
 typedef struct __attribute__((packed)) {
     uint32_t output_id;
@@ -97,9 +161,9 @@ typedef struct __attribute__((packed)) {
     uint64_t timestamp_us;  // Microseconds since epoch (monotonic clock)
     uint32_t sample_rate;   // e.g., 48000
     uint16_t channels;      // e.g., 2 (stereo)
-    uint16_t format;        // 0=PCM_S16LE, 1=PCM_S32LE, etc.
+    uint16_t format;        // 0=PCM_S16LE, 1=PCM_S32LE, 2=Opus (see audio_capture.h)
     uint32_t data_size;     // Size of audio data in bytes
-    // Followed by audio data (PCM samples)
+    // Followed by audio data (PCM samples, or one Opus packet of 10 ms)
 } audio_message_t;
 
 // DISCOVERY_REQUEST message (UDP broadcast)
@@ -121,18 +185,46 @@ typedef struct __attribute__((packed)) {
 // PIN_VERIFIED message (TCP, response to PIN_VERIFY)
 // Empty payload - just the message header
 
-// CAPABILITIES message (TCP, sent immediately after connection by receiver)
+// CAPABILITIES message (TCP, receiver -> streamer, right after HELLO)
+// Streamers that predate a field ignore it; receivers that never send it get PCM audio
 typedef struct __attribute__((packed)) {
     uint8_t requires_encryption;  // 1 if encryption/PIN required, 0 if not
-    uint8_t reserved[3];          // Reserved for future use
+    uint8_t audio_codecs;         // CAPABILITY_AUDIO_* the receiver can decode (PCM is always supported)
+    uint8_t reserved[2];          // Reserved for future use
+    // Optional (older receivers stop at CAPABILITIES_BASE_SIZE): the audio output's native
+    // format, which PCM is resampled to on the streamer (0 = no preference)
+    uint32_t audio_sample_rate;
+    uint16_t audio_channels;
+    uint16_t reserved2;
 } capabilities_message_t;
 
+#define CAPABILITIES_BASE_SIZE 4
+
+// capabilities_message_t audio_codecs bits
+#define CAPABILITY_AUDIO_OPUS 0x01
+
 int protocol_send_message(int fd, message_type_t type, const void *data, size_t data_len);
+
+// Fill in a message header (network byte order, next sequence number) without sending it
+void protocol_build_header(message_header_t *header, message_type_t type, size_t data_len);
 int protocol_receive_message(int fd, message_header_t *header, void **payload);
 
+// Vectored send: header, fixed struct (data/data_len, counted in header.length) and
+// trailing payload iovecs (e.g. FRAME pixel data, not counted in header.length)
+// are written with a single sendmsg() in the common case.
+// Returns 0 on success, -1 on error
+int protocol_send_message_iov(int fd, message_type_t type, const void *data, size_t data_len,
+                              const struct iovec *payload, int payload_cnt);
+
 // Encrypted versions (require Noise Protocol context)
 // These functions encrypt/decrypt messages using Noise Protocol Framework
 int protocol_send_message_encrypted(void *noise_ctx, int fd, message_type_t type, const void *data, size_t data_len);
 int protocol_receive_message_encrypted(void *noise_ctx, int fd, message_header_t *header, void **payload);
 
+// Encrypted vectored send: header, fixed struct and each payload iovec become separate
+// Noise records (same framing as the unvectored path) but are batched into one write
+int protocol_send_message_encrypted_iov(void *noise_ctx, int fd, message_type_t type,
+                                        const void *data, size_t data_len,
+                                        const struct iovec *payload, int payload_cnt);
+
 #endif // PROTOCOL_H
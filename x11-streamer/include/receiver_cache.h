@@ -0,0 +1,17 @@
+#ifndef RECEIVER_CACHE_H
+#define RECEIVER_CACHE_H
+
+#include <stddef.h>
+
+// Last receiver the streamer connected to, kept in
+// $XDG_CACHE_HOME/x11-streamer/last_receiver (~/.cache/... if unset) as "HOST PORT".
+// Startup tries it directly while discovery runs, which usually finds the same TV.
+
+// Load the cached endpoint
+// Returns 0 on success, -1 if there is none
+int receiver_cache_load(char *host, size_t host_size, int *port);
+
+// Remember an endpoint that completed the handshake (errors are ignored: it is only a hint)
+void receiver_cache_save(const char *host, int port);
+
+#endif // RECEIVER_CACHE_H
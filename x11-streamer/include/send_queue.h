@@ -0,0 +1,83 @@
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>  // For struct iovec
+#include "protocol.h"
+
+// Per-connection non-blocking output queue.
+// Messages are copied into the queue and written with MSG_DONTWAIT as the socket
+// drains. TCP_NOTSENT_LOWAT keeps the kernel's unsent backlog small so stale data
+// waits here, where not-yet-started video frames can still be replaced by newer ones.
+// Control and audio messages are never dropped and are queued ahead of waiting video.
+typedef struct send_queue send_queue_t;
+
+// Reference-counted plaintext message. Build once with send_message_create() and push
+// the same message to several queues (fan-out): each queue only adds its own
+// encryption and send, and the bytes are freed once the last queue is done with them.
+typedef struct send_message send_message_t;
+
+// Message classes (derived from the message type)
+typedef enum {
+    SEND_CLASS_CONTROL,
+    SEND_CLASS_AUDIO,
+    SEND_CLASS_VIDEO
+} send_class_t;
+
+// Default backlog (in milliseconds of queued data) above which the link counts as congested
+#define SEND_QUEUE_DEFAULT_MAX_BACKLOG_MS 100
+
+// Create queue for a connected socket
+// noise_ctx: Noise encryption context (NULL = plaintext); messages are encrypted when
+//            they start transmitting, so dropped frames never consume a nonce
+// max_backlog_ms: congestion threshold (0 = default)
+send_queue_t *send_queue_create(int fd, void *noise_ctx, int max_backlog_ms);
+
+// Destroy queue (unsent messages are discarded)
+void send_queue_destroy(send_queue_t *queue);
+
+// Build a message (same layout as protocol_send_message_iov); holds one reference
+send_message_t *send_message_create(message_type_t type,
+                                    const void *data, size_t data_len,
+                                    const struct iovec *payload, int payload_cnt);
+
+// Take / drop a reference
+send_message_t *send_message_ref(send_message_t *msg);
+void send_message_unref(send_message_t *msg);
+
+// Plaintext size (header + fixed struct + payload)
+size_t send_message_get_size(const send_message_t *msg);
+
+// Queue a message (same layout as protocol_send_message_iov) and try to send it
+// replace_video: drop all queued video messages that have not started transmitting
+//                (use when this message is a self-contained frame)
+// Returns 0 on success, -1 on error (allocation failure or broken connection)
+int send_queue_push(send_queue_t *queue, message_type_t type,
+                    const void *data, size_t data_len,
+                    const struct iovec *payload, int payload_cnt,
+                    bool replace_video);
+
+// Queue a shared message (the queue takes its own reference) and try to send it
+// Returns 0 on success, -1 on error
+int send_queue_push_message(send_queue_t *queue, send_message_t *msg, bool replace_video);
+
+// Write as much queued data as the socket accepts without blocking
+// Returns 0 on success (data may remain queued), -1 on connection error
+int send_queue_flush(send_queue_t *queue);
+
+// True if queued data is waiting for the socket to become writable
+bool send_queue_has_pending(send_queue_t *queue);
+
+// Estimated milliseconds of data waiting in the queue
+uint32_t send_queue_get_backlog_ms(send_queue_t *queue);
+
+// True if the backlog exceeds max_backlog_ms (the next frame should be self-contained
+// and pushed with replace_video)
+bool send_queue_is_congested(send_queue_t *queue);
+
+// Number of video messages dropped because a newer frame replaced them
+uint64_t send_queue_get_dropped_frames(send_queue_t *queue);
+
+#endif // SEND_QUEUE_H
@@ -0,0 +1,79 @@
+#ifndef SESSION_RECORDING_H
+#define SESSION_RECORDING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame_source.h"
+
+// Captured frames on disk, for replaying a real workload through the pipeline later.
+//
+// File layout (host byte order - recordings are replayed on the machine type that made them):
+//   recording_header_t
+//   per frame: recording_frame_t, then either the whole picture (RECORDING_FRAME_FULL)
+//              or num_tiles x (recording_tile_t + tile pixels, rows packed)
+// Pixels are 4 bytes each with rows packed (pitch = width * 4). Edge tiles are clipped
+// to the picture. In tile mode only tiles that differ from the previous frame are stored,
+// so an idle screen costs 16 bytes per frame. The reader scans the records, so a file
+// cut short by a crash still replays up to its last complete frame.
+typedef struct session_recorder session_recorder_t;
+typedef struct session_recording session_recording_t;
+
+#define RECORDING_MAGIC "FBREC001"
+#define RECORDING_TILE_SIZE 64
+
+#define RECORDING_FRAME_FULL 0x01  // Frame stores the whole picture
+
+typedef struct __attribute__((packed)) {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;         // DRM fourcc of the captured frames
+    uint32_t tile_size;      // 0 = every frame stored whole
+    uint32_t refresh_rate;   // Capture rate when recorded (Hz)
+    uint32_t frame_count;    // Filled in on close (the reader does not rely on it)
+    uint64_t duration_us;    // Filled in on close
+} recording_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint64_t timestamp_us;   // Since the first frame
+    uint32_t num_tiles;      // Changed tiles that follow (0 with RECORDING_FRAME_FULL)
+    uint32_t flags;
+} recording_frame_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t tile_x;         // Tile column
+    uint16_t tile_y;         // Tile row
+} recording_tile_t;
+
+// Start a recording
+// changed_tiles: store only tiles that differ from the previous frame (false = every frame whole)
+session_recorder_t *session_recorder_create(const char *path, bool changed_tiles, uint32_t refresh_rate);
+
+// Finish the header and close the file
+void session_recorder_destroy(session_recorder_t *recorder);
+
+// Append a frame captured at timestamp_us (any monotonic clock)
+// Frames must keep the size of the first one (others are skipped)
+// Returns 0 on success, -1 on error
+int session_recorder_write(session_recorder_t *recorder, const frame_buffer_t *frame, uint64_t timestamp_us);
+
+// Statistics
+uint32_t session_recorder_get_frames(session_recorder_t *recorder);
+uint64_t session_recorder_get_bytes(session_recorder_t *recorder);
+
+// Open a recording (memory-mapped)
+session_recording_t *session_recording_open(const char *path);
+void session_recording_close(session_recording_t *recording);
+
+const recording_header_t *session_recording_get_header(session_recording_t *recording);
+uint32_t session_recording_get_frames(session_recording_t *recording);
+
+// Timestamp of frame index (since the first frame)
+uint64_t session_recording_get_timestamp(session_recording_t *recording, uint32_t index);
+
+// Apply frame index to picture (width * height * 4 bytes, rows packed)
+// Tile frames patch the previous picture, so frames must be applied in order from a full one
+void session_recording_apply(session_recording_t *recording, uint32_t index, uint8_t *picture);
+
+#endif // SESSION_RECORDING_H
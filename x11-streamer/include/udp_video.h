@@ -0,0 +1,85 @@
+#ifndef UDP_VIDEO_H
+#define UDP_VIDEO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>  // For struct iovec
+#include "protocol.h"
+#include "fec.h"
+
+// UDP data channel for MSG_FRAME payloads.
+// Frames are split into MTU-sized datagrams (udp_video_header_t + slice), so a lost
+// packet only costs the frame it belongs to instead of stalling the TCP stream.
+// Optional XOR parity (fec.h) lets the receiver rebuild one lost packet per group.
+typedef struct udp_video_sender udp_video_sender_t;
+typedef struct udp_video_reassembler udp_video_reassembler_t;
+
+// Frames being reassembled at once (older incomplete frames are dropped)
+#define UDP_VIDEO_REASSEMBLY_SLOTS 4
+
+// Create sender for the receiver's UDP address
+// mtu: Largest datagram to send (0 = UDP_VIDEO_MAX_DATAGRAM)
+// fec_group: Data packets per parity packet, FEC_GROUP_OFF, or FEC_GROUP_AUTO to adapt
+//            to the loss rate in receiver feedback
+udp_video_sender_t *udp_video_sender_create(const struct sockaddr *addr, socklen_t addr_len,
+                                            size_t mtu, int fec_group);
+
+// Destroy sender
+void udp_video_sender_destroy(udp_video_sender_t *sender);
+
+// Send one frame: data (frame_message_t) followed by payload iovecs
+// Never blocks: what the socket buffer can't take stays pending for
+// udp_video_sender_flush(). A frame still pending is abandoned (counted as truncated).
+// Returns 0 if the whole frame was sent, 1 if part of it is pending, -1 on error
+int udp_video_sender_send_frame(udp_video_sender_t *sender,
+                                const void *data, size_t data_len,
+                                const struct iovec *payload, int payload_cnt);
+
+// Send more of the pending frame once the socket is writable (EPOLLOUT on get_fd())
+// Returns 0 if nothing is left, 1 if part of it is still pending, -1 on error
+int udp_video_sender_flush(udp_video_sender_t *sender);
+
+// Whether a frame is waiting for socket buffer space
+bool udp_video_sender_has_pending(udp_video_sender_t *sender);
+
+// Socket to watch for EPOLLOUT while a frame is pending
+int udp_video_sender_get_fd(udp_video_sender_t *sender);
+
+// Apply a VIDEO_FEEDBACK report (host byte order); adjusts FEC in FEC_GROUP_AUTO mode
+// Safe to call from a different thread than udp_video_sender_send_frame()
+void udp_video_sender_report_feedback(udp_video_sender_t *sender, const video_feedback_message_t *feedback);
+
+// Current group size (0 = no FEC)
+int udp_video_sender_get_fec_group(udp_video_sender_t *sender);
+
+// Statistics
+uint64_t udp_video_sender_get_frames_sent(udp_video_sender_t *sender);
+uint64_t udp_video_sender_get_frames_truncated(udp_video_sender_t *sender);
+uint64_t udp_video_sender_get_packets_sent(udp_video_sender_t *sender);
+
+// Create reassembler
+// max_frame_size: Largest frame accepted (bigger frames are ignored)
+udp_video_reassembler_t *udp_video_reassembler_create(size_t max_frame_size);
+
+// Destroy reassembler
+void udp_video_reassembler_destroy(udp_video_reassembler_t *reasm);
+
+// Add a received datagram
+// On completion *frame/*frame_len point at the frame (frame_message_t + payload), valid
+// until the next call. Incomplete frames older than a completed one are dropped.
+// Returns 1 if a frame completed, 0 if not (yet), -1 if the packet is malformed
+int udp_video_reassembler_push(udp_video_reassembler_t *reasm,
+                               const void *packet, size_t packet_len,
+                               const void **frame, size_t *frame_len);
+
+// Fill a VIDEO_FEEDBACK report (host byte order) covering frames since the previous call
+void udp_video_reassembler_take_feedback(udp_video_reassembler_t *reasm, video_feedback_message_t *feedback);
+
+// Statistics
+uint64_t udp_video_reassembler_get_completed_frames(udp_video_reassembler_t *reasm);
+uint64_t udp_video_reassembler_get_lost_frames(udp_video_reassembler_t *reasm);
+uint64_t udp_video_reassembler_get_recovered_frames(udp_video_reassembler_t *reasm);
+
+#endif // UDP_VIDEO_H
@@ -15,6 +15,7 @@ typedef struct output_info {
     int refresh_rate;  // Hz
     bool connected;
     bool is_virtual;
+    RRCrtc crtc;  // CRTC driving the output (None if disabled)
     // Track previous state for change detection
     int prev_width;
     int prev_height;
@@ -22,18 +23,34 @@ typedef struct output_info {
     bool prev_connected;
 } output_info_t;
 
+typedef struct {
+    RRMode id;
+    int refresh_rate;  // Hz
+} x11_mode_t;
+
+// One X connection and the outputs seen through it; use each context from one thread
+// at a time. Queries go through XCB on the same connection so that every output (and
+// then every CRTC) is fetched in one pipelined batch instead of a round trip each.
 typedef struct x11_context {
     Display *display;
+    struct xcb_connection_t *xcb;  // display's XCB connection
     Window root;
     int screen;
-    XRRScreenResources *screen_resources;
-    output_info_t *outputs;
+    output_info_t *outputs;  // Connected outputs
     int num_outputs;
+    x11_mode_t *modes;  // From the last screen resources, to resolve CRTC modes
+    int num_modes;
+    uint32_t config_timestamp;
+    RROutput manager_output;  // XR-Manager control output (None until found)
+    Atom framebuffer_atom;  // FRAMEBUFFER_ID
     int rr_event_base;
     int rr_error_base;
 } x11_context_t;
 
-x11_context_t *x11_context_create(void);
+// select_events: receive RandR change events (x11_context_process_events() must then be
+// called whenever the connection is readable); a context that only sets up outputs
+// leaves them off so its event queue does not grow
+x11_context_t *x11_context_create(bool select_events);
 void x11_context_destroy(x11_context_t *ctx);
 int x11_context_refresh_outputs(x11_context_t *ctx);
 output_info_t *x11_context_find_output(x11_context_t *ctx, RROutput output_id);
@@ -47,6 +64,9 @@ void x11_context_set_virtual_output_modes(x11_context_t *ctx, RROutput output_id
                                           const int *refresh_rates, int num_modes);
 void x11_context_delete_virtual_output(x11_context_t *ctx, RROutput output_id);
 int x11_context_get_fd(x11_context_t *ctx);
+// Apply pending RandR events to the output table: CRTC changes in place, changed outputs
+// re-fetched in one batch, a full refresh only when the screen or mode list changed.
+// prev_* hold each output's state before the batch. Returns 1 if outputs changed.
 int x11_context_process_events(x11_context_t *ctx);
 
 #endif // X11_OUTPUT_H
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 
 #define DEFAULT_TV_PORT 4321
+#define STREAMER_MAX_RECEIVERS 8  // TVs one streamer can send the same output to
+#define STREAMER_DEFAULT_RESUME_GRACE_MS 10000  // How long a dropped receiver's session is kept
 
 typedef struct x11_streamer x11_streamer_t;
 
@@ -17,19 +19,34 @@ typedef enum {
 // Streamer options (passed from command-line to streamer creation)
 typedef struct {
     bool use_broadcast;      // Use broadcast discovery (default: true)
-    const char *host;        // Direct host to connect to (if not NULL, disables broadcast)
-    int port;                // Port number (default: DEFAULT_TV_PORT)
+    const char *hosts[STREAMER_MAX_RECEIVERS];  // Hosts to connect to directly (any disables broadcast)
+    int ports[STREAMER_MAX_RECEIVERS];          // Port for each host
+    int num_hosts;           // Number of hosts (0 = broadcast discovery)
+    int port;                // Port number for broadcast discovery (default: DEFAULT_TV_PORT)
     int broadcast_timeout_ms; // Timeout for broadcast discovery in milliseconds (default: 5000)
     const char *program_name; // Program name (for error messages, extracted from argv[0])
     bool force_encrypt;      // Force encryption for session (overrides autodetect)
     bool force_no_encrypt;   // Disable encryption for session (overrides autodetect)
     uint16_t pin;            // PIN from command line (0xFFFF if not provided, valid PINs are 0-9999)
     streamer_display_mode_t display_mode; // Display mode: extend (default) or mirror
+    int max_backlog_ms;      // Queued milliseconds before stale frames are replaced (default: 100)
+    bool udp_video;          // Offer UDP channel for video frames (unencrypted sessions only)
+    int fec_group;           // UDP FEC: data packets per parity packet, FEC_GROUP_AUTO (default) or FEC_GROUP_OFF
+    int resume_grace_ms;     // Keep a dropped receiver's session this long while reconnecting (0 = off)
+    uint64_t start_us;       // Process start on the audio_get_timestamp_us() clock (0 = streamer creation)
+    const char *frame_source; // Stream this source instead of an X11 output (NULL = X11; see frame_source.h)
+    const char *record_path;  // Record captured frames to this file for replay (NULL = off; see session_recording.h)
+    bool record_full_frames;  // Record every frame whole instead of only changed tiles
+    bool latency_stamp;      // Stamp capture times into frame_source frames (glass-to-glass latency tests)
+    bool pcm_audio;          // Send PCM audio even to receivers that can decode Opus
+    int audio_fragment_ms;   // PulseAudio capture fragment, 5-20 ms (0 = AUDIO_CAPTURE_DEFAULT_FRAGMENT_MS)
+    const char *audio_source; // PulseAudio source to record (NULL = monitor of the default sink)
 } x11_streamer_options_t;
 
-// Create X11 streamer that connects to TV receiver
-// If options->host is NULL and options->use_broadcast is true, uses broadcast discovery
-// If options->host is set, connects directly to that host (broadcast disabled)
+// Create X11 streamer that connects to TV receivers
+// If options->num_hosts is 0 and options->use_broadcast is true, uses broadcast discovery
+// Otherwise connects directly to every host (broadcast disabled); the output is captured
+// and encoded once and sent to all of them
 x11_streamer_t *x11_streamer_create(const x11_streamer_options_t *options);
 void x11_streamer_destroy(x11_streamer_t *streamer);
 int x11_streamer_run(x11_streamer_t *streamer);
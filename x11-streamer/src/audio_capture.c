@@ -1,19 +1,56 @@
 #include "audio_capture.h"
 #include <pulse/pulseaudio.h>
-#include <pulse/simple.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define AUDIO_CHUNK_MS 10     // audio_capture_read() hands out 10 ms (one Opus frame)
+#define AUDIO_RING_MS 200     // Captured audio kept before the oldest is dropped
+#define ANCHOR_SMOOTHING 32   // Latency measurements averaged into the timestamp anchor
+#define ANCHOR_RESET_US 50000 // A jump this large (suspend, xrun) re-anchors outright
+#define FALLBACK_RATE 48000   // When the source's own rate cannot be used
+#define MIN_NATIVE_RATE 8000
+#define MAX_NATIVE_RATE 192000
 
 struct audio_capture {
-    pa_simple *pa;
-    uint32_t sample_rate;
+    pa_threaded_mainloop *mainloop;
+    pa_context *context;
+    pa_stream *stream;
+    uint32_t sample_rate;  // 0 until the first start when recording at the source's rate
     uint16_t channels;
     uint16_t format;
+    uint32_t fragment_ms;
+    char *source;  // Source to record (NULL = monitor of the default sink)
     bool running;
+    pthread_mutex_t state_mutex;  // Serializes start/stop (each receiver thread starts capture)
+    int event_fd;  // Readable while at least one chunk is buffered
+
+    // Ring buffer filled by the read callback (mainloop thread), drained by audio_capture_read()
     pthread_mutex_t mutex;
+    uint8_t *ring;
+    size_t ring_size;
+    size_t ring_head;  // Next byte to read
+    size_t ring_fill;
+    size_t chunk_size;
+    uint64_t dropped_bytes;  // Overwritten because nobody read them in time
+    size_t frame_bytes;      // One sample per channel
+    uint64_t samples_written;  // Sample frames delivered since start (ring holds the newest)
+
+    // Sample position -> capture time: sample n was captured at
+    // anchor_us + (n - anchor_sample) / sample_rate, refined from every latency measurement
+    bool anchored;
+    uint64_t anchor_sample;
+    double anchor_us;
+
+    // pa_stream_get_latency() samples, taken in the read callback
+    uint64_t latency_us;
+    uint64_t latency_max_us;
+    uint64_t latency_sum_us;
+    uint64_t latency_samples;
 };
 
 static pa_sample_format_t format_to_pa_format(uint16_t format)
@@ -28,31 +65,288 @@ static pa_sample_format_t format_to_pa_format(uint16_t format)
     }
 }
 
+// Bytes in ms milliseconds of audio (whole sample frames)
+static size_t bytes_for_ms(const audio_capture_t *capture, uint32_t ms)
+{
+    return (size_t)capture->sample_rate * ms / 1000 * capture->frame_bytes;
+}
+
+// Size the ring and chunks for the sample rate (ring empty, not yet recording)
+// Returns 0 on success, -1 on allocation failure
+static int capture_set_rate(audio_capture_t *capture, uint32_t sample_rate)
+{
+    pthread_mutex_lock(&capture->mutex);
+    capture->sample_rate = sample_rate;
+    capture->chunk_size = bytes_for_ms(capture, AUDIO_CHUNK_MS);
+    capture->ring_size = bytes_for_ms(capture, AUDIO_RING_MS);
+    capture->ring_head = 0;
+    capture->ring_fill = 0;
+    free(capture->ring);
+    capture->ring = malloc(capture->ring_size);
+    int ret = capture->ring ? 0 : -1;
+    pthread_mutex_unlock(&capture->mutex);
+    return ret;
+}
+
 audio_capture_t *audio_capture_create(uint32_t sample_rate, uint16_t channels, uint16_t format)
 {
     audio_capture_t *capture = calloc(1, sizeof(audio_capture_t));
     if (!capture)
         return NULL;
 
-    capture->sample_rate = sample_rate;
     capture->channels = channels;
     capture->format = format;
+    capture->fragment_ms = AUDIO_CAPTURE_DEFAULT_FRAGMENT_MS;
     capture->running = false;
+    capture->frame_bytes = (format == AUDIO_FORMAT_PCM_S32LE ? 4 : 2) * channels;
     pthread_mutex_init(&capture->mutex, NULL);
+    pthread_mutex_init(&capture->state_mutex, NULL);
+    capture->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (capture->event_fd < 0 || (sample_rate && capture_set_rate(capture, sample_rate) < 0)) {
+        if (capture->event_fd >= 0)
+            close(capture->event_fd);
+        pthread_mutex_destroy(&capture->mutex);
+        pthread_mutex_destroy(&capture->state_mutex);
+        free(capture);
+        return NULL;
+    }
 
     return capture;
 }
 
-int audio_capture_start(audio_capture_t *capture)
+int audio_capture_set_fragment_ms(audio_capture_t *capture, uint32_t fragment_ms)
+{
+    if (!capture || fragment_ms < AUDIO_CAPTURE_MIN_FRAGMENT_MS || fragment_ms > AUDIO_CAPTURE_MAX_FRAGMENT_MS)
+        return -1;
+    capture->fragment_ms = fragment_ms;
+    return 0;
+}
+
+int audio_capture_set_source(audio_capture_t *capture, const char *source)
 {
     if (!capture)
         return -1;
+    char *copy = source ? strdup(source) : NULL;
+    if (source && !copy)
+        return -1;
+    free(capture->source);
+    capture->source = copy;
+    return 0;
+}
+
+// Mainloop callbacks run with the mainloop lock held
+
+static void context_state_cb(pa_context *context, void *userdata)
+{
+    (void)context;
+    pa_threaded_mainloop_signal(((audio_capture_t *)userdata)->mainloop, 0);
+}
+
+static void stream_state_cb(pa_stream *stream, void *userdata)
+{
+    (void)stream;
+    pa_threaded_mainloop_signal(((audio_capture_t *)userdata)->mainloop, 0);
+}
+
+typedef struct {
+    audio_capture_t *capture;
+    char *monitor;  // "<default sink>.monitor" (NULL if there is no default sink)
+} monitor_lookup_t;
+
+static void server_info_cb(pa_context *context, const pa_server_info *info, void *userdata)
+{
+    (void)context;
+    monitor_lookup_t *lookup = userdata;
+    if (info && info->default_sink_name) {
+        size_t len = strlen(info->default_sink_name) + sizeof(".monitor");
+        lookup->monitor = malloc(len);
+        if (lookup->monitor)
+            snprintf(lookup->monitor, len, "%s.monitor", info->default_sink_name);
+    }
+    pa_threaded_mainloop_signal(lookup->capture->mainloop, 0);
+}
+
+typedef struct {
+    audio_capture_t *capture;
+    uint32_t rate;  // 0 if the source was not found
+} rate_lookup_t;
+
+static void source_info_cb(pa_context *context, const pa_source_info *info, int eol, void *userdata)
+{
+    (void)context;
+    rate_lookup_t *lookup = userdata;
+    if (!eol && info)
+        lookup->rate = info->sample_spec.rate;
+    pa_threaded_mainloop_signal(lookup->capture->mainloop, 0);
+}
+
+// Rate the source records at, so the server does not resample what we capture
+// Rates that are not a whole number of samples per 10 ms chunk fall back to FALLBACK_RATE
+static uint32_t native_rate(audio_capture_t *capture, const char *source)
+{
+    rate_lookup_t lookup = { .capture = capture, .rate = 0 };
+    pa_operation *op = pa_context_get_source_info_by_name(capture->context, source ? source : "@DEFAULT_SOURCE@",
+                                                          source_info_cb, &lookup);
+    if (op) {
+        while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
+            pa_threaded_mainloop_wait(capture->mainloop);
+        pa_operation_unref(op);
+    }
+    if (lookup.rate < MIN_NATIVE_RATE || lookup.rate > MAX_NATIVE_RATE || lookup.rate % (1000 / AUDIO_CHUNK_MS)) {
+        fprintf(stderr, "Warning: Cannot record at the source's rate (%u Hz), using %d Hz\n", lookup.rate,
+                FALLBACK_RATE);
+        return FALLBACK_RATE;
+    }
+    return lookup.rate;
+}
+
+// Copy captured audio into the ring (NULL data = hole, recorded as silence)
+static void ring_write(audio_capture_t *capture, const void *data, size_t len)
+{
+    capture->samples_written += len / capture->frame_bytes;
+
+    // Keep only the newest ring_size bytes
+    if (len > capture->ring_size) {
+        if (data)
+            data = (const uint8_t *)data + (len - capture->ring_size);
+        capture->dropped_bytes += len - capture->ring_size;
+        len = capture->ring_size;
+    }
+    if (capture->ring_fill + len > capture->ring_size) {
+        size_t drop = capture->ring_fill + len - capture->ring_size;
+        capture->ring_head = (capture->ring_head + drop) % capture->ring_size;
+        capture->ring_fill -= drop;
+        capture->dropped_bytes += drop;
+    }
+
+    size_t tail = (capture->ring_head + capture->ring_fill) % capture->ring_size;
+    size_t first = capture->ring_size - tail < len ? capture->ring_size - tail : len;
+    if (data) {
+        memcpy(capture->ring + tail, data, first);
+        memcpy(capture->ring, (const uint8_t *)data + first, len - first);
+    } else {
+        memset(capture->ring + tail, 0, first);
+        memset(capture->ring, 0, len - first);
+    }
+    capture->ring_fill += len;
+}
+
+// The newest sample in the ring was captured at captured_us (now minus the measured
+// latency). Measurements jitter by a fragment, so they are averaged into the anchor;
+// the slow correction also tracks the sound card clock drifting from CLOCK_MONOTONIC.
+static void anchor_update(audio_capture_t *capture, double captured_us)
+{
+    uint64_t sample = capture->samples_written;
+    double predicted_us = capture->anchor_us +
+                          (double)(int64_t)(sample - capture->anchor_sample) * 1e6 / capture->sample_rate;
+    double error_us = captured_us - predicted_us;
+
+    if (!capture->anchored || error_us > ANCHOR_RESET_US || error_us < -ANCHOR_RESET_US) {
+        capture->anchor_us = captured_us;
+        capture->anchored = true;
+    } else {
+        capture->anchor_us = predicted_us + error_us / ANCHOR_SMOOTHING;
+    }
+    capture->anchor_sample = sample;
+}
+
+static void stream_read_cb(pa_stream *stream, size_t nbytes, void *userdata)
+{
+    (void)nbytes;
+    audio_capture_t *capture = userdata;
 
     pthread_mutex_lock(&capture->mutex);
+    for (;;) {
+        const void *data;
+        size_t len;
+        if (pa_stream_peek(stream, &data, &len) < 0 || len == 0)
+            break;
+        ring_write(capture, data, len);
+        pa_stream_drop(stream);
+    }
+    bool ready = capture->ring_fill >= capture->chunk_size;
 
-    if (capture->running) {
-        pthread_mutex_unlock(&capture->mutex);
-        return 0;  // Already running
+    // Time from the source to our read pointer (device buffer + server queue)
+    pa_usec_t latency;
+    int negative = 0;
+    if (pa_stream_get_latency(stream, &latency, &negative) == 0) {
+        capture->latency_us = negative ? 0 : latency;
+        capture->latency_sum_us += capture->latency_us;
+        capture->latency_samples++;
+        if (capture->latency_us > capture->latency_max_us)
+            capture->latency_max_us = capture->latency_us;
+        anchor_update(capture, (double)audio_get_timestamp_us() - capture->latency_us);
+    }
+    pthread_mutex_unlock(&capture->mutex);
+
+    if (ready) {
+        uint64_t one = 1;
+        if (write(capture->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            perror("write(audio eventfd)");
+    }
+}
+
+// Tear down the stream, context and mainloop (whatever exists)
+static void capture_disconnect(audio_capture_t *capture)
+{
+    if (capture->mainloop)
+        pa_threaded_mainloop_stop(capture->mainloop);
+    if (capture->stream) {
+        pa_stream_disconnect(capture->stream);
+        pa_stream_unref(capture->stream);
+        capture->stream = NULL;
+    }
+    if (capture->context) {
+        pa_context_disconnect(capture->context);
+        pa_context_unref(capture->context);
+        capture->context = NULL;
+    }
+    if (capture->mainloop) {
+        pa_threaded_mainloop_free(capture->mainloop);
+        capture->mainloop = NULL;
+    }
+}
+
+// Connect the context and record stream (mainloop lock held)
+// Returns 0 on success, -1 on error
+static int capture_connect(audio_capture_t *capture)
+{
+    capture->context = pa_context_new(pa_threaded_mainloop_get_api(capture->mainloop), "x11-streamer");
+    if (!capture->context)
+        return -1;
+    pa_context_set_state_callback(capture->context, context_state_cb, capture);
+    if (pa_context_connect(capture->context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
+        fprintf(stderr, "Failed to connect to PulseAudio: %s\n", pa_strerror(pa_context_errno(capture->context)));
+        return -1;
+    }
+    pa_context_state_t context_state;
+    while ((context_state = pa_context_get_state(capture->context)) != PA_CONTEXT_READY) {
+        if (!PA_CONTEXT_IS_GOOD(context_state)) {
+            fprintf(stderr, "Failed to connect to PulseAudio: %s\n", pa_strerror(pa_context_errno(capture->context)));
+            return -1;
+        }
+        pa_threaded_mainloop_wait(capture->mainloop);
+    }
+
+    // Desktop sound comes from the default sink's monitor, not the default source (a microphone)
+    monitor_lookup_t lookup = { .capture = capture, .monitor = NULL };
+    if (!capture->source) {
+        pa_operation *op = pa_context_get_server_info(capture->context, server_info_cb, &lookup);
+        if (op) {
+            while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
+                pa_threaded_mainloop_wait(capture->mainloop);
+            pa_operation_unref(op);
+        }
+        if (!lookup.monitor)
+            fprintf(stderr, "Warning: No default sink, recording the default source\n");
+    }
+    char *monitor = lookup.monitor;
+    const char *source = capture->source ? capture->source : monitor;
+
+    // The rate is settled on the first start; a later default sink is resampled by the server
+    if (capture->sample_rate == 0 && capture_set_rate(capture, native_rate(capture, source)) < 0) {
+        free(monitor);
+        return -1;
     }
 
     pa_sample_spec ss = {
@@ -60,35 +354,77 @@ int audio_capture_start(audio_capture_t *capture)
         .rate = capture->sample_rate,
         .channels = capture->channels
     };
+    capture->stream = pa_stream_new(capture->context, "Audio capture", &ss, NULL);
+    if (!capture->stream) {
+        free(monitor);
+        return -1;
+    }
+    pa_stream_set_state_callback(capture->stream, stream_state_cb, capture);
+    pa_stream_set_read_callback(capture->stream, stream_read_cb, capture);
 
+    // fragsize is how much the server batches per delivery: the capture latency floor
     pa_buffer_attr ba = {
         .maxlength = (uint32_t)-1,
         .tlength = (uint32_t)-1,
         .prebuf = (uint32_t)-1,
         .minreq = (uint32_t)-1,
-        .fragsize = capture->sample_rate * capture->channels * sizeof(int16_t) / 10  // 100ms fragments for low latency
+        .fragsize = (uint32_t)bytes_for_ms(capture, capture->fragment_ms)
     };
+    int ret = pa_stream_connect_record(capture->stream, source, &ba,
+                                       PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING |
+                                       PA_STREAM_AUTO_TIMING_UPDATE);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to record from %s: %s\n", source ? source : "default source",
+                pa_strerror(pa_context_errno(capture->context)));
+        free(monitor);
+        return -1;
+    }
+    pa_stream_state_t stream_state;
+    while ((stream_state = pa_stream_get_state(capture->stream)) != PA_STREAM_READY) {
+        if (!PA_STREAM_IS_GOOD(stream_state)) {
+            fprintf(stderr, "Failed to record from %s: %s\n", source ? source : "default source",
+                    pa_strerror(pa_context_errno(capture->context)));
+            free(monitor);
+            return -1;
+        }
+        pa_threaded_mainloop_wait(capture->mainloop);
+    }
 
-    int error;
-    capture->pa = pa_simple_new(NULL,                    // server
-                                 "x11-streamer",         // application name
-                                 PA_STREAM_RECORD,       // direction
-                                 NULL,                   // device (NULL = default)
-                                 "Audio capture",        // stream name
-                                 &ss,                    // sample spec
-                                 NULL,                   // channel map (NULL = default)
-                                 &ba,                    // buffer attributes
-                                 &error);
-
-    if (!capture->pa) {
-        fprintf(stderr, "Failed to create PulseAudio connection: %s\n", pa_strerror(error));
-        pthread_mutex_unlock(&capture->mutex);
+    printf("Audio capture from %s, %u Hz, %u ms fragments\n", source ? source : "default source",
+           capture->sample_rate, capture->fragment_ms);
+    free(monitor);
+    return 0;
+}
+
+int audio_capture_start(audio_capture_t *capture)
+{
+    if (!capture)
         return -1;
+
+    pthread_mutex_lock(&capture->state_mutex);
+
+    if (capture->running) {
+        pthread_mutex_unlock(&capture->state_mutex);
+        return 0;  // Already running
     }
 
-    capture->running = true;
-    pthread_mutex_unlock(&capture->mutex);
+    capture->mainloop = pa_threaded_mainloop_new();
+    if (!capture->mainloop) {
+        pthread_mutex_unlock(&capture->state_mutex);
+        return -1;
+    }
 
+    pa_threaded_mainloop_lock(capture->mainloop);
+    if (pa_threaded_mainloop_start(capture->mainloop) < 0 || capture_connect(capture) < 0) {
+        pa_threaded_mainloop_unlock(capture->mainloop);
+        capture_disconnect(capture);
+        pthread_mutex_unlock(&capture->state_mutex);
+        return -1;
+    }
+    pa_threaded_mainloop_unlock(capture->mainloop);
+
+    capture->running = true;
+    pthread_mutex_unlock(&capture->state_mutex);
     return 0;
 }
 
@@ -97,55 +433,104 @@ void audio_capture_stop(audio_capture_t *capture)
     if (!capture)
         return;
 
-    pthread_mutex_lock(&capture->mutex);
-    if (capture->pa) {
-        pa_simple_free(capture->pa);
-        capture->pa = NULL;
+    pthread_mutex_lock(&capture->state_mutex);
+    if (!capture->running) {
+        pthread_mutex_unlock(&capture->state_mutex);
+        return;
     }
+    capture_disconnect(capture);
     capture->running = false;
+    pthread_mutex_unlock(&capture->state_mutex);
+
+    pthread_mutex_lock(&capture->mutex);
+    if (capture->latency_samples)
+        printf("Audio capture latency: avg %.1f ms, max %.1f ms (%.1f ms of audio dropped)\n",
+               capture->latency_sum_us / 1000.0 / capture->latency_samples, capture->latency_max_us / 1000.0,
+               capture->dropped_bytes / (double)bytes_for_ms(capture, 1));
+    capture->ring_head = 0;
+    capture->ring_fill = 0;
+    capture->samples_written = 0;
+    capture->anchored = false;
+    uint64_t count;
+    if (read(capture->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("read(audio eventfd)");
     pthread_mutex_unlock(&capture->mutex);
 }
 
-int audio_capture_read(audio_capture_t *capture, void **data, uint32_t *size)
+int audio_capture_read(audio_capture_t *capture, void **data, uint32_t *size, uint64_t *timestamp_us)
 {
     if (!capture || !data || !size)
         return -1;
 
-    pthread_mutex_lock(&capture->mutex);
+    if (!capture->running)
+        return -1;
 
-    if (!capture->running || !capture->pa) {
+    pthread_mutex_lock(&capture->mutex);
+    if (capture->ring_fill < capture->chunk_size) {
+        // Nothing ready: quiet the eventfd until the read callback adds more
+        uint64_t count;
+        if (read(capture->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            perror("read(audio eventfd)");
         pthread_mutex_unlock(&capture->mutex);
-        return -1;
+        return 0;
     }
 
-    // Read a small chunk for low latency (about 10ms of audio)
-    size_t bytes_per_sample = (capture->format == AUDIO_FORMAT_PCM_S32LE) ? 4 : 2;
-    size_t chunk_size = capture->sample_rate * capture->channels * bytes_per_sample / 100;  // 10ms
-
-    void *buffer = malloc(chunk_size);
+    void *buffer = malloc(capture->chunk_size);
     if (!buffer) {
         pthread_mutex_unlock(&capture->mutex);
         return -1;
     }
 
-    int error;
-    int ret = pa_simple_read(capture->pa, buffer, chunk_size, &error);
+    // Stamp the chunk by the position of its first sample
+    if (timestamp_us) {
+        uint64_t sample = capture->samples_written - capture->ring_fill / capture->frame_bytes;
+        if (capture->anchored)
+            *timestamp_us = (uint64_t)(capture->anchor_us + (double)(int64_t)(sample - capture->anchor_sample) *
+                                                                1e6 / capture->sample_rate);
+        else
+            *timestamp_us = audio_get_timestamp_us() -
+                            (uint64_t)(capture->samples_written - sample) * 1000000 / capture->sample_rate;
+    }
+
+    size_t first = capture->ring_size - capture->ring_head;
+    if (first > capture->chunk_size)
+        first = capture->chunk_size;
+    memcpy(buffer, capture->ring + capture->ring_head, first);
+    memcpy((uint8_t *)buffer + first, capture->ring, capture->chunk_size - first);
+    capture->ring_head = (capture->ring_head + capture->chunk_size) % capture->ring_size;
+    capture->ring_fill -= capture->chunk_size;
     pthread_mutex_unlock(&capture->mutex);
 
-    if (ret < 0) {
-        if (error == PA_ERR_NOENTITY) {
-            // No data available yet, return 0
-            free(buffer);
-            return 0;
-        }
-        fprintf(stderr, "PulseAudio read error: %s\n", pa_strerror(error));
-        free(buffer);
+    *data = buffer;
+    *size = capture->chunk_size;
+    return capture->chunk_size;
+}
+
+uint32_t audio_capture_get_sample_rate(audio_capture_t *capture)
+{
+    if (!capture)
+        return 0;
+    pthread_mutex_lock(&capture->mutex);
+    uint32_t rate = capture->sample_rate;
+    pthread_mutex_unlock(&capture->mutex);
+    return rate;
+}
+
+int audio_capture_get_fd(audio_capture_t *capture)
+{
+    return capture ? capture->event_fd : -1;
+}
+
+int audio_capture_get_latency_us(audio_capture_t *capture, uint64_t *latency_us)
+{
+    if (!capture || !latency_us || !capture->running)
         return -1;
-    }
 
-    *data = buffer;
-    *size = chunk_size;
-    return chunk_size;
+    pthread_mutex_lock(&capture->mutex);
+    bool valid = capture->latency_samples > 0;
+    *latency_us = capture->latency_us;
+    pthread_mutex_unlock(&capture->mutex);
+    return valid ? 0 : -1;
 }
 
 void audio_capture_destroy(audio_capture_t *capture)
@@ -155,6 +540,10 @@ void audio_capture_destroy(audio_capture_t *capture)
 
     audio_capture_stop(capture);
     pthread_mutex_destroy(&capture->mutex);
+    pthread_mutex_destroy(&capture->state_mutex);
+    close(capture->event_fd);
+    free(capture->ring);
+    free(capture->source);
     free(capture);
 }
 
@@ -166,4 +555,3 @@ uint64_t audio_get_timestamp_us(void)
     }
     return 0;
 }
-
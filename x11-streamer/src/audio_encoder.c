@@ -0,0 +1,66 @@
+#include "audio_encoder.h"
+#include <opus/opus.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+struct audio_encoder {
+    OpusEncoder *opus;
+    uint16_t channels;
+    uint32_t frame_samples;  // Per channel, 10 ms
+};
+
+audio_encoder_t *audio_encoder_create(uint32_t sample_rate, uint16_t channels, uint32_t bitrate)
+{
+    audio_encoder_t *enc = calloc(1, sizeof(audio_encoder_t));
+    if (!enc)
+        return NULL;
+
+    // Restricted low delay drops the speech (SILK) layer and its lookahead: 2.5 ms algorithmic delay
+    int error;
+    enc->opus = opus_encoder_create((opus_int32)sample_rate, channels, OPUS_APPLICATION_RESTRICTED_LOWDELAY,
+                                    &error);
+    if (!enc->opus) {
+        fprintf(stderr, "Failed to create Opus encoder: %s\n", opus_strerror(error));
+        free(enc);
+        return NULL;
+    }
+    enc->channels = channels;
+    enc->frame_samples = sample_rate / 100;
+
+    opus_encoder_ctl(enc->opus, OPUS_SET_BITRATE((opus_int32)bitrate));
+    opus_encoder_ctl(enc->opus, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+    opus_encoder_ctl(enc->opus, OPUS_SET_DTX(1));
+
+    printf("Opus encoder: %u Hz, %u channels, %u kbps, 10 ms frames\n",
+           sample_rate, channels, bitrate / 1000);
+    return enc;
+}
+
+void audio_encoder_destroy(audio_encoder_t *encoder)
+{
+    if (!encoder)
+        return;
+    opus_encoder_destroy(encoder->opus);
+    free(encoder);
+}
+
+uint32_t audio_encoder_get_frame_samples(audio_encoder_t *encoder)
+{
+    return encoder ? encoder->frame_samples : 0;
+}
+
+int audio_encoder_encode(audio_encoder_t *encoder, const int16_t *pcm, uint32_t samples,
+                         uint8_t *packet, size_t packet_size)
+{
+    if (!encoder || !pcm || !packet || samples != encoder->frame_samples)
+        return -1;
+
+    opus_int32 len = opus_encode(encoder->opus, pcm, (int)samples, packet, (opus_int32)packet_size);
+    if (len < 0) {
+        fprintf(stderr, "Opus encode error: %s\n", opus_strerror(len));
+        return -1;
+    }
+
+    // With DTX, packets of 1-2 bytes mark silence the decoder fills in on its own
+    return len <= 2 ? 0 : (int)len;
+}
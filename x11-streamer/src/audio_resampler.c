@@ -0,0 +1,333 @@
+#include "audio_resampler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define PASSBAND 0.455     // Cutoff as a fraction of the lower rate (transition band centred below Nyquist)
+#define KAISER_BETA 8.96   // About 90 dB stopband with AUDIO_RESAMPLER_TAPS taps
+#define TAP_ALIGN 8        // Taps per phase are padded to a whole number of AVX vectors
+
+struct audio_resampler {
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint16_t in_channels;
+    uint16_t out_channels;
+    uint32_t up;     // out_rate / in_rate = up / down, reduced
+    uint32_t down;
+    uint32_t taps;   // Per phase (0 = rates match, channels are only converted)
+    float *coeffs;   // up phases of `taps`, each ordered oldest input first
+    bool simd;
+
+    // Planar input per output channel: taps - 1 frames of history, then the current chunk
+    float *history[AUDIO_RESAMPLER_MAX_CHANNELS];
+    uint32_t history_cap;  // Frames per channel
+
+    // Next output: newest input it uses (index into history) and its phase
+    uint32_t pos;
+    uint32_t phase;
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind (Kaiser window)
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+// Design the prototype low-pass at the upsampled rate and split it into phases.
+// Tap m of the prototype sits at m - taps / 2 * up, so output k is the input
+// interpolated at k * down / up - taps / 2: the delay is a whole number of input frames.
+static int design_filter(audio_resampler_t *r)
+{
+    uint32_t up = r->up, taps = r->taps;
+    r->coeffs = aligned_alloc(32, (size_t)up * taps * sizeof(float));
+    if (!r->coeffs)
+        return -1;
+
+    double cutoff = PASSBAND * (r->up < r->down ? (double)r->up / r->down : 1.0);  // Cycles per input frame
+    double fc = cutoff / up;                                                           // Per upsampled frame
+    double half = (double)taps / 2 * up;
+    double i0_beta = bessel_i0(KAISER_BETA);
+
+    for (uint32_t p = 0; p < up; p++) {
+        float *row = r->coeffs + (size_t)p * taps;
+        double sum = 0;
+        double row_d[AUDIO_RESAMPLER_MAX_TAPS];
+        for (uint32_t k = 0; k < taps; k++) {
+            // row[k] weights the input taps - 1 - k frames before the newest
+            double x = p + (double)(taps - 1 - k) * up - half;
+            double sinc = x == 0 ? 1.0 : sin(2 * M_PI * fc * x) / (2 * M_PI * fc * x);
+            double w = x / half;
+            double window = w <= -1 || w >= 1 ? 0 : bessel_i0(KAISER_BETA * sqrt(1 - w * w)) / i0_beta;
+            row_d[k] = sinc * window;
+            sum += row_d[k];
+        }
+        // Unity gain in every phase, so DC and low tones carry no phase-dependent ripple
+        for (uint32_t k = 0; k < taps; k++)
+            row[k] = (float)(row_d[k] / sum);
+    }
+    return 0;
+}
+
+audio_resampler_t *audio_resampler_create(uint32_t in_rate, uint16_t in_channels,
+                                          uint32_t out_rate, uint16_t out_channels)
+{
+    if (in_rate == 0 || out_rate == 0 || in_channels == 0 || out_channels == 0 ||
+        in_channels > AUDIO_RESAMPLER_MAX_CHANNELS || out_channels > AUDIO_RESAMPLER_MAX_CHANNELS)
+        return NULL;
+
+    uint32_t g = gcd(in_rate, out_rate);
+    if (out_rate / g > AUDIO_RESAMPLER_MAX_PHASES) {
+        fprintf(stderr, "Audio resampler: %u -> %u Hz needs %u phases (max %d)\n",
+                in_rate, out_rate, out_rate / g, AUDIO_RESAMPLER_MAX_PHASES);
+        return NULL;
+    }
+
+    audio_resampler_t *r = calloc(1, sizeof(audio_resampler_t));
+    if (!r)
+        return NULL;
+    r->in_rate = in_rate;
+    r->out_rate = out_rate;
+    r->in_channels = in_channels;
+    r->out_channels = out_channels;
+    r->up = out_rate / g;
+    r->down = in_rate / g;
+    r->simd = true;
+
+    if (r->up != r->down) {
+        // Downsampling narrows the passband; keep the transition as many input frames wide
+        uint64_t taps = (uint64_t)AUDIO_RESAMPLER_TAPS * (r->down > r->up ? r->down : r->up) / r->up;
+        taps = (taps + TAP_ALIGN - 1) / TAP_ALIGN * TAP_ALIGN;
+        r->taps = taps > AUDIO_RESAMPLER_MAX_TAPS ? AUDIO_RESAMPLER_MAX_TAPS : (uint32_t)taps;
+        if (design_filter(r) < 0) {
+            free(r);
+            return NULL;
+        }
+    }
+    audio_resampler_reset(r);
+    return r;
+}
+
+void audio_resampler_destroy(audio_resampler_t *resampler)
+{
+    if (!resampler)
+        return;
+    for (int c = 0; c < AUDIO_RESAMPLER_MAX_CHANNELS; c++)
+        free(resampler->history[c]);
+    free(resampler->coeffs);
+    free(resampler);
+}
+
+void audio_resampler_reset(audio_resampler_t *resampler)
+{
+    if (!resampler || resampler->taps == 0)
+        return;
+    // Silence before the first sample, which is the newest input of the first output
+    if (resampler->history_cap)
+        for (int c = 0; c < resampler->out_channels; c++)
+            memset(resampler->history[c], 0, (resampler->taps - 1) * sizeof(float));
+    resampler->pos = resampler->taps - 1;
+    resampler->phase = 0;
+}
+
+uint32_t audio_resampler_max_output(const audio_resampler_t *resampler, uint32_t in_frames)
+{
+    if (!resampler)
+        return 0;
+    return (uint32_t)(((uint64_t)in_frames * resampler->up + resampler->down - 1) / resampler->down) + 1;
+}
+
+uint32_t audio_resampler_delay_frames(const audio_resampler_t *resampler)
+{
+    return resampler ? resampler->taps / 2 : 0;
+}
+
+void audio_resampler_set_simd(audio_resampler_t *resampler, bool enabled)
+{
+    if (resampler)
+        resampler->simd = enabled;
+}
+
+const char *audio_resampler_simd_name(void)
+{
+#if defined(__AVX__) && defined(__FMA__)
+    return "AVX/FMA";
+#elif defined(__AVX__)
+    return "AVX";
+#elif defined(__SSE__)
+    return "SSE";
+#elif defined(__ARM_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+static float dot_scalar(const float *x, const float *h, uint32_t n)
+{
+    float sum = 0;
+    for (uint32_t i = 0; i < n; i++)
+        sum += x[i] * h[i];
+    return sum;
+}
+
+// n is a multiple of TAP_ALIGN; h is 32-byte aligned, x is not
+static float dot_simd(const float *x, const float *h, uint32_t n)
+{
+#if defined(__AVX__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+#ifdef __FMA__
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_load_ps(h + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_load_ps(h + i + 8), acc1);
+#else
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_load_ps(h + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), _mm256_load_ps(h + i + 8)));
+#endif
+    }
+    if (i < n)
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_load_ps(h + i)));
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(__SSE__)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_load_ps(h + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_load_ps(h + i + 4)));
+    }
+    __m128 sum = _mm_add_ps(acc0, acc1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(__ARM_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    for (uint32_t i = 0; i < n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(h + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    return dot_scalar(x, h, n);
+#endif
+}
+
+static int16_t to_s16(float v)
+{
+    v *= 32768.0f;
+    if (v >= 32767.0f)
+        return 32767;
+    if (v <= -32768.0f)
+        return -32768;
+    return (int16_t)lrintf(v);
+}
+
+// Input sample for output channel c of frame i (channel conversion)
+static float input_sample(const audio_resampler_t *r, const int16_t *in, uint32_t i, int c)
+{
+    const int16_t *frame = in + (size_t)i * r->in_channels;
+    if (r->out_channels == 1 && r->in_channels > 1) {
+        int32_t sum = 0;
+        for (int k = 0; k < r->in_channels; k++)
+            sum += frame[k];
+        return (float)sum / (32768.0f * r->in_channels);
+    }
+    return frame[c % r->in_channels] / 32768.0f;
+}
+
+int audio_resampler_process(audio_resampler_t *resampler, const int16_t *in, uint32_t in_frames,
+                            uint64_t in_timestamp_us, int16_t *out, uint32_t out_capacity,
+                            uint64_t *out_timestamp_us)
+{
+    audio_resampler_t *r = resampler;
+    if (!r || (!in && in_frames) || !out)
+        return -1;
+    int channels = r->out_channels;
+
+    if (r->taps == 0) {
+        // Same rate: channel conversion only
+        if (in_frames > out_capacity)
+            return -1;
+        for (uint32_t i = 0; i < in_frames; i++)
+            for (int c = 0; c < channels; c++)
+                out[(size_t)i * channels + c] = to_s16(input_sample(r, in, i, c));
+        if (out_timestamp_us)
+            *out_timestamp_us = in_timestamp_us;
+        return (int)in_frames;
+    }
+
+    uint32_t keep = r->taps - 1;
+    if (keep + in_frames > r->history_cap) {
+        for (int c = 0; c < channels; c++) {
+            float *h = realloc(r->history[c], (keep + in_frames) * sizeof(float));
+            if (!h)
+                return -1;
+            if (r->history_cap == 0)
+                memset(h, 0, keep * sizeof(float));  // Silence before the first chunk
+            r->history[c] = h;
+        }
+        r->history_cap = keep + in_frames;
+    }
+    for (int c = 0; c < channels; c++) {
+        float *h = r->history[c] + keep;
+        for (uint32_t i = 0; i < in_frames; i++)
+            h[i] = input_sample(r, in, i, c);
+    }
+
+    // First output: newest input pos (history index), phase / up of a frame later
+    if (out_timestamp_us) {
+        double offset = (double)r->pos - keep + (double)r->phase / r->up - r->taps / 2;
+        *out_timestamp_us = (uint64_t)((double)in_timestamp_us + offset * 1e6 / r->in_rate);
+    }
+
+    float (*dot)(const float *, const float *, uint32_t) = r->simd ? dot_simd : dot_scalar;
+    uint32_t end = keep + in_frames;
+    uint32_t n = 0;
+    while (r->pos < end) {
+        if (n >= out_capacity)
+            return -1;
+        const float *h = r->coeffs + (size_t)r->phase * r->taps;
+        for (int c = 0; c < channels; c++)
+            out[(size_t)n * channels + c] = to_s16(dot(r->history[c] + r->pos - keep, h, r->taps));
+        n++;
+        r->phase += r->down;
+        r->pos += r->phase / r->up;
+        r->phase %= r->up;
+    }
+
+    // Keep the newest taps - 1 frames as history for the next chunk
+    for (int c = 0; c < channels; c++)
+        memmove(r->history[c], r->history[c] + in_frames, keep * sizeof(float));
+    r->pos -= in_frames;
+    return (int)n;
+}
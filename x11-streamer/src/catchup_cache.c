@@ -0,0 +1,97 @@
+#include "catchup_cache.h"
+#include <stdlib.h>
+
+struct catchup_cache {
+    send_message_t **frames;  // frames[0] is the IDR
+    int num_frames;
+    int max_frames;
+    size_t bytes;
+    size_t max_bytes;
+};
+
+catchup_cache_t *catchup_cache_create(int max_frames, size_t max_bytes)
+{
+    catchup_cache_t *cache = calloc(1, sizeof(catchup_cache_t));
+    if (!cache)
+        return NULL;
+
+    cache->max_frames = max_frames > 0 ? max_frames : CATCHUP_CACHE_MAX_FRAMES;
+    cache->max_bytes = max_bytes > 0 ? max_bytes : CATCHUP_CACHE_MAX_BYTES;
+    cache->frames = calloc(cache->max_frames, sizeof(send_message_t *));
+    if (!cache->frames) {
+        free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void catchup_cache_destroy(catchup_cache_t *cache)
+{
+    if (!cache)
+        return;
+
+    catchup_cache_clear(cache);
+    free(cache->frames);
+    free(cache);
+}
+
+void catchup_cache_clear(catchup_cache_t *cache)
+{
+    if (!cache)
+        return;
+
+    for (int i = 0; i < cache->num_frames; i++)
+        send_message_unref(cache->frames[i]);
+    cache->num_frames = 0;
+    cache->bytes = 0;
+}
+
+void catchup_cache_add(catchup_cache_t *cache, send_message_t *msg, bool keyframe)
+{
+    if (!cache || !msg)
+        return;
+
+    if (keyframe)
+        catchup_cache_clear(cache);
+    else if (cache->num_frames == 0)
+        return;  // No IDR to start from
+
+    // A chain that no longer fits would make the catch-up burst worse than a keyframe
+    size_t size = send_message_get_size(msg);
+    if (cache->num_frames == cache->max_frames || cache->bytes + size > cache->max_bytes) {
+        catchup_cache_clear(cache);
+        return;
+    }
+
+    cache->frames[cache->num_frames++] = send_message_ref(msg);
+    cache->bytes += size;
+}
+
+bool catchup_cache_is_ready(catchup_cache_t *cache)
+{
+    return cache && cache->num_frames > 0;
+}
+
+int catchup_cache_get_frames(catchup_cache_t *cache)
+{
+    return cache ? cache->num_frames : 0;
+}
+
+size_t catchup_cache_get_bytes(catchup_cache_t *cache)
+{
+    return cache ? cache->bytes : 0;
+}
+
+ssize_t catchup_cache_send(catchup_cache_t *cache, send_queue_t *queue)
+{
+    if (!cache || !queue)
+        return -1;
+
+    for (int i = 0; i < cache->num_frames; i++) {
+        if (send_queue_push_message(queue, cache->frames[i], i == 0) < 0)
+            return -1;
+    }
+
+    return (ssize_t)cache->bytes;
+}
@@ -10,6 +10,7 @@ struct dirty_rect_context {
     uint32_t pitch;
     void *previous_frame;
     size_t frame_size;
+    bool has_previous;  // previous_frame holds a detected frame (false after create/reset)
 };
 
 dirty_rect_context_t *dirty_rect_create(uint32_t width, uint32_t height, uint32_t bpp)
@@ -49,6 +50,7 @@ void dirty_rect_reset(dirty_rect_context_t *ctx)
         return;
 
     memset(ctx->previous_frame, 0, ctx->frame_size);
+    ctx->has_previous = false;
 }
 
 static inline bool pixels_differ(const uint8_t *a, const uint8_t *b, uint32_t bpp)
@@ -61,6 +63,79 @@ static inline bool pixels_differ(const uint8_t *a, const uint8_t *b, uint32_t bp
     return false;
 }
 
+// Merge adjacent dirty tiles into rectangles
+// Simple greedy algorithm: find contiguous regions
+int dirty_rect_merge_tiles(const bool *dirty_tiles, uint32_t tiles_x, uint32_t tiles_y, uint32_t tile_size,
+                           uint32_t width, uint32_t height, dirty_rect_t *rectangles, int max_rects)
+{
+    int rect_count = 0;
+    bool *processed = calloc(tiles_x * tiles_y, sizeof(bool));
+    if (!processed)
+        return -1;
+
+    for (uint32_t ty = 0; ty < tiles_y && rect_count < max_rects; ty++) {
+        for (uint32_t tx = 0; tx < tiles_x && rect_count < max_rects; tx++) {
+            if (!dirty_tiles[ty * tiles_x + tx] || processed[ty * tiles_x + tx])
+                continue;
+
+            // Start a new rectangle
+            uint32_t rect_x = tx * tile_size;
+            uint32_t rect_y = ty * tile_size;
+            uint32_t rect_w = tile_size;
+            uint32_t rect_h = tile_size;
+
+            // Try to expand right
+            uint32_t expand_x = tx + 1;
+            while (expand_x < tiles_x &&
+                   dirty_tiles[ty * tiles_x + expand_x] &&
+                   !processed[ty * tiles_x + expand_x]) {
+                rect_w += tile_size;
+                processed[ty * tiles_x + expand_x] = true;
+                expand_x++;
+            }
+
+            // Try to expand down
+            uint32_t expand_y = ty + 1;
+            bool can_expand_down = true;
+            while (expand_y < tiles_y && can_expand_down && rect_count < max_rects) {
+                // Check if entire row is dirty
+                for (uint32_t check_x = tx; check_x < expand_x; check_x++) {
+                    if (!dirty_tiles[expand_y * tiles_x + check_x] ||
+                        processed[expand_y * tiles_x + check_x]) {
+                        can_expand_down = false;
+                        break;
+                    }
+                }
+
+                if (can_expand_down) {
+                    rect_h += tile_size;
+                    for (uint32_t mark_x = tx; mark_x < expand_x; mark_x++) {
+                        processed[expand_y * tiles_x + mark_x] = true;
+                    }
+                    expand_y++;
+                }
+            }
+
+            // Clamp to screen bounds
+            if (rect_x + rect_w > width)
+                rect_w = width - rect_x;
+            if (rect_y + rect_h > height)
+                rect_h = height - rect_y;
+
+            rectangles[rect_count].x = rect_x;
+            rectangles[rect_count].y = rect_y;
+            rectangles[rect_count].width = rect_w;
+            rectangles[rect_count].height = rect_h;
+            rect_count++;
+
+            processed[ty * tiles_x + tx] = true;
+        }
+    }
+
+    free(processed);
+    return rect_count;
+}
+
 // Simple algorithm: scan for changed pixels and create rectangles
 // This is a basic implementation - could be optimized with better algorithms
 int dirty_rect_detect(dirty_rect_context_t *ctx,
@@ -71,7 +146,7 @@ int dirty_rect_detect(dirty_rect_context_t *ctx,
     if (!ctx || !current_frame || !rectangles || max_rects <= 0)
         return 0;
 
-    if (!ctx->previous_frame) {
+    if (!ctx->has_previous) {
         // First frame - mark entire screen as dirty
         dirty_rect_t *rect = &rectangles[0];
         rect->x = 0;
@@ -81,6 +156,7 @@ int dirty_rect_detect(dirty_rect_context_t *ctx,
 
         // Save current frame as previous
         memcpy(ctx->previous_frame, current_frame, ctx->frame_size);
+        ctx->has_previous = true;
         return 1;
     }
 
@@ -89,8 +165,7 @@ int dirty_rect_detect(dirty_rect_context_t *ctx,
     int rect_count = 0;
 
     // Simple approach: divide screen into tiles and check each tile
-    // For better performance, we use 32x32 pixel tiles
-    const uint32_t tile_size = 32;
+    const uint32_t tile_size = DIRTY_RECT_TILE_SIZE;
     uint32_t tiles_x = (ctx->width + tile_size - 1) / tile_size;
     uint32_t tiles_y = (ctx->height + tile_size - 1) / tile_size;
 
@@ -125,75 +200,11 @@ int dirty_rect_detect(dirty_rect_context_t *ctx,
         }
     }
 
-    // Merge adjacent dirty tiles into rectangles
-    // Simple greedy algorithm: find contiguous regions
-    bool *processed = calloc(tiles_x * tiles_y, sizeof(bool));
-    if (!processed) {
-        free(dirty_tiles);
-        return 0;
-    }
-
-    for (uint32_t ty = 0; ty < tiles_y && rect_count < max_rects; ty++) {
-        for (uint32_t tx = 0; tx < tiles_x && rect_count < max_rects; tx++) {
-            if (!dirty_tiles[ty * tiles_x + tx] || processed[ty * tiles_x + tx])
-                continue;
-
-            // Start a new rectangle
-            uint32_t rect_x = tx * tile_size;
-            uint32_t rect_y = ty * tile_size;
-            uint32_t rect_w = tile_size;
-            uint32_t rect_h = tile_size;
-
-            // Try to expand right
-            uint32_t expand_x = tx + 1;
-            while (expand_x < tiles_x &&
-                   dirty_tiles[ty * tiles_x + expand_x] &&
-                   !processed[ty * tiles_x + expand_x]) {
-                rect_w += tile_size;
-                processed[ty * tiles_x + expand_x] = true;
-                expand_x++;
-            }
-
-            // Try to expand down
-            uint32_t expand_y = ty + 1;
-            bool can_expand_down = true;
-            while (expand_y < tiles_y && can_expand_down && rect_count < max_rects) {
-                // Check if entire row is dirty
-                for (uint32_t check_x = tx; check_x < expand_x; check_x++) {
-                    if (!dirty_tiles[expand_y * tiles_x + check_x] ||
-                        processed[expand_y * tiles_x + check_x]) {
-                        can_expand_down = false;
-                        break;
-                    }
-                }
-
-                if (can_expand_down) {
-                    rect_h += tile_size;
-                    for (uint32_t mark_x = tx; mark_x < expand_x; mark_x++) {
-                        processed[expand_y * tiles_x + mark_x] = true;
-                    }
-                    expand_y++;
-                }
-            }
-
-            // Clamp to screen bounds
-            if (rect_x + rect_w > ctx->width)
-                rect_w = ctx->width - rect_x;
-            if (rect_y + rect_h > ctx->height)
-                rect_h = ctx->height - rect_y;
-
-            rectangles[rect_count].x = rect_x;
-            rectangles[rect_count].y = rect_y;
-            rectangles[rect_count].width = rect_w;
-            rectangles[rect_count].height = rect_h;
-            rect_count++;
-
-            processed[ty * tiles_x + tx] = true;
-        }
-    }
-
+    rect_count = dirty_rect_merge_tiles(dirty_tiles, tiles_x, tiles_y, tile_size,
+                                        ctx->width, ctx->height, rectangles, max_rects);
     free(dirty_tiles);
-    free(processed);
+    if (rect_count < 0)
+        return 0;
 
     // Save current frame as previous for next comparison
     memcpy(ctx->previous_frame, current_frame, ctx->frame_size);
@@ -1,4 +1,5 @@
 #include "drm_fb.h"
+#include "fb_convert.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,7 @@
 #include <xf86drmMode.h>
 #include <drm/drm.h>
 #include <drm/drm_mode.h>
+#include <drm/drm_fourcc.h>
 
 #define DRM_DEVICE_PATH "/dev/dri"
 
@@ -46,7 +48,7 @@ drm_device_t *drm_find_device_by_fb_id(uint32_t fb_id)
             strncmp(entry->d_name, "renderD", 7) != 0)
             continue;
 
-        char path[256];
+        char path[sizeof(DRM_DEVICE_PATH) + sizeof(entry->d_name)];
         snprintf(path, sizeof(path), "%s/%s", DRM_DEVICE_PATH, entry->d_name);
 
         int fd = drm_open_device(path);
@@ -104,23 +106,45 @@ drm_fb_t *drm_fb_open(uint32_t fb_id)
     free(dev->path);
     free(dev);
 
-    // Get framebuffer info
-    drmModeFBPtr fb_info = drmModeGetFB(fb->fd, fb_id);
-    if (!fb_info) {
-        close(fb->fd);
-        free(fb);
-        return NULL;
-    }
-
-    fb->width = fb_info->width;
-    fb->height = fb_info->height;
-    fb->pitch = fb_info->pitch;
-    fb->bpp = fb_info->bpp;
-    fb->size = fb_info->height * fb_info->pitch;
-    // Default to ARGB8888 format (most common)
-    fb->format = 0x34325241;  // DRM_FORMAT_ARGB8888
+    // Get framebuffer info: format and tiling modifier from GETFB2 (Linux 5.7+)
+    drmModeFB2Ptr fb2_info = drmModeGetFB2(fb->fd, fb_id);
+    if (fb2_info) {
+        fb->width = fb2_info->width;
+        fb->height = fb2_info->height;
+        fb->pitch = fb2_info->pitches[0];
+        fb->format = fb2_info->pixel_format;
+        fb->modifier = (fb2_info->flags & DRM_MODE_FB_MODIFIERS) ? fb2_info->modifier : DRM_FORMAT_MOD_LINEAR;
+        fb->handle = fb2_info->handles[0];
+        fb->offset = fb2_info->offsets[0];
+        fb->bpp = fb_convert_format_cpp(fb->format) * 8;
+        drmModeFreeFB2(fb2_info);
+    } else {
+        // Older kernel: legacy GETFB has no format, so derive it from depth and bpp
+        drmModeFBPtr fb_info = drmModeGetFB(fb->fd, fb_id);
+        if (!fb_info) {
+            close(fb->fd);
+            free(fb);
+            return NULL;
+        }
 
-    drmModeFreeFB(fb_info);
+        fb->width = fb_info->width;
+        fb->height = fb_info->height;
+        fb->pitch = fb_info->pitch;
+        fb->bpp = fb_info->bpp;
+        fb->handle = fb_info->handle;
+        fb->modifier = DRM_FORMAT_MOD_LINEAR;
+        if (fb_info->bpp == 16)
+            fb->format = DRM_FORMAT_RGB565;
+        else if (fb_info->depth == 30)
+            fb->format = DRM_FORMAT_XRGB2101010;
+        else if (fb_info->depth == 32)
+            fb->format = DRM_FORMAT_ARGB8888;
+        else
+            fb->format = DRM_FORMAT_XRGB8888;
+
+        drmModeFreeFB(fb_info);
+    }
+    fb->size = fb->offset + (size_t)fb->pitch * fb_convert_aligned_height(fb->modifier, fb->height);
 
     return fb;
 }
@@ -148,17 +172,10 @@ int drm_fb_map(drm_fb_t *fb)
     // We just need CPU-accessible memory to read pixel data from.
     // Try mapping via DRM_IOCTL_MODE_MAP_DUMB (works for dumb buffers from Xorg/X11Libre)
 
-    // Get the buffer handle from drmModeGetFB()->handle
-    drmModeFBPtr fb_info = drmModeGetFB(fb->fd, fb->fb_id);
-    if (!fb_info)
-        return -1;
-
-    uint32_t handle = fb_info->handle;
-    drmModeFreeFB(fb_info);
-
-    // Use DRM_IOCTL_MODE_MAP_DUMB to get a mapping offset
+    // Tiled buffers are mapped as they are (the caller detiles them, see fb_convert.h)
+    // Use DRM_IOCTL_MODE_MAP_DUMB to get a mapping offset for the handle from drm_fb_open()
     struct drm_mode_map_dumb map_arg = {
-        .handle = handle
+        .handle = fb->handle
     };
 
     if (drmIoctl(fb->fd, DRM_IOCTL_MODE_MAP_DUMB, &map_arg) < 0) {
@@ -0,0 +1,536 @@
+#include "fb_convert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <drm/drm_fourcc.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>  // MOVNTDQA
+#endif
+
+#define X_TILE_WIDTH 512   // Bytes
+#define X_TILE_HEIGHT 8
+#define Y_TILE_WIDTH 128
+#define Y_TILE_HEIGHT 32
+#define Y_TILE_COLUMN 16   // Y tiles are 16-byte wide columns, each 32 rows tall
+#define TILE_SIZE 4096
+#define OPAQUE 0xFF000000u
+#define LINE_SIZE 64          // Bytes per streaming load burst (one cache line)
+#define PROBE_BYTES (256 * 1024)  // Mapping sample timed by the probe (fits in L2)
+#define PROBE_PASSES 3        // Best of; the first pass faults pages in and warms caches
+#define SLOW_READ_FACTOR 4    // Mapping this much slower than cached memory is copied once
+
+typedef void (*convert_row_fn)(const uint8_t *src, uint32_t *dst, uint32_t width);
+typedef void (*read_fn)(uint8_t *dst, const uint8_t *src, size_t n);
+
+static bool use_simd = true;
+
+void fb_convert_set_simd(bool enabled)
+{
+    use_simd = enabled;
+}
+
+const char *fb_convert_simd_name(void)
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#elif defined(__ARM_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+bool fb_convert_has_streaming_loads(void)
+{
+#if defined(__SSE4_1__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *fb_convert_read_mode_name(fb_read_mode_t mode)
+{
+    switch (mode) {
+    case FB_READ_IN_PLACE:
+        return "in place";
+    case FB_READ_COPY:
+        return "copy";
+    case FB_READ_STREAM:
+        return "streaming copy";
+    }
+    return "?";
+}
+
+uint32_t fb_convert_format_cpp(uint32_t format)
+{
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_ARGB2101010:
+        return 4;
+    case DRM_FORMAT_RGB565:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t tile_height(uint64_t modifier)
+{
+    if (modifier == I915_FORMAT_MOD_X_TILED)
+        return X_TILE_HEIGHT;
+    if (modifier == I915_FORMAT_MOD_Y_TILED)
+        return Y_TILE_HEIGHT;
+    return 1;
+}
+
+bool fb_convert_supported(uint32_t format, uint64_t modifier)
+{
+    return fb_convert_format_cpp(format) != 0 &&
+           (modifier == DRM_FORMAT_MOD_LINEAR || modifier == I915_FORMAT_MOD_X_TILED ||
+            modifier == I915_FORMAT_MOD_Y_TILED);
+}
+
+bool fb_convert_is_passthrough(uint32_t format, uint64_t modifier)
+{
+    return modifier == DRM_FORMAT_MOD_LINEAR &&
+           (format == DRM_FORMAT_ARGB8888 || format == DRM_FORMAT_XRGB8888);
+}
+
+uint32_t fb_convert_aligned_height(uint64_t modifier, uint32_t height)
+{
+    uint32_t h = tile_height(modifier);
+    return (height + h - 1) / h * h;
+}
+
+// Scalar pixel conversions (also the tails of the SIMD loops)
+
+static inline uint32_t swap_rb(uint32_t p)
+{
+    return (p & 0x0000FF00u) | ((p >> 16) & 0xFFu) | ((p & 0xFFu) << 16) | OPAQUE;
+}
+
+// 2:10:10:10 -> top 8 bits of each channel
+static inline uint32_t from_2101010(uint32_t p)
+{
+    return ((p >> 6) & 0x00FF0000u) | ((p >> 4) & 0x0000FF00u) | ((p >> 2) & 0xFFu) | OPAQUE;
+}
+
+// 5:6:5 -> 8:8:8, low bits filled from the high ones so white stays 0xFF
+static inline uint32_t from_565(uint32_t p)
+{
+    return ((p << 8) & 0xF80000u) | ((p << 3) & 0x070000u) |
+           ((p << 5) & 0x00FC00u) | ((p >> 1) & 0x000300u) |
+           ((p << 3) & 0x0000F8u) | ((p >> 2) & 0x000007u) | OPAQUE;
+}
+
+static void copy_row(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    if ((const void *)src != (const void *)dst)
+        memcpy(dst, src, (size_t)width * 4);
+}
+
+static void swap_rb_row_scalar(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++) {
+        uint32_t p;
+        memcpy(&p, src + (size_t)x * 4, 4);
+        dst[x] = swap_rb(p);
+    }
+}
+
+static void from_2101010_row_scalar(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++) {
+        uint32_t p;
+        memcpy(&p, src + (size_t)x * 4, 4);
+        dst[x] = from_2101010(p);
+    }
+}
+
+static void from_565_row_scalar(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++) {
+        uint16_t p;
+        memcpy(&p, src + (size_t)x * 2, 2);
+        dst[x] = from_565(p);
+    }
+}
+
+// SIMD versions: same formulas on 8 (AVX2) or 4 (SSE2/NEON) pixels at a time
+
+static void swap_rb_row_simd(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    uint32_t x = 0;
+#if defined(__AVX2__)
+    const __m256i g = _mm256_set1_epi32(0x0000FF00), lo = _mm256_set1_epi32(0xFF), a = _mm256_set1_epi32((int)OPAQUE);
+    for (; x + 8 <= width; x += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + (size_t)x * 4));
+        __m256i v = _mm256_or_si256(_mm256_and_si256(p, g), _mm256_and_si256(_mm256_srli_epi32(p, 16), lo));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(_mm256_and_si256(p, lo), 16));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_or_si256(v, a));
+    }
+#elif defined(__SSE2__)
+    const __m128i g = _mm_set1_epi32(0x0000FF00), lo = _mm_set1_epi32(0xFF), a = _mm_set1_epi32((int)OPAQUE);
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + (size_t)x * 4));
+        __m128i v = _mm_or_si128(_mm_and_si128(p, g), _mm_and_si128(_mm_srli_epi32(p, 16), lo));
+        v = _mm_or_si128(v, _mm_slli_epi32(_mm_and_si128(p, lo), 16));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(v, a));
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 4 <= width; x += 4) {
+        uint32x4_t p = vld1q_u32((const uint32_t *)(const void *)(src + (size_t)x * 4));
+        uint32x4_t v = vorrq_u32(vandq_u32(p, vdupq_n_u32(0x0000FF00)),
+                                 vandq_u32(vshrq_n_u32(p, 16), vdupq_n_u32(0xFF)));
+        v = vorrq_u32(v, vshlq_n_u32(vandq_u32(p, vdupq_n_u32(0xFF)), 16));
+        vst1q_u32(dst + x, vorrq_u32(v, vdupq_n_u32(OPAQUE)));
+    }
+#endif
+    swap_rb_row_scalar(src + (size_t)x * 4, dst + x, width - x);
+}
+
+static void from_2101010_row_simd(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    uint32_t x = 0;
+#if defined(__AVX2__)
+    const __m256i r = _mm256_set1_epi32(0x00FF0000), g = _mm256_set1_epi32(0x0000FF00),
+                  b = _mm256_set1_epi32(0xFF), a = _mm256_set1_epi32((int)OPAQUE);
+    for (; x + 8 <= width; x += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + (size_t)x * 4));
+        __m256i v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p, 6), r),
+                                    _mm256_and_si256(_mm256_srli_epi32(p, 4), g));
+        v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(p, 2), b));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_or_si256(v, a));
+    }
+#elif defined(__SSE2__)
+    const __m128i r = _mm_set1_epi32(0x00FF0000), g = _mm_set1_epi32(0x0000FF00),
+                  b = _mm_set1_epi32(0xFF), a = _mm_set1_epi32((int)OPAQUE);
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + (size_t)x * 4));
+        __m128i v = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 6), r), _mm_and_si128(_mm_srli_epi32(p, 4), g));
+        v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(p, 2), b));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(v, a));
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 4 <= width; x += 4) {
+        uint32x4_t p = vld1q_u32((const uint32_t *)(const void *)(src + (size_t)x * 4));
+        uint32x4_t v = vorrq_u32(vandq_u32(vshrq_n_u32(p, 6), vdupq_n_u32(0x00FF0000)),
+                                 vandq_u32(vshrq_n_u32(p, 4), vdupq_n_u32(0x0000FF00)));
+        v = vorrq_u32(v, vandq_u32(vshrq_n_u32(p, 2), vdupq_n_u32(0xFF)));
+        vst1q_u32(dst + x, vorrq_u32(v, vdupq_n_u32(OPAQUE)));
+    }
+#endif
+    from_2101010_row_scalar(src + (size_t)x * 4, dst + x, width - x);
+}
+
+#if defined(__AVX2__)
+static inline __m256i from_565_avx2(__m256i p)
+{
+    __m256i v = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(p, 8), _mm256_set1_epi32(0xF80000)),
+                                _mm256_and_si256(_mm256_slli_epi32(p, 3), _mm256_set1_epi32(0x0700F8)));
+    v = _mm256_or_si256(v, _mm256_and_si256(_mm256_slli_epi32(p, 5), _mm256_set1_epi32(0x00FC00)));
+    v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(p, 1), _mm256_set1_epi32(0x000300)));
+    v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(p, 2), _mm256_set1_epi32(0x000007)));
+    return _mm256_or_si256(v, _mm256_set1_epi32((int)OPAQUE));
+}
+#elif defined(__SSE2__)
+static inline __m128i from_565_sse2(__m128i p)
+{
+    __m128i v = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(p, 8), _mm_set1_epi32(0xF80000)),
+                             _mm_and_si128(_mm_slli_epi32(p, 3), _mm_set1_epi32(0x0700F8)));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_slli_epi32(p, 5), _mm_set1_epi32(0x00FC00)));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(p, 1), _mm_set1_epi32(0x000300)));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(p, 2), _mm_set1_epi32(0x000007)));
+    return _mm_or_si128(v, _mm_set1_epi32((int)OPAQUE));
+}
+#endif
+
+static void from_565_row_simd(const uint8_t *src, uint32_t *dst, uint32_t width)
+{
+    uint32_t x = 0;
+#if defined(__AVX2__)
+    for (; x + 16 <= width; x += 16) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + (size_t)x * 2));
+        _mm256_storeu_si256((__m256i *)(dst + x), from_565_avx2(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(p))));
+        _mm256_storeu_si256((__m256i *)(dst + x + 8),
+                            from_565_avx2(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(p, 1))));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 8 <= width; x += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + (size_t)x * 2));
+        _mm_storeu_si128((__m128i *)(dst + x), from_565_sse2(_mm_unpacklo_epi16(p, zero)));
+        _mm_storeu_si128((__m128i *)(dst + x + 4), from_565_sse2(_mm_unpackhi_epi16(p, zero)));
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 8 <= width; x += 8) {
+        uint16x8_t p = vld1q_u16((const uint16_t *)(const void *)(src + (size_t)x * 2));
+        uint32x4_t halves[2] = { vmovl_u16(vget_low_u16(p)), vmovl_u16(vget_high_u16(p)) };
+        for (int h = 0; h < 2; h++) {
+            uint32x4_t q = halves[h];
+            uint32x4_t v = vorrq_u32(vandq_u32(vshlq_n_u32(q, 8), vdupq_n_u32(0xF80000)),
+                                     vandq_u32(vshlq_n_u32(q, 3), vdupq_n_u32(0x0700F8)));
+            v = vorrq_u32(v, vandq_u32(vshlq_n_u32(q, 5), vdupq_n_u32(0x00FC00)));
+            v = vorrq_u32(v, vandq_u32(vshrq_n_u32(q, 1), vdupq_n_u32(0x000300)));
+            v = vorrq_u32(v, vandq_u32(vshrq_n_u32(q, 2), vdupq_n_u32(0x000007)));
+            vst1q_u32(dst + x + h * 4, vorrq_u32(v, vdupq_n_u32(OPAQUE)));
+        }
+    }
+#endif
+    from_565_row_scalar(src + (size_t)x * 2, dst + x, width - x);
+}
+
+static convert_row_fn row_converter(uint32_t format)
+{
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XRGB8888:
+        return copy_row;
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_XBGR8888:
+        return use_simd ? swap_rb_row_simd : swap_rb_row_scalar;
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_ARGB2101010:
+        return use_simd ? from_2101010_row_simd : from_2101010_row_scalar;
+    case DRM_FORMAT_RGB565:
+        return use_simd ? from_565_row_simd : from_565_row_scalar;
+    default:
+        return NULL;
+    }
+}
+
+static void plain_copy(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+// Copy out of a write-combined or uncached mapping: whole lines of streaming loads, so
+// each line is fetched once into a streaming-load buffer instead of one read per load
+static void stream_copy(uint8_t *dst, const uint8_t *src, size_t n)
+{
+#if defined(__SSE4_1__)
+    size_t head = (16 - ((uintptr_t)src & 15)) & 15;  // MOVNTDQA needs 16-byte alignment
+    if (head > n)
+        head = n;
+    memcpy(dst, src, head);
+    src += head;
+    dst += head;
+    n -= head;
+    for (; n >= LINE_SIZE; n -= LINE_SIZE, src += LINE_SIZE, dst += LINE_SIZE) {
+        __m128i *line = (__m128i *)(uintptr_t)src;
+        __m128i a = _mm_stream_load_si128(line), b = _mm_stream_load_si128(line + 1);
+        __m128i c = _mm_stream_load_si128(line + 2), d = _mm_stream_load_si128(line + 3);
+        _mm_storeu_si128((__m128i *)dst, a);
+        _mm_storeu_si128((__m128i *)dst + 1, b);
+        _mm_storeu_si128((__m128i *)dst + 2, c);
+        _mm_storeu_si128((__m128i *)dst + 3, d);
+    }
+    for (; n >= 16; n -= 16, src += 16, dst += 16)
+        _mm_storeu_si128((__m128i *)dst, _mm_stream_load_si128((__m128i *)(uintptr_t)src));
+#endif
+    memcpy(dst, src, n);
+}
+
+static inline void copy16(uint8_t *dst, const uint8_t *src)
+{
+#if defined(__SSE2__)
+    _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+#elif defined(__ARM_NEON)
+    vst1q_u8(dst, vld1q_u8(src));
+#else
+    memcpy(dst, src, 16);
+#endif
+}
+
+// Gather one pixel row of an X-tiled buffer: 512-byte spans, one per tile
+static void detile_row_x(const uint8_t *src, uint32_t pitch, uint32_t y, uint8_t *row, uint32_t row_bytes,
+                         read_fn read)
+{
+    const uint8_t *tiles = src + (size_t)(y / X_TILE_HEIGHT) * pitch * X_TILE_HEIGHT +
+                           (y % X_TILE_HEIGHT) * X_TILE_WIDTH;
+    for (uint32_t bx = 0; bx < row_bytes; bx += X_TILE_WIDTH) {
+        uint32_t n = row_bytes - bx < X_TILE_WIDTH ? row_bytes - bx : X_TILE_WIDTH;
+        read(row + bx, tiles + (size_t)(bx / X_TILE_WIDTH) * TILE_SIZE, n);
+    }
+}
+
+// Gather up to Y_BAND pixel rows of a Y-tiled buffer, starting at a multiple of Y_BAND:
+// a 16-byte column piece every 512 bytes. The pieces of four consecutive rows make up
+// one 64-byte line, which is read in one go
+#define Y_BAND (LINE_SIZE / Y_TILE_COLUMN)
+static void detile_rows_y(const uint8_t *src, uint32_t pitch, uint32_t y, uint8_t *const *rows, uint32_t count,
+                          uint32_t row_bytes, bool streaming_loads)
+{
+    const uint8_t *tiles = src + (size_t)(y / Y_TILE_HEIGHT) * pitch * Y_TILE_HEIGHT +
+                           (y % Y_TILE_HEIGHT) * Y_TILE_COLUMN;
+    uint32_t bx = 0;
+    for (; bx + Y_TILE_COLUMN <= row_bytes; bx += Y_TILE_COLUMN) {
+        const uint8_t *column = tiles + (size_t)(bx / Y_TILE_WIDTH) * TILE_SIZE +
+                                (bx % Y_TILE_WIDTH) / Y_TILE_COLUMN * (Y_TILE_COLUMN * Y_TILE_HEIGHT);
+        if (streaming_loads && count == Y_BAND) {
+            uint8_t line[LINE_SIZE];
+            stream_copy(line, column, LINE_SIZE);
+            for (uint32_t i = 0; i < Y_BAND; i++)
+                memcpy(rows[i] + bx, line + i * Y_TILE_COLUMN, Y_TILE_COLUMN);
+        } else {
+            for (uint32_t i = 0; i < count; i++)
+                copy16(rows[i] + bx, column + i * Y_TILE_COLUMN);
+        }
+    }
+    if (bx < row_bytes) {
+        const uint8_t *column = tiles + (size_t)(bx / Y_TILE_WIDTH) * TILE_SIZE +
+                                (bx % Y_TILE_WIDTH) / Y_TILE_COLUMN * (Y_TILE_COLUMN * Y_TILE_HEIGHT);
+        for (uint32_t i = 0; i < count; i++)
+            memcpy(rows[i] + bx, column + i * Y_TILE_COLUMN, row_bytes - bx);
+    }
+}
+
+// Flag the tiles of output row y that differ from the previous frame (flagged tiles are
+// not compared again)
+static void compare_row(fb_convert_dirty_t *dirty, const uint32_t *row, const uint32_t *prev, uint32_t y,
+                        uint32_t width, uint32_t tiles_x)
+{
+    bool *flags = dirty->tiles + (size_t)(y / dirty->tile_size) * tiles_x;
+    for (uint32_t tx = 0, x = 0; tx < tiles_x; tx++, x += dirty->tile_size) {
+        if (flags[tx])
+            continue;
+        uint32_t n = width - x < dirty->tile_size ? width - x : dirty->tile_size;
+        if (memcmp(row + x, prev + x, (size_t)n * FB_CONVERT_BPP) != 0)
+            flags[tx] = true;
+    }
+}
+
+int fb_convert_frame(const void *src, uint32_t src_pitch, uint32_t format, uint64_t modifier,
+                     uint32_t width, uint32_t height, void *dst, uint32_t dst_pitch,
+                     bool streaming_loads, fb_convert_dirty_t *dirty)
+{
+    uint32_t cpp = fb_convert_format_cpp(format);
+    convert_row_fn convert = row_converter(format);
+    if (!src || !dst || !convert || !fb_convert_supported(format, modifier))
+        return -1;
+    uint32_t row_bytes = width * cpp;
+    if (src_pitch < row_bytes || dst_pitch < width * FB_CONVERT_BPP)
+        return -1;
+    if ((modifier == I915_FORMAT_MOD_X_TILED && src_pitch % X_TILE_WIDTH) ||
+        (modifier == I915_FORMAT_MOD_Y_TILED && src_pitch % Y_TILE_WIDTH))
+        return -1;
+    if (dirty && (!dirty->tiles || dirty->tile_size == 0))
+        return -1;
+
+    // Tiled rows, and linear rows read with streaming loads, are gathered into linear
+    // rows first: straight into dst when the format needs no conversion, otherwise into
+    // scratch rows that stay in L1
+    streaming_loads = streaming_loads && fb_convert_has_streaming_loads();
+    read_fn read = streaming_loads ? stream_copy : plain_copy;
+    bool gather = modifier != DRM_FORMAT_MOD_LINEAR || streaming_loads;
+    uint32_t band = modifier == I915_FORMAT_MOD_Y_TILED ? Y_BAND : 1;
+    uint8_t *scratch = NULL;
+    if (gather && convert != copy_row) {
+        scratch = malloc((size_t)band * row_bytes);
+        if (!scratch)
+            return -1;
+    }
+
+    uint32_t tiles_x = 0;
+    if (dirty) {
+        tiles_x = (width + dirty->tile_size - 1) / dirty->tile_size;
+        uint32_t tiles_y = (height + dirty->tile_size - 1) / dirty->tile_size;
+        memset(dirty->tiles, !dirty->previous, (size_t)tiles_x * tiles_y * sizeof(bool));
+    }
+
+    const uint8_t *in = src;
+    uint8_t *out = dst;
+    for (uint32_t y = 0; y < height; y += band) {
+        uint32_t count = height - y < band ? height - y : band;
+        uint8_t *rows[Y_BAND];
+        for (uint32_t i = 0; i < count; i++)
+            rows[i] = scratch ? scratch + (size_t)i * row_bytes : out + (size_t)(y + i) * dst_pitch;
+
+        if (modifier == I915_FORMAT_MOD_X_TILED)
+            detile_row_x(in, src_pitch, y, rows[0], row_bytes, read);
+        else if (modifier == I915_FORMAT_MOD_Y_TILED)
+            detile_rows_y(in, src_pitch, y, rows, count, row_bytes, streaming_loads);
+        else if (gather)
+            read(rows[0], in + (size_t)y * src_pitch, row_bytes);
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t *out_row = (uint32_t *)(void *)(out + (size_t)(y + i) * dst_pitch);
+            convert(gather ? rows[i] : in + (size_t)(y + i) * src_pitch, out_row, width);
+            if (dirty && dirty->previous)
+                compare_row(dirty, out_row,
+                            (const uint32_t *)(const void *)((const uint8_t *)dirty->previous +
+                                                             (size_t)(y + i) * dst_pitch),
+                            y + i, width, tiles_x);
+        }
+    }
+
+    free(scratch);
+    return 0;
+}
+
+int fb_convert_to_xrgb8888(const void *src, uint32_t src_pitch, uint32_t format, uint64_t modifier,
+                           uint32_t width, uint32_t height, void *dst, uint32_t dst_pitch)
+{
+    return fb_convert_frame(src, src_pitch, format, modifier, width, height, dst, dst_pitch, false, NULL);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fastest of PROBE_PASSES reads of size bytes of src
+static double time_reads(read_fn read, uint8_t *dst, const uint8_t *src, size_t size)
+{
+    double best = 0;
+    for (int pass = 0; pass < PROBE_PASSES; pass++) {
+        double start = now_sec();
+        read(dst, src, size);
+        double sec = now_sec() - start;
+        if (pass == 0 || sec < best)
+            best = sec;
+    }
+    return best;
+}
+
+fb_read_mode_t fb_convert_probe_read_mode(const void *src, size_t size)
+{
+    if (size > PROBE_BYTES)
+        size = PROBE_BYTES;
+    uint8_t *cached = malloc(size);
+    uint8_t *copy = malloc(size);
+    if (!src || size == 0 || !cached || !copy) {
+        free(cached);
+        free(copy);
+        return FB_READ_IN_PLACE;
+    }
+    memset(cached, 0x5A, size);
+
+    double cached_sec = time_reads(plain_copy, copy, cached, size);
+    double plain_sec = time_reads(plain_copy, copy, src, size);
+    double stream_sec = fb_convert_has_streaming_loads() ? time_reads(stream_copy, copy, src, size) : plain_sec;
+    free(cached);
+    free(copy);
+
+    // Cached mappings are cheap to read as often as the consumers like
+    if (plain_sec < cached_sec * SLOW_READ_FACTOR)
+        return FB_READ_IN_PLACE;
+    return stream_sec < plain_sec ? FB_READ_STREAM : FB_READ_COPY;
+}
@@ -0,0 +1,86 @@
+#include "fec.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Aim for (group + 1) * loss <= this, so a group rarely loses more than one packet
+#define FEC_TARGET_GROUP_LOSS 0.05
+
+void fec_xor(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // 64 bytes per iteration
+    for (; i + 64 <= len; i += 64) {
+        __m128i d0 = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i d1 = _mm_loadu_si128((const __m128i *)(dst + i + 16));
+        __m128i d2 = _mm_loadu_si128((const __m128i *)(dst + i + 32));
+        __m128i d3 = _mm_loadu_si128((const __m128i *)(dst + i + 48));
+        d0 = _mm_xor_si128(d0, _mm_loadu_si128((const __m128i *)(src + i)));
+        d1 = _mm_xor_si128(d1, _mm_loadu_si128((const __m128i *)(src + i + 16)));
+        d2 = _mm_xor_si128(d2, _mm_loadu_si128((const __m128i *)(src + i + 32)));
+        d3 = _mm_xor_si128(d3, _mm_loadu_si128((const __m128i *)(src + i + 48)));
+        _mm_storeu_si128((__m128i *)(dst + i), d0);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), d1);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), d2);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), d3);
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        d = _mm_xor_si128(d, _mm_loadu_si128((const __m128i *)(src + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+#else
+    // Scalar fallback: 8 bytes at a time
+    for (; i + 8 <= len; i += 8) {
+        uint64_t d, s;
+        memcpy(&d, dst + i, 8);
+        memcpy(&s, src + i, 8);
+        d ^= s;
+        memcpy(dst + i, &d, 8);
+    }
+#endif
+
+    // Remaining bytes
+    for (; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+size_t fec_num_groups(size_t packet_count, int group)
+{
+    if (group <= 0)
+        return 0;
+    return (packet_count + group - 1) / group;
+}
+
+void fec_encode(const uint8_t *data, size_t data_len, size_t packet_data, int group, uint8_t *parity)
+{
+    if (group <= 0 || packet_data == 0)
+        return;
+
+    size_t packet_count = (data_len + packet_data - 1) / packet_data;
+    size_t num_groups = fec_num_groups(packet_count, group);
+    memset(parity, 0, num_groups * packet_data);
+
+    for (size_t i = 0; i < packet_count; i++) {
+        size_t start = i * packet_data;
+        size_t len = data_len - start < packet_data ? data_len - start : packet_data;
+        fec_xor(parity + (i / group) * packet_data, data + start, len);
+    }
+}
+
+int fec_group_for_loss(double loss_rate)
+{
+    if (loss_rate <= 0)
+        return FEC_GROUP_MAX;
+
+    double group = FEC_TARGET_GROUP_LOSS / loss_rate - 1;
+    if (group < FEC_GROUP_MIN)
+        return FEC_GROUP_MIN;
+    if (group > FEC_GROUP_MAX)
+        return FEC_GROUP_MAX;
+    return (int)group;
+}
@@ -0,0 +1,172 @@
+#include "frame_pipeline.h"
+#include "dirty_rect.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_BPP 4
+
+struct frame_pipeline {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    bool *dirty_tiles;
+    uint8_t *history;        // Last frame, width * PIPELINE_BPP bytes per row (allocated when first needed)
+    bool history_valid;      // history holds the last processed frame
+    bool has_last;
+    uint64_t last_sequence;  // frame_buffer_t.sequence of the last processed frame
+    const uint8_t *i420_y;   // Luma plane of the I420 planes holding the last frame (NULL if none)
+};
+
+frame_pipeline_t *frame_pipeline_create(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+        return NULL;
+
+    frame_pipeline_t *pipeline = calloc(1, sizeof(frame_pipeline_t));
+    if (!pipeline)
+        return NULL;
+
+    pipeline->width = width;
+    pipeline->height = height;
+    pipeline->tiles_x = (width + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    pipeline->tiles_y = (height + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE;
+    pipeline->dirty_tiles = calloc((size_t)pipeline->tiles_x * pipeline->tiles_y, sizeof(bool));
+    if (!pipeline->dirty_tiles) {
+        free(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+void frame_pipeline_destroy(frame_pipeline_t *pipeline)
+{
+    if (!pipeline)
+        return;
+
+    free(pipeline->dirty_tiles);
+    free(pipeline->history);
+    free(pipeline);
+}
+
+// Copy rows of a span of the frame
+static void span_copy(const uint8_t *frame, uint32_t pitch, uint8_t *history, uint32_t history_pitch,
+                      uint32_t rows, size_t row_bytes)
+{
+    for (uint32_t row = 0; row < rows; row++)
+        memcpy(history + (size_t)row * history_pitch, frame + (size_t)row * pitch, row_bytes);
+}
+
+// True if any row of a tile differs from the history
+static bool tile_differs(const uint8_t *frame, uint32_t pitch, const uint8_t *history, uint32_t history_pitch,
+                         uint32_t rows, size_t row_bytes)
+{
+    for (uint32_t row = 0; row < rows; row++) {
+        if (memcmp(frame + (size_t)row * pitch, history + (size_t)row * history_pitch, row_bytes) != 0)
+            return true;
+    }
+    return false;
+}
+
+int frame_pipeline_process(frame_pipeline_t *pipeline, const frame_buffer_t *frame,
+                           const h264_i420_planes_t *i420)
+{
+    if (!pipeline || !frame || !frame->data || frame->width != pipeline->width ||
+        frame->height != pipeline->height || frame->bpp != PIPELINE_BPP)
+        return -1;
+#ifndef HAVE_X264
+    if (i420)
+        return -1;
+#endif
+
+    // Changes are relative to the last frame processed here; after one that was not (sent
+    // whole, or not at all), everything counts as changed. Source tiles are relative to
+    // the frame before, so they are only usable if that is the last one processed.
+    bool consecutive = pipeline->has_last && frame->sequence == pipeline->last_sequence + 1;
+    bool known = frame->dirty_tiles && consecutive;
+    if (!known && !pipeline->history) {
+        pipeline->history = malloc((size_t)pipeline->width * pipeline->height * PIPELINE_BPP);
+        if (!pipeline->history)
+            return -1;
+        pipeline->history_valid = false;
+    }
+    bool compare = !known && consecutive && pipeline->history_valid;
+#ifdef HAVE_X264
+    bool convert_all = i420 && i420->y != pipeline->i420_y;
+#endif
+
+    const uint8_t *pixels = frame->data;
+    uint32_t history_pitch = pipeline->width * PIPELINE_BPP;
+    for (uint32_t ty = 0; ty < pipeline->tiles_y; ty++) {
+        uint32_t y = ty * DIRTY_RECT_TILE_SIZE;
+        uint32_t rows = pipeline->height - y < DIRTY_RECT_TILE_SIZE ? pipeline->height - y : DIRTY_RECT_TILE_SIZE;
+        const uint8_t *stripe = pixels + (size_t)y * frame->pitch;
+        uint8_t *history = known ? NULL : pipeline->history + (size_t)y * history_pitch;
+        bool *dirty = pipeline->dirty_tiles + (size_t)ty * pipeline->tiles_x;
+
+        // Which tiles of the stripe changed
+        for (uint32_t tx = 0; tx < pipeline->tiles_x; tx++) {
+            uint32_t x = tx * DIRTY_RECT_TILE_SIZE;
+            uint32_t cols = pipeline->width - x < DIRTY_RECT_TILE_SIZE ? pipeline->width - x : DIRTY_RECT_TILE_SIZE;
+            if (known)
+                dirty[tx] = frame->dirty_tiles[(size_t)ty * pipeline->tiles_x + tx];
+            else if (compare)
+                dirty[tx] = tile_differs(stripe + (size_t)x * PIPELINE_BPP, frame->pitch,
+                                         history + (size_t)x * PIPELINE_BPP, history_pitch,
+                                         rows, (size_t)cols * PIPELINE_BPP);
+            else
+                dirty[tx] = true;
+        }
+
+        // Then, while the stripe is still in cache, copy runs of changed tiles into the
+        // history and convert them, a row of the run at a time rather than tile by tile
+        for (uint32_t tx = 0; tx < pipeline->tiles_x;) {
+            uint32_t end = tx + 1;
+            while (end < pipeline->tiles_x && dirty[end] == dirty[tx])
+                end++;
+            uint32_t x = tx * DIRTY_RECT_TILE_SIZE;
+            uint32_t x_end = end * DIRTY_RECT_TILE_SIZE < pipeline->width ? end * DIRTY_RECT_TILE_SIZE : pipeline->width;
+            if (dirty[tx] && !known)
+                span_copy(stripe + (size_t)x * PIPELINE_BPP, frame->pitch, history + (size_t)x * PIPELINE_BPP,
+                          history_pitch, rows, (size_t)(x_end - x) * PIPELINE_BPP);
+#ifdef HAVE_X264
+            if (i420 && (dirty[tx] || convert_all))
+                h264_encoder_argb_to_i420(pixels, frame->pitch, i420, x, y, x_end - x, rows);
+#endif
+            tx = end;
+        }
+    }
+
+    pipeline->history_valid = !known;  // Not kept up to date while the source compares
+    pipeline->i420_y = i420 ? i420->y : NULL;
+    pipeline->has_last = true;
+    pipeline->last_sequence = frame->sequence;
+    return 0;
+}
+
+const bool *frame_pipeline_get_dirty_tiles(frame_pipeline_t *pipeline, uint32_t *tiles_x, uint32_t *tiles_y)
+{
+    if (!pipeline)
+        return NULL;
+    if (tiles_x)
+        *tiles_x = pipeline->tiles_x;
+    if (tiles_y)
+        *tiles_y = pipeline->tiles_y;
+    return pipeline->dirty_tiles;
+}
+
+void frame_pipeline_reset_i420(frame_pipeline_t *pipeline)
+{
+    if (pipeline)
+        pipeline->i420_y = NULL;
+}
+
+uint32_t frame_pipeline_get_width(frame_pipeline_t *pipeline)
+{
+    return pipeline ? pipeline->width : 0;
+}
+
+uint32_t frame_pipeline_get_height(frame_pipeline_t *pipeline)
+{
+    return pipeline ? pipeline->height : 0;
+}
@@ -0,0 +1,757 @@
+#include "frame_source.h"
+#include "drm_fb.h"
+#include "fb_convert.h"
+#include "dirty_rect.h"
+#include "session_recording.h"
+#include "latency_stamp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define SYNTHETIC_BPP 4
+#define GLYPH_WIDTH 8     // Text cell size for the scroll-text pattern
+#define GLYPH_HEIGHT 16
+#define WINDOW_COUNT 3
+#define TITLE_BAR_HEIGHT 24
+
+typedef enum {
+    FRAME_SOURCE_DRM,
+    FRAME_SOURCE_SYNTHETIC,
+    FRAME_SOURCE_FILE,
+    FRAME_SOURCE_REPLAY
+} frame_source_type_t;
+
+typedef struct {
+    int x, y;
+    int dx, dy;
+    uint32_t title_color;
+} synthetic_window_t;
+
+struct frame_source {
+    frame_source_type_t type;
+    char name[64];
+    uint32_t width;
+    uint32_t height;
+    uint32_t refresh_rate;
+
+    // DRM (pixels is the staging copy of framebuffers that are converted or slow to read,
+    // previous_pixels the one before it)
+    uint32_t fb_id;
+    drm_fb_t *fb;
+    bool read_mode_probed;
+    fb_read_mode_t read_mode;
+    uint32_t *previous_pixels;
+    bool has_previous;            // previous_pixels holds the last frame at the staged size
+    uint32_t staged_width;
+    uint32_t staged_height;
+    bool *dirty_tiles;
+    uint64_t unsupported_layout;  // Format << 32 ^ modifier last reported as unsupported
+
+    // Synthetic
+    synthetic_pattern_t pattern;
+    uint32_t *pixels;
+    uint32_t *desktop;  // Background the windows are dragged over
+    synthetic_window_t windows[WINDOW_COUNT];
+    uint64_t frame_count;
+    uint64_t rng;
+
+    // File
+    int fd;
+    const uint8_t *map;
+    size_t map_size;
+    size_t frame_size;
+    size_t num_frames;
+    size_t next_frame;
+
+    // Replay (pixels holds the picture rebuilt so far)
+    session_recording_t *recording;
+    bool replay_max_speed;
+    uint64_t replay_start_us;  // Clock time of frame 0 in the current loop
+
+    bool latency_stamp;        // Draw the acquire time into each frame (pixels holds file frames)
+    uint64_t sequence;         // Acquire calls so far
+};
+
+static const char *pattern_names[] = {
+    [SYNTHETIC_PATTERN_SCROLL_TEXT] = "scroll-text",
+    [SYNTHETIC_PATTERN_MOVING_WINDOWS] = "moving-windows",
+    [SYNTHETIC_PATTERN_VIDEO_NOISE] = "video-noise",
+    [SYNTHETIC_PATTERN_IDLE] = "idle",
+};
+
+static frame_source_t *frame_source_alloc(frame_source_type_t type)
+{
+    frame_source_t *source = calloc(1, sizeof(frame_source_t));
+    if (!source)
+        return NULL;
+    source->type = type;
+    source->fd = -1;
+    return source;
+}
+
+frame_source_t *frame_source_create_drm(uint32_t fb_id)
+{
+    frame_source_t *source = frame_source_alloc(FRAME_SOURCE_DRM);
+    if (!source)
+        return NULL;
+
+    source->fb_id = fb_id;
+    snprintf(source->name, sizeof(source->name), "drm");
+    return source;
+}
+
+// Cheap deterministic hash so the generated text is the same on every run
+static uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static uint32_t desktop_pixel(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    uint32_t r = 0x20 + x * 0x40 / width;
+    uint32_t g = 0x30 + y * 0x50 / height;
+    return (r << 16) | (g << 8) | 0x90;
+}
+
+static void fill_rect(frame_source_t *source, int x, int y, int w, int h, uint32_t color)
+{
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + w > (int)source->width ? (int)source->width : x + w;
+    int y1 = y + h > (int)source->height ? (int)source->height : y + h;
+
+    for (int row = y0; row < y1; row++) {
+        uint32_t *line = source->pixels + (size_t)row * source->width;
+        for (int col = x0; col < x1; col++)
+            line[col] = color;
+    }
+}
+
+// Draw one line of made-up text at the given pixel row
+static void draw_text_line(frame_source_t *source, uint32_t y, uint32_t line_number)
+{
+    uint32_t columns = source->width / GLYPH_WIDTH;
+    uint32_t length = hash32(line_number) % (columns + 1);
+
+    for (uint32_t c = 0; c < length; c++) {
+        uint32_t glyph = hash32(line_number * 131 + c);
+        if (glyph % 6 == 0)
+            continue;  // Space between words
+
+        // 5x7 dot pattern, each dot two rows tall, inside the 8x16 cell
+        for (int gy = 0; gy < 7; gy++) {
+            for (int gx = 0; gx < 5; gx++) {
+                if (!((glyph >> ((gy * 5 + gx) % 32)) & 1))
+                    continue;
+                uint32_t px = c * GLYPH_WIDTH + 1 + gx;
+                uint32_t py = y + 1 + gy * 2;
+                if (py + 1 >= source->height)
+                    continue;
+                source->pixels[(size_t)py * source->width + px] = 0xC0C0C0;
+                source->pixels[(size_t)(py + 1) * source->width + px] = 0xC0C0C0;
+            }
+        }
+    }
+}
+
+static void synthetic_scroll_text(frame_source_t *source)
+{
+    uint32_t lines = source->height / GLYPH_HEIGHT;
+
+    if (source->frame_count == 0) {
+        fill_rect(source, 0, 0, source->width, source->height, 0x101010);
+        for (uint32_t i = 0; i < lines; i++)
+            draw_text_line(source, i * GLYPH_HEIGHT, i);
+        return;
+    }
+
+    // Scroll everything up by one text line and print a new one at the bottom
+    size_t row_bytes = (size_t)source->width * SYNTHETIC_BPP;
+    memmove(source->pixels, source->pixels + (size_t)GLYPH_HEIGHT * source->width,
+            (source->height - GLYPH_HEIGHT) * row_bytes);
+    uint32_t y = (lines - 1) * GLYPH_HEIGHT;
+    fill_rect(source, 0, y, source->width, source->height - y, 0x101010);
+    draw_text_line(source, y, lines - 1 + (uint32_t)source->frame_count);
+}
+
+static void draw_window(frame_source_t *source, const synthetic_window_t *window, int w, int h)
+{
+    fill_rect(source, window->x, window->y, w, h, 0x404040);                       // Border
+    fill_rect(source, window->x + 1, window->y + 1, w - 2, TITLE_BAR_HEIGHT, window->title_color);
+    fill_rect(source, window->x + 1, window->y + 1 + TITLE_BAR_HEIGHT,
+              w - 2, h - 2 - TITLE_BAR_HEIGHT, 0xF0F0F0);
+}
+
+static void synthetic_moving_windows(frame_source_t *source)
+{
+    int w = source->width / 3;
+    int h = source->height / 3;
+
+    if (source->frame_count == 0) {
+        memcpy(source->pixels, source->desktop, (size_t)source->width * source->height * SYNTHETIC_BPP);
+    } else {
+        // Uncover the desktop where the windows were, then move them
+        for (int i = 0; i < WINDOW_COUNT; i++) {
+            synthetic_window_t *window = &source->windows[i];
+            for (int row = window->y; row < window->y + h; row++) {
+                size_t offset = (size_t)row * source->width + window->x;
+                memcpy(source->pixels + offset, source->desktop + offset, (size_t)w * SYNTHETIC_BPP);
+            }
+
+            window->x += window->dx;
+            window->y += window->dy;
+            if (window->x < 0 || window->x + w > (int)source->width) {
+                window->dx = -window->dx;
+                window->x += 2 * window->dx;
+            }
+            if (window->y < 0 || window->y + h > (int)source->height) {
+                window->dy = -window->dy;
+                window->y += 2 * window->dy;
+            }
+        }
+    }
+
+    for (int i = 0; i < WINDOW_COUNT; i++)
+        draw_window(source, &source->windows[i], w, h);
+}
+
+static void synthetic_video_noise(frame_source_t *source)
+{
+    uint64_t *words = (uint64_t *)source->pixels;
+    size_t count = (size_t)source->width * source->height / 2;
+    for (size_t i = 0; i < count; i++)
+        words[i] = xorshift64(&source->rng);
+}
+
+frame_source_t *frame_source_create_synthetic(synthetic_pattern_t pattern, uint32_t width,
+                                              uint32_t height, uint32_t refresh_rate)
+{
+    if (pattern > SYNTHETIC_PATTERN_IDLE)
+        return NULL;
+
+    frame_source_t *source = frame_source_alloc(FRAME_SOURCE_SYNTHETIC);
+    if (!source)
+        return NULL;
+
+    // Even width keeps the noise pattern's 64-bit stores inside the buffer
+    source->width = width ? (width + 1) & ~1u : FRAME_SOURCE_DEFAULT_WIDTH;
+    source->height = height ? height : FRAME_SOURCE_DEFAULT_HEIGHT;
+    source->refresh_rate = refresh_rate ? refresh_rate : FRAME_SOURCE_DEFAULT_REFRESH;
+    source->pattern = pattern;
+    source->rng = 0x9E3779B97F4A7C15ULL;
+    snprintf(source->name, sizeof(source->name), "synthetic:%s", pattern_names[pattern]);
+
+    if (source->width < 3 * 16 || source->height < 3 * (TITLE_BAR_HEIGHT + 2)) {
+        fprintf(stderr, "Synthetic source: %ux%u is too small\n", source->width, source->height);
+        free(source);
+        return NULL;
+    }
+
+    size_t pixels = (size_t)source->width * source->height;
+    source->pixels = malloc(pixels * SYNTHETIC_BPP);
+    source->desktop = malloc(pixels * SYNTHETIC_BPP);
+    if (!source->pixels || !source->desktop) {
+        frame_source_destroy(source);
+        return NULL;
+    }
+
+    for (uint32_t y = 0; y < source->height; y++) {
+        for (uint32_t x = 0; x < source->width; x++)
+            source->desktop[(size_t)y * source->width + x] = desktop_pixel(x, y, source->width, source->height);
+    }
+
+    static const uint32_t title_colors[WINDOW_COUNT] = { 0x3060C0, 0xC06030, 0x30A050 };
+    for (int i = 0; i < WINDOW_COUNT; i++) {
+        source->windows[i].x = (int)source->width / 8 * (i + 1);
+        source->windows[i].y = (int)source->height / 10 * (i + 1);
+        source->windows[i].dx = 4 + 3 * i;
+        source->windows[i].dy = 3 + 2 * i;
+        source->windows[i].title_color = title_colors[i];
+    }
+
+    return source;
+}
+
+frame_source_t *frame_source_create_file(const char *path, uint32_t width, uint32_t height,
+                                         uint32_t refresh_rate)
+{
+    if (!path || width == 0 || height == 0)
+        return NULL;
+
+    frame_source_t *source = frame_source_alloc(FRAME_SOURCE_FILE);
+    if (!source)
+        return NULL;
+
+    source->width = width;
+    source->height = height;
+    source->refresh_rate = refresh_rate ? refresh_rate : FRAME_SOURCE_DEFAULT_REFRESH;
+    source->frame_size = (size_t)width * height * SYNTHETIC_BPP;
+    const char *base = strrchr(path, '/');
+    snprintf(source->name, sizeof(source->name), "file:%s", base ? base + 1 : path);
+
+    source->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (source->fd < 0) {
+        perror("open frame file");
+        free(source);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(source->fd, &st) < 0) {
+        perror("fstat frame file");
+        frame_source_destroy(source);
+        return NULL;
+    }
+
+    source->num_frames = (size_t)st.st_size / source->frame_size;
+    if (source->num_frames == 0) {
+        fprintf(stderr, "Frame file %s is smaller than one %ux%u frame\n", path, width, height);
+        frame_source_destroy(source);
+        return NULL;
+    }
+    if ((size_t)st.st_size % source->frame_size != 0) {
+        fprintf(stderr, "Warning: Frame file %s ends with a partial frame, ignoring it\n", path);
+    }
+
+    source->map_size = source->num_frames * source->frame_size;
+    void *map = mmap(NULL, source->map_size, PROT_READ, MAP_PRIVATE, source->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap frame file");
+        source->map_size = 0;
+        frame_source_destroy(source);
+        return NULL;
+    }
+    source->map = map;
+    madvise(map, source->map_size, MADV_SEQUENTIAL);
+
+    printf("Frame file %s: %zu frames of %ux%u\n", path, source->num_frames, width, height);
+    return source;
+}
+
+frame_source_t *frame_source_create_replay(const char *path, bool max_speed)
+{
+    if (!path)
+        return NULL;
+
+    frame_source_t *source = frame_source_alloc(FRAME_SOURCE_REPLAY);
+    if (!source)
+        return NULL;
+
+    source->recording = session_recording_open(path);
+    if (!source->recording) {
+        free(source);
+        return NULL;
+    }
+
+    const recording_header_t *header = session_recording_get_header(source->recording);
+    source->width = header->width;
+    source->height = header->height;
+    source->num_frames = session_recording_get_frames(source->recording);
+    source->replay_max_speed = max_speed;
+    if (max_speed)
+        source->refresh_rate = FRAME_SOURCE_REPLAY_MAX_RATE;
+    else
+        source->refresh_rate = header->refresh_rate ? header->refresh_rate : FRAME_SOURCE_DEFAULT_REFRESH;
+    const char *base = strrchr(path, '/');
+    snprintf(source->name, sizeof(source->name), "replay:%s", base ? base + 1 : path);
+
+    source->pixels = malloc((size_t)source->width * source->height * SYNTHETIC_BPP);
+    if (!source->pixels) {
+        frame_source_destroy(source);
+        return NULL;
+    }
+
+    printf("Recording %s: %zu frames of %ux%u over %.1f s, replaying at %s speed\n", path,
+           source->num_frames, source->width, source->height,
+           session_recording_get_timestamp(source->recording, source->num_frames - 1) / 1e6,
+           max_speed ? "maximum" : "original");
+    return source;
+}
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Bring the picture up to the frame due now (every frame applied in turn, since tile
+// frames patch their predecessor), starting over from frame 0 after the last one
+static void replay_advance(frame_source_t *source)
+{
+    uint8_t *picture = (uint8_t *)source->pixels;
+
+    if (source->next_frame == 0 || source->replay_max_speed) {
+        if (source->next_frame == 0)
+            source->replay_start_us = monotonic_us();
+        session_recording_apply(source->recording, source->next_frame, picture);
+        source->next_frame = (source->next_frame + 1) % source->num_frames;
+        return;
+    }
+
+    uint64_t elapsed = monotonic_us() - source->replay_start_us;
+    while (source->next_frame != 0 &&
+           session_recording_get_timestamp(source->recording, source->next_frame) <= elapsed) {
+        session_recording_apply(source->recording, source->next_frame, picture);
+        source->next_frame = (source->next_frame + 1) % source->num_frames;
+    }
+}
+
+int frame_source_enable_latency_stamp(frame_source_t *source)
+{
+    if (!source || source->type == FRAME_SOURCE_DRM)
+        return -1;  // The framebuffer is read-only to us
+    if (source->width < LATENCY_STAMP_WIDTH || source->height < LATENCY_STAMP_HEIGHT) {
+        fprintf(stderr, "Latency stamp needs frames of at least %ux%u\n", LATENCY_STAMP_WIDTH, LATENCY_STAMP_HEIGHT);
+        return -1;
+    }
+
+    // File frames are mapped read-only, so they are stamped on a copy
+    if (!source->pixels) {
+        source->pixels = malloc(source->frame_size);
+        if (!source->pixels)
+            return -1;
+    }
+    source->latency_stamp = true;
+    return 0;
+}
+
+// Stamp the frame about to be returned (data is source->pixels or a mapped file frame)
+static void stamp_frame(frame_source_t *source, frame_buffer_t *frame)
+{
+    if (frame->data != source->pixels) {
+        memcpy(source->pixels, frame->data, source->frame_size);
+        frame->data = source->pixels;
+    }
+    latency_stamp_write(source->pixels, source->width, source->height, source->width * SYNTHETIC_BPP,
+                        monotonic_us());
+}
+
+// Parse "WxH[@HZ]"; missing parts keep their value
+static int parse_geometry(const char *text, uint32_t *width, uint32_t *height, uint32_t *refresh_rate)
+{
+    unsigned int w, h, hz;
+    int n = sscanf(text, "%ux%u@%u", &w, &h, &hz);
+    if (n < 2 || w == 0 || h == 0)
+        return -1;
+    *width = w;
+    *height = h;
+    if (n == 3) {
+        if (hz == 0)
+            return -1;
+        *refresh_rate = hz;
+    }
+    return 0;
+}
+
+frame_source_t *frame_source_create_from_spec(const char *spec)
+{
+    if (!spec)
+        return NULL;
+
+    uint32_t width = 0, height = 0, refresh_rate = 0;
+
+    if (strncmp(spec, "synthetic:", 10) == 0) {
+        const char *name = spec + 10;
+        const char *geometry = strchr(name, ':');
+        size_t name_len = geometry ? (size_t)(geometry - name) : strlen(name);
+
+        for (size_t i = 0; i < sizeof(pattern_names) / sizeof(pattern_names[0]); i++) {
+            if (strlen(pattern_names[i]) != name_len || strncmp(name, pattern_names[i], name_len) != 0)
+                continue;
+            if (geometry && parse_geometry(geometry + 1, &width, &height, &refresh_rate) < 0) {
+                fprintf(stderr, "Invalid frame size in source: %s\n", spec);
+                return NULL;
+            }
+            return frame_source_create_synthetic((synthetic_pattern_t)i, width, height, refresh_rate);
+        }
+        fprintf(stderr, "Unknown synthetic pattern in source: %s\n", spec);
+        return NULL;
+    }
+
+    if (strncmp(spec, "file:", 5) == 0) {
+        // The size comes last, so the path itself may contain ':'
+        const char *geometry = strrchr(spec + 5, ':');
+        if (!geometry || parse_geometry(geometry + 1, &width, &height, &refresh_rate) < 0) {
+            fprintf(stderr, "File source needs a frame size (file:PATH:WxH): %s\n", spec);
+            return NULL;
+        }
+        char path[4096];
+        size_t path_len = (size_t)(geometry - (spec + 5));
+        if (path_len == 0 || path_len >= sizeof(path)) {
+            fprintf(stderr, "Invalid path in source: %s\n", spec);
+            return NULL;
+        }
+        memcpy(path, spec + 5, path_len);
+        path[path_len] = '\0';
+        return frame_source_create_file(path, width, height, refresh_rate);
+    }
+
+    if (strncmp(spec, "replay:", 7) == 0) {
+        const char *path = spec + 7;
+        size_t path_len = strlen(path);
+        bool max_speed = false;
+        if (path_len > 4 && strcmp(path + path_len - 4, ":max") == 0) {
+            max_speed = true;
+            path_len -= 4;
+        }
+        char buf[4096];
+        if (path_len == 0 || path_len >= sizeof(buf)) {
+            fprintf(stderr, "Invalid path in source: %s\n", spec);
+            return NULL;
+        }
+        memcpy(buf, path, path_len);
+        buf[path_len] = '\0';
+        return frame_source_create_replay(buf, max_speed);
+    }
+
+    fprintf(stderr, "Unknown frame source: %s\n", spec);
+    return NULL;
+}
+
+void frame_source_destroy(frame_source_t *source)
+{
+    if (!source)
+        return;
+
+    if (source->fb)
+        drm_fb_close(source->fb);
+    free(source->pixels);
+    free(source->previous_pixels);
+    free(source->dirty_tiles);
+    free(source->desktop);
+    if (source->map)
+        munmap((void *)source->map, source->map_size);
+    if (source->fd >= 0)
+        close(source->fd);
+    session_recording_close(source->recording);
+    free(source);
+}
+
+// Size the two staging buffers and the dirty tile flags for a width x height frame
+static int drm_staging_resize(frame_source_t *source, uint32_t width, uint32_t height)
+{
+    if (source->pixels && width == source->staged_width && height == source->staged_height)
+        return 0;
+
+    size_t size = (size_t)width * height * FB_CONVERT_BPP;
+    size_t tiles = (size_t)((width + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE) *
+                   ((height + DIRTY_RECT_TILE_SIZE - 1) / DIRTY_RECT_TILE_SIZE);
+    free(source->pixels);
+    free(source->previous_pixels);
+    free(source->dirty_tiles);
+    source->pixels = malloc(size);
+    source->previous_pixels = malloc(size);
+    source->dirty_tiles = malloc(tiles * sizeof(bool));
+    source->has_previous = false;
+    if (!source->pixels || !source->previous_pixels || !source->dirty_tiles) {
+        free(source->pixels);
+        free(source->previous_pixels);
+        free(source->dirty_tiles);
+        source->pixels = source->previous_pixels = NULL;
+        source->dirty_tiles = NULL;
+        return -1;
+    }
+    source->staged_width = width;
+    source->staged_height = height;
+    return 0;
+}
+
+// Hand out the mapped framebuffer: in place if it is linear ARGB/XRGB in cached memory,
+// otherwise read once (detiled and converted as needed) into staging, comparing it with
+// the previous frame on the way
+static int drm_frame(frame_source_t *source, frame_buffer_t *frame)
+{
+    drm_fb_t *fb = source->fb;
+    const uint8_t *pixels = (const uint8_t *)fb->map + fb->offset;
+    frame->width = fb->width;
+    frame->height = fb->height;
+
+    // The memory type of a framebuffer does not change, so time it once
+    if (!source->read_mode_probed) {
+        source->read_mode = fb_convert_probe_read_mode(fb->map, fb->size);
+        source->read_mode_probed = true;
+        printf("Framebuffer %u is read %s\n", source->fb_id, fb_convert_read_mode_name(source->read_mode));
+    }
+
+    if (fb_convert_is_passthrough(fb->format, fb->modifier) && source->read_mode == FB_READ_IN_PLACE) {
+        frame->data = pixels;
+        frame->pitch = fb->pitch;
+        frame->bpp = FB_CONVERT_BPP;
+        frame->size = (size_t)fb->pitch * fb->height;
+        frame->format = fb->format;
+        return 0;
+    }
+
+    if (!fb_convert_supported(fb->format, fb->modifier)) {
+        uint64_t layout = ((uint64_t)fb->format << 32) ^ fb->modifier;
+        if (layout != source->unsupported_layout) {
+            fprintf(stderr, "Framebuffer format %.4s with modifier 0x%016llx is not supported\n",
+                    (const char *)&fb->format, (unsigned long long)fb->modifier);
+            source->unsupported_layout = layout;
+        }
+        return -1;
+    }
+
+    if (drm_staging_resize(source, fb->width, fb->height) < 0)
+        return -1;
+
+    // The new frame goes into the older buffer, compared with the newer one
+    uint32_t pitch = fb->width * FB_CONVERT_BPP;
+    fb_convert_dirty_t dirty = {
+        .previous = source->has_previous ? source->pixels : NULL,
+        .tile_size = DIRTY_RECT_TILE_SIZE,
+        .tiles = source->dirty_tiles
+    };
+    if (fb_convert_frame(pixels, fb->pitch, fb->format, fb->modifier, fb->width, fb->height,
+                         source->previous_pixels, pitch, source->read_mode == FB_READ_STREAM, &dirty) < 0) {
+        source->has_previous = false;
+        return -1;
+    }
+    uint32_t *latest = source->previous_pixels;
+    source->previous_pixels = source->pixels;
+    source->pixels = latest;
+    source->has_previous = true;
+
+    frame->data = source->pixels;
+    frame->pitch = pitch;
+    frame->bpp = FB_CONVERT_BPP;
+    frame->size = (size_t)pitch * fb->height;
+    frame->format = FRAME_SOURCE_FORMAT_XRGB8888;
+    frame->dirty_tiles = source->dirty_tiles;
+    return 0;
+}
+
+int frame_source_acquire(frame_source_t *source, frame_buffer_t *frame)
+{
+    if (!source || !frame)
+        return -1;
+
+    frame->sequence = ++source->sequence;
+    frame->dirty_tiles = NULL;
+    switch (source->type) {
+    case FRAME_SOURCE_DRM:
+        if (source->fb) {
+            drm_fb_close(source->fb);  // Previous frame was not released
+            source->fb = NULL;
+        }
+        source->fb = drm_fb_open(source->fb_id);
+        if (!source->fb)
+            return -1;  // Framebuffer might have changed
+
+        // Map the framebuffer for CPU access (needed for network transmission)
+        // Note: DMA-BUF zero-copy doesn't help here since we're sending over the network anyway
+        if (drm_fb_map(source->fb) < 0 || drm_frame(source, frame) < 0) {
+            drm_fb_close(source->fb);
+            source->fb = NULL;
+            return -1;
+        }
+        return 0;
+
+    case FRAME_SOURCE_SYNTHETIC:
+        switch (source->pattern) {
+        case SYNTHETIC_PATTERN_SCROLL_TEXT:
+            synthetic_scroll_text(source);
+            break;
+        case SYNTHETIC_PATTERN_MOVING_WINDOWS:
+            synthetic_moving_windows(source);
+            break;
+        case SYNTHETIC_PATTERN_VIDEO_NOISE:
+            synthetic_video_noise(source);
+            break;
+        case SYNTHETIC_PATTERN_IDLE:
+            if (source->frame_count == 0)
+                memcpy(source->pixels, source->desktop, (size_t)source->width * source->height * SYNTHETIC_BPP);
+            break;
+        }
+        source->frame_count++;
+        frame->data = source->pixels;
+        break;
+
+    case FRAME_SOURCE_FILE:
+        frame->data = source->map + source->next_frame * source->frame_size;
+        source->next_frame = (source->next_frame + 1) % source->num_frames;
+        break;
+
+    case FRAME_SOURCE_REPLAY:
+        replay_advance(source);
+        frame->data = source->pixels;
+        frame->width = source->width;
+        frame->height = source->height;
+        frame->bpp = SYNTHETIC_BPP;
+        frame->pitch = source->width * SYNTHETIC_BPP;
+        frame->size = (size_t)frame->pitch * source->height;
+        frame->format = session_recording_get_header(source->recording)->format;
+        if (source->latency_stamp)
+            stamp_frame(source, frame);
+        return 0;
+    }
+
+    frame->width = source->width;
+    frame->height = source->height;
+    frame->bpp = SYNTHETIC_BPP;
+    frame->pitch = source->width * SYNTHETIC_BPP;
+    frame->size = (size_t)frame->pitch * source->height;
+    frame->format = FRAME_SOURCE_FORMAT_XRGB8888;
+    if (source->latency_stamp)
+        stamp_frame(source, frame);
+    return 0;
+}
+
+void frame_source_release(frame_source_t *source, frame_buffer_t *frame)
+{
+    if (!source)
+        return;
+
+    if (source->type == FRAME_SOURCE_DRM && source->fb) {
+        drm_fb_close(source->fb);
+        source->fb = NULL;
+    }
+    if (frame)
+        frame->data = NULL;
+}
+
+uint32_t frame_source_get_fb_id(frame_source_t *source)
+{
+    return source ? source->fb_id : 0;
+}
+
+uint32_t frame_source_get_width(frame_source_t *source)
+{
+    return source ? source->width : 0;
+}
+
+uint32_t frame_source_get_height(frame_source_t *source)
+{
+    return source ? source->height : 0;
+}
+
+uint32_t frame_source_get_refresh_rate(frame_source_t *source)
+{
+    return source ? source->refresh_rate : 0;
+}
+
+const char *frame_source_get_name(frame_source_t *source)
+{
+    return source ? source->name : "";
+}
@@ -19,6 +19,8 @@ struct h264_encoder {
     x264_picture_t pic_in;
     x264_picture_t pic_out;
     bool initialized;
+    bool force_keyframe;
+    bool last_was_idr;  // Last encoded frame was an IDR
 };
 
 h264_encoder_t *h264_encoder_create(uint32_t width, uint32_t height, int fps, int bitrate_kbps)
@@ -97,30 +99,46 @@ void h264_encoder_destroy(h264_encoder_t *encoder)
     free(encoder);
 }
 
+static inline uint8_t clamp_u8(int v)
+{
+    return (v > 255) ? 255 : (v < 0) ? 0 : v;
+}
+
+// Chroma of the 2x2 block whose top-left pixel this is (simplified - the block is not averaged)
+// Fixed-point: -0.169*256≈-43, -0.331*256≈-85, 0.5*256=128
+//              0.5*256=128, -0.419*256≈-107, -0.081*256≈-21
+static inline void chroma(int r, int g, int b, uint8_t *u, uint8_t *v)
+{
+    *u = clamp_u8((-43 * r - 85 * g + 128 * b) / 256 + 128);
+    *v = clamp_u8((128 * r - 107 * g - 21 * b) / 256 + 128);
+}
+
 // Convert ARGB8888 to I420 (YUV420) with SIMD optimization
 // Uses fixed-point arithmetic for better performance
-static void argb_to_i420(const uint8_t *argb, uint8_t *y, uint8_t *u, uint8_t *v,
-                         uint32_t width, uint32_t height, uint32_t pitch)
+void h264_encoder_argb_to_i420(const uint8_t *argb, uint32_t pitch, const h264_i420_planes_t *planes,
+                               uint32_t x, uint32_t y, uint32_t width, uint32_t height)
 {
-    uint32_t uv_width = width / 2;
+    for (uint32_t i = y; i < y + height; i++) {
+        const uint8_t *row = argb + (size_t)i * pitch + (size_t)x * 4;
+        uint8_t *y_row = planes->y + (size_t)i * planes->y_stride + x;
+        uint8_t *u_row = planes->u + (size_t)(i / 2) * planes->uv_stride + x / 2;
+        uint8_t *v_row = planes->v + (size_t)(i / 2) * planes->uv_stride + x / 2;
+        bool chroma_row = i % 2 == 0;
+        uint32_t j = 0;
 
 #ifdef __SSE2__
-    // SIMD-optimized path using SSE2
-    // Fixed-point coefficients (scaled by 256 for precision)
-    const __m128i y_r_coeff = _mm_set1_epi16(77);   // 0.299 * 256 ≈ 77
-    const __m128i y_g_coeff = _mm_set1_epi16(150); // 0.587 * 256 ≈ 150
-    const __m128i y_b_coeff = _mm_set1_epi16(29);  // 0.114 * 256 ≈ 29
-
-    for (uint32_t i = 0; i < height; i++) {
-        uint32_t j = 0;
+        // SIMD-optimized path using SSE2
+        // Fixed-point coefficients (scaled by 256 for precision)
+        const __m128i y_r_coeff = _mm_set1_epi16(77);   // 0.299 * 256 ≈ 77
+        const __m128i y_g_coeff = _mm_set1_epi16(150); // 0.587 * 256 ≈ 150
+        const __m128i y_b_coeff = _mm_set1_epi16(29);  // 0.114 * 256 ≈ 29
 
         // Process 4 pixels at a time (SSE2 processes 4 32-bit pixels)
         for (; j + 4 <= width; j += 4) {
             // Load 4 ARGB pixels (16 bytes)
-            __m128i pixels = _mm_loadu_si128((__m128i*)(argb + i * pitch + j * 4));
+            __m128i pixels = _mm_loadu_si128((const __m128i *)(row + j * 4));
 
             // Extract R, G, B channels (ARGB format: byte order is B G R A)
-            // Shuffle to get: R R R R, G G G G, B B B B
             __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), _mm_set1_epi32(0xFF));
             __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), _mm_set1_epi32(0xFF));
             __m128i b = _mm_and_si128(pixels, _mm_set1_epi32(0xFF));
@@ -137,75 +155,44 @@ static void argb_to_i420(const uint8_t *argb, uint8_t *y, uint8_t *u, uint8_t *v
                 _mm_mullo_epi16(b_16, y_b_coeff));
             y_val = _mm_srli_epi16(y_val, 8); // Divide by 256
 
-            // Store Y values (pack to 8-bit)
-            __m128i y_packed = _mm_packus_epi16(y_val, y_val);
-            _mm_storel_epi64((__m128i*)(y + i * width + j), y_packed);
-
-            // For U/V, process every 2x2 block (simplified - use first pixel of block)
-            if (i % 2 == 0 && j % 2 == 0) {
-                uint8_t r_val = (uint8_t)_mm_extract_epi16(r_16, 0);
-                uint8_t g_val = (uint8_t)_mm_extract_epi16(g_16, 0);
-                uint8_t b_val = (uint8_t)_mm_extract_epi16(b_16, 0);
+            // Store Y values (4 bytes)
+            int y4 = _mm_cvtsi128_si32(_mm_packus_epi16(y_val, y_val));
+            memcpy(y_row + j, &y4, 4);
 
-                int u_val = (-43 * r_val - 85 * g_val + 128 * b_val) / 256 + 128;
-                int v_val = (128 * r_val - 107 * g_val - 21 * b_val) / 256 + 128;
-
-                uint32_t uv_idx = (i / 2) * uv_width + (j / 2);
-                u[uv_idx] = (u_val > 255) ? 255 : (u_val < 0) ? 0 : u_val;
-                v[uv_idx] = (v_val > 255) ? 255 : (v_val < 0) ? 0 : v_val;
+            // U/V for the two 2x2 blocks these pixels start
+            if (chroma_row) {
+                chroma(_mm_extract_epi16(r_16, 0), _mm_extract_epi16(g_16, 0), _mm_extract_epi16(b_16, 0),
+                       &u_row[j / 2], &v_row[j / 2]);
+                chroma(_mm_extract_epi16(r_16, 2), _mm_extract_epi16(g_16, 2), _mm_extract_epi16(b_16, 2),
+                       &u_row[j / 2 + 1], &v_row[j / 2 + 1]);
             }
         }
+#endif
 
-        // Handle remaining pixels with scalar code
+        // Remaining pixels (all of them without SIMD)
         for (; j < width; j++) {
-            const uint8_t *pixel = argb + (i * pitch + j * 4);
-            uint8_t r = pixel[2];
-            uint8_t g = pixel[1];
-            uint8_t b = pixel[0];
-
-            // Convert RGB to Y using fixed-point
-            int y_val = (77 * r + 150 * g + 29 * b) / 256;
-            y[i * width + j] = (y_val > 255) ? 255 : (y_val < 0) ? 0 : y_val;
-
-            // Subsample U and V (every 2x2 block)
-            if (i % 2 == 0 && j % 2 == 0) {
-                int u_val = (-43 * r - 85 * g + 128 * b) / 256 + 128;
-                int v_val = (128 * r - 107 * g - 21 * b) / 256 + 128;
-
-                uint32_t uv_idx = (i / 2) * uv_width + (j / 2);
-                u[uv_idx] = (u_val > 255) ? 255 : (u_val < 0) ? 0 : u_val;
-                v[uv_idx] = (v_val > 255) ? 255 : (v_val < 0) ? 0 : v_val;
-            }
-        }
-    }
-#else
-    // Scalar fallback path (no SIMD)
-    // Fixed-point coefficients for better performance
-    for (uint32_t i = 0; i < height; i++) {
-        for (uint32_t j = 0; j < width; j++) {
-            const uint8_t *pixel = argb + (i * pitch + j * 4);
+            const uint8_t *pixel = row + j * 4;
             uint8_t r = pixel[2];
             uint8_t g = pixel[1];
             uint8_t b = pixel[0];
 
             // Convert RGB to Y using fixed-point (0.299*256≈77, 0.587*256≈150, 0.114*256≈29)
-            int y_val = (77 * r + 150 * g + 29 * b) / 256;
-            y[i * width + j] = (y_val > 255) ? 255 : (y_val < 0) ? 0 : y_val;
+            y_row[j] = clamp_u8((77 * r + 150 * g + 29 * b) / 256);
 
             // Subsample U and V (every 2x2 block)
-            if (i % 2 == 0 && j % 2 == 0) {
-                // Fixed-point: -0.169*256≈-43, -0.331*256≈-85, 0.5*256=128
-                //              0.5*256=128, -0.419*256≈-107, -0.081*256≈-21
-                int u_val = (-43 * r - 85 * g + 128 * b) / 256 + 128;
-                int v_val = (128 * r - 107 * g - 21 * b) / 256 + 128;
-
-                uint32_t uv_idx = (i / 2) * uv_width + (j / 2);
-                u[uv_idx] = (u_val > 255) ? 255 : (u_val < 0) ? 0 : u_val;
-                v[uv_idx] = (v_val > 255) ? 255 : (v_val < 0) ? 0 : v_val;
-            }
+            if (chroma_row && j % 2 == 0)
+                chroma(r, g, b, &u_row[j / 2], &v_row[j / 2]);
         }
     }
-#endif
+}
+
+void h264_encoder_get_input(h264_encoder_t *encoder, h264_i420_planes_t *planes)
+{
+    planes->y = encoder->pic_in.img.plane[0];
+    planes->u = encoder->pic_in.img.plane[1];
+    planes->v = encoder->pic_in.img.plane[2];
+    planes->y_stride = encoder->pic_in.img.i_stride[0];
+    planes->uv_stride = encoder->pic_in.img.i_stride[1];
 }
 
 int h264_encoder_encode_frame(h264_encoder_t *encoder,
@@ -213,23 +200,30 @@ int h264_encoder_encode_frame(h264_encoder_t *encoder,
                               void **output,
                               size_t *output_size)
 {
-    if (!encoder || !encoder->encoder || !input || !output || !output_size)
+    if (!encoder || !encoder->encoder || !input)
         return -1;
 
     // Convert ARGB8888 to I420
     // x264 expects I420 with specific plane layout
-    uint8_t *y_plane = encoder->pic_in.img.plane[0];
-    uint8_t *u_plane = encoder->pic_in.img.plane[1];
-    uint8_t *v_plane = encoder->pic_in.img.plane[2];
+    h264_i420_planes_t planes;
+    h264_encoder_get_input(encoder, &planes);
 
     // Assume input is ARGB8888 with pitch = width * 4
     uint32_t input_pitch = encoder->width * 4;
-    argb_to_i420((const uint8_t *)input, y_plane, u_plane, v_plane,
-                 encoder->width, encoder->height, input_pitch);
+    h264_encoder_argb_to_i420((const uint8_t *)input, input_pitch, &planes, 0, 0, encoder->width, encoder->height);
+
+    return h264_encoder_encode_input(encoder, output, output_size);
+}
+
+int h264_encoder_encode_input(h264_encoder_t *encoder, void **output, size_t *output_size)
+{
+    if (!encoder || !encoder->encoder || !output || !output_size)
+        return -1;
 
     // Set picture properties
     encoder->pic_in.i_pts = encoder->pic_in.i_pts + 1;
-    encoder->pic_in.i_type = X264_TYPE_AUTO;
+    encoder->pic_in.i_type = encoder->force_keyframe ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    encoder->force_keyframe = false;
 
     // Encode
     x264_nal_t *nals = NULL;
@@ -239,6 +233,7 @@ int h264_encoder_encode_frame(h264_encoder_t *encoder,
     if (frame_size < 0) {
         return -1;
     }
+    encoder->last_was_idr = frame_size > 0 && encoder->pic_out.i_type == X264_TYPE_IDR;
 
     // Allocate output buffer
     size_t total_size = 0;
@@ -263,6 +258,17 @@ int h264_encoder_encode_frame(h264_encoder_t *encoder,
     return 0;
 }
 
+void h264_encoder_force_keyframe(h264_encoder_t *encoder)
+{
+    if (encoder)
+        encoder->force_keyframe = true;
+}
+
+bool h264_encoder_is_keyframe(h264_encoder_t *encoder)
+{
+    return encoder && encoder->last_was_idr;
+}
+
 uint32_t h264_encoder_get_width(h264_encoder_t *encoder)
 {
     return encoder ? encoder->width : 0;
@@ -0,0 +1,90 @@
+#include "latency_stamp.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define STAMP_COLUMNS 16
+#define STAMP_BITS 64
+#define TIMESTAMP_BITS 48
+#define MARKER_START 0xA  // 1010 in the first four cells
+#define MARKER_END 0x5    // 0101 in the last four
+
+static uint8_t crc8(uint64_t value)
+{
+    uint8_t crc = 0;
+    for (int i = TIMESTAMP_BITS - 8; i >= 0; i -= 8) {
+        crc ^= (uint8_t)(value >> i);
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+// Cell i holds bit 63 - i
+static uint64_t stamp_bits(uint64_t timestamp_us)
+{
+    uint64_t ts = timestamp_us & LATENCY_STAMP_MASK;
+    return ((uint64_t)MARKER_START << 60) | (ts << 12) | ((uint64_t)crc8(ts) << 4) | MARKER_END;
+}
+
+int latency_stamp_write(void *pixels, uint32_t width, uint32_t height, uint32_t pitch, uint64_t timestamp_us)
+{
+    if (!pixels || width < LATENCY_STAMP_WIDTH || height < LATENCY_STAMP_HEIGHT || pitch < width * 4)
+        return -1;
+
+    uint64_t bits = stamp_bits(timestamp_us);
+    for (uint32_t y = 0; y < LATENCY_STAMP_HEIGHT; y++) {
+        uint32_t *row = (uint32_t *)((uint8_t *)pixels + (size_t)y * pitch);
+        uint32_t cell_row = y / LATENCY_STAMP_CELL;
+        for (uint32_t x = 0; x < LATENCY_STAMP_WIDTH; x++) {
+            uint32_t cell = cell_row * STAMP_COLUMNS + x / LATENCY_STAMP_CELL;
+            row[x] = (bits >> (STAMP_BITS - 1 - cell)) & 1 ? 0xFFFFFF : 0x000000;
+        }
+    }
+    return 0;
+}
+
+static int decode_bits(uint64_t bits, uint64_t *timestamp_us)
+{
+    if ((bits >> 60) != MARKER_START || (bits & 0xF) != MARKER_END)
+        return -1;
+    uint64_t ts = (bits >> 12) & LATENCY_STAMP_MASK;
+    if (((bits >> 4) & 0xFF) != crc8(ts))
+        return -1;
+    *timestamp_us = ts;
+    return 0;
+}
+
+// Average brightness of the middle 4x4 of every cell; brighter than mid-grey is a 1
+static int read_cells(const uint8_t *base, uint32_t stride, uint32_t bytes_per_pixel, bool rgb,
+                      uint64_t *timestamp_us)
+{
+    uint64_t bits = 0;
+    for (uint32_t cell = 0; cell < STAMP_BITS; cell++) {
+        uint32_t x0 = (cell % STAMP_COLUMNS) * LATENCY_STAMP_CELL + 2;
+        uint32_t y0 = (cell / STAMP_COLUMNS) * LATENCY_STAMP_CELL + 2;
+        uint32_t sum = 0;
+        for (uint32_t y = y0; y < y0 + 4; y++) {
+            const uint8_t *p = base + (size_t)y * stride + (size_t)x0 * bytes_per_pixel;
+            for (uint32_t x = 0; x < 4; x++, p += bytes_per_pixel)
+                sum += rgb ? (uint32_t)(p[0] + 2 * p[1] + p[2]) / 4 : p[0];
+        }
+        bits = (bits << 1) | (sum > 16 * 128);
+    }
+    return decode_bits(bits, timestamp_us);
+}
+
+int latency_stamp_read(const void *pixels, uint32_t width, uint32_t height, uint32_t pitch, uint64_t *timestamp_us)
+{
+    if (!pixels || !timestamp_us || width < LATENCY_STAMP_WIDTH || height < LATENCY_STAMP_HEIGHT ||
+        pitch < width * 4)
+        return -1;
+    return read_cells(pixels, pitch, 4, true, timestamp_us);
+}
+
+int latency_stamp_read_luma(const uint8_t *luma, uint32_t width, uint32_t height, uint32_t stride,
+                            uint64_t *timestamp_us)
+{
+    if (!luma || !timestamp_us || width < LATENCY_STAMP_WIDTH || height < LATENCY_STAMP_HEIGHT || stride < width)
+        return -1;
+    return read_cells(luma, stride, 1, false, timestamp_us);
+}
@@ -1,4 +1,7 @@
 #include "x11_streamer.h"
+#include "send_queue.h"
+#include "fec.h"
+#include "audio_capture.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,10 +21,11 @@ static void signal_handler(int sig)
 
 static void print_usage(const char *prog_name)
 {
-    fprintf(stderr, "Usage: %s [HOST:PORT] [OPTIONS]\n", prog_name);
+    fprintf(stderr, "Usage: %s [HOST:PORT...] [OPTIONS]\n", prog_name);
     fprintf(stderr, "\n");
     fprintf(stderr, "Arguments:\n");
     fprintf(stderr, "  HOST:PORT            Connect directly to HOST:PORT (e.g., 192.168.1.100:4321)\n");
+    fprintf(stderr, "                       Up to %d receivers, all showing the same output\n", STREAMER_MAX_RECEIVERS);
     fprintf(stderr, "                       If omitted, uses broadcast discovery\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Options:\n");
@@ -32,26 +36,57 @@ static void print_usage(const char *prog_name)
     fprintf(stderr, "  --pin PIN            PIN code (4 digits, avoids prompt)\n");
     fprintf(stderr, "  --mirror             Mirror primary display (clone primary display)\n");
     fprintf(stderr, "  --extend             Extend desktop (create new virtual display, default)\n");
+    fprintf(stderr, "  --udp                Send video frames over UDP (unencrypted sessions only)\n");
+    fprintf(stderr, "  --fec auto|off|N     UDP parity: one per N packets (%d-%d), or adapt to loss (default: auto)\n", FEC_GROUP_MIN, FEC_GROUP_MAX);
+    fprintf(stderr, "  --pcm-audio          Send uncompressed audio even to receivers that can decode Opus\n");
+    fprintf(stderr, "  --audio-fragment MS  PulseAudio capture fragment, %d-%d ms (default: %d)\n",
+            AUDIO_CAPTURE_MIN_FRAGMENT_MS, AUDIO_CAPTURE_MAX_FRAGMENT_MS, AUDIO_CAPTURE_DEFAULT_FRAGMENT_MS);
+    fprintf(stderr, "  --audio-source NAME  PulseAudio source to record (default: monitor of the default sink)\n");
+    fprintf(stderr, "  --max-backlog MS     Queued data before stale frames are replaced (default: %d)\n", SEND_QUEUE_DEFAULT_MAX_BACKLOG_MS);
+    fprintf(stderr, "  --resume-grace MS    Reconnect a dropped receiver for this long, 0 = off (default: %d)\n", STREAMER_DEFAULT_RESUME_GRACE_MS);
+    fprintf(stderr, "  --source SPEC        Stream test frames instead of an X11 output (no X server needed):\n");
+    fprintf(stderr, "                       synthetic:scroll-text|moving-windows|video-noise|idle[:WxH[@HZ]]\n");
+    fprintf(stderr, "                       file:PATH:WxH[@HZ] (raw XRGB8888 frames, played in a loop)\n");
+    fprintf(stderr, "                       replay:PATH[:max] (a --record file, at original or maximum speed)\n");
+    fprintf(stderr, "  --latency-stamp      Stamp capture times into --source frames (read by reference-receiver)\n");
+    fprintf(stderr, "  --record PATH        Record captured frames (changed tiles and timestamps) for replay\n");
+    fprintf(stderr, "  --record-full        Record every frame whole instead of only changed tiles\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Examples:\n");
     fprintf(stderr, "  %s                           # Broadcast discovery on port %d\n", prog_name, DEFAULT_TV_PORT);
     fprintf(stderr, "  %s 192.168.1.100:4321        # Connect directly to IP:port\n", prog_name);
+    fprintf(stderr, "  %s 192.168.1.100 192.168.1.101  # Same output on two TVs\n", prog_name);
     fprintf(stderr, "  %s --port 8888               # Broadcast discovery on port 8888\n", prog_name);
+    fprintf(stderr, "  %s 127.0.0.1 --source synthetic:moving-windows:1280x720@30\n", prog_name);
+    fprintf(stderr, "  %s 192.168.1.100 --record ide.rec   # Later: --source replay:ide.rec\n", prog_name);
     fprintf(stderr, "\n");
 }
 
 int main(int argc, char *argv[])
 {
+    uint64_t start_us = audio_get_timestamp_us();  // Time-to-first-frame is measured from here
     x11_streamer_options_t options = {
         .use_broadcast = true,  // Default: use broadcast
-        .host = NULL,
+        .num_hosts = 0,
         .port = DEFAULT_TV_PORT,
         .broadcast_timeout_ms = 5000,
         .program_name = argv[0],  // Pass program name for error messages
         .force_encrypt = false,
         .force_no_encrypt = false,
         .pin = 0xFFFF,  // No PIN provided by default (0xFFFF = sentinel, valid PINs are 0-9999)
-        .display_mode = STREAMER_DISPLAY_MODE_EXTEND  // Default: extend desktop
+        .display_mode = STREAMER_DISPLAY_MODE_EXTEND,  // Default: extend desktop
+        .max_backlog_ms = SEND_QUEUE_DEFAULT_MAX_BACKLOG_MS,
+        .udp_video = false,
+        .fec_group = FEC_GROUP_AUTO,
+        .resume_grace_ms = STREAMER_DEFAULT_RESUME_GRACE_MS,
+        .start_us = start_us,
+        .frame_source = NULL,  // Default: capture the X11 output
+        .record_path = NULL,
+        .record_full_frames = false,
+        .latency_stamp = false,
+        .pcm_audio = false,
+        .audio_fragment_ms = 0,  // Default: AUDIO_CAPTURE_DEFAULT_FRAGMENT_MS
+        .audio_source = NULL     // Default: monitor of the default sink
     };
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
@@ -100,27 +135,111 @@ int main(int argc, char *argv[])
             options.display_mode = STREAMER_DISPLAY_MODE_MIRROR;
         } else if (strcmp(argv[i], "--extend") == 0) {
             options.display_mode = STREAMER_DISPLAY_MODE_EXTEND;
+        } else if (strcmp(argv[i], "--udp") == 0) {
+            options.udp_video = true;
+        } else if (strcmp(argv[i], "--fec") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --fec requires an argument\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
+            if (strcmp(argv[i], "auto") == 0) {
+                options.fec_group = FEC_GROUP_AUTO;
+            } else if (strcmp(argv[i], "off") == 0) {
+                options.fec_group = FEC_GROUP_OFF;
+            } else {
+                options.fec_group = atoi(argv[i]);
+                if (options.fec_group < FEC_GROUP_MIN || options.fec_group > FEC_GROUP_MAX) {
+                    fprintf(stderr, "Error: Invalid FEC group size: %s\n", argv[i]);
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--max-backlog") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --max-backlog requires an argument\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.max_backlog_ms = atoi(argv[++i]);
+            if (options.max_backlog_ms <= 0) {
+                fprintf(stderr, "Error: Invalid backlog: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--resume-grace") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --resume-grace requires an argument\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.resume_grace_ms = atoi(argv[++i]);
+            if (options.resume_grace_ms < 0) {
+                fprintf(stderr, "Error: Invalid resume grace: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--source") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --source requires an argument\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.frame_source = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --record requires a file\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.record_path = argv[++i];
+        } else if (strcmp(argv[i], "--record-full") == 0) {
+            options.record_full_frames = true;
+        } else if (strcmp(argv[i], "--latency-stamp") == 0) {
+            options.latency_stamp = true;
+        } else if (strcmp(argv[i], "--pcm-audio") == 0) {
+            options.pcm_audio = true;
+        } else if (strcmp(argv[i], "--audio-fragment") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --audio-fragment requires an argument\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.audio_fragment_ms = atoi(argv[++i]);
+            if (options.audio_fragment_ms < AUDIO_CAPTURE_MIN_FRAGMENT_MS ||
+                options.audio_fragment_ms > AUDIO_CAPTURE_MAX_FRAGMENT_MS) {
+                fprintf(stderr, "Error: Audio fragment must be %d-%d ms: %s\n", AUDIO_CAPTURE_MIN_FRAGMENT_MS,
+                        AUDIO_CAPTURE_MAX_FRAGMENT_MS, argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--audio-source") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --audio-source requires a source name\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.audio_source = argv[++i];
         } else if (argv[i][0] != '-') {
-            // Positional argument: HOST:PORT or HOST
+            // Positional argument: HOST:PORT or HOST (one per receiver)
+            if (options.num_hosts >= STREAMER_MAX_RECEIVERS) {
+                fprintf(stderr, "Error: At most %d receivers are supported\n", STREAMER_MAX_RECEIVERS);
+                return 1;
+            }
             char *host_port = argv[i];
             char *colon = strchr(host_port, ':');
+            int port = DEFAULT_TV_PORT;  // Format: HOST (use default port)
 
             if (colon) {
                 // Format: HOST:PORT
                 *colon = '\0';
-                options.host = host_port;
-                options.port = atoi(colon + 1);
-                if (options.port <= 0 || options.port > 65535) {
+                port = atoi(colon + 1);
+                if (port <= 0 || port > 65535) {
                     fprintf(stderr, "Error: Invalid port number in %s\n", argv[i]);
                     return 1;
                 }
-                options.use_broadcast = false;  // Host specified, disable broadcast
-            } else {
-                // Format: HOST (use default port)
-                options.host = host_port;
-                options.port = DEFAULT_TV_PORT;
-                options.use_broadcast = false;  // Host specified, disable broadcast
             }
+            options.hosts[options.num_hosts] = host_port;
+            options.ports[options.num_hosts] = port;
+            options.num_hosts++;
+            options.use_broadcast = false;  // Host specified, disable broadcast
         } else {
             fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
             print_usage(argv[0]);
@@ -141,10 +260,11 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if (options.use_broadcast && !options.host) {
+    if (options.use_broadcast && options.num_hosts == 0) {
         printf("X11 Framebuffer Streamer: Broadcast discovery enabled (port %d)\n", options.port);
     } else {
-        printf("X11 Framebuffer Streamer: Connecting to %s:%d\n", options.host, options.port);
+        for (int i = 0; i < options.num_hosts; i++)
+            printf("X11 Framebuffer Streamer: Connecting to %s:%d\n", options.hosts[i], options.ports[i]);
     }
     printf("Press Ctrl+C to stop\n");
 
@@ -10,6 +10,9 @@
 #include <stdio.h>
 
 #define MAX_MESSAGE_LEN 65535
+#define NOISE_MAC_LEN 16  // ChaChaPoly authentication tag
+#define MAX_RECORD_PLAINTEXT (MAX_MESSAGE_LEN - NOISE_MAC_LEN)
+#define SEND_BATCH_SIZE (4 * (MAX_MESSAGE_LEN + 2))  // Up to 4 full records per write
 #define NOISE_PATTERN "Noise_NK_25519_ChaChaPoly_SHA256"  // Receiver has static key, streamer uses ephemeral
 
 // Helper function to format Noise error messages
@@ -26,7 +29,9 @@ struct noise_encryption_context {
     NoiseHandshakeState *handshake;
     NoiseCipherState *send_cipher;
     NoiseCipherState *recv_cipher;
+    uint8_t handshake_hash[32];  // SHA-256 of the handshake transcript (for session tickets)
     uint8_t message_buffer[MAX_MESSAGE_LEN + 2];
+    uint8_t *send_batch;  // Length-prefixed ciphertext records awaiting one write (lazy)
 };
 
 noise_encryption_context_t *noise_encryption_init(bool is_initiator)
@@ -79,6 +84,7 @@ void noise_encryption_cleanup(noise_encryption_context_t *ctx)
         ctx->handshake = NULL;
     }
 
+    free(ctx->send_batch);
     free(ctx);
 }
 
@@ -199,6 +205,14 @@ int noise_encryption_handshake(noise_encryption_context_t *ctx, int fd)
         }
     }
 
+    // Keep the handshake hash; split() does not need it but session tickets do
+    err = noise_handshakestate_get_handshake_hash(ctx->handshake, ctx->handshake_hash,
+                                                  sizeof(ctx->handshake_hash));
+    if (err != NOISE_ERROR_NONE) {
+        noise_log_error("Failed to get Noise handshake hash", err);
+        return -1;
+    }
+
     // Split handshake into send/recv cipher states
     err = noise_handshakestate_split(ctx->handshake, &ctx->send_cipher, &ctx->recv_cipher);
     if (err != NOISE_ERROR_NONE) {
@@ -210,10 +224,45 @@ int noise_encryption_handshake(noise_encryption_context_t *ctx, int fd)
     return 0;
 }
 
-int noise_encryption_send(noise_encryption_context_t *ctx, int fd,
-                          const void *data, size_t data_len)
+// Encrypt one record (plaintext <= MAX_RECORD_PLAINTEXT) into out as
+// [2-byte length][ciphertext]. Returns bytes written, or -1 on error
+static ssize_t seal_record(noise_encryption_context_t *ctx, const uint8_t *src, size_t len, uint8_t *out)
 {
-    if (!ctx || !data || fd < 0 || data_len == 0)
+    // Encrypt in place after the 2-byte length prefix
+    uint8_t *record = out + 2;
+    memcpy(record, src, len);
+
+    NoiseBuffer buffer;
+    noise_buffer_set_inout(buffer, record, len, len + NOISE_MAC_LEN);
+
+    int err = noise_cipherstate_encrypt(ctx->send_cipher, &buffer);
+    if (err != NOISE_ERROR_NONE) {
+        noise_log_error("Failed to encrypt data", err);
+        return -1;
+    }
+
+    // Encrypted message length (2 bytes, network byte order)
+    uint16_t msg_len = htons((uint16_t)buffer.size);
+    memcpy(out, &msg_len, 2);
+    return 2 + (ssize_t)buffer.size;
+}
+
+size_t noise_encryption_sealed_size(const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t len = iov[i].iov_len;
+        size_t records = (len + MAX_RECORD_PLAINTEXT - 1) / MAX_RECORD_PLAINTEXT;
+        total += len + records * (2 + NOISE_MAC_LEN);
+    }
+    return total;
+}
+
+ssize_t noise_encryption_seal(noise_encryption_context_t *ctx,
+                              const struct iovec *iov, int iovcnt,
+                              void *out, size_t out_size)
+{
+    if (!ctx || !iov || iovcnt <= 0 || !out)
         return -1;
 
     if (!ctx->handshake_complete || !ctx->send_cipher) {
@@ -221,40 +270,88 @@ int noise_encryption_send(noise_encryption_context_t *ctx, int fd,
         return -1;
     }
 
-    // Encrypt the data
-    // Need to leave room for MAC (16 bytes for ChaChaPoly)
-    size_t max_plaintext = sizeof(ctx->message_buffer) - 16;
-    if (data_len > max_plaintext) {
+    if (out_size < noise_encryption_sealed_size(iov, iovcnt)) {
         errno = EMSGSIZE;
         return -1;
     }
 
-    // Copy plaintext to buffer
-    memcpy(ctx->message_buffer, data, data_len);
+    size_t used = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        const uint8_t *src = (const uint8_t *)iov[i].iov_base;
+        size_t remaining = iov[i].iov_len;
 
-    NoiseBuffer buffer;
-    noise_buffer_set_inout(buffer, ctx->message_buffer, data_len, sizeof(ctx->message_buffer));
+        while (remaining > 0) {
+            size_t chunk = remaining < MAX_RECORD_PLAINTEXT ? remaining : MAX_RECORD_PLAINTEXT;
+            ssize_t n = seal_record(ctx, src, chunk, (uint8_t *)out + used);
+            if (n < 0)
+                return -1;
+            used += n;
+            src += chunk;
+            remaining -= chunk;
+        }
+    }
 
-    int err = noise_cipherstate_encrypt(ctx->send_cipher, &buffer);
-    if (err != NOISE_ERROR_NONE) {
-        noise_log_error("Failed to encrypt data", err);
+    return (ssize_t)used;
+}
+
+int noise_encryption_sendv(noise_encryption_context_t *ctx, int fd,
+                           const struct iovec *iov, int iovcnt)
+{
+    if (!ctx || fd < 0 || !iov || iovcnt <= 0)
         return -1;
-    }
 
-    // Send encrypted message length (2 bytes, network byte order)
-    uint16_t msg_len = htons((uint16_t)buffer.size);
-    if (write_exact(fd, &msg_len, 2) != 2) {
+    if (!ctx->handshake_complete || !ctx->send_cipher) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Send encrypted data
-    if (write_exact(fd, buffer.data, buffer.size) != (int)buffer.size) {
-        return -1;
+    if (!ctx->send_batch) {
+        ctx->send_batch = malloc(SEND_BATCH_SIZE);
+        if (!ctx->send_batch)
+            return -1;
     }
 
+    size_t used = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        const uint8_t *src = (const uint8_t *)iov[i].iov_base;
+        size_t remaining = iov[i].iov_len;
+
+        while (remaining > 0) {
+            size_t chunk = remaining < MAX_RECORD_PLAINTEXT ? remaining : MAX_RECORD_PLAINTEXT;
+
+            // Flush the batch if this record doesn't fit
+            if (used + 2 + chunk + NOISE_MAC_LEN > SEND_BATCH_SIZE) {
+                if (write_exact(fd, ctx->send_batch, used) != (int)used)
+                    return -1;
+                used = 0;
+            }
+
+            ssize_t n = seal_record(ctx, src, chunk, ctx->send_batch + used);
+            if (n < 0)
+                return -1;
+            used += n;
+
+            src += chunk;
+            remaining -= chunk;
+        }
+    }
+
+    if (used > 0 && write_exact(fd, ctx->send_batch, used) != (int)used)
+        return -1;
+
     return 0;
 }
 
+int noise_encryption_send(noise_encryption_context_t *ctx, int fd,
+                          const void *data, size_t data_len)
+{
+    if (!ctx || !data || fd < 0 || data_len == 0)
+        return -1;
+
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = data_len };
+    return noise_encryption_sendv(ctx, fd, &iov, 1);
+}
+
 ssize_t noise_encryption_recv(noise_encryption_context_t *ctx, int fd,
                                void *buf, size_t buf_len)
 {
@@ -306,6 +403,34 @@ ssize_t noise_encryption_recv(noise_encryption_context_t *ctx, int fd,
     return (ssize_t)buffer.size;
 }
 
+int noise_encryption_derive_ticket(noise_encryption_context_t *ctx,
+                                   const uint8_t *nonce, size_t nonce_len,
+                                   uint8_t *ticket, size_t ticket_len)
+{
+    uint8_t hash[32];
+
+    if (!ctx || !ctx->handshake_complete || !ticket || ticket_len > sizeof(hash))
+        return -1;
+
+    NoiseHashState *sha256 = NULL;
+    int err = noise_hashstate_new_by_id(&sha256, NOISE_HASH_SHA256);
+    if (err != NOISE_ERROR_NONE) {
+        noise_log_error("Failed to create SHA-256 state", err);
+        return -1;
+    }
+
+    err = noise_hashstate_hash_two(sha256, ctx->handshake_hash, sizeof(ctx->handshake_hash),
+                                   nonce, nonce_len, hash, sizeof(hash));
+    noise_hashstate_free(sha256);
+    if (err != NOISE_ERROR_NONE) {
+        noise_log_error("Failed to derive session ticket", err);
+        return -1;
+    }
+
+    memcpy(ticket, hash, ticket_len);
+    return 0;
+}
+
 bool noise_encryption_is_ready(noise_encryption_context_t *ctx)
 {
     return ctx && ctx->handshake_complete && ctx->send_cipher && ctx->recv_cipher;
@@ -12,29 +12,112 @@
 // Note: Using TCP, so sequence numbers are mainly for debugging/monitoring
 static _Thread_local uint32_t sequence_counter = 0;
 
-int protocol_send_message(int fd, message_type_t type, const void *data, size_t data_len)
+// Maximum iovecs per sendmsg() (IOV_MAX is 1024 on Linux)
+#define PROTOCOL_MAX_IOV 1024
+
+// Write an iovec array completely, batching at most PROTOCOL_MAX_IOV entries per
+// sendmsg() and resuming after partial writes. The array is modified in place.
+static int send_iov_all(int fd, struct iovec *iov, int iovcnt)
 {
-    message_header_t header = {
-        .type = type,
-        .length = htonl((uint32_t)data_len),  // Convert to network byte order
-        .sequence = htonl(sequence_counter++)  // Convert to network byte order
-    };
-
-    // Send header
-    ssize_t sent = send(fd, &header, sizeof(header), MSG_NOSIGNAL);
-    if (sent != sizeof(header))
-        return -1;
+    while (iovcnt > 0) {
+        // Skip fully-sent (or empty) entries
+        if (iov->iov_len == 0) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+
+        struct msghdr msg = {
+            .msg_iov = iov,
+            .msg_iovlen = iovcnt < PROTOCOL_MAX_IOV ? iovcnt : PROTOCOL_MAX_IOV
+        };
 
-    // Send payload if any
-    if (data && data_len > 0) {
-        sent = send(fd, data, data_len, MSG_NOSIGNAL);
-        if (sent != (ssize_t)data_len)
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
             return -1;
+        }
+
+        // Advance past what was written
+        while (sent > 0 && iovcnt > 0) {
+            if ((size_t)sent >= iov->iov_len) {
+                sent -= iov->iov_len;
+                iov++;
+                iovcnt--;
+            } else {
+                iov->iov_base = (uint8_t *)iov->iov_base + sent;
+                iov->iov_len -= sent;
+                sent = 0;
+            }
+        }
     }
 
     return 0;
 }
 
+void protocol_build_header(message_header_t *header, message_type_t type, size_t data_len)
+{
+    header->type = type;
+    header->length = htonl((uint32_t)data_len);  // Convert to network byte order
+    header->sequence = htonl(sequence_counter++);  // Convert to network byte order
+}
+
+// Build the [header, fixed struct, payload...] gather list for a message.
+// Uses stack_iov when it is large enough, otherwise allocates (caller frees if != stack_iov)
+static struct iovec *message_iov_build(message_header_t *header, message_type_t type,
+                                       const void *data, size_t data_len,
+                                       const struct iovec *payload, int payload_cnt,
+                                       struct iovec *stack_iov, int stack_cnt, int *iovcnt)
+{
+    if (payload_cnt < 0 || (payload_cnt > 0 && !payload))
+        return NULL;
+
+    protocol_build_header(header, type, data_len);
+
+    *iovcnt = 2 + payload_cnt;
+    struct iovec *iov = stack_iov;
+    if (*iovcnt > stack_cnt) {
+        iov = malloc(*iovcnt * sizeof(struct iovec));
+        if (!iov)
+            return NULL;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(*header);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = data ? data_len : 0;
+    if (payload_cnt > 0)
+        memcpy(&iov[2], payload, payload_cnt * sizeof(struct iovec));
+
+    return iov;
+}
+
+int protocol_send_message_iov(int fd, message_type_t type, const void *data, size_t data_len,
+                              const struct iovec *payload, int payload_cnt)
+{
+    message_header_t header;
+    struct iovec stack_iov[16];
+    int iovcnt;
+
+    // Header + fixed struct + payload; small messages stay on the stack
+    struct iovec *iov = message_iov_build(&header, type, data, data_len, payload, payload_cnt,
+                                          stack_iov, sizeof(stack_iov) / sizeof(stack_iov[0]), &iovcnt);
+    if (!iov)
+        return -1;
+
+    int ret = send_iov_all(fd, iov, iovcnt);
+
+    if (iov != stack_iov)
+        free(iov);
+    return ret;
+}
+
+int protocol_send_message(int fd, message_type_t type, const void *data, size_t data_len)
+{
+    return protocol_send_message_iov(fd, type, data, data_len, NULL, 0);
+}
+
 int protocol_receive_message(int fd, message_header_t *header, void **payload)
 {
     if (!header)
@@ -73,33 +156,39 @@ int protocol_receive_message(int fd, message_header_t *header, void **payload)
     return 1;
 }
 
-// Encrypted version of protocol_send_message
-int protocol_send_message_encrypted(void *noise_ctx, int fd, message_type_t type, const void *data, size_t data_len)
+// Encrypted version of protocol_send_message_iov
+int protocol_send_message_encrypted_iov(void *noise_ctx, int fd, message_type_t type,
+                                        const void *data, size_t data_len,
+                                        const struct iovec *payload, int payload_cnt)
 {
     noise_encryption_context_t *ctx = (noise_encryption_context_t *)noise_ctx;
 
     if (!ctx || !noise_encryption_is_ready(ctx)) {
         // Fallback to unencrypted if encryption not ready
-        return protocol_send_message(fd, type, data, data_len);
+        return protocol_send_message_iov(fd, type, data, data_len, payload, payload_cnt);
     }
 
-    message_header_t header = {
-        .type = type,
-        .length = htonl((uint32_t)data_len),  // Convert to network byte order
-        .sequence = htonl(sequence_counter++)  // Convert to network byte order
-    };
-
-    // Encrypt and send header
-    if (noise_encryption_send(ctx, fd, &header, sizeof(header)) < 0)
+    // Header, fixed struct and payload are each encrypted as their own record(s),
+    // matching what the receiver expects, but flushed together
+    message_header_t header;
+    struct iovec stack_iov[16];
+    int iovcnt;
+    struct iovec *iov = message_iov_build(&header, type, data, data_len, payload, payload_cnt,
+                                          stack_iov, sizeof(stack_iov) / sizeof(stack_iov[0]), &iovcnt);
+    if (!iov)
         return -1;
 
-    // Encrypt and send payload if any
-    if (data && data_len > 0) {
-        if (noise_encryption_send(ctx, fd, data, data_len) < 0)
-            return -1;
-    }
+    int ret = noise_encryption_sendv(ctx, fd, iov, iovcnt);
 
-    return 0;
+    if (iov != stack_iov)
+        free(iov);
+    return ret;
+}
+
+// Encrypted version of protocol_send_message
+int protocol_send_message_encrypted(void *noise_ctx, int fd, message_type_t type, const void *data, size_t data_len)
+{
+    return protocol_send_message_encrypted_iov(noise_ctx, fd, type, data, data_len, NULL, 0);
 }
 
 // Encrypted version of protocol_receive_message
@@ -0,0 +1,85 @@
+#include "receiver_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define RECEIVER_CACHE_DIR "x11-streamer"
+#define RECEIVER_CACHE_FILE "last_receiver"
+
+// Build the cache directory path; returns -1 if there is no home to put it in
+static int cache_dir_path(char *buf, size_t size)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+
+    if (xdg && xdg[0] == '/')
+        n = snprintf(buf, size, "%s/%s", xdg, RECEIVER_CACHE_DIR);
+    else if (home && home[0])
+        n = snprintf(buf, size, "%s/.cache/%s", home, RECEIVER_CACHE_DIR);
+    else
+        return -1;
+
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+int receiver_cache_load(char *host, size_t host_size, int *port)
+{
+    char dir[512];
+    char path[600];
+    if (cache_dir_path(dir, sizeof(dir)) < 0)
+        return -1;
+    snprintf(path, sizeof(path), "%s/%s", dir, RECEIVER_CACHE_FILE);
+
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    char line[320];
+    char cached_host[256];
+    int cached_port = 0;
+    int ok = fgets(line, sizeof(line), fp) &&
+             sscanf(line, "%255s %d", cached_host, &cached_port) == 2 &&
+             cached_port > 0 && cached_port <= 65535 && strlen(cached_host) < host_size;
+    fclose(fp);
+    if (!ok)
+        return -1;
+
+    strcpy(host, cached_host);
+    *port = cached_port;
+    return 0;
+}
+
+void receiver_cache_save(const char *host, int port)
+{
+    char dir[512];
+    char path[600];
+    char tmp[608];
+
+    if (!host || cache_dir_path(dir, sizeof(dir)) < 0)
+        return;
+
+    // Create ~/.cache if needed, then our directory
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdir(dir, 0700);
+        *slash = '/';
+    }
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+        return;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, RECEIVER_CACHE_FILE);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    // Write and rename, so a concurrent startup never reads half a line
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return;
+    int ok = fprintf(fp, "%s %d\n", host, port) > 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) < 0)
+        remove(tmp);
+}
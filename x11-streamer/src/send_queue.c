@@ -0,0 +1,473 @@
+#include "send_queue.h"
+#include "noise_encryption.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef TCP_NOTSENT_LOWAT
+#define TCP_NOTSENT_LOWAT 25
+#endif
+
+#define SEND_QUEUE_NOTSENT_LOWAT (128 * 1024)  // Unsent bytes the kernel may hold
+#define DRAIN_RATE_MIN_SAMPLE_US 10000         // Ignore shorter busy periods
+#define DRAIN_RATE_SAMPLE_US 100000            // Re-sample every 100ms while busy
+
+struct send_message {
+    atomic_int refs;
+    send_class_t cls;
+    uint8_t *plain;      // Header + fixed struct + payload
+    size_t plain_size;
+    size_t *seg_lens;    // Record boundaries for encryption (one per original iovec)
+    int num_segs;
+};
+
+typedef struct send_entry {
+    struct send_entry *next;
+    send_class_t cls;
+    uint64_t enqueue_us;
+    send_message_t *msg; // Shared plaintext (one reference per entry)
+    uint8_t *wire;       // Bytes on the wire (== msg->plain when unencrypted)
+    size_t wire_size;
+    size_t sent;         // Bytes of wire already written
+} send_entry_t;
+
+struct send_queue {
+    int fd;
+    noise_encryption_context_t *noise_ctx;
+    uint32_t max_backlog_ms;
+    pthread_mutex_t mutex;
+    send_entry_t *head;
+    send_entry_t *tail;
+    size_t queued_bytes;    // Unsent bytes across all entries
+    uint64_t dropped_frames;
+    bool failed;
+    // Drain rate estimate (bytes/sec while data is queued)
+    uint64_t busy_start_us;
+    uint64_t busy_bytes;
+    double drain_rate;
+};
+
+static uint64_t send_queue_get_timestamp_us(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+    }
+    return 0;
+}
+
+static send_class_t class_for_type(message_type_t type)
+{
+    switch (type) {
+        case MSG_FRAME:
+            return SEND_CLASS_VIDEO;
+        case MSG_AUDIO:
+            return SEND_CLASS_AUDIO;
+        default:
+            return SEND_CLASS_CONTROL;
+    }
+}
+
+send_message_t *send_message_create(message_type_t type,
+                                    const void *data, size_t data_len,
+                                    const struct iovec *payload, int payload_cnt)
+{
+    if (payload_cnt < 0 || (payload_cnt > 0 && !payload))
+        return NULL;
+
+    send_message_t *msg = calloc(1, sizeof(send_message_t));
+    if (!msg)
+        return NULL;
+
+    atomic_init(&msg->refs, 1);
+    msg->cls = class_for_type(type);
+    msg->num_segs = 2 + payload_cnt;
+    msg->seg_lens = malloc(msg->num_segs * sizeof(size_t));
+
+    size_t total = sizeof(message_header_t) + (data ? data_len : 0);
+    for (int i = 0; i < payload_cnt; i++)
+        total += payload[i].iov_len;
+
+    msg->plain = malloc(total);
+    if (!msg->plain || !msg->seg_lens) {
+        send_message_unref(msg);
+        return NULL;
+    }
+    msg->plain_size = total;
+
+    // Copy header, fixed struct and payload into the message
+    message_header_t header;
+    protocol_build_header(&header, type, data_len);
+    memcpy(msg->plain, &header, sizeof(header));
+    msg->seg_lens[0] = sizeof(header);
+
+    size_t offset = sizeof(header);
+    msg->seg_lens[1] = data ? data_len : 0;
+    if (data && data_len > 0) {
+        memcpy(msg->plain + offset, data, data_len);
+        offset += data_len;
+    }
+    for (int i = 0; i < payload_cnt; i++) {
+        memcpy(msg->plain + offset, payload[i].iov_base, payload[i].iov_len);
+        msg->seg_lens[2 + i] = payload[i].iov_len;
+        offset += payload[i].iov_len;
+    }
+
+    return msg;
+}
+
+send_message_t *send_message_ref(send_message_t *msg)
+{
+    if (msg)
+        atomic_fetch_add(&msg->refs, 1);
+    return msg;
+}
+
+void send_message_unref(send_message_t *msg)
+{
+    if (!msg || atomic_fetch_sub(&msg->refs, 1) > 1)
+        return;
+    free(msg->plain);
+    free(msg->seg_lens);
+    free(msg);
+}
+
+size_t send_message_get_size(const send_message_t *msg)
+{
+    return msg ? msg->plain_size : 0;
+}
+
+static void entry_free(send_entry_t *e)
+{
+    if (!e)
+        return;
+    if (e->wire && e->wire != e->msg->plain)
+        free(e->wire);
+    send_message_unref(e->msg);
+    free(e);
+}
+
+static size_t entry_remaining(const send_entry_t *e)
+{
+    return (e->wire ? e->wire_size : e->msg->plain_size) - e->sent;
+}
+
+// An entry has started once any of it was written or it was sealed: sealing used up
+// Noise nonces, so it must go out, and before anything sealed after it
+static bool entry_started(const send_entry_t *e)
+{
+    return e->sent > 0 || (e->wire && e->wire != e->msg->plain);
+}
+
+send_queue_t *send_queue_create(int fd, void *noise_ctx, int max_backlog_ms)
+{
+    if (fd < 0)
+        return NULL;
+
+    send_queue_t *queue = calloc(1, sizeof(send_queue_t));
+    if (!queue)
+        return NULL;
+
+    queue->fd = fd;
+    queue->noise_ctx = (noise_encryption_context_t *)noise_ctx;
+    queue->max_backlog_ms = max_backlog_ms > 0 ? max_backlog_ms : SEND_QUEUE_DEFAULT_MAX_BACKLOG_MS;
+    pthread_mutex_init(&queue->mutex, NULL);
+
+    // Keep unsent data in our queue rather than the kernel's, where it can still be replaced
+    int lowat = SEND_QUEUE_NOTSENT_LOWAT;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) < 0) {
+        fprintf(stderr, "Warning: TCP_NOTSENT_LOWAT not supported, frame dropping will react later\n");
+    }
+
+    return queue;
+}
+
+void send_queue_destroy(send_queue_t *queue)
+{
+    if (!queue)
+        return;
+
+    send_entry_t *e = queue->head;
+    while (e) {
+        send_entry_t *next = e->next;
+        entry_free(e);
+        e = next;
+    }
+
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+}
+
+// Remove video entries that haven't started transmitting (caller holds mutex)
+static void drop_waiting_video(send_queue_t *queue)
+{
+    send_entry_t **link = &queue->head;
+    queue->tail = NULL;
+
+    while (*link) {
+        send_entry_t *e = *link;
+        if (e->cls == SEND_CLASS_VIDEO && !entry_started(e)) {
+            *link = e->next;
+            queue->queued_bytes -= entry_remaining(e);
+            queue->dropped_frames++;
+            entry_free(e);
+        } else {
+            queue->tail = e;
+            link = &e->next;
+        }
+    }
+}
+
+// Insert entry: control/audio go ahead of video that hasn't started (caller holds mutex)
+static void insert_entry(send_queue_t *queue, send_entry_t *entry)
+{
+    if (!queue->head)
+        queue->busy_start_us = entry->enqueue_us;
+
+    if (entry->cls != SEND_CLASS_VIDEO) {
+        send_entry_t **link = &queue->head;
+        while (*link && !((*link)->cls == SEND_CLASS_VIDEO && !entry_started(*link)))
+            link = &(*link)->next;
+
+        entry->next = *link;
+        *link = entry;
+        if (!entry->next)
+            queue->tail = entry;
+    } else {
+        entry->next = NULL;
+        if (queue->tail)
+            queue->tail->next = entry;
+        else
+            queue->head = entry;
+        queue->tail = entry;
+    }
+
+    queue->queued_bytes += entry->msg->plain_size;
+}
+
+int send_queue_push(send_queue_t *queue, message_type_t type,
+                    const void *data, size_t data_len,
+                    const struct iovec *payload, int payload_cnt,
+                    bool replace_video)
+{
+    if (!queue)
+        return -1;
+
+    send_message_t *msg = send_message_create(type, data, data_len, payload, payload_cnt);
+    if (!msg)
+        return -1;
+
+    int ret = send_queue_push_message(queue, msg, replace_video);
+    send_message_unref(msg);
+    return ret;
+}
+
+int send_queue_push_message(send_queue_t *queue, send_message_t *msg, bool replace_video)
+{
+    if (!queue || !msg)
+        return -1;
+
+    send_entry_t *entry = calloc(1, sizeof(send_entry_t));
+    if (!entry)
+        return -1;
+
+    entry->cls = msg->cls;
+    entry->enqueue_us = send_queue_get_timestamp_us();
+    entry->msg = send_message_ref(msg);
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->failed) {
+        pthread_mutex_unlock(&queue->mutex);
+        entry_free(entry);
+        return -1;
+    }
+    if (replace_video && entry->cls == SEND_CLASS_VIDEO)
+        drop_waiting_video(queue);
+    insert_entry(queue, entry);
+    pthread_mutex_unlock(&queue->mutex);
+
+    // Opportunistically start sending
+    return send_queue_flush(queue);
+}
+
+// Produce wire bytes for an entry about to start transmitting (caller holds mutex)
+static int entry_prepare(send_queue_t *queue, send_entry_t *e)
+{
+    const send_message_t *msg = e->msg;
+
+    if (!queue->noise_ctx || !noise_encryption_is_ready(queue->noise_ctx)) {
+        e->wire = msg->plain;
+        e->wire_size = msg->plain_size;
+        return 0;
+    }
+
+    // Rebuild the gather list so records keep the original boundaries
+    struct iovec stack_iov[16];
+    struct iovec *iov = stack_iov;
+    if (msg->num_segs > (int)(sizeof(stack_iov) / sizeof(stack_iov[0]))) {
+        iov = malloc(msg->num_segs * sizeof(struct iovec));
+        if (!iov)
+            return -1;
+    }
+
+    int iovcnt = 0;
+    size_t offset = 0;
+    for (int i = 0; i < msg->num_segs; i++) {
+        if (msg->seg_lens[i] == 0)
+            continue;
+        iov[iovcnt].iov_base = msg->plain + offset;
+        iov[iovcnt].iov_len = msg->seg_lens[i];
+        offset += msg->seg_lens[i];
+        iovcnt++;
+    }
+
+    size_t sealed_size = noise_encryption_sealed_size(iov, iovcnt);
+    e->wire = malloc(sealed_size);
+    ssize_t n = e->wire ? noise_encryption_seal(queue->noise_ctx, iov, iovcnt, e->wire, sealed_size) : -1;
+
+    if (iov != stack_iov)
+        free(iov);
+    if (n < 0)
+        return -1;
+
+    e->wire_size = (size_t)n;
+    queue->queued_bytes += e->wire_size - msg->plain_size;
+    return 0;
+}
+
+static void update_drain_rate(send_queue_t *queue, uint64_t now_us, bool force)
+{
+    if (queue->busy_start_us == 0 || now_us <= queue->busy_start_us)
+        return;
+
+    uint64_t elapsed_us = now_us - queue->busy_start_us;
+    if (elapsed_us < (force ? DRAIN_RATE_MIN_SAMPLE_US : DRAIN_RATE_SAMPLE_US))
+        return;
+
+    double sample = queue->busy_bytes * 1000000.0 / elapsed_us;
+    queue->drain_rate = queue->drain_rate > 0 ? 0.7 * queue->drain_rate + 0.3 * sample : sample;
+    queue->busy_start_us = now_us;
+    queue->busy_bytes = 0;
+}
+
+int send_queue_flush(send_queue_t *queue)
+{
+    if (!queue)
+        return -1;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->failed) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+
+    int ret = 0;
+    while (queue->head) {
+        send_entry_t *e = queue->head;
+
+        if (!e->wire && entry_prepare(queue, e) < 0) {
+            ret = -1;
+            break;
+        }
+
+        ssize_t n = send(queue->fd, e->wire + e->sent, e->wire_size - e->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            ret = -1;
+            break;
+        }
+
+        e->sent += n;
+        queue->queued_bytes -= n;
+        queue->busy_bytes += n;
+
+        if (e->sent < e->wire_size)
+            break;  // Socket full
+
+        // Entry done
+        queue->head = e->next;
+        if (!queue->head)
+            queue->tail = NULL;
+        entry_free(e);
+    }
+
+    uint64_t now_us = send_queue_get_timestamp_us();
+    if (queue->head) {
+        update_drain_rate(queue, now_us, false);
+    } else {
+        update_drain_rate(queue, now_us, true);
+        queue->busy_start_us = 0;
+        queue->busy_bytes = 0;
+    }
+
+    if (ret < 0)
+        queue->failed = true;
+
+    pthread_mutex_unlock(&queue->mutex);
+    return ret;
+}
+
+bool send_queue_has_pending(send_queue_t *queue)
+{
+    if (!queue)
+        return false;
+
+    pthread_mutex_lock(&queue->mutex);
+    bool pending = queue->head != NULL;
+    pthread_mutex_unlock(&queue->mutex);
+    return pending;
+}
+
+uint32_t send_queue_get_backlog_ms(send_queue_t *queue)
+{
+    if (!queue)
+        return 0;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    uint64_t backlog_ms = 0;
+    if (queue->head) {
+        // Age of the oldest queued message
+        uint64_t now_us = send_queue_get_timestamp_us();
+        if (now_us > queue->head->enqueue_us)
+            backlog_ms = (now_us - queue->head->enqueue_us) / 1000;
+
+        // Time to drain what is queued at the measured rate
+        if (queue->drain_rate > 0) {
+            uint64_t drain_ms = (uint64_t)(queue->queued_bytes * 1000.0 / queue->drain_rate);
+            if (drain_ms > backlog_ms)
+                backlog_ms = drain_ms;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+    return backlog_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)backlog_ms;
+}
+
+bool send_queue_is_congested(send_queue_t *queue)
+{
+    return queue && send_queue_get_backlog_ms(queue) > queue->max_backlog_ms;
+}
+
+uint64_t send_queue_get_dropped_frames(send_queue_t *queue)
+{
+    if (!queue)
+        return 0;
+
+    pthread_mutex_lock(&queue->mutex);
+    uint64_t dropped = queue->dropped_frames;
+    pthread_mutex_unlock(&queue->mutex);
+    return dropped;
+}
@@ -0,0 +1,403 @@
+#include "session_recording.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RECORDING_BPP 4
+
+struct session_recorder {
+    int fd;
+    recording_header_t header;
+    bool changed_tiles;
+    uint8_t *previous;       // Last recorded picture (tile mode)
+    uint8_t *record;         // One frame's record, written with a single write()
+    size_t record_cap;
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+    uint64_t bytes;
+    bool size_warned;
+};
+
+struct session_recording {
+    int fd;
+    const uint8_t *map;
+    size_t map_size;
+    const recording_header_t *header;
+    size_t *offsets;         // File offset of each complete frame record
+    uint32_t num_frames;
+};
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+session_recorder_t *session_recorder_create(const char *path, bool changed_tiles, uint32_t refresh_rate)
+{
+    if (!path)
+        return NULL;
+
+    session_recorder_t *recorder = calloc(1, sizeof(session_recorder_t));
+    if (!recorder)
+        return NULL;
+
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recorder->fd < 0) {
+        perror("open recording");
+        free(recorder);
+        return NULL;
+    }
+
+    memcpy(recorder->header.magic, RECORDING_MAGIC, sizeof(recorder->header.magic));
+    recorder->header.tile_size = changed_tiles ? RECORDING_TILE_SIZE : 0;
+    recorder->header.refresh_rate = refresh_rate;
+    recorder->changed_tiles = changed_tiles;
+
+    // Header is rewritten with the frame size on the first frame and the totals on close
+    if (write_all(recorder->fd, &recorder->header, sizeof(recorder->header)) < 0) {
+        perror("write recording");
+        close(recorder->fd);
+        free(recorder);
+        return NULL;
+    }
+    recorder->bytes = sizeof(recorder->header);
+
+    return recorder;
+}
+
+void session_recorder_destroy(session_recorder_t *recorder)
+{
+    if (!recorder)
+        return;
+
+    recorder->header.duration_us = recorder->last_timestamp_us - recorder->first_timestamp_us;
+    if (pwrite(recorder->fd, &recorder->header, sizeof(recorder->header), 0) != sizeof(recorder->header))
+        perror("write recording header");
+    close(recorder->fd);
+
+    printf("Recorded %u frames (%.1f MB, %.1f s)\n", recorder->header.frame_count,
+           recorder->bytes / (1024.0 * 1024.0), recorder->header.duration_us / 1e6);
+
+    free(recorder->previous);
+    free(recorder->record);
+    free(recorder);
+}
+
+static uint8_t *record_reserve(session_recorder_t *recorder, size_t used, size_t more)
+{
+    if (used + more > recorder->record_cap) {
+        size_t cap = recorder->record_cap ? recorder->record_cap : 64 * 1024;
+        while (cap < used + more)
+            cap *= 2;
+        uint8_t *record = realloc(recorder->record, cap);
+        if (!record)
+            return NULL;
+        recorder->record = record;
+        recorder->record_cap = cap;
+    }
+    return recorder->record + used;
+}
+
+static bool tile_changed(const frame_buffer_t *frame, const uint8_t *previous, uint32_t x, uint32_t y,
+                         uint32_t w, uint32_t h)
+{
+    size_t row_bytes = (size_t)w * RECORDING_BPP;
+    size_t packed_pitch = (size_t)frame->width * RECORDING_BPP;
+    const uint8_t *src = (const uint8_t *)frame->data;
+    for (uint32_t row = y; row < y + h; row++) {
+        if (memcmp(src + (size_t)row * frame->pitch + (size_t)x * RECORDING_BPP,
+                   previous + row * packed_pitch + (size_t)x * RECORDING_BPP, row_bytes) != 0)
+            return true;
+    }
+    return false;
+}
+
+int session_recorder_write(session_recorder_t *recorder, const frame_buffer_t *frame, uint64_t timestamp_us)
+{
+    if (!recorder || !frame || !frame->data || frame->bpp != RECORDING_BPP)
+        return -1;
+
+    recording_header_t *header = &recorder->header;
+    size_t packed_pitch = (size_t)frame->width * RECORDING_BPP;
+    size_t picture_size = packed_pitch * frame->height;
+
+    if (header->frame_count == 0) {
+        header->width = frame->width;
+        header->height = frame->height;
+        header->format = frame->format;
+        recorder->first_timestamp_us = timestamp_us;
+        if (recorder->changed_tiles) {
+            recorder->previous = malloc(picture_size);
+            if (!recorder->previous)
+                return -1;
+        }
+    } else if (frame->width != header->width || frame->height != header->height) {
+        if (!recorder->size_warned) {
+            fprintf(stderr, "Warning: Frame size changed to %ux%u, recording only keeps %ux%u frames\n",
+                    frame->width, frame->height, header->width, header->height);
+            recorder->size_warned = true;
+        }
+        return 0;
+    }
+
+    const uint8_t *src = (const uint8_t *)frame->data;
+    recording_frame_t record = {
+        .timestamp_us = timestamp_us - recorder->first_timestamp_us,
+    };
+    size_t used = sizeof(record);
+    if (!record_reserve(recorder, 0, used))
+        return -1;
+
+    if (!recorder->changed_tiles || header->frame_count == 0) {
+        // Whole picture (always the first frame, so tile frames have something to patch)
+        record.flags = RECORDING_FRAME_FULL;
+        uint8_t *out = record_reserve(recorder, used, picture_size);
+        if (!out)
+            return -1;
+        for (uint32_t row = 0; row < frame->height; row++)
+            memcpy(out + row * packed_pitch, src + (size_t)row * frame->pitch, packed_pitch);
+        used += picture_size;
+    } else {
+        uint32_t tile = header->tile_size;
+        for (uint32_t y = 0; y < frame->height; y += tile) {
+            uint32_t h = frame->height - y < tile ? frame->height - y : tile;
+            for (uint32_t x = 0; x < frame->width; x += tile) {
+                uint32_t w = frame->width - x < tile ? frame->width - x : tile;
+                if (!tile_changed(frame, recorder->previous, x, y, w, h))
+                    continue;
+
+                size_t row_bytes = (size_t)w * RECORDING_BPP;
+                uint8_t *out = record_reserve(recorder, used, sizeof(recording_tile_t) + row_bytes * h);
+                if (!out)
+                    return -1;
+                recording_tile_t tile_record = { .tile_x = x / tile, .tile_y = y / tile };
+                memcpy(out, &tile_record, sizeof(tile_record));
+                out += sizeof(tile_record);
+                for (uint32_t row = 0; row < h; row++)
+                    memcpy(out + row * row_bytes, src + (size_t)(y + row) * frame->pitch + (size_t)x * RECORDING_BPP,
+                           row_bytes);
+                used += sizeof(tile_record) + row_bytes * h;
+                record.num_tiles++;
+            }
+        }
+    }
+
+    memcpy(recorder->record, &record, sizeof(record));
+    if (write_all(recorder->fd, recorder->record, used) < 0) {
+        perror("write recording");
+        return -1;
+    }
+
+    if (recorder->changed_tiles) {
+        for (uint32_t row = 0; row < frame->height; row++)
+            memcpy(recorder->previous + row * packed_pitch, src + (size_t)row * frame->pitch, packed_pitch);
+    }
+
+    header->frame_count++;
+    recorder->last_timestamp_us = timestamp_us;
+    recorder->bytes += used;
+    return 0;
+}
+
+uint32_t session_recorder_get_frames(session_recorder_t *recorder)
+{
+    return recorder ? recorder->header.frame_count : 0;
+}
+
+uint64_t session_recorder_get_bytes(session_recorder_t *recorder)
+{
+    return recorder ? recorder->bytes : 0;
+}
+
+// Size of the frame record at offset, or 0 if it is cut short or malformed
+static size_t frame_record_size(const session_recording_t *recording, size_t offset)
+{
+    const recording_header_t *header = recording->header;
+    size_t remaining = recording->map_size - offset;
+    recording_frame_t record;
+
+    if (remaining < sizeof(record))
+        return 0;
+    memcpy(&record, recording->map + offset, sizeof(record));
+
+    size_t size = sizeof(record);
+    if (record.flags & RECORDING_FRAME_FULL) {
+        size += (size_t)header->width * header->height * RECORDING_BPP;
+        return size <= remaining ? size : 0;
+    }
+
+    uint32_t tile = header->tile_size;
+    if (tile == 0)
+        return 0;
+    uint32_t tiles_x = (header->width + tile - 1) / tile;
+    uint32_t tiles_y = (header->height + tile - 1) / tile;
+    for (uint32_t i = 0; i < record.num_tiles; i++) {
+        recording_tile_t tile_record;
+        if (size + sizeof(tile_record) > remaining)
+            return 0;
+        memcpy(&tile_record, recording->map + offset + size, sizeof(tile_record));
+        if (tile_record.tile_x >= tiles_x || tile_record.tile_y >= tiles_y)
+            return 0;
+        uint32_t x = tile_record.tile_x * tile, y = tile_record.tile_y * tile;
+        uint32_t w = header->width - x < tile ? header->width - x : tile;
+        uint32_t h = header->height - y < tile ? header->height - y : tile;
+        size += sizeof(tile_record) + (size_t)w * h * RECORDING_BPP;
+        if (size > remaining)
+            return 0;
+    }
+    return size;
+}
+
+session_recording_t *session_recording_open(const char *path)
+{
+    if (!path)
+        return NULL;
+
+    session_recording_t *recording = calloc(1, sizeof(session_recording_t));
+    if (!recording)
+        return NULL;
+
+    recording->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (recording->fd < 0) {
+        perror("open recording");
+        free(recording);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(recording->fd, &st) < 0 || (size_t)st.st_size < sizeof(recording_header_t)) {
+        fprintf(stderr, "%s is not a recording\n", path);
+        session_recording_close(recording);
+        return NULL;
+    }
+
+    recording->map_size = st.st_size;
+    void *map = mmap(NULL, recording->map_size, PROT_READ, MAP_PRIVATE, recording->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap recording");
+        recording->map_size = 0;
+        session_recording_close(recording);
+        return NULL;
+    }
+    recording->map = map;
+    recording->header = map;
+    madvise(map, recording->map_size, MADV_SEQUENTIAL);
+
+    const recording_header_t *header = recording->header;
+    if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0 ||
+        header->width == 0 || header->height == 0) {
+        fprintf(stderr, "%s is not a recording (or has no frames)\n", path);
+        session_recording_close(recording);
+        return NULL;
+    }
+
+    // Index the complete frames
+    size_t cap = header->frame_count ? header->frame_count : 1024;
+    recording->offsets = malloc(cap * sizeof(size_t));
+    size_t offset = sizeof(recording_header_t);
+    while (recording->offsets) {
+        size_t size = frame_record_size(recording, offset);
+        if (size == 0)
+            break;
+        if (recording->num_frames == cap) {
+            cap *= 2;
+            size_t *offsets = realloc(recording->offsets, cap * sizeof(size_t));
+            if (!offsets)
+                break;
+            recording->offsets = offsets;
+        }
+        recording->offsets[recording->num_frames++] = offset;
+        offset += size;
+    }
+
+    if (recording->num_frames == 0) {
+        fprintf(stderr, "%s has no complete frames\n", path);
+        session_recording_close(recording);
+        return NULL;
+    }
+    if (offset != recording->map_size)
+        fprintf(stderr, "Warning: %s ends with an incomplete frame, ignoring it\n", path);
+
+    return recording;
+}
+
+void session_recording_close(session_recording_t *recording)
+{
+    if (!recording)
+        return;
+
+    if (recording->map)
+        munmap((void *)recording->map, recording->map_size);
+    if (recording->fd >= 0)
+        close(recording->fd);
+    free(recording->offsets);
+    free(recording);
+}
+
+const recording_header_t *session_recording_get_header(session_recording_t *recording)
+{
+    return recording ? recording->header : NULL;
+}
+
+uint32_t session_recording_get_frames(session_recording_t *recording)
+{
+    return recording ? recording->num_frames : 0;
+}
+
+uint64_t session_recording_get_timestamp(session_recording_t *recording, uint32_t index)
+{
+    if (!recording || index >= recording->num_frames)
+        return 0;
+    recording_frame_t record;
+    memcpy(&record, recording->map + recording->offsets[index], sizeof(record));
+    return record.timestamp_us;
+}
+
+void session_recording_apply(session_recording_t *recording, uint32_t index, uint8_t *picture)
+{
+    if (!recording || !picture || index >= recording->num_frames)
+        return;
+
+    const recording_header_t *header = recording->header;
+    const uint8_t *p = recording->map + recording->offsets[index];
+    recording_frame_t record;
+    memcpy(&record, p, sizeof(record));
+    p += sizeof(record);
+
+    size_t packed_pitch = (size_t)header->width * RECORDING_BPP;
+    if (record.flags & RECORDING_FRAME_FULL) {
+        memcpy(picture, p, packed_pitch * header->height);
+        return;
+    }
+
+    uint32_t tile = header->tile_size;
+    for (uint32_t i = 0; i < record.num_tiles; i++) {
+        recording_tile_t tile_record;
+        memcpy(&tile_record, p, sizeof(tile_record));
+        p += sizeof(tile_record);
+        uint32_t x = tile_record.tile_x * tile, y = tile_record.tile_y * tile;
+        uint32_t w = header->width - x < tile ? header->width - x : tile;
+        uint32_t h = header->height - y < tile ? header->height - y : tile;
+        size_t row_bytes = (size_t)w * RECORDING_BPP;
+        for (uint32_t row = 0; row < h; row++) {
+            memcpy(picture + (size_t)(y + row) * packed_pitch + (size_t)x * RECORDING_BPP, p, row_bytes);
+            p += row_bytes;
+        }
+    }
+}
@@ -0,0 +1,613 @@
+#define _GNU_SOURCE  // sendmmsg()
+#include "udp_video.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#define UDP_VIDEO_SEND_BATCH 64               // Datagrams per sendmmsg()
+#define UDP_VIDEO_SNDBUF (4 * 1024 * 1024)    // Room for a few raw frames in flight
+#define UDP_VIDEO_LOSS_EWMA 0.3               // Weight of the newest loss report
+
+struct udp_video_sender {
+    int fd;
+    size_t packet_data;   // Frame bytes per datagram
+    uint32_t frame_seq;
+    uint8_t *frame_buf;   // Frame gathered into one buffer for slicing
+    size_t frame_buf_size;
+    uint8_t *parity_buf;  // One packet_data block per FEC group
+    size_t parity_buf_size;
+    // Feedback state (written from the TCP receive thread)
+    pthread_mutex_t mutex;
+    bool fec_auto;
+    int fec_group;
+    double loss_rate;
+    // Frame being sent: datagrams in send order, the ones before next_packet are out
+    udp_video_header_t header;  // Fields shared by every datagram of the frame
+    size_t frame_size;
+    size_t packet_count;
+    int group;
+    size_t total_packets;  // Data + parity (0 = nothing pending)
+    size_t next_packet;
+    // Batch being built for sendmmsg()
+    udp_video_header_t headers[UDP_VIDEO_SEND_BATCH];
+    struct iovec iov[UDP_VIDEO_SEND_BATCH][2];
+    struct mmsghdr msgs[UDP_VIDEO_SEND_BATCH];
+    // Statistics
+    uint64_t frames_sent;
+    uint64_t frames_truncated;
+    uint64_t packets_sent;
+};
+
+typedef struct {
+    bool in_use;
+    uint32_t frame_seq;
+    uint32_t frame_size;
+    uint16_t packet_count;
+    uint16_t packets_received;  // Data packets present (received or rebuilt)
+    uint16_t packets_recovered; // Data packets rebuilt from parity
+    uint16_t packet_data;
+    uint8_t fec_group;
+    uint8_t *received;    // One byte per data packet (1 = present)
+    size_t received_size;
+    uint8_t *data;
+    size_t data_size;
+    uint16_t *group_received;   // Data packets present per FEC group
+    uint8_t *parity_received;   // One byte per FEC group
+    size_t parity_received_size;
+    uint8_t *parity;            // One packet_data block per FEC group
+    size_t num_groups;
+    size_t groups_size;
+    size_t parity_size;
+} reassembly_slot_t;
+
+struct udp_video_reassembler {
+    size_t max_frame_size;
+    reassembly_slot_t slots[UDP_VIDEO_REASSEMBLY_SLOTS];
+    uint8_t scratch[UDP_VIDEO_MAX_DATAGRAM];
+    bool have_completed;
+    uint32_t last_completed_seq;
+    uint64_t completed_frames;
+    uint64_t lost_frames;
+    uint64_t recovered_frames;
+    video_feedback_message_t feedback;  // Accumulates until taken
+};
+
+udp_video_sender_t *udp_video_sender_create(const struct sockaddr *addr, socklen_t addr_len,
+                                            size_t mtu, int fec_group)
+{
+    if (!addr)
+        return NULL;
+
+    if (mtu == 0 || mtu > UDP_VIDEO_MAX_DATAGRAM)
+        mtu = UDP_VIDEO_MAX_DATAGRAM;
+    if (mtu <= sizeof(udp_video_header_t))
+        return NULL;
+
+    udp_video_sender_t *sender = calloc(1, sizeof(udp_video_sender_t));
+    if (!sender)
+        return NULL;
+
+    sender->packet_data = mtu - sizeof(udp_video_header_t);
+    sender->fec_auto = fec_group == FEC_GROUP_AUTO;
+    if (sender->fec_auto)
+        sender->fec_group = FEC_GROUP_MAX;  // Light protection until the receiver reports loss
+    else if (fec_group > FEC_GROUP_MAX)
+        sender->fec_group = FEC_GROUP_MAX;
+    else if (fec_group > 0 && fec_group < FEC_GROUP_MIN)
+        sender->fec_group = FEC_GROUP_MIN;
+    else
+        sender->fec_group = fec_group > 0 ? fec_group : FEC_GROUP_OFF;
+    pthread_mutex_init(&sender->mutex, NULL);
+
+    sender->fd = socket(addr->sa_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sender->fd < 0) {
+        perror("socket(UDP video)");
+        pthread_mutex_destroy(&sender->mutex);
+        free(sender);
+        return NULL;
+    }
+
+    // Connected UDP socket: no per-packet address, and ICMP errors are reported
+    if (connect(sender->fd, addr, addr_len) < 0) {
+        perror("connect(UDP video)");
+        close(sender->fd);
+        pthread_mutex_destroy(&sender->mutex);
+        free(sender);
+        return NULL;
+    }
+
+    int sndbuf = UDP_VIDEO_SNDBUF;
+    setsockopt(sender->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    return sender;
+}
+
+void udp_video_sender_destroy(udp_video_sender_t *sender)
+{
+    if (!sender)
+        return;
+
+    if (sender->fd >= 0)
+        close(sender->fd);
+    pthread_mutex_destroy(&sender->mutex);
+    free(sender->frame_buf);
+    free(sender->parity_buf);
+    free(sender);
+}
+
+// Build datagram pos of the pending frame (send order: each FEC group, then its parity)
+static void sender_build_packet(udp_video_sender_t *sender, int i, size_t pos)
+{
+    size_t packet_data = sender->packet_data;
+    size_t index = pos, g = 0;
+    bool is_parity = false;
+    if (sender->group > 0) {
+        g = pos / (sender->group + 1);
+        size_t r = pos % (sender->group + 1);
+        index = g * sender->group + r;
+        is_parity = r == (size_t)sender->group || index >= sender->packet_count;
+    }
+
+    sender->headers[i] = sender->header;
+    if (is_parity) {
+        sender->headers[i].offset = 0;
+        sender->headers[i].packet_index = htons((uint16_t)(sender->packet_count + g));
+        sender->iov[i][1].iov_base = sender->parity_buf + g * packet_data;
+        sender->iov[i][1].iov_len = packet_data;
+    } else {
+        size_t start = index * packet_data;
+        sender->headers[i].offset = htonl((uint32_t)start);
+        sender->headers[i].packet_index = htons((uint16_t)index);
+        sender->iov[i][1].iov_base = sender->frame_buf + start;
+        sender->iov[i][1].iov_len = sender->frame_size - start < packet_data ? sender->frame_size - start
+                                                                             : packet_data;
+    }
+    sender->iov[i][0].iov_base = &sender->headers[i];
+    sender->iov[i][0].iov_len = sizeof(sender->headers[i]);
+
+    memset(&sender->msgs[i], 0, sizeof(sender->msgs[i]));
+    sender->msgs[i].msg_hdr.msg_iov = sender->iov[i];
+    sender->msgs[i].msg_hdr.msg_iovlen = 2;
+}
+
+// Send as much of the pending frame as the socket takes without blocking
+// Returns 0 when it is all out, 1 if some is left for the next call, -1 on error
+static int sender_pump(udp_video_sender_t *sender)
+{
+    while (sender->next_packet < sender->total_packets) {
+        size_t left = sender->total_packets - sender->next_packet;
+        int batch = left < UDP_VIDEO_SEND_BATCH ? (int)left : UDP_VIDEO_SEND_BATCH;
+        for (int i = 0; i < batch; i++)
+            sender_build_packet(sender, i, sender->next_packet + i);
+
+        int sent = sendmmsg(sender->fd, sender->msgs, batch, 0);
+        if (sent > 0) {
+            sender->next_packet += sent;
+            sender->packets_sent += sent;
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && errno == ECONNREFUSED)
+            continue;  // ICMP from an earlier packet; the receiver may just be restarting
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;  // Socket buffer full: the rest goes out on EPOLLOUT
+        perror("sendmmsg(UDP video)");
+        sender->total_packets = 0;
+        return -1;
+    }
+
+    if (sender->total_packets > 0)
+        sender->frames_sent++;
+    sender->total_packets = 0;
+    return 0;
+}
+
+int udp_video_sender_send_frame(udp_video_sender_t *sender,
+                                const void *data, size_t data_len,
+                                const struct iovec *payload, int payload_cnt)
+{
+    if (!sender || payload_cnt < 0 || (payload_cnt > 0 && !payload))
+        return -1;
+
+    size_t frame_size = data ? data_len : 0;
+    for (int i = 0; i < payload_cnt; i++)
+        frame_size += payload[i].iov_len;
+
+    pthread_mutex_lock(&sender->mutex);
+    int group = sender->fec_group;
+    pthread_mutex_unlock(&sender->mutex);
+
+    size_t packet_count = (frame_size + sender->packet_data - 1) / sender->packet_data;
+    size_t num_groups = fec_num_groups(packet_count, group);
+    if (packet_count == 0 || packet_count + num_groups > UINT16_MAX || frame_size > UINT32_MAX) {
+        fprintf(stderr, "UDP video: frame of %zu bytes can't be packetized\n", frame_size);
+        return -1;
+    }
+
+    // A frame still going out is abandoned: this one supersedes it (and reuses its buffers)
+    if (sender->total_packets > 0)
+        sender->frames_truncated++;
+    sender->total_packets = 0;
+
+    // Gather frame struct and payload into one buffer so packets can slice it freely
+    if (sender->frame_buf_size < frame_size) {
+        uint8_t *buf = realloc(sender->frame_buf, frame_size);
+        if (!buf)
+            return -1;
+        sender->frame_buf = buf;
+        sender->frame_buf_size = frame_size;
+    }
+
+    size_t offset = 0;
+    if (data && data_len > 0) {
+        memcpy(sender->frame_buf, data, data_len);
+        offset = data_len;
+    }
+    for (int i = 0; i < payload_cnt; i++) {
+        memcpy(sender->frame_buf + offset, payload[i].iov_base, payload[i].iov_len);
+        offset += payload[i].iov_len;
+    }
+
+    if (num_groups > 0) {
+        size_t parity_size = num_groups * sender->packet_data;
+        if (sender->parity_buf_size < parity_size) {
+            uint8_t *buf = realloc(sender->parity_buf, parity_size);
+            if (!buf)
+                return -1;
+            sender->parity_buf = buf;
+            sender->parity_buf_size = parity_size;
+        }
+        fec_encode(sender->frame_buf, frame_size, sender->packet_data, group, sender->parity_buf);
+    }
+
+    sender->header = (udp_video_header_t){
+        .frame_seq = htonl(sender->frame_seq++),
+        .frame_size = htonl((uint32_t)frame_size),
+        .packet_count = htons((uint16_t)packet_count),
+        .packet_data = htons((uint16_t)sender->packet_data),
+        .fec_group = (uint8_t)group
+    };
+    sender->frame_size = frame_size;
+    sender->packet_count = packet_count;
+    sender->group = group;
+    sender->total_packets = packet_count + num_groups;
+    sender->next_packet = 0;
+
+    return sender_pump(sender);
+}
+
+int udp_video_sender_flush(udp_video_sender_t *sender)
+{
+    return sender ? sender_pump(sender) : 0;
+}
+
+bool udp_video_sender_has_pending(udp_video_sender_t *sender)
+{
+    return sender && sender->total_packets > 0;
+}
+
+int udp_video_sender_get_fd(udp_video_sender_t *sender)
+{
+    return sender ? sender->fd : -1;
+}
+
+void udp_video_sender_report_feedback(udp_video_sender_t *sender, const video_feedback_message_t *feedback)
+{
+    if (!sender || !feedback || feedback->packets_expected == 0)
+        return;
+
+    double loss = (double)feedback->packets_lost / feedback->packets_expected;
+
+    pthread_mutex_lock(&sender->mutex);
+    sender->loss_rate = sender->loss_rate * (1.0 - UDP_VIDEO_LOSS_EWMA) + loss * UDP_VIDEO_LOSS_EWMA;
+    if (sender->fec_auto) {
+        int group = fec_group_for_loss(sender->loss_rate);
+        // Add protection right away, but only relax it on a clear improvement so the
+        // group size doesn't flap between neighbouring values
+        if (group < sender->fec_group || group > sender->fec_group + sender->fec_group / 4 + 1) {
+            printf("UDP video: packet loss %.2f%%, FEC group size %d -> %d\n",
+                   sender->loss_rate * 100.0, sender->fec_group, group);
+            sender->fec_group = group;
+        }
+    }
+    pthread_mutex_unlock(&sender->mutex);
+}
+
+int udp_video_sender_get_fec_group(udp_video_sender_t *sender)
+{
+    if (!sender)
+        return 0;
+
+    pthread_mutex_lock(&sender->mutex);
+    int group = sender->fec_group;
+    pthread_mutex_unlock(&sender->mutex);
+    return group;
+}
+
+uint64_t udp_video_sender_get_frames_sent(udp_video_sender_t *sender)
+{
+    return sender ? sender->frames_sent : 0;
+}
+
+uint64_t udp_video_sender_get_frames_truncated(udp_video_sender_t *sender)
+{
+    return sender ? sender->frames_truncated : 0;
+}
+
+uint64_t udp_video_sender_get_packets_sent(udp_video_sender_t *sender)
+{
+    return sender ? sender->packets_sent : 0;
+}
+
+udp_video_reassembler_t *udp_video_reassembler_create(size_t max_frame_size)
+{
+    udp_video_reassembler_t *reasm = calloc(1, sizeof(udp_video_reassembler_t));
+    if (!reasm)
+        return NULL;
+
+    reasm->max_frame_size = max_frame_size;
+    return reasm;
+}
+
+void udp_video_reassembler_destroy(udp_video_reassembler_t *reasm)
+{
+    if (!reasm)
+        return;
+
+    for (int i = 0; i < UDP_VIDEO_REASSEMBLY_SLOTS; i++) {
+        reassembly_slot_t *slot = &reasm->slots[i];
+        free(slot->received);
+        free(slot->data);
+        free(slot->group_received);
+        free(slot->parity_received);
+        free(slot->parity);
+    }
+    free(reasm);
+}
+
+// Release a slot and account its packets in the feedback report
+static void reassembler_retire_slot(udp_video_reassembler_t *reasm, reassembly_slot_t *slot)
+{
+    reasm->feedback.packets_expected += slot->packet_count;
+    reasm->feedback.packets_lost += slot->packet_count - slot->packets_received + slot->packets_recovered;
+    slot->in_use = false;
+}
+
+static int grow_buffer(void **buf, size_t *size, size_t needed)
+{
+    if (*size >= needed)
+        return 0;
+    void *p = realloc(*buf, needed);
+    if (!p)
+        return -1;
+    *buf = p;
+    *size = needed;
+    return 0;
+}
+
+// Find the slot for a frame, or claim one (evicting the oldest frame if all are busy)
+static reassembly_slot_t *reassembler_get_slot(udp_video_reassembler_t *reasm, const udp_video_header_t *h)
+{
+    uint32_t frame_seq = ntohl(h->frame_seq);
+    uint32_t frame_size = ntohl(h->frame_size);
+    uint16_t packet_count = ntohs(h->packet_count);
+    uint16_t packet_data = ntohs(h->packet_data);
+
+    reassembly_slot_t *free_slot = NULL;
+    reassembly_slot_t *oldest = NULL;
+
+    for (int i = 0; i < UDP_VIDEO_REASSEMBLY_SLOTS; i++) {
+        reassembly_slot_t *slot = &reasm->slots[i];
+        if (!slot->in_use) {
+            if (!free_slot)
+                free_slot = slot;
+            continue;
+        }
+        if (slot->frame_seq == frame_seq) {
+            bool same = slot->frame_size == frame_size && slot->packet_count == packet_count &&
+                        slot->packet_data == packet_data && slot->fec_group == h->fec_group;
+            return same ? slot : NULL;
+        }
+        if (!oldest || (int32_t)(slot->frame_seq - oldest->frame_seq) < 0)
+            oldest = slot;
+    }
+
+    reassembly_slot_t *slot = free_slot;
+    if (!slot) {
+        // Don't let a straggler from an old frame evict a newer one
+        if ((int32_t)(frame_seq - oldest->frame_seq) < 0)
+            return NULL;
+        reassembler_retire_slot(reasm, oldest);
+        slot = oldest;
+    }
+
+    size_t num_groups = fec_num_groups(packet_count, h->fec_group);
+    if (grow_buffer((void **)&slot->received, &slot->received_size, packet_count) < 0 ||
+        grow_buffer((void **)&slot->data, &slot->data_size, frame_size) < 0 ||
+        grow_buffer((void **)&slot->group_received, &slot->groups_size, num_groups * sizeof(uint16_t)) < 0 ||
+        grow_buffer((void **)&slot->parity_received, &slot->parity_received_size, num_groups) < 0 ||
+        grow_buffer((void **)&slot->parity, &slot->parity_size, num_groups * packet_data) < 0) {
+        return NULL;
+    }
+
+    memset(slot->received, 0, packet_count);
+    if (num_groups > 0) {
+        memset(slot->group_received, 0, num_groups * sizeof(uint16_t));
+        memset(slot->parity_received, 0, num_groups);
+    }
+    slot->in_use = true;
+    slot->frame_seq = frame_seq;
+    slot->frame_size = frame_size;
+    slot->packet_count = packet_count;
+    slot->packet_data = packet_data;
+    slot->fec_group = h->fec_group;
+    slot->num_groups = num_groups;
+    slot->packets_received = 0;
+    slot->packets_recovered = 0;
+    return slot;
+}
+
+// Bytes of the frame a data packet carries (0 for an index past the end)
+static size_t slot_packet_len(const reassembly_slot_t *slot, size_t index)
+{
+    size_t start = index * slot->packet_data;
+    if (start >= slot->frame_size)
+        return 0;
+    return slot->frame_size - start < slot->packet_data ? slot->frame_size - start : slot->packet_data;
+}
+
+// Rebuild the single missing data packet of a group from the parity and the others
+static void reassembler_try_recover(udp_video_reassembler_t *reasm, reassembly_slot_t *slot, size_t g)
+{
+    size_t first = g * slot->fec_group;
+    size_t last = first + slot->fec_group;
+    if (last > slot->packet_count)
+        last = slot->packet_count;
+
+    if (!slot->parity_received[g] || (size_t)slot->group_received[g] + 1 != last - first)
+        return;
+
+    memcpy(reasm->scratch, slot->parity + g * slot->packet_data, slot->packet_data);
+    size_t missing = last;
+    for (size_t i = first; i < last; i++) {
+        if (slot->received[i])
+            fec_xor(reasm->scratch, slot->data + i * slot->packet_data, slot_packet_len(slot, i));
+        else
+            missing = i;
+    }
+
+    size_t missing_len = missing < last ? slot_packet_len(slot, missing) : 0;
+    if (missing_len == 0)
+        return;
+    memcpy(slot->data + missing * slot->packet_data, reasm->scratch, missing_len);
+    slot->received[missing] = 1;
+    slot->group_received[g]++;
+    slot->packets_received++;
+    slot->packets_recovered++;
+}
+
+int udp_video_reassembler_push(udp_video_reassembler_t *reasm,
+                               const void *packet, size_t packet_len,
+                               const void **frame, size_t *frame_len)
+{
+    if (!reasm || !packet || packet_len < sizeof(udp_video_header_t))
+        return -1;
+
+    udp_video_header_t header;
+    memcpy(&header, packet, sizeof(header));
+    uint32_t frame_seq = ntohl(header.frame_seq);
+    uint32_t frame_size = ntohl(header.frame_size);
+    uint32_t offset = ntohl(header.offset);
+    uint16_t packet_index = ntohs(header.packet_index);
+    uint16_t packet_count = ntohs(header.packet_count);
+    uint16_t packet_data = ntohs(header.packet_data);
+
+    const uint8_t *slice = (const uint8_t *)packet + sizeof(header);
+    size_t slice_len = packet_len - sizeof(header);
+    size_t num_groups = fec_num_groups(packet_count, header.fec_group);
+    bool is_parity = packet_index >= packet_count;
+
+    // Exactly as many data packets as the frame needs, each but the last one full, so
+    // every packet (and every one parity rebuilds) lies inside the frame
+    if (packet_count == 0 || packet_data == 0 || packet_data > sizeof(reasm->scratch) ||
+        packet_count != ((size_t)frame_size + packet_data - 1) / packet_data ||
+        packet_index >= packet_count + num_groups) {
+        return -1;
+    }
+    if (is_parity ? slice_len != packet_data
+                  : (offset != (uint32_t)packet_index * packet_data || offset >= frame_size ||
+                     slice_len != (frame_size - offset < packet_data ? frame_size - offset : packet_data))) {
+        return -1;
+    }
+    if (frame_size > reasm->max_frame_size)
+        return 0;
+
+    // Late packet for a frame that is already complete or superseded
+    if (reasm->have_completed && (int32_t)(frame_seq - reasm->last_completed_seq) <= 0)
+        return 0;
+
+    reassembly_slot_t *slot = reassembler_get_slot(reasm, &header);
+    if (!slot)
+        return 0;
+
+    if (is_parity) {
+        size_t g = packet_index - packet_count;
+        if (!slot->parity_received[g]) {
+            memcpy(slot->parity + g * packet_data, slice, packet_data);
+            slot->parity_received[g] = 1;
+            reassembler_try_recover(reasm, slot, g);
+        }
+    } else if (!slot->received[packet_index]) {
+        memcpy(slot->data + offset, slice, slice_len);
+        slot->received[packet_index] = 1;
+        slot->packets_received++;
+        if (slot->fec_group > 0) {
+            size_t g = packet_index / slot->fec_group;
+            slot->group_received[g]++;
+            reassembler_try_recover(reasm, slot, g);
+        }
+    }
+
+    if (slot->packets_received < slot->packet_count)
+        return 0;
+
+    // Frame complete: frames in between that never completed are lost
+    if (reasm->have_completed) {
+        uint32_t gap = frame_seq - reasm->last_completed_seq - 1;
+        reasm->lost_frames += gap;
+        reasm->feedback.frames_lost += gap;
+    }
+    reasm->have_completed = true;
+    reasm->last_completed_seq = frame_seq;
+    reasm->completed_frames++;
+    reasm->feedback.frames_completed++;
+    if (slot->packets_recovered > 0) {
+        reasm->recovered_frames++;
+        reasm->feedback.frames_recovered++;
+    }
+
+    // Older partial frames can no longer be shown
+    for (int i = 0; i < UDP_VIDEO_REASSEMBLY_SLOTS; i++) {
+        reassembly_slot_t *other = &reasm->slots[i];
+        if (other->in_use && (int32_t)(other->frame_seq - frame_seq) < 0)
+            reassembler_retire_slot(reasm, other);
+    }
+
+    reassembler_retire_slot(reasm, slot);  // Data stays valid until the slot is claimed again
+    if (frame)
+        *frame = slot->data;
+    if (frame_len)
+        *frame_len = slot->frame_size;
+    return 1;
+}
+
+void udp_video_reassembler_take_feedback(udp_video_reassembler_t *reasm, video_feedback_message_t *feedback)
+{
+    if (!reasm || !feedback)
+        return;
+
+    *feedback = reasm->feedback;
+    memset(&reasm->feedback, 0, sizeof(reasm->feedback));
+}
+
+uint64_t udp_video_reassembler_get_completed_frames(udp_video_reassembler_t *reasm)
+{
+    return reasm ? reasm->completed_frames : 0;
+}
+
+uint64_t udp_video_reassembler_get_lost_frames(udp_video_reassembler_t *reasm)
+{
+    return reasm ? reasm->lost_frames : 0;
+}
+
+uint64_t udp_video_reassembler_get_recovered_frames(udp_video_reassembler_t *reasm)
+{
+    return reasm ? reasm->recovered_frames : 0;
+}
@@ -4,10 +4,14 @@
 #include <stdio.h>
 #include <X11/Xatom.h>
 #include <X11/extensions/Xrandr.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/randr.h>
 #include <unistd.h>
 #include <poll.h>
 
-x11_context_t *x11_context_create(void)
+#define MAX_CHANGED_OUTPUTS 16  // More in one event batch: refresh everything
+
+x11_context_t *x11_context_create(bool select_events)
 {
     x11_context_t *ctx = calloc(1, sizeof(x11_context_t));
     if (!ctx)
@@ -19,8 +23,10 @@ x11_context_t *x11_context_create(void)
         return NULL;
     }
 
+    ctx->xcb = XGetXCBConnection(ctx->display);
     ctx->screen = DefaultScreen(ctx->display);
     ctx->root = RootWindow(ctx->display, ctx->screen);
+    ctx->framebuffer_atom = XInternAtom(ctx->display, "FRAMEBUFFER_ID", False);
 
     // Initialize RandR extension
     int rr_major, rr_minor;
@@ -38,10 +44,11 @@ x11_context_t *x11_context_create(void)
         return NULL;
     }
 
-    // Select RandR events to monitor output and CRTC changes
-    XRRSelectInput(ctx->display, ctx->root,
-                   RROutputChangeNotifyMask | RRCrtcChangeNotifyMask |
-                   RRScreenChangeNotifyMask);
+    // Select RandR events to monitor output, CRTC and framebuffer changes
+    if (select_events)
+        XRRSelectInput(ctx->display, ctx->root,
+                       RROutputChangeNotifyMask | RRCrtcChangeNotifyMask |
+                       RRScreenChangeNotifyMask | RROutputPropertyNotifyMask);
 
     return ctx;
 }
@@ -52,9 +59,7 @@ void x11_context_destroy(x11_context_t *ctx)
         return;
 
     x11_context_free_outputs(ctx);
-
-    if (ctx->screen_resources)
-        XRRFreeScreenResources(ctx->screen_resources);
+    free(ctx->modes);
 
     if (ctx->display)
         XCloseDisplay(ctx->display);
@@ -67,192 +72,251 @@ static Atom get_atom(Display *display, const char *name)
     return XInternAtom(display, name, False);
 }
 
-static bool get_output_property(Display *display, RROutput output,
-                                const char *prop_name, uint32_t *value)
-{
-    Atom atom = get_atom(display, prop_name);
-    if (atom == None)
-        return false;
-
-    Atom actual_type;
-    int actual_format;
-    unsigned long nitems, bytes_after;
-    unsigned char *prop_data = NULL;
-
-    int status = XRRGetOutputProperty(display, output, atom,
-                                      0, 4, False, False,
-                                      XA_INTEGER, &actual_type, &actual_format,
-                                      &nitems, &bytes_after, &prop_data);
-
-    if (status != Success || actual_type != XA_INTEGER ||
-        actual_format != 32 || nitems != 1 || !prop_data) {
-        if (prop_data)
-            XFree(prop_data);
-        return false;
-    }
-
-    *value = *((uint32_t *)prop_data);
-    XFree(prop_data);
-    return true;
-}
-
 /* Keep-alive function: Query FRAMEBUFFER_ID property to signal active consumption */
 /* This resets the inactivity timer in the X server, keeping the virtual output active */
-/* Uses existing Display connection - X11 property queries are synchronous but very fast (microseconds) */
+/* The reply is discarded unread, so the caller does not wait for a round trip */
 void x11_context_keep_alive_output(x11_context_t *ctx, RROutput output_id)
 {
     if (!ctx || !ctx->display || output_id == None)
         return;
 
-    // Flush any pending events first (non-blocking check)
-    // This ensures we don't accumulate events that could cause delays
-    if (XPending(ctx->display) > 0) {
-        // Process pending events quickly (non-blocking)
-        while (XPending(ctx->display) > 0) {
-            XEvent ev;
-            XNextEvent(ctx->display, &ev);
+    xcb_randr_get_output_property_cookie_t cookie =
+        xcb_randr_get_output_property(ctx->xcb, output_id, ctx->framebuffer_atom, XCB_ATOM_INTEGER, 0, 1, 0, 0);
+    xcb_discard_reply(ctx->xcb, cookie.sequence);
+    xcb_flush(ctx->xcb);
+}
+
+// Refresh rate of a mode from the last screen resources; -1 if the mode is unknown
+static int mode_refresh_rate(const x11_context_t *ctx, RRMode mode)
+{
+    if (mode == None)
+        return 0;
+    for (int i = 0; i < ctx->num_modes; i++) {
+        if (ctx->modes[i].id == mode)
+            return ctx->modes[i].refresh_rate;
+    }
+    return -1;
+}
+
+static int set_modes(x11_context_t *ctx, const xcb_randr_mode_info_t *modes, int num_modes)
+{
+    x11_mode_t *table = malloc((num_modes > 0 ? num_modes : 1) * sizeof(*table));
+    if (!table)
+        return -1;
+    for (int i = 0; i < num_modes; i++) {
+        table[i].id = modes[i].id;
+        table[i].refresh_rate = 0;
+        if (modes[i].htotal > 0 && modes[i].vtotal > 0) {
+            // Calculate refresh rate: (dot clock * 1000) / (hTotal * vTotal)
+            double refresh = ((double)modes[i].dot_clock * 1000.0) /
+                             ((double)modes[i].htotal * (double)modes[i].vtotal);
+            table[i].refresh_rate = (int)(refresh + 0.5);  // Round to nearest Hz
+        }
+    }
+    free(ctx->modes);
+    ctx->modes = table;
+    ctx->num_modes = num_modes;
+    return 0;
+}
+
+// Fetch outputs in one pipelined batch: the info and FRAMEBUFFER_ID of every output,
+// then the CRTCs of the connected ones, each sent while earlier replies are in flight
+// out[i] describes ids[i] (connected = false if it is not, or the query failed)
+// Returns 0, or -1 if out of memory or a CRTC runs a mode the table does not know
+// (the screen resources are stale)
+static int fetch_outputs(x11_context_t *ctx, const RROutput *ids, int n, output_info_t *out)
+{
+    if (n == 0)
+        return 0;
+    xcb_randr_get_output_info_cookie_t *info_cookies = malloc(n * sizeof(*info_cookies));
+    xcb_randr_get_output_property_cookie_t *fb_cookies = malloc(n * sizeof(*fb_cookies));
+    xcb_randr_get_crtc_info_cookie_t *crtc_cookies = malloc(n * sizeof(*crtc_cookies));
+    if (!info_cookies || !fb_cookies || !crtc_cookies) {
+        free(info_cookies);
+        free(fb_cookies);
+        free(crtc_cookies);
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        info_cookies[i] = xcb_randr_get_output_info(ctx->xcb, ids[i], ctx->config_timestamp);
+        fb_cookies[i] = xcb_randr_get_output_property(ctx->xcb, ids[i], ctx->framebuffer_atom,
+                                                      XCB_ATOM_INTEGER, 0, 1, 0, 0);
+    }
+
+    for (int i = 0; i < n; i++) {
+        memset(&out[i], 0, sizeof(out[i]));
+        out[i].output_id = ids[i];
+        xcb_randr_get_output_info_reply_t *info = xcb_randr_get_output_info_reply(ctx->xcb, info_cookies[i], NULL);
+        if (!info)
+            continue;
+        const char *name = (const char *)xcb_randr_get_output_info_name(info);
+        int name_len = xcb_randr_get_output_info_name_length(info);
+        if (name_len == (int)strlen("XR-Manager") && memcmp(name, "XR-Manager", name_len) == 0)
+            ctx->manager_output = ids[i];
+        if (info->connection == XCB_RANDR_CONNECTION_CONNECTED) {
+            out[i].name = strndup(name, name_len);
+            out[i].connected = out[i].name != NULL;
+            out[i].crtc = info->crtc;
+            if (out[i].connected && info->crtc != None)
+                crtc_cookies[i] = xcb_randr_get_crtc_info(ctx->xcb, info->crtc, ctx->config_timestamp);
         }
+        free(info);
+    }
+
+    bool stale_modes = false;
+    for (int i = 0; i < n; i++) {
+        xcb_randr_get_output_property_reply_t *fb = xcb_randr_get_output_property_reply(ctx->xcb, fb_cookies[i], NULL);
+        if (fb && fb->type == XCB_ATOM_INTEGER && fb->format == 32 && fb->num_items == 1)
+            memcpy(&out[i].framebuffer_id, xcb_randr_get_output_property_data(fb), sizeof(uint32_t));
+        free(fb);
+
+        if (!out[i].connected || out[i].crtc == None)
+            continue;
+        // Actual resolution and refresh rate from the CRTC's current mode
+        xcb_randr_get_crtc_info_reply_t *crtc = xcb_randr_get_crtc_info_reply(ctx->xcb, crtc_cookies[i], NULL);
+        if (!crtc)
+            continue;
+        int refresh = mode_refresh_rate(ctx, crtc->mode);
+        if (refresh < 0)
+            stale_modes = true;
+        out[i].width = crtc->width;
+        out[i].height = crtc->height;
+        out[i].refresh_rate = refresh > 0 ? refresh : 0;
+        free(crtc);
     }
 
-    // Query FRAMEBUFFER_ID property as a lightweight keep-alive signal
-    // This is a synchronous X11 call, but it's very fast (typically <100 microseconds)
-    // since the property is already in the server's memory and we're using an existing connection
-    uint32_t dummy;
-    get_output_property(ctx->display, output_id, "FRAMEBUFFER_ID", &dummy);
+    free(info_cookies);
+    free(fb_cookies);
+    free(crtc_cookies);
+    return stale_modes ? -1 : 0;
+}
+
+static void free_fetched(output_info_t *fetched, int n)
+{
+    for (int i = 0; i < n; i++)
+        free(fetched[i].name);
+    free(fetched);
 }
 
+// Full refresh: screen resources (without probing the hardware), then every output
 int x11_context_refresh_outputs(x11_context_t *ctx)
 {
     if (!ctx || !ctx->display)
         return -1;
 
-    // Free existing outputs
-    x11_context_free_outputs(ctx);
-
-    // Get screen resources
-    if (ctx->screen_resources)
-        XRRFreeScreenResources(ctx->screen_resources);
+    xcb_randr_get_screen_resources_current_reply_t *res = xcb_randr_get_screen_resources_current_reply(
+        ctx->xcb, xcb_randr_get_screen_resources_current(ctx->xcb, ctx->root), NULL);
+    if (!res)
+        return -1;
+    ctx->config_timestamp = res->config_timestamp;
+    if (set_modes(ctx, xcb_randr_get_screen_resources_current_modes(res),
+                  xcb_randr_get_screen_resources_current_modes_length(res)) < 0) {
+        free(res);
+        return -1;
+    }
 
-    ctx->screen_resources = XRRGetScreenResources(ctx->display, ctx->root);
-    if (!ctx->screen_resources)
+    int n = xcb_randr_get_screen_resources_current_outputs_length(res);
+    RROutput *ids = malloc((n > 0 ? n : 1) * sizeof(*ids));
+    output_info_t *fetched = calloc(n > 0 ? n : 1, sizeof(*fetched));
+    if (!ids || !fetched) {
+        free(ids);
+        free(fetched);
+        free(res);
         return -1;
+    }
+    const xcb_randr_output_t *res_outputs = xcb_randr_get_screen_resources_current_outputs(res);
+    for (int i = 0; i < n; i++)
+        ids[i] = res_outputs[i];
+    free(res);
+    fetch_outputs(ctx, ids, n, fetched);  // Modes were just read, so they cannot be stale
+    free(ids);
 
-    // Count connected outputs
     int connected_count = 0;
-    for (int i = 0; i < ctx->screen_resources->noutput; i++) {
-        XRROutputInfo *output_info = XRRGetOutputInfo(ctx->display,
-                                                       ctx->screen_resources,
-                                                       ctx->screen_resources->outputs[i]);
-        if (output_info && output_info->connection == RR_Connected) {
+    for (int i = 0; i < n; i++) {
+        if (fetched[i].connected)
             connected_count++;
-        }
-        if (output_info)
-            XRRFreeOutputInfo(output_info);
     }
-
-    if (connected_count == 0) {
-        ctx->num_outputs = 0;
-        ctx->outputs = NULL;
-        return 0;
+    output_info_t *outputs = NULL;
+    if (connected_count > 0) {
+        outputs = calloc(connected_count, sizeof(output_info_t));
+        if (!outputs) {
+            free_fetched(fetched, n);
+            return -1;
+        }
     }
 
-    // Allocate output array
-    ctx->outputs = calloc(connected_count, sizeof(output_info_t));
-    if (!ctx->outputs)
-        return -1;
-
-    // Populate outputs
+    // Keep what was known about outputs that are still there (prev_* is the state before
+    // the current event batch, see x11_context_process_events())
     int idx = 0;
-    for (int i = 0; i < ctx->screen_resources->noutput; i++) {
-        XRROutputInfo *output_info = XRRGetOutputInfo(ctx->display,
-                                                       ctx->screen_resources,
-                                                       ctx->screen_resources->outputs[i]);
-        if (!output_info || output_info->connection != RR_Connected) {
-            if (output_info)
-                XRRFreeOutputInfo(output_info);
+    for (int i = 0; i < n; i++) {
+        if (!fetched[i].connected) {
+            free(fetched[i].name);
             continue;
         }
-
-        output_info_t *out = &ctx->outputs[idx];
-        out->output_id = ctx->screen_resources->outputs[i];
-        out->name = strdup(output_info->name);
-        out->connected = (output_info->connection == RR_Connected);
-
-        // Store previous state for change detection
+        output_info_t *out = &outputs[idx++];
+        *out = fetched[i];
         output_info_t *prev_out = x11_context_find_output(ctx, out->output_id);
         if (prev_out) {
-            out->prev_width = prev_out->width;
-            out->prev_height = prev_out->height;
-            out->prev_refresh_rate = prev_out->refresh_rate;
-            out->prev_connected = prev_out->connected;
-        } else {
-            out->prev_width = 0;
-            out->prev_height = 0;
-            out->prev_refresh_rate = 0;
-            out->prev_connected = false;
+            out->prev_width = prev_out->prev_width;
+            out->prev_height = prev_out->prev_height;
+            out->prev_refresh_rate = prev_out->prev_refresh_rate;
+            out->prev_connected = prev_out->prev_connected;
+            out->is_virtual = prev_out->is_virtual;
         }
+    }
+    free(fetched);
 
-        // Check if it's a virtual output (not a physical connector)
-        // Virtual outputs are created via CREATE_XR_OUTPUT.
-        // Physical outputs typically have standard connector names like:
-        // eDP, DisplayPort-0, HDMI-1, VGA-1, etc.
-        // XR-Manager is a special control output, not a virtual output.
-        // For now, we can't reliably distinguish virtual from physical outputs
-        // just by name, so we'll default to false (physical) and let the
-        // caller mark virtual outputs explicitly if needed.
-        out->is_virtual = false;
-
-        // Get FRAMEBUFFER_ID property
-        if (!get_output_property(ctx->display, out->output_id,
-                                 "FRAMEBUFFER_ID", &out->framebuffer_id)) {
-            out->framebuffer_id = 0;
-        }
+    x11_context_free_outputs(ctx);
+    ctx->outputs = outputs;
+    ctx->num_outputs = connected_count;
+    return 0;
+}
 
-        // Get actual resolution and refresh rate from current mode
-        out->width = 0;
-        out->height = 0;
-        out->refresh_rate = 0;
-
-        if (output_info->crtc != None) {
-            XRRCrtcInfo *crtc_info = XRRGetCrtcInfo(ctx->display,
-                                                    ctx->screen_resources,
-                                                    output_info->crtc);
-            if (crtc_info) {
-                out->width = crtc_info->width;
-                out->height = crtc_info->height;
-
-                // Get refresh rate from current mode
-                if (crtc_info->mode != None) {
-                    for (int j = 0; j < output_info->nmode; j++) {
-                        if (output_info->modes[j] == crtc_info->mode) {
-                            // Mode ID found, get mode info
-                            XRRModeInfo *mode_info = NULL;
-                            for (int k = 0; k < ctx->screen_resources->nmode; k++) {
-                                if (ctx->screen_resources->modes[k].id == crtc_info->mode) {
-                                    mode_info = &ctx->screen_resources->modes[k];
-                                    break;
-                                }
-                            }
-                            if (mode_info && mode_info->hTotal > 0 && mode_info->vTotal > 0) {
-                                // Calculate refresh rate: (dot clock * 1000) / (hTotal * vTotal)
-                                double refresh = ((double)mode_info->dotClock * 1000.0) /
-                                                ((double)mode_info->hTotal * (double)mode_info->vTotal);
-                                out->refresh_rate = (int)(refresh + 0.5);  // Round to nearest Hz
-                            }
-                            break;
-                        }
-                    }
-                }
+// Re-fetch the given outputs and merge them into the table
+// Returns 0, or -1 if a full refresh is needed instead
+static int update_outputs(x11_context_t *ctx, const RROutput *ids, int n)
+{
+    output_info_t *fetched = calloc(n, sizeof(*fetched));
+    if (!fetched)
+        return -1;
+    if (fetch_outputs(ctx, ids, n, fetched) < 0) {
+        free_fetched(fetched, n);
+        return -1;
+    }
 
-                XRRFreeCrtcInfo(crtc_info);
+    for (int i = 0; i < n; i++) {
+        output_info_t *out = x11_context_find_output(ctx, ids[i]);
+        if (fetched[i].connected && out) {
+            // Changed in place: keep the state before this batch and the virtual flag
+            free(out->name);
+            out->name = fetched[i].name;
+            out->framebuffer_id = fetched[i].framebuffer_id;
+            out->width = fetched[i].width;
+            out->height = fetched[i].height;
+            out->refresh_rate = fetched[i].refresh_rate;
+            out->crtc = fetched[i].crtc;
+        } else if (fetched[i].connected) {
+            // New output
+            output_info_t *outputs = realloc(ctx->outputs, (ctx->num_outputs + 1) * sizeof(output_info_t));
+            if (!outputs) {
+                free(fetched[i].name);
+                continue;
+            }
+            ctx->outputs = outputs;
+            ctx->outputs[ctx->num_outputs++] = fetched[i];
+        } else {
+            // Disconnected: drop it from the table
+            free(fetched[i].name);
+            if (out) {
+                free(out->name);
+                int index = (int)(out - ctx->outputs);
+                memmove(out, out + 1, (ctx->num_outputs - index - 1) * sizeof(output_info_t));
+                ctx->num_outputs--;
             }
         }
-
-        idx++;
-        XRRFreeOutputInfo(output_info);
     }
-
-    ctx->num_outputs = idx;
+    free(fetched);
     return 0;
 }
 
@@ -271,7 +335,7 @@ output_info_t *x11_context_find_output(x11_context_t *ctx, RROutput output_id)
 
 output_info_t *x11_context_get_primary_output(x11_context_t *ctx)
 {
-    if (!ctx || !ctx->display || !ctx->screen_resources)
+    if (!ctx || !ctx->display || !ctx->outputs)
         return NULL;
 
     // Get the primary output
@@ -304,27 +368,10 @@ RROutput x11_context_create_virtual_output(x11_context_t *ctx, const char *name,
     if (!ctx || !ctx->display || !name)
         return None;
 
-    // Find the XR-Manager output
-    if (!ctx->screen_resources) {
-        ctx->screen_resources = XRRGetScreenResources(ctx->display, ctx->root);
-        if (!ctx->screen_resources)
-            return None;
-    }
-
-    RROutput manager_output = None;
-    for (int i = 0; i < ctx->screen_resources->noutput; i++) {
-        XRROutputInfo *output_info = XRRGetOutputInfo(ctx->display,
-                                                       ctx->screen_resources,
-                                                       ctx->screen_resources->outputs[i]);
-        if (output_info && strcmp(output_info->name, "XR-Manager") == 0) {
-            manager_output = ctx->screen_resources->outputs[i];
-            XRRFreeOutputInfo(output_info);
-            break;
-        }
-        if (output_info)
-            XRRFreeOutputInfo(output_info);
-    }
-
+    // Find the XR-Manager output (recorded by the output refresh)
+    if (ctx->manager_output == None)
+        x11_context_refresh_outputs(ctx);
+    RROutput manager_output = ctx->manager_output;
     if (manager_output == None) {
         printf("XR-Manager output not found\n");
         return None;
@@ -379,17 +426,6 @@ void x11_context_set_virtual_output_modes(x11_context_t *ctx, RROutput output_id
     if (!ctx || !ctx->display || output_id == None || !widths || !heights || !refresh_rates || num_modes <= 0)
         return;
 
-    // Find the output
-    XRRScreenResources *res = XRRGetScreenResources(ctx->display, ctx->root);
-    if (!res)
-        return;
-
-    XRROutputInfo *output_info = XRRGetOutputInfo(ctx->display, res, output_id);
-    if (!output_info) {
-        XRRFreeScreenResources(res);
-        return;
-    }
-
     // Build modes string: "WIDTH:HEIGHT:REFRESH|WIDTH:HEIGHT:REFRESH|..."
     char modes_str[4096] = {0};
     size_t pos = 0;
@@ -412,9 +448,6 @@ void x11_context_set_virtual_output_modes(x11_context_t *ctx, RROutput output_id
                                (unsigned char *)modes_str, strlen(modes_str));
         XSync(ctx->display, False);
     }
-
-    XRRFreeOutputInfo(output_info);
-    XRRFreeScreenResources(res);
 }
 
 void x11_context_delete_virtual_output(x11_context_t *ctx, RROutput output_id)
@@ -422,36 +455,17 @@ void x11_context_delete_virtual_output(x11_context_t *ctx, RROutput output_id)
     if (!ctx || !ctx->display || output_id == None)
         return;
 
-    // Find the XR-Manager output
-    XRRScreenResources *res = XRRGetScreenResources(ctx->display, ctx->root);
-    if (!res)
-        return;
-
-    RROutput manager_output = None;
-    for (int i = 0; i < res->noutput; i++) {
-        XRROutputInfo *output_info = XRRGetOutputInfo(ctx->display, res, res->outputs[i]);
-        if (output_info && output_info->connection == RR_Connected) {
-            if (strstr(output_info->name, "XR-Manager") != NULL) {
-                manager_output = res->outputs[i];
-                XRRFreeOutputInfo(output_info);
-                break;
-            }
-        }
-        if (output_info)
-            XRRFreeOutputInfo(output_info);
-    }
-
-    if (manager_output == None) {
-        XRRFreeScreenResources(res);
+    // Find the XR-Manager output (recorded by the output refresh)
+    if (ctx->manager_output == None)
+        x11_context_refresh_outputs(ctx);
+    RROutput manager_output = ctx->manager_output;
+    if (manager_output == None)
         return;
-    }
 
     // Get the DELETE_XR_OUTPUT atom
     Atom delete_atom = get_atom(ctx->display, "DELETE_XR_OUTPUT");
-    if (delete_atom == None) {
-        XRRFreeScreenResources(res);
+    if (delete_atom == None)
         return;
-    }
 
     // Format: "DELETE_XR_OUTPUT <output_id>"
     char delete_cmd[64];
@@ -467,8 +481,6 @@ void x11_context_delete_virtual_output(x11_context_t *ctx, RROutput output_id)
     // Wait a bit for the output to be deleted, then refresh outputs
     usleep(100000);  // 100ms
     x11_context_refresh_outputs(ctx);
-
-    XRRFreeScreenResources(res);
 }
 
 int x11_context_get_fd(x11_context_t *ctx)
@@ -487,30 +499,76 @@ int x11_context_process_events(x11_context_t *ctx)
     if (XPending(ctx->display) == 0)
         return 0;
 
-    XEvent event;
-    bool output_changed = false;
-
-    while (XCheckTypedEvent(ctx->display, ctx->rr_event_base + RRScreenChangeNotify, &event) ||
-           XCheckTypedEvent(ctx->display, ctx->rr_event_base + RRNotify, &event)) {
+    // State before this batch, for change detection
+    for (int i = 0; i < ctx->num_outputs; i++) {
+        output_info_t *out = &ctx->outputs[i];
+        out->prev_width = out->width;
+        out->prev_height = out->height;
+        out->prev_refresh_rate = out->refresh_rate;
+        out->prev_connected = out->connected;
+    }
 
-        if (event.type == ctx->rr_event_base + RRScreenChangeNotify) {
-            // Screen configuration changed
-            output_changed = true;
-        } else if (event.type == ctx->rr_event_base + RRNotify) {
-            XRRNotifyEvent *rr_event = (XRRNotifyEvent *)&event;
+    bool output_changed = false;
+    do {
+        bool full_refresh = false;
+        RROutput changed[MAX_CHANGED_OUTPUTS];
+        int num_changed = 0;
 
-            if (rr_event->subtype == RRNotify_OutputChange ||
-                rr_event->subtype == RRNotify_CrtcChange) {
-                output_changed = true;
+        while (XPending(ctx->display) > 0) {
+            XEvent event;
+            XNextEvent(ctx->display, &event);
+            RROutput output = None;
+
+            if (event.type == ctx->rr_event_base + RRScreenChangeNotify) {
+                // Screen configuration changed
+                XRRUpdateConfiguration(&event);
+                full_refresh = true;
+            } else if (event.type == ctx->rr_event_base + RRNotify) {
+                XRRNotifyEvent *rr_event = (XRRNotifyEvent *)&event;
+
+                if (rr_event->subtype == RRNotify_CrtcChange) {
+                    // Mode and size are in the event: update the outputs on that CRTC in place
+                    XRRCrtcChangeNotifyEvent *crtc_event = (XRRCrtcChangeNotifyEvent *)&event;
+                    int refresh = mode_refresh_rate(ctx, crtc_event->mode);
+                    if (refresh < 0)
+                        full_refresh = true;  // New mode: the mode table is stale
+                    for (int i = 0; i < ctx->num_outputs && refresh >= 0; i++) {
+                        output_info_t *out = &ctx->outputs[i];
+                        if (out->crtc != crtc_event->crtc)
+                            continue;
+                        out->width = crtc_event->mode != None ? (int)crtc_event->width : 0;
+                        out->height = crtc_event->mode != None ? (int)crtc_event->height : 0;
+                        out->refresh_rate = refresh;
+                        output_changed = true;
+                    }
+                } else if (rr_event->subtype == RRNotify_OutputChange) {
+                    output = ((XRROutputChangeNotifyEvent *)&event)->output;
+                } else if (rr_event->subtype == RRNotify_OutputProperty) {
+                    XRROutputPropertyNotifyEvent *prop_event = (XRROutputPropertyNotifyEvent *)&event;
+                    if (prop_event->property == ctx->framebuffer_atom)
+                        output = prop_event->output;
+                }
+            }
+            // Anything else (nothing else is selected, but MappingNotify always arrives) is dropped
+
+            if (output != None) {
+                bool queued = false;
+                for (int i = 0; i < num_changed; i++)
+                    queued = queued || changed[i] == output;
+                if (!queued && num_changed < MAX_CHANGED_OUTPUTS)
+                    changed[num_changed++] = output;
+                else if (!queued)
+                    full_refresh = true;
             }
         }
-    }
 
-    // Refresh outputs if changes detected
-    if (output_changed) {
-        x11_context_refresh_outputs(ctx);
-        return 1;  // Indicate changes detected
-    }
+        // Re-fetch what the events do not carry, falling back to a full refresh
+        if (!full_refresh && num_changed > 0 && update_outputs(ctx, changed, num_changed) < 0)
+            full_refresh = true;
+        if (full_refresh)
+            x11_context_refresh_outputs(ctx);
+        output_changed = output_changed || full_refresh || num_changed > 0;
+    } while (XPending(ctx->display) > 0);  // Also pulls events XCB read while waiting for the replies
 
-    return 0;
+    return output_changed ? 1 : 0;
 }
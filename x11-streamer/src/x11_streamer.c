@@ -1,14 +1,24 @@
 #include "x11_streamer.h"
 #include "x11_output.h"
-#include "drm_fb.h"
+#include "frame_source.h"
+#include "frame_pipeline.h"
+#include "session_recording.h"
 #include "protocol.h"
 #include "audio_capture.h"
+#include "audio_resampler.h"
 #include "dirty_rect.h"
 #include "encoding_metrics.h"
 #include "noise_encryption.h"
+#include "send_queue.h"
+#include "udp_video.h"
+#include "catchup_cache.h"
+#include "receiver_cache.h"
 #ifdef HAVE_X264
 #include "h264_encoder.h"
 #endif
+#ifdef HAVE_OPUS
+#include "audio_encoder.h"
+#endif
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,21 +31,80 @@
 #include <net/if.h>
 #include <ifaddrs.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <errno.h>
 #include <poll.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <sys/random.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <netinet/tcp.h>
+
+// Session resume: how often a dropped receiver is redialled, and the longest single connect
+#define RESUME_RETRY_INTERVAL_MS 250
+#define RESUME_CONNECT_TIMEOUT_MS 1000
+// Unacknowledged data older than this fails the connection, so a dead link is noticed promptly
+#define RECEIVER_USER_TIMEOUT_MS 5000
+// Audio is captured in stereo; PCM formats resampled at once for receivers' native outputs
+#define AUDIO_CAPTURE_CHANNELS 2
+#define MAX_AUDIO_PCM_FORMATS 4
+#define OPUS_SAMPLE_RATE 48000
+// Main loop timers
+#define FALLBACK_FRAME_INTERVAL_US 100000  // ~10 FPS while the refresh rate is unknown
+#define KEEPALIVE_INTERVAL_US 1000000
+
+// What the frame path reads every frame, published as an immutable snapshot: the main
+// loop reads it without locks; writers copy it, change the copy and swap it in under
+// tv_mutex. Replaced snapshots are freed by the main loop between iterations, when it
+// holds none (receiver threads only read the snapshot under tv_mutex).
+typedef struct streamer_state {
+    RROutput output_id;  // Output being streamed (virtual in extend mode, primary in mirror mode)
+    int refresh_rate_hz;  // Display refresh rate for frame throttling
+    uint8_t encoding_mode;  // Current encoding mode (0=full, 1=dirty rects, 2=H.264)
+    uint32_t output_generation;  // Bumped when the output is (re)configured: restart the frame ticks
+    struct streamer_state *retired_next;
+} streamer_state_t;
+
+// PCM at a receiver's native rate and channels, resampled from the capture
+typedef struct {
+    uint32_t rate;
+    uint16_t channels;
+    audio_resampler_t *resampler;
+    int16_t *pcm;  // One resampled chunk
+    uint32_t pcm_frames;
+} audio_pcm_format_t;
 
 typedef struct tv_connection {
     int fd;
-    bool active;
+    volatile bool active;  // Cleared when the receiver thread exits (connection is then reaped)
     x11_streamer_t *streamer;  // Reference to streamer for frame sending
-    RROutput virtual_output_id;  // Virtual XR output created for this TV
+    char peer[INET_ADDRSTRLEN + 8];  // "address:port" for log messages
     char display_name[64];
-    bool paused;  // True when receiver has no surface (paused sending frames)
-    // Pre-received HELLO message (when encryption is disabled, HELLO is received before thread starts)
+    atomic_bool paused;  // True when receiver has no surface (paused sending frames)
+    atomic_bool resync;  // Skipping frames until the next self-contained one (just joined, fell behind or resumed)
+    volatile bool audio_opus;  // Receiver decodes Opus (CAPABILITIES), so it is sent Opus instead of PCM
+    volatile uint32_t audio_rate;      // Native output format for PCM (CAPABILITIES, 0 = capture format)
+    volatile uint16_t audio_channels;
+    int epoll_fd;  // Socket registered for EPOLLOUT in the main loop (-1 = none, main loop only)
+    int udp_epoll_fd;  // Same for the UDP video socket while a frame is pending
+    // Pre-received HELLO message (HELLO is received before thread starts)
     message_header_t hello_header;
     void *hello_payload;
+    noise_encryption_context_t *noise_ctx;  // Noise Protocol encryption context (NULL = plaintext)
+    send_queue_t *send_queue;  // Non-blocking output queue for fd
+    udp_video_sender_t *udp_video;  // UDP data channel for frames (NULL = frames go over TCP)
+    uint64_t join_us;  // When the receiver connected or resumed (0 once its first picture was reported, main loop only)
+    char catchup_desc[64];  // What brought it up to date (empty until queued, main loop only)
+    _Atomic uint64_t resume_us;  // Receiver thread: resumed or reconnected at this time (0 = taken by the main loop)
+    struct sockaddr_in addr;  // Receiver address (to reconnect a dropped session)
+    bool encrypted;  // Session uses Noise (a resumed connection must too)
+    bool has_ticket;  // Receiver was given a session ticket, so a dropped connection can be resumed
+    uint8_t ticket[SESSION_TICKET_SIZE];
+    volatile bool suspended;  // Connection dropped: the main loop leaves fd/send_queue alone until resumed
+    volatile bool reconnecting;  // Receiver thread is done with the old transport (main loop releases it)
+    pthread_t thread;  // Receives messages from this TV
 } tv_connection_t;
 
 struct x11_streamer {
@@ -43,48 +112,230 @@ struct x11_streamer {
     bool force_no_encrypt;
     uint16_t pin;  // PIN from command line (0 if not provided)
     streamer_display_mode_t display_mode;  // Display mode: extend or mirror
-    int tv_fd;  // Connection to TV receiver
-    char *tv_host;
-    int tv_port;
+    char *tv_hosts[STREAMER_MAX_RECEIVERS];  // Receivers to connect to (from options or discovery)
+    int tv_ports[STREAMER_MAX_RECEIVERS];
+    int num_tv_hosts;
+    int tv_port;  // Port for broadcast discovery
     bool use_broadcast;  // Whether to use broadcast discovery
     int broadcast_timeout_ms;  // Broadcast discovery timeout
     char *program_name;  // Program name (for error messages)
     bool running;
-    x11_context_t *x11_ctx;
-    tv_connection_t *tv_conn;  // Single TV connection
+    x11_context_t *x11_ctx;  // Main loop: RandR events, output table, keep-alive
+    x11_context_t *output_manager;  // Own X connection for output setup (under output_mutex)
+    tv_connection_t *tv_conns[STREAMER_MAX_RECEIVERS];  // Connected receivers (added/reaped by the main loop)
+    int num_tv_conns;
+    frame_source_t *frame_source;  // Where frames come from (DRM framebuffer of that output, or headless source)
+    bool headless;  // Synthetic/file source: no X server, no virtual output
+    char *record_path;  // Write captured frames here (NULL = not recording)
+    bool record_full_frames;  // Record whole frames rather than changed tiles
+    session_recorder_t *recorder;  // Opened on the first captured frame, once the rate is known
     pthread_mutex_t tv_mutex;
-    pthread_t tv_thread;
-    pthread_t keepalive_thread;  // Separate thread for keep-alive (non-blocking)
+    pthread_mutex_t output_mutex;  // Serializes output setup between receiver threads
+    int wake_fd;  // eventfd that wakes the main loop (stop, new output)
+    int loop_epfd;  // Main loop's epoll set (-1 when the loop isn't running)
+    _Atomic(streamer_state_t *) state;  // Current per-frame state (see streamer_state_t)
+    streamer_state_t initial_state;  // First snapshot (never freed)
+    streamer_state_t *retired_states;  // Replaced snapshots awaiting the main loop (tv_mutex)
+    atomic_bool has_retired_states;
     audio_capture_t *audio_capture;
-    int refresh_rate_hz;  // Display refresh rate for frame throttling
-    uint64_t last_frame_time_us;  // Last frame capture time (microseconds)
-    dirty_rect_context_t *dirty_rect_ctx;  // For dirty rectangle detection
-    uint8_t encoding_mode;  // Current encoding mode (0=full, 1=dirty rects, 2=H.264)
+    bool audio_latency_reported;  // Capture latency logged once per run
+    audio_pcm_format_t audio_formats[MAX_AUDIO_PCM_FORMATS];  // Resampled PCM (audio thread only)
+    int num_audio_formats;
+    audio_resampler_t *opus_resampler;  // Capture rate -> OPUS_SAMPLE_RATE, when they differ
+    int16_t *opus_pcm;
+    frame_pipeline_t *pipeline;  // Dirty tiles and H.264 input, in one pass over each frame
     encoding_metrics_t *metrics;  // Metrics for adaptive switching
-    bool enable_encryption;  // Whether encryption is enabled (from options)
-    noise_encryption_context_t *noise_ctx;  // Noise Protocol encryption context
+    int max_backlog_ms;  // Send queue congestion threshold (from options)
+    bool udp_video_requested;  // Offer UDP video channel (from options)
+    int fec_group;  // UDP FEC group size or FEC_GROUP_AUTO/FEC_GROUP_OFF (from options)
+    int resume_grace_ms;  // How long a dropped receiver is reconnected before it is removed (from options)
+    uint32_t udp_frames_since_refresh;  // Frames since the last self-contained UDP frame
+    catchup_cache_t *h264_catchup;  // Last IDR and the frames since, for receivers that join mid-stream
+    char usb_ip[INET_ADDRSTRLEN];  // USB tethering address of the adb device (empty = none)
+    bool usb_ip_checked;  // usb_ip has been looked up
+    uint64_t start_us;  // Process start (from options), for time-to-first-frame
+    double discovery_ms;  // Time startup discovery took (0 with hosts given)
+    const char *discovery_method;  // Probe that found the receiver (NULL with hosts given)
+    bool first_picture_logged;  // Time-to-first-frame was reported
 #ifdef HAVE_X264
     h264_encoder_t *h264_encoder;  // H.264 encoder (when mode=2)
 #endif
+#ifdef HAVE_OPUS
+    audio_encoder_t *audio_encoder;  // Opus encoder for receivers that support it (NULL = PCM only)
+#endif
 };
 
-// Helper functions for encrypted/unencrypted protocol operations
-static inline int streamer_send_message(x11_streamer_t *streamer, message_type_t type, const void *data, size_t data_len)
+// Helper functions for encrypted/unencrypted protocol operations on one connection
+static inline int conn_send_message(tv_connection_t *conn, message_type_t type, const void *data, size_t data_len)
 {
-    if (streamer->noise_ctx && noise_encryption_is_ready(streamer->noise_ctx)) {
-        return protocol_send_message_encrypted(streamer->noise_ctx, streamer->tv_fd, type, data, data_len);
+    if (conn->send_queue) {
+        return send_queue_push(conn->send_queue, type, data, data_len, NULL, 0, false);
+    } else if (conn->noise_ctx && noise_encryption_is_ready(conn->noise_ctx)) {
+        return protocol_send_message_encrypted(conn->noise_ctx, conn->fd, type, data, data_len);
     } else {
-        return protocol_send_message(streamer->tv_fd, type, data, data_len);
+        return protocol_send_message(conn->fd, type, data, data_len);
     }
 }
 
-static inline int streamer_receive_message(x11_streamer_t *streamer, message_header_t *header, void **payload)
+static inline int conn_receive_message(tv_connection_t *conn, message_header_t *header, void **payload)
 {
-    if (streamer->noise_ctx && noise_encryption_is_ready(streamer->noise_ctx)) {
-        return protocol_receive_message_encrypted(streamer->noise_ctx, streamer->tv_fd, header, payload);
+    if (conn->noise_ctx && noise_encryption_is_ready(conn->noise_ctx)) {
+        return protocol_receive_message_encrypted(conn->noise_ctx, conn->fd, header, payload);
     } else {
-        return protocol_receive_message(streamer->tv_fd, header, payload);
+        return protocol_receive_message(conn->fd, header, payload);
+    }
+}
+
+// True if the main loop may queue data on the connection (not closed or being resumed)
+static inline bool conn_is_usable(const tv_connection_t *conn)
+{
+    return conn->active && !conn->suspended;
+}
+
+// Stop using a connection after a send error; its receiver thread then resumes the
+// session or exits (and the connection is reaped)
+static void conn_fail(tv_connection_t *conn, const char *what)
+{
+    if (!conn_is_usable(conn))
+        return;
+    fprintf(stderr, "Failed to send %s to TV receiver %s, dropping the connection\n", what, conn->peer);
+    conn->suspended = true;
+    shutdown(conn->fd, SHUT_RDWR);
+}
+
+// Take a socket out of the main loop's EPOLLOUT watch before it is closed, so a
+// reused fd number never inherits the registration (main loop only)
+static void conn_unwatch(tv_connection_t *conn, int *watched)
+{
+    if (*watched >= 0 && conn->streamer->loop_epfd >= 0)
+        epoll_ctl(conn->streamer->loop_epfd, EPOLL_CTL_DEL, *watched, NULL);
+    *watched = -1;
+}
+
+// Release the old transport of a connection that is being resumed (main loop only, so
+// nothing is being queued on it); the receiver thread waits for this before redialling
+static void conn_detach(tv_connection_t *conn)
+{
+    conn_unwatch(conn, &conn->epoll_fd);
+    pthread_mutex_lock(&conn->streamer->tv_mutex);
+    send_queue_destroy(conn->send_queue);
+    conn->send_queue = NULL;
+    if (conn->noise_ctx)
+        noise_encryption_cleanup(conn->noise_ctx);
+    conn->noise_ctx = NULL;
+    close(conn->fd);
+    conn->fd = -1;
+    pthread_mutex_unlock(&conn->streamer->tv_mutex);
+}
+
+// Fail sends that go unacknowledged for RECEIVER_USER_TIMEOUT_MS (dropped Wi-Fi would
+// otherwise only be noticed after minutes of TCP retransmissions)
+static void conn_set_user_timeout(int fd)
+{
+    unsigned int timeout_ms = RECEIVER_USER_TIMEOUT_MS;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout_ms, sizeof(timeout_ms)) < 0)
+        perror("setsockopt(TCP_USER_TIMEOUT)");
+}
+
+// Log time-to-first-correct-frame for a joining receiver once the picture that brought it
+// up to date has been handed to the network
+static void conn_report_first_picture(tv_connection_t *conn)
+{
+    if (!conn->join_us || !conn->catchup_desc[0] || send_queue_has_pending(conn->send_queue) ||
+        udp_video_sender_has_pending(conn->udp_video))
+        return;
+    uint64_t now_us = audio_get_timestamp_us();
+    printf("TV receiver %s: first complete picture sent %.1f ms after joining (%s)\n", conn->peer,
+           (now_us - conn->join_us) / 1000.0, conn->catchup_desc);
+    conn->join_us = 0;
+
+    // Startup cost as the user sees it: process start to the first picture on any TV
+    x11_streamer_t *streamer = conn->streamer;
+    if (!streamer->first_picture_logged && streamer->start_us) {
+        streamer->first_picture_logged = true;
+        if (streamer->discovery_method)
+            printf("Time to first frame: %.1f ms from process start (discovery %.1f ms via %s)\n",
+                   (now_us - streamer->start_us) / 1000.0, streamer->discovery_ms, streamer->discovery_method);
+        else
+            printf("Time to first frame: %.1f ms from process start\n", (now_us - streamer->start_us) / 1000.0);
+    }
+}
+
+// Restart the time-to-first-picture clock if the receiver thread resumed the receiver (main loop only)
+static void conn_take_resume(tv_connection_t *conn)
+{
+    uint64_t resume_us = atomic_exchange(&conn->resume_us, 0);
+    if (resume_us) {
+        conn->join_us = resume_us;
+        conn->catchup_desc[0] = '\0';
+    }
+}
+
+// A receiver that was skipping frames has been sent a complete picture
+static void conn_caught_up(tv_connection_t *conn, const char *how, size_t bytes)
+{
+    conn->resync = false;
+    if (conn->join_us && !conn->catchup_desc[0])
+        snprintf(conn->catchup_desc, sizeof(conn->catchup_desc), "%s, %zu KB", how, bytes / 1024);
+    conn_report_first_picture(conn);
+}
+
+// Send one message to every connected receiver
+// The message is built once; each receiver's queue only adds its own encryption and send
+static void streamer_broadcast_message_iov(x11_streamer_t *streamer, message_type_t type,
+                                           const void *data, size_t data_len,
+                                           const struct iovec *payload, int payload_cnt)
+{
+    send_message_t *msg = send_message_create(type, data, data_len, payload, payload_cnt);
+    if (!msg)
+        return;
+
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        if (conn_is_usable(conn) && send_queue_push_message(conn->send_queue, msg, false) < 0)
+            conn_fail(conn, type == MSG_AUDIO ? "audio" : "message");
     }
+    send_message_unref(msg);
+}
+
+static inline void streamer_broadcast_message(x11_streamer_t *streamer, message_type_t type,
+                                              const void *data, size_t data_len)
+{
+    streamer_broadcast_message_iov(streamer, type, data, data_len, NULL, 0);
+}
+
+// Release everything a connection owns (receiver thread must have exited)
+static void tv_connection_free(tv_connection_t *conn)
+{
+    if (!conn)
+        return;
+    conn_unwatch(conn, &conn->epoll_fd);
+    conn_unwatch(conn, &conn->udp_epoll_fd);
+    if (conn->send_queue)
+        send_queue_destroy(conn->send_queue);
+    if (conn->udp_video)
+        udp_video_sender_destroy(conn->udp_video);
+    if (conn->noise_ctx)
+        noise_encryption_cleanup(conn->noise_ctx);
+    if (conn->fd >= 0)
+        close(conn->fd);
+    free(conn->hello_payload);
+    free(conn);
+}
+
+// Find the optional transport extension after the display modes (fields still in network order)
+static const hello_transport_t *hello_find_transport(const void *payload, size_t len)
+{
+    if (!payload || len < sizeof(hello_message_t))
+        return NULL;
+
+    const hello_message_t *hello = (const hello_message_t *)payload;
+    size_t offset = sizeof(hello_message_t) + ntohs(hello->display_name_len) +
+                    ntohs(hello->num_modes) * sizeof(display_mode_t);
+    if (len < offset + sizeof(hello_transport_t))
+        return NULL;
+
+    return (const hello_transport_t *)((const uint8_t *)payload + offset);
 }
 
 // Helper function to get PIN (from CLI or prompt)
@@ -108,61 +359,278 @@ static uint16_t get_pin(x11_streamer_t *streamer)
     return pin;
 }
 
-// Helper function to send raw data (encrypted if available)
-static inline int streamer_send_raw(x11_streamer_t *streamer, const void *data, size_t data_len)
+// Wake the main loop out of epoll_wait() (async-signal-safe)
+static void streamer_wake(x11_streamer_t *streamer)
 {
-    if (streamer->noise_ctx && noise_encryption_is_ready(streamer->noise_ctx)) {
-        return noise_encryption_send(streamer->noise_ctx, streamer->tv_fd, data, data_len);
-    } else {
-        return send(streamer->tv_fd, data, data_len, MSG_NOSIGNAL) == (ssize_t)data_len ? 0 : -1;
+    uint64_t one = 1;
+    if (streamer->wake_fd >= 0 && write(streamer->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("write(wake eventfd)");
+}
+
+// Current per-frame state: lock-free in the main loop, under tv_mutex anywhere else
+static const streamer_state_t *streamer_state(x11_streamer_t *streamer)
+{
+    return atomic_load_explicit(&streamer->state, memory_order_acquire);
+}
+
+// Swap in a copy of next as the current state (tv_mutex held)
+// Returns 0 on success, -1 if out of memory (the state is left unchanged)
+static int streamer_publish_state(x11_streamer_t *streamer, const streamer_state_t *next)
+{
+    streamer_state_t *state = malloc(sizeof(*state));
+    if (!state) {
+        fprintf(stderr, "Failed to allocate streamer state\n");
+        return -1;
     }
+    *state = *next;
+    state->retired_next = NULL;
+    streamer_state_t *old = atomic_exchange_explicit(&streamer->state, state, memory_order_acq_rel);
+    if (old != &streamer->initial_state) {
+        old->retired_next = streamer->retired_states;
+        streamer->retired_states = old;
+        atomic_store_explicit(&streamer->has_retired_states, true, memory_order_release);
+    }
+    return 0;
 }
 
-// Keep-alive thread function (runs independently, doesn't block frame capture)
-// This ensures keep-alive queries don't interrupt 120Hz frame capture timing
-static void *keepalive_thread_func(void *arg) {
-    x11_streamer_t *streamer = (x11_streamer_t *)arg;
-    while (streamer->running) {
-        // Sleep for 1 second
-        struct timespec sleep_time = { .tv_sec = 1, .tv_nsec = 0 };
-        nanosleep(&sleep_time, NULL);
+// Free replaced snapshots (main loop, while it holds no snapshot)
+static void streamer_reclaim_states(x11_streamer_t *streamer)
+{
+    if (!atomic_load_explicit(&streamer->has_retired_states, memory_order_acquire))
+        return;
+    pthread_mutex_lock(&streamer->tv_mutex);
+    streamer_state_t *list = streamer->retired_states;
+    streamer->retired_states = NULL;
+    atomic_store_explicit(&streamer->has_retired_states, false, memory_order_relaxed);
+    pthread_mutex_unlock(&streamer->tv_mutex);
+    while (list) {
+        streamer_state_t *next = list->retired_next;
+        free(list);
+        list = next;
+    }
+}
 
-        if (!streamer->running)
-            break;
+// Stream a newly configured output and restart frame pacing with a frame now
+static void streamer_set_output(x11_streamer_t *streamer, RROutput output_id, int refresh_rate_hz)
+{
+    pthread_mutex_lock(&streamer->tv_mutex);
+    streamer_state_t next = *streamer_state(streamer);
+    next.output_id = output_id;
+    next.refresh_rate_hz = refresh_rate_hz;
+    next.output_generation++;
+    streamer_publish_state(streamer, &next);
+    pthread_mutex_unlock(&streamer->tv_mutex);
+    streamer_wake(streamer);
+}
+
+// Adaptive encoding switch (main loop)
+static void streamer_set_encoding_mode(x11_streamer_t *streamer, uint8_t encoding_mode)
+{
+    pthread_mutex_lock(&streamer->tv_mutex);
+    streamer_state_t next = *streamer_state(streamer);
+    next.encoding_mode = encoding_mode;
+    streamer_publish_state(streamer, &next);
+    pthread_mutex_unlock(&streamer->tv_mutex);
+}
 
-        // Get virtual output ID (with mutex protection)
+// Non-blocking connect bounded by timeout_ms
+// Returns the connected socket (blocking mode), or -1
+static int connect_with_timeout(const struct sockaddr_in *addr, int timeout_ms)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        goto fail;
+
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        if (errno != EINPROGRESS)
+            goto fail;
+        struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        if (poll(&pfd, 1, timeout_ms) <= 0 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0 || so_error != 0)
+            goto fail;
+    }
+
+    if (fcntl(fd, F_SETFL, flags) < 0)
+        goto fail;
+    return fd;
+
+fail:
+    close(fd);
+    return -1;
+}
+
+// One attempt at resuming a dropped session: CLIENT_HELLO with CLIENT_HELLO_FLAG_RESUME,
+// the Noise handshake if the session was encrypted, SESSION_RESUME, then SESSION_RESUMED.
+// No PIN, HELLO or output setup - the receiver kept its side of the session.
+// Returns 0 with the new transport installed, -1 on failure (*rejected is set if the
+// receiver answered but no longer has the session)
+static int streamer_try_resume(x11_streamer_t *streamer, tv_connection_t *conn,
+                               int connect_timeout_ms, int reply_timeout_ms, bool *rejected)
+{
+    noise_encryption_context_t *noise_ctx = NULL;
+    send_queue_t *queue = NULL;
+    message_header_t header;
+    void *payload = NULL;
+    int ret;
+
+    int fd = connect_with_timeout(&conn->addr, connect_timeout_ms);
+    if (fd < 0)
+        return -1;
+    conn_set_user_timeout(fd);
+
+    uint8_t client_hello[2] = { 1, CLIENT_HELLO_FLAG_RESUME };  // version + flags
+    if (conn->encrypted)
+        client_hello[1] |= CLIENT_HELLO_FLAG_ENCRYPT;
+    if (conn->udp_video)
+        client_hello[1] |= CLIENT_HELLO_FLAG_UDP_VIDEO;
+    if (protocol_send_message(fd, MSG_CLIENT_HELLO, client_hello, sizeof(client_hello)) < 0)
+        goto fail;
+
+    if (conn->encrypted) {
+        noise_ctx = noise_encryption_init(true);
+        if (!noise_ctx || noise_encryption_handshake(noise_ctx, fd) < 0)
+            goto fail;
+    }
+
+    session_resume_message_t resume;
+    memcpy(resume.ticket, conn->ticket, sizeof(resume.ticket));
+    if (noise_ctx)
+        ret = protocol_send_message_encrypted(noise_ctx, fd, MSG_SESSION_RESUME, &resume, sizeof(resume));
+    else
+        ret = protocol_send_message(fd, MSG_SESSION_RESUME, &resume, sizeof(resume));
+    if (ret < 0)
+        goto fail;
+
+    // The receiver only answers once it has noticed the old connection is gone
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    for (int waited_ms = 0; (ret = poll(&pfd, 1, RESUME_RETRY_INTERVAL_MS)) == 0; ) {
+        waited_ms += RESUME_RETRY_INTERVAL_MS;
+        if (!streamer->running || waited_ms >= reply_timeout_ms)
+            goto fail;
+    }
+    if (ret < 0)
+        goto fail;
+
+    if (noise_ctx)
+        ret = protocol_receive_message_encrypted(noise_ctx, fd, &header, &payload);
+    else
+        ret = protocol_receive_message(fd, &header, &payload);
+    free(payload);
+    if (ret <= 0 || header.type != MSG_SESSION_RESUMED) {
+        *rejected = ret > 0;
+        goto fail;
+    }
+
+    queue = send_queue_create(fd, noise_ctx, streamer->max_backlog_ms);
+    if (!queue)
+        goto fail;
+
+    // Hand the new transport to the main loop; the receiver skips frames until the
+    // catch-up path has sent it a complete picture, as for a receiver that just joined
+    pthread_mutex_lock(&streamer->tv_mutex);
+    if (!streamer->running) {
+        pthread_mutex_unlock(&streamer->tv_mutex);
+        goto fail;
+    }
+    conn->fd = fd;
+    conn->noise_ctx = noise_ctx;
+    conn->send_queue = queue;
+    conn->resume_us = audio_get_timestamp_us();
+    conn->resync = true;
+    conn->reconnecting = false;
+    conn->suspended = false;
+    pthread_mutex_unlock(&streamer->tv_mutex);
+    return 0;
+
+fail:
+    send_queue_destroy(queue);
+    if (noise_ctx)
+        noise_encryption_cleanup(noise_ctx);
+    close(fd);
+    return -1;
+}
+
+// Called by a receiver thread when its connection drops: keep the session (output,
+// encoder, catch-up cache) and redial the receiver for up to resume_grace_ms
+// Returns 0 once the session runs on a new connection, -1 if it is over
+static int streamer_resume_receiver(x11_streamer_t *streamer, tv_connection_t *conn)
+{
+    if (!conn->has_ticket || streamer->resume_grace_ms <= 0 || !streamer->running)
+        return -1;
+
+    // The main loop may be mid-send on the old transport; it releases it in its reap pass
+    pthread_mutex_lock(&streamer->tv_mutex);
+    conn->suspended = true;
+    conn->reconnecting = true;
+    pthread_mutex_unlock(&streamer->tv_mutex);
+    for (;;) {
+        if (!streamer->running)
+            return -1;
         pthread_mutex_lock(&streamer->tv_mutex);
-        RROutput virtual_output_id = (streamer->tv_conn && streamer->tv_conn->virtual_output_id != None)
-                                  ? streamer->tv_conn->virtual_output_id : None;
+        bool released = conn->send_queue == NULL;
         pthread_mutex_unlock(&streamer->tv_mutex);
+        if (released)
+            break;
+        usleep(10000);
+    }
+
+    uint64_t dropped_us = audio_get_timestamp_us();
+    uint64_t deadline_us = dropped_us + (uint64_t)streamer->resume_grace_ms * 1000;
+    printf("TV receiver %s: connection lost, resuming session (up to %d ms)\n",
+           conn->peer, streamer->resume_grace_ms);
 
-        // Send keep-alive signal (can block here - we're in a separate thread)
-        // This won't affect frame capture timing since it's in a separate thread
-        if (virtual_output_id != None && streamer->x11_ctx) {
-            x11_context_keep_alive_output(streamer->x11_ctx, virtual_output_id);
+    int attempts = 0;
+    while (streamer->running) {
+        uint64_t now_us = audio_get_timestamp_us();
+        if (now_us >= deadline_us)
+            break;
+        int remaining_ms = (int)((deadline_us - now_us) / 1000);
+        int connect_timeout_ms = remaining_ms < RESUME_CONNECT_TIMEOUT_MS ? remaining_ms : RESUME_CONNECT_TIMEOUT_MS;
+
+        bool rejected = false;
+        attempts++;
+        if (streamer_try_resume(streamer, conn, connect_timeout_ms, remaining_ms, &rejected) == 0) {
+            printf("TV receiver %s: session resumed %.1f ms after the connection was lost (%d attempt%s)\n",
+                   conn->peer, (audio_get_timestamp_us() - dropped_us) / 1000.0,
+                   attempts, attempts == 1 ? "" : "s");
+            return 0;
         }
+        if (rejected) {
+            printf("TV receiver %s: session no longer known to the receiver\n", conn->peer);
+            return -1;
+        }
+        usleep(RESUME_RETRY_INTERVAL_MS * 1000);
     }
-    return NULL;
+
+    printf("TV receiver %s: session not resumed within %d ms\n", conn->peer, streamer->resume_grace_ms);
+    return -1;
 }
 
 static void *tv_receiver_thread(void *arg)
 {
-    x11_streamer_t *streamer = (x11_streamer_t *)arg;
+    tv_connection_t *conn = (tv_connection_t *)arg;
+    x11_streamer_t *streamer = conn->streamer;
     message_header_t header;
     void *payload = NULL;
 
     // Check if HELLO was already received (when encryption is disabled)
-    if (streamer->tv_conn && streamer->tv_conn->hello_payload) {
+    if (conn->hello_payload) {
         // Use pre-received HELLO
-        header = streamer->tv_conn->hello_header;
-        payload = streamer->tv_conn->hello_payload;
-        streamer->tv_conn->hello_payload = NULL;  // Clear so we don't free it twice
+        header = conn->hello_header;
+        payload = conn->hello_payload;
+        conn->hello_payload = NULL;  // Clear so we don't free it twice
     } else {
         // TV receiver sends HELLO first (when encryption is enabled)
         // Validate protocol by checking the first message
 
         // Receive TV HELLO with timeout to detect invalid protocols
-        struct pollfd pfd = {.fd = streamer->tv_fd, .events = POLLIN};
+        struct pollfd pfd = {.fd = conn->fd, .events = POLLIN};
         int poll_ret = poll(&pfd, 1, 2000);  // 2 second timeout
         if (poll_ret <= 0) {
             if (poll_ret == 0) {
@@ -173,7 +641,7 @@ static void *tv_receiver_thread(void *arg)
             goto cleanup;
         }
 
-        int ret = streamer_receive_message(streamer, &header, &payload);
+        int ret = conn_receive_message(conn, &header, &payload);
         if (ret <= 0) {
             fprintf(stderr, "TV receiver handshake failed: connection closed or invalid data\n");
             goto cleanup;
@@ -253,21 +721,36 @@ static void *tv_receiver_thread(void *arg)
             snprintf(tv_display_name, sizeof(tv_display_name), "TV Display");
         }
 
+        strncpy(conn->display_name, tv_display_name, sizeof(conn->display_name) - 1);
+        conn->display_name[sizeof(conn->display_name) - 1] = '\0';
+
         // Handle display setup based on mode
         RROutput virtual_output_id = None;
         output_info_t *primary_output = NULL;
 
-        if (streamer->display_mode == STREAMER_DISPLAY_MODE_MIRROR) {
+        pthread_mutex_lock(&streamer->output_mutex);
+        pthread_mutex_lock(&streamer->tv_mutex);
+        bool output_ready = streamer_state(streamer)->output_id != None;
+        pthread_mutex_unlock(&streamer->tv_mutex);
+        if (streamer->headless) {
+            // Frame size and rate are the source's; the receiver scales the picture
+            printf("TV receiver '%s' joined, streaming %s\n", tv_display_name,
+                   frame_source_get_name(streamer->frame_source));
+        } else if (output_ready) {
+            // Another receiver already set up the output: stream the same picture to this one
+            printf("TV receiver '%s' joined, sharing the existing output\n", tv_display_name);
+        } else if (streamer->display_mode == STREAMER_DISPLAY_MODE_MIRROR) {
             // Mirror mode: use primary display directly (no virtual output needed)
-            primary_output = x11_context_get_primary_output(streamer->x11_ctx);
+            if (x11_context_refresh_outputs(streamer->output_manager) == 0)
+                primary_output = x11_context_get_primary_output(streamer->output_manager);
             if (!primary_output) {
                 fprintf(stderr, "Error: Could not find primary display for mirroring\n");
                 // Free and continue to cleanup
                 if (display_name && display_name != (char *)payload + sizeof(hello_message_t)) {
                     free(display_name);
                 }
-                free(payload);
-                return NULL;
+                pthread_mutex_unlock(&streamer->output_mutex);
+                goto cleanup;
             }
 
             if (!primary_output->connected || primary_output->framebuffer_id == 0) {
@@ -277,8 +760,8 @@ static void *tv_receiver_thread(void *arg)
                 if (display_name && display_name != (char *)payload + sizeof(hello_message_t)) {
                     free(display_name);
                 }
-                free(payload);
-                return NULL;
+                pthread_mutex_unlock(&streamer->output_mutex);
+                goto cleanup;
             }
 
             printf("Mirroring primary display '%s' (%dx%d@%dHz) - no virtual output needed\n",
@@ -286,16 +769,7 @@ static void *tv_receiver_thread(void *arg)
                    primary_output->width, primary_output->height, primary_output->refresh_rate);
 
             // Store primary output ID for frame capture
-            pthread_mutex_lock(&streamer->tv_mutex);
-            if (streamer->tv_conn) {
-                streamer->tv_conn->virtual_output_id = primary_output->output_id;  // Reuse field for primary output ID
-                strncpy(streamer->tv_conn->display_name, tv_display_name,
-                       sizeof(streamer->tv_conn->display_name) - 1);
-                streamer->tv_conn->display_name[sizeof(streamer->tv_conn->display_name) - 1] = '\0';
-            }
-            streamer->refresh_rate_hz = primary_output->refresh_rate;
-            streamer->last_frame_time_us = 0;
-            pthread_mutex_unlock(&streamer->tv_mutex);
+            streamer_set_output(streamer, primary_output->output_id, primary_output->refresh_rate);
         } else {
             // Extend mode: create virtual output
             if (modes && hello_msg->num_modes > 0) {
@@ -306,7 +780,7 @@ static void *tv_receiver_thread(void *arg)
 
                 // Create virtual output with the exact display name (no "XR-" prefix)
                 virtual_output_id = x11_context_create_virtual_output(
-                    streamer->x11_ctx,
+                    streamer->output_manager,
                     tv_display_name,  // Use display name directly
                     output_width,
                     output_height,
@@ -318,9 +792,9 @@ static void *tv_receiver_thread(void *arg)
 
                     // Find and print the TV receiver's virtual output
                     output_info_t *tv_output = NULL;
-                    for (int i = 0; i < streamer->x11_ctx->num_outputs; i++) {
-                        if (streamer->x11_ctx->outputs[i].output_id == virtual_output_id) {
-                            tv_output = &streamer->x11_ctx->outputs[i];
+                    for (int i = 0; i < streamer->output_manager->num_outputs; i++) {
+                        if (streamer->output_manager->outputs[i].output_id == virtual_output_id) {
+                            tv_output = &streamer->output_manager->outputs[i];
                             break;
                         }
                     }
@@ -351,7 +825,7 @@ static void *tv_receiver_thread(void *arg)
                                 refresh_rates[i] = modes[i].refresh_rate / 100;  // Convert from Hz*100 to Hz
                             }
 
-                            x11_context_set_virtual_output_modes(streamer->x11_ctx, virtual_output_id,
+                            x11_context_set_virtual_output_modes(streamer->output_manager, virtual_output_id,
                                                                 widths, heights, refresh_rates,
                                                                 hello_msg->num_modes);
                             printf("Set %d modes for virtual output '%s'\n",
@@ -363,16 +837,7 @@ static void *tv_receiver_thread(void *arg)
                         }
                     }
 
-                    pthread_mutex_lock(&streamer->tv_mutex);
-                    if (streamer->tv_conn) {
-                        streamer->tv_conn->virtual_output_id = virtual_output_id;
-                        strncpy(streamer->tv_conn->display_name, tv_display_name,
-                               sizeof(streamer->tv_conn->display_name) - 1);
-                        streamer->tv_conn->display_name[sizeof(streamer->tv_conn->display_name) - 1] = '\0';
-                    }
-                    streamer->refresh_rate_hz = refresh_rate;
-                    streamer->last_frame_time_us = 0;
-                    pthread_mutex_unlock(&streamer->tv_mutex);
+                    streamer_set_output(streamer, virtual_output_id, refresh_rate);
                 } else {
                     printf("Failed to create virtual output for TV receiver\n");
                 }
@@ -380,6 +845,7 @@ static void *tv_receiver_thread(void *arg)
                 fprintf(stderr, "Error: TV receiver sent no display modes\n");
             }
         }
+        pthread_mutex_unlock(&streamer->output_mutex);
 
         // Free display name if we allocated it
         if (display_name && display_name != (char *)payload + sizeof(hello_message_t)) {
@@ -404,34 +870,73 @@ static void *tv_receiver_thread(void *arg)
         payload = NULL;
     }
 
-    // Main TV receiver communication loop
-    while (streamer->running) {
-        int ret = streamer_receive_message(streamer, &header, &payload);
+    // Main TV receiver communication loop (carries on over a new connection if the session is resumed)
+    while (streamer->running && conn->active) {
+        int ret = conn_receive_message(conn, &header, &payload);
         if (ret <= 0) {
             if (ret == 0)
-                printf("TV receiver disconnected\n");
+                printf("TV receiver %s disconnected\n", conn->peer);
+            if (streamer_resume_receiver(streamer, conn) == 0)
+                continue;
             break;
         }
 
         switch (header.type) {
         case MSG_PING:
-            streamer_send_message(streamer, MSG_PONG, NULL, 0);
+            conn_send_message(conn, MSG_PONG, NULL, 0);
             break;
 
-        case MSG_PAUSE:
-            if (streamer->tv_conn) {
-                streamer->tv_conn->paused = true;
-                printf("TV receiver paused (no surface) - frame sending paused\n");
+        case MSG_VIDEO_FEEDBACK:
+            if (payload && header.length >= sizeof(video_feedback_message_t)) {
+                video_feedback_message_t *feedback = (video_feedback_message_t *)payload;
+                feedback->packets_expected = ntohl(feedback->packets_expected);
+                feedback->packets_lost = ntohl(feedback->packets_lost);
+                feedback->frames_completed = ntohl(feedback->frames_completed);
+                feedback->frames_lost = ntohl(feedback->frames_lost);
+                feedback->frames_recovered = ntohl(feedback->frames_recovered);
+                udp_video_sender_report_feedback(conn->udp_video, feedback);
             }
             break;
 
-        case MSG_RESUME:
-            if (streamer->tv_conn) {
-                streamer->tv_conn->paused = false;
-                printf("TV receiver resumed (surface available) - frame sending resumed\n");
+        case MSG_CAPABILITIES:
+            if (payload && header.length >= CAPABILITIES_BASE_SIZE) {
+                const capabilities_message_t *caps = (const capabilities_message_t *)payload;
+#ifdef HAVE_OPUS
+                conn->audio_opus = streamer->audio_encoder && (caps->audio_codecs & CAPABILITY_AUDIO_OPUS);
+#endif
+                if (header.length >= sizeof(capabilities_message_t)) {
+                    uint32_t rate = ntohl(caps->audio_sample_rate);
+                    uint16_t channels = ntohs(caps->audio_channels);
+                    // Capture is stereo, so there is nothing to gain from more channels
+                    if (rate >= 8000 && rate <= 192000 && channels >= 1 && channels <= AUDIO_CAPTURE_CHANNELS) {
+                        conn->audio_channels = channels;
+                        conn->audio_rate = rate;
+                    }
+                }
+                if (conn->audio_opus)
+                    printf("TV receiver %s: audio as Opus\n", conn->peer);
+                else if (conn->audio_rate)
+                    printf("TV receiver %s: audio as PCM at its native %u Hz, %u channels\n", conn->peer,
+                           conn->audio_rate, conn->audio_channels);
+                else
+                    printf("TV receiver %s: audio as PCM\n", conn->peer);
             }
             break;
 
+        case MSG_PAUSE:
+            conn->paused = true;
+            printf("TV receiver %s paused (no surface) - frame sending paused\n", conn->peer);
+            break;
+
+        case MSG_RESUME:
+            // Frames were skipped while paused, so bring the receiver up to date again
+            // (resync is set first: once the main loop sees it unpaused, it sees it resyncing)
+            conn->resume_us = audio_get_timestamp_us();
+            conn->resync = true;
+            conn->paused = false;
+            printf("TV receiver %s resumed (surface available) - frame sending resumed\n", conn->peer);
+            break;
+
         default:
             printf("Unknown message type from TV receiver: %d\n", header.type);
             break;
@@ -447,40 +952,43 @@ cleanup:
     if (payload)
         free(payload);
 
-    // Clean up virtual output if it was created
-    pthread_mutex_lock(&streamer->tv_mutex);
-    if (streamer->tv_conn && streamer->tv_conn->virtual_output_id != None) {
-        x11_context_delete_virtual_output(streamer->x11_ctx, streamer->tv_conn->virtual_output_id);
-        streamer->tv_conn->virtual_output_id = None;
-    }
-    pthread_mutex_unlock(&streamer->tv_mutex);
+    // The main loop reaps the connection (and removes the output after the last receiver)
+    conn->active = false;
+    return NULL;
+}
 
-    if (streamer->tv_fd >= 0) {
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
+// Compare the frame with the last one and, if i420 is given, convert the tiles that
+// changed into it (see frame_pipeline.h)
+static int streamer_run_pipeline(x11_streamer_t *streamer, const frame_buffer_t *fb, const h264_i420_planes_t *i420)
+{
+    if (!streamer->pipeline ||
+        frame_pipeline_get_width(streamer->pipeline) != fb->width ||
+        frame_pipeline_get_height(streamer->pipeline) != fb->height) {
+        frame_pipeline_destroy(streamer->pipeline);
+        streamer->pipeline = frame_pipeline_create(fb->width, fb->height);
+        if (!streamer->pipeline)
+            return -1;
     }
-
-    streamer->running = false;
-    return NULL;
+    return frame_pipeline_process(streamer->pipeline, fb, i420);
 }
 
-static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
-                                      output_info_t *output, drm_fb_t *fb)
+static void streamer_send_frame_to_tv(x11_streamer_t *streamer, const streamer_state_t *state,
+                                      uint32_t output_id, const frame_buffer_t *fb)
 {
-    if (!streamer->running || streamer->tv_fd < 0 || !output || !fb)
+    if (!streamer->running || streamer->num_tv_conns == 0 || !fb)
         return;
 
     uint64_t encoding_start_us = audio_get_timestamp_us();
-    uint8_t encoding_mode = streamer->encoding_mode;
+    uint8_t encoding_mode = state->encoding_mode;
     const void *frame_data = NULL;
     size_t frame_data_size = 0;
 
-    // Get frame data (framebuffer should already be mapped)
-    if (!fb->map) {
-        printf("Framebuffer not mapped\n");
+    // Get frame data (the source keeps it mapped until the frame is released)
+    if (!fb->data) {
+        printf("Frame has no data\n");
         return;
     }
-    frame_data = fb->map;
+    frame_data = fb->data;
     frame_data_size = fb->size;
 
     // Detect dirty rectangles if enabled
@@ -488,39 +996,68 @@ static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
     int num_dirty_rects = 0;
     uint64_t total_dirty_pixels = 0;
 
-    if (encoding_mode == ENCODING_MODE_DIRTY_RECTS && streamer->dirty_rect_ctx && frame_data) {
-        // Ensure dirty rect context matches current frame size
-        if (!streamer->dirty_rect_ctx ||
-            dirty_rect_get_width(streamer->dirty_rect_ctx) != fb->width ||
-            dirty_rect_get_height(streamer->dirty_rect_ctx) != fb->height) {
-            if (streamer->dirty_rect_ctx)
-                dirty_rect_destroy(streamer->dirty_rect_ctx);
-            streamer->dirty_rect_ctx = dirty_rect_create(fb->width, fb->height, fb->bpp);
+    if (encoding_mode == ENCODING_MODE_DIRTY_RECTS && frame_data) {
+        if (streamer_run_pipeline(streamer, fb, NULL) == 0) {
+            uint32_t tiles_x, tiles_y;
+            const bool *tiles = frame_pipeline_get_dirty_tiles(streamer->pipeline, &tiles_x, &tiles_y);
+            num_dirty_rects = dirty_rect_merge_tiles(tiles, tiles_x, tiles_y, DIRTY_RECT_TILE_SIZE,
+                                                     fb->width, fb->height, dirty_rects, 64);
+            if (num_dirty_rects < 0)
+                num_dirty_rects = 0;
         }
 
-        if (streamer->dirty_rect_ctx) {
-            num_dirty_rects = dirty_rect_detect(streamer->dirty_rect_ctx, frame_data,
-                                                dirty_rects, 64);
+        // Calculate total dirty pixels
+        for (int i = 0; i < num_dirty_rects; i++) {
+            total_dirty_pixels += dirty_rects[i].width * dirty_rects[i].height;
+        }
 
-            // Calculate total dirty pixels
-            for (int i = 0; i < num_dirty_rects; i++) {
-                total_dirty_pixels += dirty_rects[i].width * dirty_rects[i].height;
-            }
+        // If dirty region is too large (>50%), fall back to full frame
+        uint64_t total_pixels = fb->width * fb->height;
+        if (total_dirty_pixels > total_pixels / 2) {
+            encoding_mode = ENCODING_MODE_FULL_FRAME;
+            num_dirty_rects = 0;
+        }
+    }
 
-            // If dirty region is too large (>50%), fall back to full frame
-            uint64_t total_pixels = fb->width * fb->height;
-            if (total_dirty_pixels > total_pixels / 2) {
-                encoding_mode = ENCODING_MODE_FULL_FRAME;
-                num_dirty_rects = 0;
-            }
+    // Receivers that fell behind (or just joined) skip delta frames. Once one of them has
+    // drained its queue it is brought up to date on its own (streamer_send_catchup), so the
+    // others keep their stream. Only H.264 without a cached chain to replay (or over UDP,
+    // where a long burst would not survive loss) makes this frame an IDR for everyone.
+    bool replace_queued = false;
+    bool any_udp = false;
+    bool needs_keyframe = false;
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        if (!conn_is_usable(conn) || conn->paused)
+            continue;
+        if (conn->udp_video)
+            any_udp = true;
+        if (conn->resync && !send_queue_is_congested(conn->send_queue) &&
+            (conn->udp_video || !catchup_cache_is_ready(streamer->h264_catchup)))
+            needs_keyframe = true;
+    }
+    if (needs_keyframe && encoding_mode == ENCODING_MODE_H264)
+        replace_queued = true;
+
+    // Lost UDP frames are never retransmitted, so refresh the whole picture once a second
+    if (any_udp) {
+        uint32_t refresh_interval = state->refresh_rate_hz > 0 ? state->refresh_rate_hz : 60;
+        if (++streamer->udp_frames_since_refresh >= refresh_interval) {
+            streamer->udp_frames_since_refresh = 0;
+            replace_queued = true;
         }
     }
 
+    if (replace_queued && encoding_mode == ENCODING_MODE_DIRTY_RECTS) {
+        encoding_mode = ENCODING_MODE_FULL_FRAME;
+        num_dirty_rects = 0;
+    }
+
     // Prepare frame message (will convert to network byte order before sending)
     uint64_t timestamp_us = audio_get_timestamp_us();
     frame_message_t frame = {
         .timestamp_us = timestamp_us,  // uint64 - need manual conversion
-        .output_id = output->output_id,
+        .output_id = output_id,
         .width = fb->width,
         .height = fb->height,
         .format = fb->format,
@@ -542,16 +1079,32 @@ static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
             if (streamer->h264_encoder)
                 h264_encoder_destroy(streamer->h264_encoder);
             streamer->h264_encoder = h264_encoder_create(fb->width, fb->height,
-                                                         streamer->refresh_rate_hz, 0);
+                                                         state->refresh_rate_hz, 0);
             if (!streamer->h264_encoder) {
                 fprintf(stderr, "Failed to create H.264 encoder, falling back to full frame\n");
                 encoding_mode = ENCODING_MODE_FULL_FRAME;
+            } else {
+                catchup_cache_clear(streamer->h264_catchup);
+                frame_pipeline_reset_i420(streamer->pipeline);
+                replace_queued = true;  // First frame of a new encoder is an IDR
             }
         }
 
         if (streamer->h264_encoder) {
-            if (h264_encoder_encode_frame(streamer->h264_encoder, frame_data,
-                                        &h264_data, &h264_size) == 0) {
+            if (replace_queued)
+                h264_encoder_force_keyframe(streamer->h264_encoder);
+
+            // Only the tiles that changed are converted into the encoder's input
+            h264_i420_planes_t planes;
+            h264_encoder_get_input(streamer->h264_encoder, &planes);
+            int encoded;
+            if (streamer_run_pipeline(streamer, fb, &planes) == 0) {
+                encoded = h264_encoder_encode_input(streamer->h264_encoder, &h264_data, &h264_size);
+            } else {
+                frame_pipeline_reset_i420(streamer->pipeline);
+                encoded = h264_encoder_encode_frame(streamer->h264_encoder, frame_data, &h264_data, &h264_size);
+            }
+            if (encoded == 0) {
                 frame.size = h264_size;
             } else {
                 fprintf(stderr, "H.264 encoding failed, falling back to full frame\n");
@@ -593,59 +1146,166 @@ static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
     frame_net.pitch = htonl(frame.pitch);
     frame_net.size = htonl(frame.size);
 
-    // Send frame header
-    if (streamer_send_message(streamer, MSG_FRAME, &frame_net, sizeof(frame_net)) < 0) {
-        printf("Failed to send frame to TV receiver\n");
-        streamer->running = false;
-        return;
-    }
+    // Build payload iovecs so header, frame struct and pixel data go out in one send
+    struct iovec stack_iov[2];
+    struct iovec *payload_iov = stack_iov;
+    int payload_cnt = 0;
+    dirty_rectangle_t rect_msgs[64];
 
-    // Send frame data (encrypted if available)
 #ifdef HAVE_X264
     if (encoding_mode == ENCODING_MODE_H264 && h264_data && h264_size > 0) {
-        // Send H.264 encoded data
-        if (streamer_send_raw(streamer, h264_data, h264_size) < 0) {
-            printf("Failed to send H.264 data\n");
-        }
-        free(h264_data);
+        // H.264 encoded data
+        payload_iov[0].iov_base = h264_data;
+        payload_iov[0].iov_len = h264_size;
+        payload_cnt = 1;
     } else
 #endif
     if (encoding_mode == ENCODING_MODE_DIRTY_RECTS && num_dirty_rects > 0 && frame_data) {
-        // Send dirty rectangles
+        // One header per rectangle plus one entry per row (or one per rectangle if rows are contiguous)
+        int max_iov = 0;
+        for (int i = 0; i < num_dirty_rects; i++)
+            max_iov += 1 + dirty_rects[i].height;
+
+        payload_iov = malloc(max_iov * sizeof(struct iovec));
+        if (!payload_iov) {
+            printf("Failed to allocate dirty rectangle send list\n");
+            free(h264_data);
+            return;
+        }
+
         for (int i = 0; i < num_dirty_rects; i++) {
-            dirty_rectangle_t rect_msg = {
+            size_t rect_pitch = dirty_rects[i].width * fb->bpp;
+
+            rect_msgs[i] = (dirty_rectangle_t){
                 .x = htonl(dirty_rects[i].x),
                 .y = htonl(dirty_rects[i].y),
                 .width = htonl(dirty_rects[i].width),
                 .height = htonl(dirty_rects[i].height),
                 .data_size = htonl(dirty_rects[i].width * dirty_rects[i].height * fb->bpp)
             };
+            payload_iov[payload_cnt].iov_base = &rect_msgs[i];
+            payload_iov[payload_cnt].iov_len = sizeof(rect_msgs[i]);
+            payload_cnt++;
 
-            // Send rectangle header
-            if (streamer_send_raw(streamer, &rect_msg, sizeof(rect_msg)) < 0) {
-                printf("Failed to send dirty rectangle header\n");
-                return;
-            }
-
-            // Send rectangle pixel data
+            // Rectangle pixel data
             const uint8_t *src = (const uint8_t *)frame_data +
                                  (dirty_rects[i].y * fb->pitch + dirty_rects[i].x * fb->bpp);
-            size_t rect_pitch = dirty_rects[i].width * fb->bpp;
-
-            for (uint32_t y = 0; y < dirty_rects[i].height; y++) {
-                if (streamer_send_raw(streamer, src + y * fb->pitch, rect_pitch) < 0) {
-                    printf("Failed to send dirty rectangle data\n");
-                    return;
+            if (rect_pitch == fb->pitch) {
+                payload_iov[payload_cnt].iov_base = (void *)src;
+                payload_iov[payload_cnt].iov_len = rect_pitch * dirty_rects[i].height;
+                payload_cnt++;
+            } else {
+                for (uint32_t y = 0; y < dirty_rects[i].height; y++) {
+                    payload_iov[payload_cnt].iov_base = (void *)(src + y * fb->pitch);
+                    payload_iov[payload_cnt].iov_len = rect_pitch;
+                    payload_cnt++;
                 }
             }
         }
     } else if (frame_data) {
-        // Send mapped data (full frame)
-        if (streamer_send_raw(streamer, frame_data, frame_data_size) < 0) {
-            printf("Failed to send frame data\n");
+        // Mapped data (full frame)
+        payload_iov[0].iov_base = (void *)frame_data;
+        payload_iov[0].iov_len = frame_data_size;
+        payload_cnt = 1;
+    }
+
+    // Encoded once; each TCP receiver's queue shares the same bytes
+    send_message_t *msg = NULL;
+
+    // Every H.264 frame extends the catch-up chain (an IDR starts a new one)
+    bool keyframe = false;
+#ifdef HAVE_X264
+    if (encoding_mode == ENCODING_MODE_H264 && h264_data && h264_size > 0) {
+        keyframe = h264_encoder_is_keyframe(streamer->h264_encoder);
+        msg = send_message_create(MSG_FRAME, &frame_net, sizeof(frame_net), payload_iov, payload_cnt);
+        catchup_cache_add(streamer->h264_catchup, msg, keyframe);
+    } else
+#endif
+    {
+        catchup_cache_clear(streamer->h264_catchup);
+    }
+
+    // A full frame (requested or fallen back to) and an IDR are self-contained
+    bool self_contained = encoding_mode == ENCODING_MODE_FULL_FRAME ||
+                          (encoding_mode == ENCODING_MODE_H264 && keyframe);
+
+    // Full-frame snapshot of this picture for receivers catching up in dirty rectangle mode
+    frame_message_t snapshot_net = frame_net;
+    snapshot_net.encoding_mode = ENCODING_MODE_FULL_FRAME;
+    snapshot_net.num_regions = 0;
+    snapshot_net.size = htonl(fb->size);
+    struct iovec snapshot_iov = { .iov_base = (void *)frame_data, .iov_len = frame_data_size };
+    send_message_t *snapshot = NULL;  // Built for the first TCP receiver that needs it
+
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        if (!conn_is_usable(conn) || conn->paused)
+            continue;
+
+        // A receiver that can't keep up skips deltas instead of holding back the others
+        // (over UDP, a frame still waiting for socket buffer space is one too many)
+        bool congested = send_queue_is_congested(conn->send_queue) ||
+                         udp_video_sender_has_pending(conn->udp_video);
+        if (!self_contained && (congested || conn->resync)) {
+            conn->resync = true;
+            if (congested)
+                continue;
+
+            // Bring it up to date without touching the other receivers' streams
+            ssize_t catchup_bytes = 0;
+            const char *how = NULL;
+            if (encoding_mode == ENCODING_MODE_H264) {
+                if (!conn->udp_video) {
+                    catchup_bytes = catchup_cache_send(streamer->h264_catchup, conn->send_queue);
+                    how = "cached H.264 chain";
+                }
+            } else if (conn->udp_video) {
+                catchup_bytes = udp_video_sender_send_frame(conn->udp_video, &snapshot_net, sizeof(snapshot_net),
+                                                            &snapshot_iov, 1) < 0 ? -1 : (ssize_t)frame_data_size;
+                how = "full-frame snapshot";
+            } else {
+                if (!snapshot)
+                    snapshot = send_message_create(MSG_FRAME, &snapshot_net, sizeof(snapshot_net),
+                                                   &snapshot_iov, 1);
+                catchup_bytes = snapshot && send_queue_push_message(conn->send_queue, snapshot, true) == 0 ?
+                                (ssize_t)send_message_get_size(snapshot) : -1;
+                how = "full-frame snapshot";
+            }
+
+            if (catchup_bytes < 0)
+                conn_fail(conn, "catch-up frame");
+            else if (catchup_bytes > 0)
+                conn_caught_up(conn, how, catchup_bytes);
+            continue;
         }
+
+        int send_ret;
+        if (conn->udp_video) {
+            // Never blocks: the rest of the frame goes out on EPOLLOUT, or a later
+            // self-contained frame supersedes it
+            send_ret = udp_video_sender_send_frame(conn->udp_video, &frame_net, sizeof(frame_net),
+                                                   payload_iov, payload_cnt) < 0 ? -1 : 0;
+        } else {
+            if (!msg)
+                msg = send_message_create(MSG_FRAME, &frame_net, sizeof(frame_net), payload_iov, payload_cnt);
+            // Self-contained frames replace whatever video this receiver hasn't started sending
+            bool replace = self_contained &&
+                           (congested || conn->resync || send_queue_has_pending(conn->send_queue));
+            send_ret = msg ? send_queue_push_message(conn->send_queue, msg, replace) : -1;
+        }
+
+        if (send_ret < 0)
+            conn_fail(conn, "frame");
+        else if (conn->resync)
+            conn_caught_up(conn, keyframe ? "keyframe" : "full frame", sizeof(frame_net) + frame.size);
     }
 
+    send_message_unref(snapshot);
+    send_message_unref(msg);
+    if (payload_iov != stack_iov)
+        free(payload_iov);
+    free(h264_data);
+
     // Calculate encoding time and bytes sent
     uint64_t encoding_end_us = audio_get_timestamp_us();
     uint64_t encoding_time_us = encoding_end_us - encoding_start_us;
@@ -668,24 +1328,24 @@ static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
                                      dirty_pixels,
                                      total_pixels,
                                      encoding_time_us,
-                                     streamer->refresh_rate_hz);
+                                     state->refresh_rate_hz);
     }
 
     // Check if we should switch encoding modes (adaptive switching)
-    if (streamer->metrics && streamer->refresh_rate_hz > 0) {
+    if (streamer->metrics && state->refresh_rate_hz > 0) {
         if (encoding_mode == ENCODING_MODE_DIRTY_RECTS) {
             // Check if we should switch to H.264
 #ifdef HAVE_X264
-            if (encoding_metrics_should_switch_to_h264(streamer->metrics, streamer->refresh_rate_hz)) {
+            if (encoding_metrics_should_switch_to_h264(streamer->metrics, state->refresh_rate_hz)) {
                 printf("Switching to H.264 mode (dirty region too large or bandwidth high)\n");
-                streamer->encoding_mode = ENCODING_MODE_H264;
+                streamer_set_encoding_mode(streamer, ENCODING_MODE_H264);
                 encoding_metrics_reset(streamer->metrics);
             }
 #else
             // H.264 not available, fall back to full frame
-            if (encoding_metrics_should_switch_to_h264(streamer->metrics, streamer->refresh_rate_hz)) {
+            if (encoding_metrics_should_switch_to_h264(streamer->metrics, state->refresh_rate_hz)) {
                 printf("Switching to full frame mode (H.264 not available)\n");
-                streamer->encoding_mode = ENCODING_MODE_FULL_FRAME;
+                streamer_set_encoding_mode(streamer, ENCODING_MODE_FULL_FRAME);
                 encoding_metrics_reset(streamer->metrics);
             }
 #endif
@@ -693,18 +1353,18 @@ static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
 #ifdef HAVE_X264
         else if (encoding_mode == ENCODING_MODE_H264) {
             // Check if we should switch back to dirty rectangles
-            if (encoding_metrics_should_switch_to_dirty_rects(streamer->metrics, streamer->refresh_rate_hz)) {
+            if (encoding_metrics_should_switch_to_dirty_rects(streamer->metrics, state->refresh_rate_hz)) {
                 printf("Switching to dirty rectangles mode (conditions improved)\n");
-                streamer->encoding_mode = ENCODING_MODE_DIRTY_RECTS;
+                streamer_set_encoding_mode(streamer, ENCODING_MODE_DIRTY_RECTS);
                 encoding_metrics_reset(streamer->metrics);
             }
         }
 #endif
         else if (encoding_mode == ENCODING_MODE_FULL_FRAME) {
             // Check if we should switch back to dirty rectangles
-            if (encoding_metrics_should_switch_to_dirty_rects(streamer->metrics, streamer->refresh_rate_hz)) {
+            if (encoding_metrics_should_switch_to_dirty_rects(streamer->metrics, state->refresh_rate_hz)) {
                 printf("Switching to dirty rectangles mode (conditions improved)\n");
-                streamer->encoding_mode = ENCODING_MODE_DIRTY_RECTS;
+                streamer_set_encoding_mode(streamer, ENCODING_MODE_DIRTY_RECTS);
                 encoding_metrics_reset(streamer->metrics);
             }
         }
@@ -718,109 +1378,284 @@ static void streamer_send_frame_to_tv(x11_streamer_t *streamer,
                encoding_metrics_get_fps(streamer->metrics),
                encoding_metrics_get_bandwidth_mbps(streamer->metrics),
                encoding_metrics_get_dirty_percent(streamer->metrics) * 100.0,
-               streamer->encoding_mode);
+               streamer_state(streamer)->encoding_mode);
     }
 }
 
 static void streamer_capture_and_send_frames(x11_streamer_t *streamer)
 {
-    if (!streamer || !streamer->x11_ctx || !streamer->x11_ctx->outputs || streamer->tv_fd < 0)
+    if (!streamer || streamer->num_tv_conns == 0)
         return;
 
-    pthread_mutex_lock(&streamer->tv_mutex);
-    RROutput virtual_output_id = (streamer->tv_conn && streamer->tv_conn->virtual_output_id != None)
-                                  ? streamer->tv_conn->virtual_output_id : None;
-    pthread_mutex_unlock(&streamer->tv_mutex);
+    const streamer_state_t *state = streamer_state(streamer);
+    uint32_t output_id = 0;
+    if (!streamer->headless) {
+        if (!streamer->x11_ctx || !streamer->x11_ctx->outputs)
+            return;
 
-    if (virtual_output_id == None)
-        return;  // No virtual output created yet
+        RROutput virtual_output_id = state->output_id;
+        if (virtual_output_id == None)
+            return;  // No virtual output created yet
 
-    // Capture frame from virtual output
-    output_info_t *output = x11_context_find_output(streamer->x11_ctx, virtual_output_id);
+        // Capture frame from virtual output
+        output_info_t *output = x11_context_find_output(streamer->x11_ctx, virtual_output_id);
 
-    if (!output || !output->connected || output->framebuffer_id == 0)
-        return;
+        if (!output || !output->connected || output->framebuffer_id == 0)
+            return;
+
+        // Follow the output to its current framebuffer
+        if (!streamer->frame_source || frame_source_get_fb_id(streamer->frame_source) != output->framebuffer_id) {
+            frame_source_destroy(streamer->frame_source);
+            streamer->frame_source = frame_source_create_drm(output->framebuffer_id);
+            if (!streamer->frame_source)
+                return;
+        }
+        output_id = output->output_id;
+    }
 
-    // Open framebuffer
-    drm_fb_t *fb = drm_fb_open(output->framebuffer_id);
-    if (!fb) {
+    frame_buffer_t frame;
+    if (frame_source_acquire(streamer->frame_source, &frame) < 0) {
         // Framebuffer might have changed, refresh outputs
         return;
     }
 
-    // Map the framebuffer for CPU access (needed for network transmission)
-    // Note: DMA-BUF zero-copy doesn't help here since we're sending over the network anyway
-    // We just need to map the framebuffer memory (whether DMA-BUF or dumb buffer) and send pixel data
-    if (drm_fb_map(fb) < 0) {
-        drm_fb_close(fb);
+    if (streamer->record_path) {
+        uint64_t capture_us = audio_get_timestamp_us();
+        if (!streamer->recorder) {
+            streamer->recorder = session_recorder_create(streamer->record_path, !streamer->record_full_frames,
+                                                         state->refresh_rate_hz);
+            if (!streamer->recorder) {
+                fprintf(stderr, "Recording to %s failed, continuing without it\n", streamer->record_path);
+                free(streamer->record_path);
+                streamer->record_path = NULL;
+            }
+        }
+        if (streamer->recorder && session_recorder_write(streamer->recorder, &frame, capture_us) < 0) {
+            fprintf(stderr, "Recording to %s failed after %u frames, stopping it\n", streamer->record_path,
+                    session_recorder_get_frames(streamer->recorder));
+            session_recorder_destroy(streamer->recorder);
+            streamer->recorder = NULL;
+            free(streamer->record_path);
+            streamer->record_path = NULL;
+        }
+    }
+
+    // Send frame to TV receivers
+    streamer_send_frame_to_tv(streamer, state, output_id, &frame);
+
+    // Release the frame (unmaps the framebuffer; the data has been queued or copied)
+    frame_source_release(streamer->frame_source, &frame);
+}
+
+// PCM rate and channels a receiver is sent: its native format if it announced one
+static void conn_pcm_format(const tv_connection_t *conn, uint32_t capture_rate, uint32_t *rate, uint16_t *channels)
+{
+    *rate = conn->audio_rate ? conn->audio_rate : capture_rate;
+    *channels = conn->audio_rate ? conn->audio_channels : AUDIO_CAPTURE_CHANNELS;
+}
+
+// Send one AUDIO message to the receivers that take Opus (opus_receivers) or PCM at
+// rate/channels (!opus_receivers; capture_rate resolves receivers with no native format)
+// The message is built once; each receiver's queue only adds its own encryption and send
+static void streamer_broadcast_audio(x11_streamer_t *streamer, bool opus_receivers, uint32_t capture_rate,
+                                     uint32_t rate, uint16_t channels, uint16_t format,
+                                     uint64_t timestamp_us, const void *data, uint32_t size)
+{
+    // Create audio message (convert to network byte order)
+    audio_message_t audio_msg = {
+        .timestamp_us = timestamp_us,  // uint64 - need manual conversion
+        .sample_rate = rate,
+        .channels = channels,
+        .format = format,
+        .data_size = size
+    };
+    // Convert to network byte order
+    uint32_t audio_ts_low = (uint32_t)(audio_msg.timestamp_us & 0xFFFFFFFF);
+    uint32_t audio_ts_high = (uint32_t)((audio_msg.timestamp_us >> 32) & 0xFFFFFFFF);
+    audio_msg.timestamp_us = ((uint64_t)htonl(audio_ts_high) << 32) | htonl(audio_ts_low);
+    audio_msg.sample_rate = htonl(audio_msg.sample_rate);
+    audio_msg.channels = htons(audio_msg.channels);
+    audio_msg.format = htons(audio_msg.format);
+    audio_msg.data_size = htonl(audio_msg.data_size);
+
+    struct iovec audio_iov = { .iov_base = (void *)data, .iov_len = size };
+    send_message_t *msg = send_message_create(MSG_AUDIO, &audio_msg, sizeof(audio_msg), &audio_iov, 1);
+    if (!msg)
         return;
+
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        if (!conn_is_usable(conn) || conn->audio_opus != opus_receivers)
+            continue;
+        if (!opus_receivers) {
+            uint32_t conn_rate;
+            uint16_t conn_channels;
+            conn_pcm_format(conn, capture_rate, &conn_rate, &conn_channels);
+            if (conn_rate != rate || conn_channels != channels)
+                continue;
+        }
+        if (send_queue_push_message(conn->send_queue, msg, false) < 0)
+            conn_fail(conn, "audio");
     }
+    send_message_unref(msg);
+}
 
-    // Send frame to TV receiver
-    streamer_send_frame_to_tv(streamer, output, fb);
+// Resampler state for PCM at rate/channels, created on first use
+// Returns NULL if the format cannot be produced (too many formats, or an unsupported ratio)
+static audio_pcm_format_t *streamer_audio_format(x11_streamer_t *streamer, uint32_t capture_rate,
+                                                 uint32_t rate, uint16_t channels)
+{
+    for (int i = 0; i < streamer->num_audio_formats; i++) {
+        audio_pcm_format_t *f = &streamer->audio_formats[i];
+        if (f->rate == rate && f->channels == channels)
+            return f;
+    }
+    if (streamer->num_audio_formats == MAX_AUDIO_PCM_FORMATS)
+        return NULL;
 
-    // Close framebuffer (TV receiver should have received the data/FD)
-    drm_fb_close(fb);
+    audio_pcm_format_t *f = &streamer->audio_formats[streamer->num_audio_formats];
+    f->resampler = audio_resampler_create(capture_rate, AUDIO_CAPTURE_CHANNELS, rate, channels);
+    if (!f->resampler)
+        return NULL;
+    f->pcm_frames = audio_resampler_max_output(f->resampler, capture_rate / 100);
+    f->pcm = malloc((size_t)f->pcm_frames * channels * sizeof(int16_t));
+    if (!f->pcm) {
+        audio_resampler_destroy(f->resampler);
+        return NULL;
+    }
+    f->rate = rate;
+    f->channels = channels;
+    streamer->num_audio_formats++;
+    printf("Audio: resampling %u Hz to %u Hz, %u channels (%s)\n", capture_rate, rate, channels,
+           audio_resampler_simd_name());
+    return f;
+}
+
+// Send one captured chunk as PCM to every receiver, once per distinct native format
+static void streamer_send_pcm(x11_streamer_t *streamer, uint32_t capture_rate, uint64_t timestamp_us,
+                              const int16_t *pcm, uint32_t size)
+{
+    uint32_t sent_rate[MAX_AUDIO_PCM_FORMATS + 1];
+    uint16_t sent_channels[MAX_AUDIO_PCM_FORMATS + 1];
+    int num_sent = 0;
+
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        if (!conn_is_usable(conn) || conn->audio_opus)
+            continue;
+        uint32_t rate;
+        uint16_t channels;
+        conn_pcm_format(conn, capture_rate, &rate, &channels);
+        bool sent = false;
+        for (int k = 0; k < num_sent; k++)
+            sent = sent || (sent_rate[k] == rate && sent_channels[k] == channels);
+        if (sent || num_sent == MAX_AUDIO_PCM_FORMATS + 1)
+            continue;
+
+        if (rate == capture_rate && channels == AUDIO_CAPTURE_CHANNELS) {
+            streamer_broadcast_audio(streamer, false, capture_rate, rate, channels, AUDIO_FORMAT_PCM_S16LE,
+                                     timestamp_us, pcm, size);
+        } else {
+            audio_pcm_format_t *f = streamer_audio_format(streamer, capture_rate, rate, channels);
+            if (!f) {
+                // Fall back to the capture format from the next chunk
+                fprintf(stderr, "TV receiver %s: cannot resample audio to %u Hz, %u channels\n", conn->peer,
+                        rate, channels);
+                conn->audio_rate = 0;
+                continue;
+            }
+            uint64_t out_timestamp_us = timestamp_us;
+            int frames = audio_resampler_process(f->resampler, pcm, size / (AUDIO_CAPTURE_CHANNELS * sizeof(int16_t)),
+                                                 timestamp_us, f->pcm, f->pcm_frames, &out_timestamp_us);
+            if (frames > 0)
+                streamer_broadcast_audio(streamer, false, capture_rate, rate, channels, AUDIO_FORMAT_PCM_S16LE,
+                                         out_timestamp_us, f->pcm, (uint32_t)frames * channels * sizeof(int16_t));
+        }
+        sent_rate[num_sent] = rate;
+        sent_channels[num_sent] = channels;
+        num_sent++;
+    }
 }
 
 static void streamer_capture_and_send_audio(x11_streamer_t *streamer)
 {
-    if (!streamer || !streamer->audio_capture || streamer->tv_fd < 0)
+    if (!streamer || !streamer->audio_capture || streamer->num_tv_conns == 0)
         return;
 
+    if (!streamer->audio_latency_reported) {
+        uint64_t latency_us;
+        if (audio_capture_get_latency_us(streamer->audio_capture, &latency_us) == 0) {
+            printf("Audio capture latency: %.1f ms\n", latency_us / 1000.0);
+            streamer->audio_latency_reported = true;
+        }
+    }
+
+    // Send every 10 ms chunk that is ready (the capture never blocks)
     void *audio_data = NULL;
     uint32_t audio_size = 0;
-
-    int ret = audio_capture_read(streamer->audio_capture, &audio_data, &audio_size);
-    if (ret > 0 && audio_data && audio_size > 0) {
-        // Create audio message (convert to network byte order)
-        uint64_t audio_timestamp_us = audio_get_timestamp_us();
-        audio_message_t audio_msg = {
-            .timestamp_us = audio_timestamp_us,  // uint64 - need manual conversion
-            .sample_rate = 48000,
-            .channels = 2,
-            .format = AUDIO_FORMAT_PCM_S16LE,
-            .data_size = audio_size
-        };
-        // Convert to network byte order
-        uint32_t audio_ts_low = (uint32_t)(audio_msg.timestamp_us & 0xFFFFFFFF);
-        uint32_t audio_ts_high = (uint32_t)((audio_msg.timestamp_us >> 32) & 0xFFFFFFFF);
-        audio_msg.timestamp_us = ((uint64_t)htonl(audio_ts_high) << 32) | htonl(audio_ts_low);
-        audio_msg.sample_rate = htonl(audio_msg.sample_rate);
-        audio_msg.channels = htons(audio_msg.channels);
-        audio_msg.format = htons(audio_msg.format);
-        audio_msg.data_size = htonl(audio_msg.data_size);
-
-        // Send audio header
-        if (streamer_send_message(streamer, MSG_AUDIO, &audio_msg, sizeof(audio_msg)) < 0) {
-            printf("Failed to send audio header\n");
-            free(audio_data);
-            return;
+    uint64_t audio_timestamp_us = 0;  // Capture time of the chunk's first sample (same clock as frames)
+    while (audio_capture_read(streamer->audio_capture, &audio_data, &audio_size, &audio_timestamp_us) > 0 &&
+           audio_data) {
+        // Recorded at the source's own rate (known once capture has started)
+        uint32_t capture_rate = audio_capture_get_sample_rate(streamer->audio_capture);
+
+        // PCM goes to receivers that did not ask for Opus; Opus is encoded once for the rest
+        bool want_opus = false;
+        for (int i = 0; i < streamer->num_tv_conns; i++) {
+            tv_connection_t *conn = streamer->tv_conns[i];
+            if (conn_is_usable(conn) && conn->audio_opus)
+                want_opus = true;
         }
 
-        // Send audio data (encrypted if available)
-        if (streamer_send_raw(streamer, audio_data, audio_size) < 0) {
-            printf("Failed to send audio data\n");
+        streamer_send_pcm(streamer, capture_rate, audio_timestamp_us, audio_data, audio_size);
+#ifdef HAVE_OPUS
+        if (want_opus) {
+            // Opus runs at 48 kHz whatever the source records at
+            const int16_t *opus_pcm = audio_data;
+            uint32_t samples = audio_size / (AUDIO_CAPTURE_CHANNELS * sizeof(int16_t));
+            uint64_t opus_timestamp_us = audio_timestamp_us;
+            if (capture_rate != OPUS_SAMPLE_RATE) {
+                if (!streamer->opus_resampler) {
+                    streamer->opus_resampler = audio_resampler_create(capture_rate, AUDIO_CAPTURE_CHANNELS,
+                                                                      OPUS_SAMPLE_RATE, AUDIO_CAPTURE_CHANNELS);
+                    streamer->opus_pcm = malloc(audio_resampler_max_output(streamer->opus_resampler, samples) *
+                                                AUDIO_CAPTURE_CHANNELS * sizeof(int16_t));
+                }
+                int frames = streamer->opus_resampler && streamer->opus_pcm
+                             ? audio_resampler_process(streamer->opus_resampler, audio_data, samples,
+                                                       audio_timestamp_us, streamer->opus_pcm,
+                                                       audio_resampler_max_output(streamer->opus_resampler, samples),
+                                                       &opus_timestamp_us)
+                             : -1;
+                opus_pcm = streamer->opus_pcm;
+                samples = frames > 0 ? (uint32_t)frames : 0;
+            }
+            uint8_t packet[AUDIO_ENCODER_MAX_PACKET];
+            int packet_size = samples ? audio_encoder_encode(streamer->audio_encoder, opus_pcm, samples,
+                                                             packet, sizeof(packet))
+                                      : -1;
+            if (packet_size > 0)
+                streamer_broadcast_audio(streamer, true, capture_rate, OPUS_SAMPLE_RATE, AUDIO_CAPTURE_CHANNELS,
+                                         AUDIO_FORMAT_OPUS, opus_timestamp_us, packet, (uint32_t)packet_size);
+            else if (packet_size < 0)  // Keep the sound going uncompressed
+                streamer_broadcast_audio(streamer, true, capture_rate, capture_rate, AUDIO_CAPTURE_CHANNELS,
+                                         AUDIO_FORMAT_PCM_S16LE, audio_timestamp_us, audio_data, audio_size);
         }
+#else
+        (void)want_opus;
+#endif
 
         free(audio_data);
-    } else if (ret < 0) {
-        // Error reading audio
-        if (audio_data)
-            free(audio_data);
+        audio_data = NULL;
     }
 }
 
 static void streamer_check_and_notify_output_changes(x11_streamer_t *streamer)
 {
-    if (!streamer || !streamer->x11_ctx || !streamer->x11_ctx->outputs || streamer->tv_fd < 0)
+    if (!streamer || !streamer->x11_ctx || !streamer->x11_ctx->outputs || streamer->num_tv_conns == 0)
         return;
 
-    pthread_mutex_lock(&streamer->tv_mutex);
-    RROutput virtual_output_id = (streamer->tv_conn && streamer->tv_conn->virtual_output_id != None)
-                                  ? streamer->tv_conn->virtual_output_id : None;
-    pthread_mutex_unlock(&streamer->tv_mutex);
-
+    RROutput virtual_output_id = streamer_state(streamer)->output_id;
     if (virtual_output_id == None)
         return;
 
@@ -841,7 +1676,7 @@ static void streamer_check_and_notify_output_changes(x11_streamer_t *streamer)
             .refresh_rate = htonl(output->refresh_rate)
         };
 
-        streamer_send_message(streamer, MSG_CONFIG, &config, sizeof(config));
+        streamer_broadcast_message(streamer, MSG_CONFIG, &config, sizeof(config));
         printf("Sent CONFIG to TV receiver: %dx%d@%dHz\n",
                config.width, config.height, config.refresh_rate);
     }
@@ -857,7 +1692,7 @@ static void streamer_check_and_notify_output_changes(x11_streamer_t *streamer)
             .refresh_rate = htonl(output->connected ? output->refresh_rate : 0)
         };
 
-        streamer_send_message(streamer, MSG_CONFIG, &config, sizeof(config));
+        streamer_broadcast_message(streamer, MSG_CONFIG, &config, sizeof(config));
         printf("Sent CONFIG to TV receiver: %s (output %s)\n",
                output->connected ? "connected" : "disconnected",
                output->name);
@@ -869,6 +1704,8 @@ x11_streamer_t *x11_streamer_create(const x11_streamer_options_t *options)
     x11_streamer_t *streamer = calloc(1, sizeof(x11_streamer_t));
     if (!streamer)
         return NULL;
+    streamer->wake_fd = -1;
+    streamer->loop_epfd = -1;
 
     // Set defaults if options not provided
     x11_streamer_options_t opts;
@@ -876,26 +1713,44 @@ x11_streamer_t *x11_streamer_create(const x11_streamer_options_t *options)
         opts = *options;
     } else {
         opts.use_broadcast = true;
-        opts.host = NULL;
+        opts.num_hosts = 0;
         opts.port = DEFAULT_TV_PORT;
         opts.broadcast_timeout_ms = 5000;
         opts.pin = 0xFFFF;  // No PIN provided
-    }
-
-    // If host is specified, disable broadcast
-    if (opts.host) {
-        streamer->tv_host = strdup(opts.host);
-        streamer->use_broadcast = false;
-    } else {
-        streamer->tv_host = NULL;
-        streamer->use_broadcast = opts.use_broadcast;
-    }
+        opts.max_backlog_ms = SEND_QUEUE_DEFAULT_MAX_BACKLOG_MS;
+        opts.udp_video = false;
+        opts.fec_group = FEC_GROUP_AUTO;
+        opts.resume_grace_ms = STREAMER_DEFAULT_RESUME_GRACE_MS;
+        opts.start_us = 0;
+        opts.frame_source = NULL;
+        opts.record_path = NULL;
+        opts.record_full_frames = false;
+        opts.latency_stamp = false;
+        opts.pcm_audio = false;
+        opts.audio_fragment_ms = 0;
+        opts.audio_source = NULL;
+    }
+
+    // If hosts are specified, disable broadcast
+    for (int i = 0; i < opts.num_hosts && i < STREAMER_MAX_RECEIVERS; i++) {
+        streamer->tv_hosts[i] = strdup(opts.hosts[i]);
+        streamer->tv_ports[i] = opts.ports[i];
+        streamer->num_tv_hosts++;
+    }
+    streamer->use_broadcast = streamer->num_tv_hosts == 0 && opts.use_broadcast;
     streamer->tv_port = opts.port;
     streamer->broadcast_timeout_ms = opts.broadcast_timeout_ms;
     streamer->force_encrypt = opts.force_encrypt;
     streamer->force_no_encrypt = opts.force_no_encrypt;
     streamer->pin = opts.pin;
     streamer->display_mode = opts.display_mode;
+    streamer->max_backlog_ms = opts.max_backlog_ms;
+    streamer->udp_video_requested = opts.udp_video;
+    streamer->fec_group = opts.fec_group;
+    streamer->resume_grace_ms = opts.resume_grace_ms;
+    streamer->start_us = opts.start_us ? opts.start_us : audio_get_timestamp_us();
+    streamer->record_path = opts.record_path ? strdup(opts.record_path) : NULL;
+    streamer->record_full_frames = opts.record_full_frames;
     // Store program name (extract basename if provided)
     if (opts.program_name) {
         const char *basename = strrchr(opts.program_name, '/');
@@ -903,42 +1758,83 @@ x11_streamer_t *x11_streamer_create(const x11_streamer_options_t *options)
     } else {
         streamer->program_name = strdup("x11-streamer");  // Default fallback
     }
-    streamer->enable_encryption = true;  // Default: enabled, will be determined during handshake
-    streamer->tv_fd = -1;
-    streamer->x11_ctx = x11_context_create();
-    if (!streamer->x11_ctx) {
-        free(streamer->tv_host);
-        free(streamer);
-        return NULL;
+    if (opts.frame_source) {
+        // Headless: frames come from the given source, no X server needed
+        streamer->frame_source = frame_source_create_from_spec(opts.frame_source);
+        streamer->headless = streamer->frame_source != NULL;
+        if (streamer->headless && opts.latency_stamp &&
+            frame_source_enable_latency_stamp(streamer->frame_source) < 0) {
+            frame_source_destroy(streamer->frame_source);
+            streamer->frame_source = NULL;
+            streamer->headless = false;
+        }
+        if (streamer->headless) {
+            streamer->initial_state.refresh_rate_hz = frame_source_get_refresh_rate(streamer->frame_source);
+            printf("Streaming %s (%ux%u@%dHz) instead of an X11 output\n",
+                   frame_source_get_name(streamer->frame_source),
+                   frame_source_get_width(streamer->frame_source),
+                   frame_source_get_height(streamer->frame_source), streamer->initial_state.refresh_rate_hz);
+        }
+    } else {
+        // Output setup runs in receiver threads on its own connection, so its round trips
+        // never hold up the main loop's event processing and keep-alive
+        streamer->x11_ctx = x11_context_create(true);
+        streamer->output_manager = streamer->x11_ctx ? x11_context_create(false) : NULL;
+        if (!streamer->output_manager) {
+            x11_context_destroy(streamer->x11_ctx);
+            streamer->x11_ctx = NULL;
+        }
     }
-
-    pthread_mutex_init(&streamer->tv_mutex, NULL);
-
-    // Allocate TV connection structure
-    streamer->tv_conn = calloc(1, sizeof(tv_connection_t));
-    if (!streamer->tv_conn) {
-        x11_context_destroy(streamer->x11_ctx);
-        pthread_mutex_destroy(&streamer->tv_mutex);
-        if (streamer->tv_host)
-            free(streamer->tv_host);
+    if (!streamer->x11_ctx && !streamer->headless) {
+        for (int i = 0; i < streamer->num_tv_hosts; i++)
+            free(streamer->tv_hosts[i]);
+        free(streamer->program_name);
+        free(streamer->record_path);
         free(streamer);
         return NULL;
     }
-    streamer->tv_conn->streamer = streamer;
 
-    // Create audio capture (48kHz, stereo, 16-bit PCM for low latency)
-    streamer->audio_capture = audio_capture_create(48000, 2, AUDIO_FORMAT_PCM_S16LE);
+    pthread_mutex_init(&streamer->tv_mutex, NULL);
+    streamer->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (streamer->wake_fd < 0)
+        perror("eventfd");
+    pthread_mutex_init(&streamer->output_mutex, NULL);
+
+    // Create audio capture (the source's own rate, stereo, 16-bit PCM for low latency)
+    // Receivers get PCM resampled here to their native output rate, once per distinct format
+    streamer->audio_capture = audio_capture_create(0, AUDIO_CAPTURE_CHANNELS, AUDIO_FORMAT_PCM_S16LE);
     if (!streamer->audio_capture) {
         fprintf(stderr, "Warning: Failed to create audio capture\n");
+    } else {
+        if (opts.audio_fragment_ms &&
+            audio_capture_set_fragment_ms(streamer->audio_capture, (uint32_t)opts.audio_fragment_ms) < 0)
+            fprintf(stderr, "Warning: Audio fragment must be %d-%d ms, using %d ms\n", AUDIO_CAPTURE_MIN_FRAGMENT_MS,
+                    AUDIO_CAPTURE_MAX_FRAGMENT_MS, AUDIO_CAPTURE_DEFAULT_FRAGMENT_MS);
+        if (opts.audio_source && audio_capture_set_source(streamer->audio_capture, opts.audio_source) < 0)
+            fprintf(stderr, "Warning: Failed to set audio source %s\n", opts.audio_source);
+    }
+#ifdef HAVE_OPUS
+    // Receivers that announce Opus in CAPABILITIES get it instead of PCM
+    if (streamer->audio_capture && !opts.pcm_audio) {
+        streamer->audio_encoder = audio_encoder_create(OPUS_SAMPLE_RATE, AUDIO_CAPTURE_CHANNELS,
+                                                       AUDIO_ENCODER_DEFAULT_BITRATE);
+        if (!streamer->audio_encoder)
+            fprintf(stderr, "Warning: Failed to create Opus encoder, audio will be sent as PCM\n");
     }
+#endif
 
     // Initialize encoding mode (default to dirty rectangles)
-    streamer->encoding_mode = ENCODING_MODE_DIRTY_RECTS;
-    streamer->dirty_rect_ctx = NULL;  // Will be created when we know frame size
+    streamer->initial_state.encoding_mode = ENCODING_MODE_DIRTY_RECTS;
+    atomic_init(&streamer->state, &streamer->initial_state);
+    streamer->pipeline = NULL;  // Will be created when we know frame size
 
 #ifdef HAVE_X264
     streamer->h264_encoder = NULL;  // Will be created when needed
 #endif
+    streamer->h264_catchup = catchup_cache_create(0, 0);
+    if (!streamer->h264_catchup) {
+        fprintf(stderr, "Warning: Failed to create catch-up cache, joining receivers will force keyframes\n");
+    }
 
     // Create metrics tracker (60 frame window = 1 second at 60 FPS)
     streamer->metrics = encoding_metrics_create(60);
@@ -956,48 +1852,62 @@ void x11_streamer_destroy(x11_streamer_t *streamer)
 
     x11_streamer_stop(streamer);
 
-    // Wait for TV receiver thread to finish
-    if (streamer->tv_thread) {
-        pthread_join(streamer->tv_thread, NULL);
-        streamer->tv_thread = 0;
+    // Wake up and wait for the TV receiver threads, then drop the connections
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        shutdown(conn->fd, SHUT_RDWR);
+        pthread_join(conn->thread, NULL);
+        tv_connection_free(conn);
     }
+    streamer->num_tv_conns = 0;
 
     // Clean up virtual output
-    if (streamer->tv_conn && streamer->tv_conn->virtual_output_id != None) {
-        x11_context_delete_virtual_output(streamer->x11_ctx, streamer->tv_conn->virtual_output_id);
+    RROutput virtual_output_id = streamer_state(streamer)->output_id;
+    if (streamer->display_mode == STREAMER_DISPLAY_MODE_EXTEND && virtual_output_id != None) {
+        x11_context_delete_virtual_output(streamer->output_manager, virtual_output_id);
     }
 
-    if (streamer->noise_ctx) {
-        noise_encryption_cleanup(streamer->noise_ctx);
-        streamer->noise_ctx = NULL;
-    }
-
-    if (streamer->tv_fd >= 0)
-        close(streamer->tv_fd);
-
-    if (streamer->tv_conn)
-        free(streamer->tv_conn);
-
     if (streamer->audio_capture)
         audio_capture_destroy(streamer->audio_capture);
+    for (int i = 0; i < streamer->num_audio_formats; i++) {
+        audio_resampler_destroy(streamer->audio_formats[i].resampler);
+        free(streamer->audio_formats[i].pcm);
+    }
+    audio_resampler_destroy(streamer->opus_resampler);
+    free(streamer->opus_pcm);
+#ifdef HAVE_OPUS
+    audio_encoder_destroy(streamer->audio_encoder);
+#endif
 
-    if (streamer->dirty_rect_ctx)
-        dirty_rect_destroy(streamer->dirty_rect_ctx);
+    frame_pipeline_destroy(streamer->pipeline);
 
 #ifdef HAVE_X264
     if (streamer->h264_encoder)
         h264_encoder_destroy(streamer->h264_encoder);
 #endif
+    catchup_cache_destroy(streamer->h264_catchup);
 
     if (streamer->metrics)
         encoding_metrics_destroy(streamer->metrics);
 
+    frame_source_destroy(streamer->frame_source);
+    session_recorder_destroy(streamer->recorder);
+    free(streamer->record_path);
+
     if (streamer->x11_ctx)
         x11_context_destroy(streamer->x11_ctx);
+    if (streamer->output_manager)
+        x11_context_destroy(streamer->output_manager);
 
+    streamer_reclaim_states(streamer);
+    if (streamer_state(streamer) != &streamer->initial_state)
+        free((void *)streamer_state(streamer));
     pthread_mutex_destroy(&streamer->tv_mutex);
-    if (streamer->tv_host)
-        free(streamer->tv_host);
+    pthread_mutex_destroy(&streamer->output_mutex);
+    if (streamer->wake_fd >= 0)
+        close(streamer->wake_fd);
+    for (int i = 0; i < streamer->num_tv_hosts; i++)
+        free(streamer->tv_hosts[i]);
     if (streamer->program_name)
         free(streamer->program_name);
     free(streamer);
@@ -1014,12 +1924,165 @@ typedef struct {
 static bool enable_usb_tethering_via_adb(void);
 static bool get_usb_tethering_ip_via_adb(char *ip_buf, size_t ip_buf_size);
 
-// Broadcast discovery: find TV receiver on all network interfaces using UDP
-static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_addr, int *found_port)
+// USB tethering address of the adb-attached device, or NULL (looked up once per run;
+// startup discovery fills it in when its ADB probe got that far)
+static const char *streamer_usb_tethering_ip(x11_streamer_t *streamer)
+{
+    if (!streamer->usb_ip_checked) {
+        if (!get_usb_tethering_ip_via_adb(streamer->usb_ip, sizeof(streamer->usb_ip)))
+            streamer->usb_ip[0] = '\0';
+        streamer->usb_ip_checked = true;
+    }
+    return streamer->usb_ip[0] ? streamer->usb_ip : NULL;
+}
+
+// Startup discovery runs three probes at once and takes the first receiver found:
+//   - a direct connect to the receiver used last time (receiver_cache)
+//   - UDP broadcast discovery
+//   - ADB: enable USB tethering and connect to the device's tethering address
+// Probe threads are detached so a slow loser (adb, a broadcast nobody answers) never
+// delays startup; the race is freed by whoever drops the last reference.
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int refs;     // Coordinator + probe threads
+    int pending;  // Probes still running
+    bool done;    // A probe found a receiver
+    // Inputs
+    char cached_host[INET_ADDRSTRLEN];
+    int cached_port;
+    int tv_port;
+    int broadcast_timeout_ms;
+    // Winner
+    const char *method;
+    struct sockaddr_in addr;
+    int fd;  // Connected socket to the winner (-1 if its probe only found the address)
+    discovery_response_info_t *responses;  // Broadcast answers (if broadcast won)
+    int response_count;
+    // ADB probe side result
+    bool usb_checked;
+    char usb_ip[INET_ADDRSTRLEN];
+} discovery_race_t;
+
+#define DISCOVERY_SETTLE_MS 200  // After the first broadcast answer, wait this long for other TVs
+#define DISCOVERY_POLL_MS 100    // How often a waiting probe checks whether the race is over
+
+static void discovery_race_unref(discovery_race_t *race)
+{
+    pthread_mutex_lock(&race->mutex);
+    bool last = --race->refs == 0;
+    pthread_mutex_unlock(&race->mutex);
+    if (!last)
+        return;
+
+    if (race->fd >= 0)
+        close(race->fd);
+    free(race->responses);
+    pthread_cond_destroy(&race->cond);
+    pthread_mutex_destroy(&race->mutex);
+    free(race);
+}
+
+static bool discovery_race_is_done(discovery_race_t *race)
+{
+    pthread_mutex_lock(&race->mutex);
+    bool done = race->done;
+    pthread_mutex_unlock(&race->mutex);
+    return done;
+}
+
+// Report a probe's find; the first one wins and the race takes fd/responses,
+// later ones are discarded. Returns true if this probe won
+static bool discovery_race_offer(discovery_race_t *race, const char *method, const struct sockaddr_in *addr,
+                                 int fd, discovery_response_info_t *responses, int response_count)
+{
+    pthread_mutex_lock(&race->mutex);
+    bool won = !race->done;
+    if (won) {
+        race->done = true;
+        race->method = method;
+        race->addr = *addr;
+        race->fd = fd;
+        race->responses = responses;
+        race->response_count = response_count;
+        pthread_cond_broadcast(&race->cond);
+    }
+    pthread_mutex_unlock(&race->mutex);
+
+    if (!won) {
+        if (fd >= 0)
+            close(fd);
+        free(responses);
+    }
+    return won;
+}
+
+static void discovery_race_probe_exit(discovery_race_t *race)
+{
+    pthread_mutex_lock(&race->mutex);
+    race->pending--;
+    pthread_cond_broadcast(&race->cond);
+    pthread_mutex_unlock(&race->mutex);
+    discovery_race_unref(race);
+}
+
+// Probe: the receiver that worked last time
+static void *discovery_cached_probe(void *arg)
+{
+    discovery_race_t *race = (discovery_race_t *)arg;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(race->cached_port);
+
+    if (inet_aton(race->cached_host, &addr.sin_addr) != 0) {
+        int fd = connect_with_timeout(&addr, race->broadcast_timeout_ms);
+        if (fd >= 0)
+            discovery_race_offer(race, "last receiver", &addr, fd, NULL, 0);
+    }
+
+    discovery_race_probe_exit(race);
+    return NULL;
+}
+
+// Probe: USB tethering via adb (each step is skipped once another probe has won)
+static void *discovery_adb_probe(void *arg)
+{
+    discovery_race_t *race = (discovery_race_t *)arg;
+
+    printf("Attempting to enable USB tethering on connected device...\n");
+    enable_usb_tethering_via_adb();
+
+    char usb_ip[INET_ADDRSTRLEN] = {0};
+    if (!discovery_race_is_done(race)) {
+        bool found = get_usb_tethering_ip_via_adb(usb_ip, sizeof(usb_ip));
+        pthread_mutex_lock(&race->mutex);
+        race->usb_checked = true;
+        if (found)
+            snprintf(race->usb_ip, sizeof(race->usb_ip), "%s", usb_ip);
+        pthread_mutex_unlock(&race->mutex);
+        if (!found)
+            usb_ip[0] = '\0';
+    }
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(race->tv_port);
+    if (usb_ip[0] && !discovery_race_is_done(race) && inet_aton(usb_ip, &addr.sin_addr) != 0) {
+        int fd = connect_with_timeout(&addr, RESUME_CONNECT_TIMEOUT_MS);
+        if (fd >= 0)
+            discovery_race_offer(race, "USB tethering (adb)", &addr, fd, NULL, 0);
+    }
+
+    discovery_race_probe_exit(race);
+    return NULL;
+}
+
+// Broadcast discovery requests on every interface and collect the answers: until the
+// timeout, DISCOVERY_SETTLE_MS after the first one, or until another probe wins
+// Returns the number of answers (*responses must be freed), or -1 on error
+static int broadcast_discover(discovery_race_t *race, discovery_response_info_t **responses_out)
 {
-    // Enable USB tethering before attempting broadcast discovery
-    printf("Attempting to enable USB tethering on connected device...\n");
-    enable_usb_tethering_via_adb();
+    *responses_out = NULL;
 
     int udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (udp_fd < 0) {
@@ -1046,16 +2109,6 @@ static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_
         return -1;
     }
 
-    // Set timeout for receiving responses
-    struct timeval timeout;
-    timeout.tv_sec = streamer->broadcast_timeout_ms / 1000;
-    timeout.tv_usec = (streamer->broadcast_timeout_ms % 1000) * 1000;
-    if (setsockopt(udp_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        perror("setsockopt(SO_RCVTIMEO)");
-        close(udp_fd);
-        return -1;
-    }
-
     // Build discovery request message
     message_header_t request_header = {
         .type = MSG_DISCOVERY_REQUEST,
@@ -1110,8 +2163,22 @@ static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_
     discovery_response_info_t *responses = NULL;
     int response_count = 0;
     int response_capacity = 0;
+    uint64_t deadline_us = audio_get_timestamp_us() + (uint64_t)race->broadcast_timeout_ms * 1000;
+
+    while (!discovery_race_is_done(race)) {
+        uint64_t now_us = audio_get_timestamp_us();
+        if (now_us >= deadline_us)
+            break;
+        int wait_ms = (int)((deadline_us - now_us + 999) / 1000);
+        struct pollfd pfd = {.fd = udp_fd, .events = POLLIN};
+        int ret = poll(&pfd, 1, wait_ms < DISCOVERY_POLL_MS ? wait_ms : DISCOVERY_POLL_MS);
+        if (ret < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ret <= 0)
+            continue;
 
-    while (1) {
         uint8_t buffer[1024];
         struct sockaddr_in from_addr;
         socklen_t from_len = sizeof(from_addr);
@@ -1119,9 +2186,8 @@ static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_
         ssize_t n = recvfrom(udp_fd, buffer, sizeof(buffer), 0,
                             (struct sockaddr *)&from_addr, &from_len);
         if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-                break;  // Timeout or interrupted
-            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                continue;
             perror("recvfrom");
             break;
         }
@@ -1151,20 +2217,166 @@ static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_
             responses = realloc(responses, response_capacity * sizeof(discovery_response_info_t));
         }
 
+        memset(&responses[response_count], 0, sizeof(responses[response_count]));
         inet_ntop(AF_INET, &from_addr.sin_addr, responses[response_count].ip, INET_ADDRSTRLEN);
         responses[response_count].tcp_port = tcp_port;
         strncpy(responses[response_count].display_name, display_name, sizeof(responses[response_count].display_name) - 1);
         response_count++;
+
+        // Other TVs answer within a few milliseconds; no need to sit out the full timeout
+        if (response_count == 1) {
+            uint64_t settle_us = audio_get_timestamp_us() + DISCOVERY_SETTLE_MS * 1000;
+            if (settle_us < deadline_us)
+                deadline_us = settle_us;
+        }
     }
 
     close(udp_fd);
+    *responses_out = responses;
+    return response_count;
+}
+
+// Probe: UDP broadcast discovery
+static void *discovery_broadcast_probe(void *arg)
+{
+    discovery_race_t *race = (discovery_race_t *)arg;
+    discovery_response_info_t *responses = NULL;
+
+    int count = broadcast_discover(race, &responses);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    if (count > 0 && inet_aton(responses[0].ip, &addr.sin_addr) != 0) {
+        addr.sin_port = htons(responses[0].tcp_port);
+        discovery_race_offer(race, "broadcast", &addr, -1, responses, count);
+    } else {
+        free(responses);
+    }
+
+    discovery_race_probe_exit(race);
+    return NULL;
+}
+
+// Let the user pick one of several receivers that answered the broadcast
+// Returns the index, or -1
+static int select_discovered_receiver(const discovery_response_info_t *responses, int response_count)
+{
+    // Display found receivers
+    printf("\nFound %d TV receiver(s):\n", response_count);
+    for (int i = 0; i < response_count; i++) {
+        printf("  %d. %s:%d - %s\n",
+               i + 1, responses[i].ip, responses[i].tcp_port,
+               responses[i].display_name[0] ? responses[i].display_name : "Unknown");
+    }
+
+    if (response_count == 1) {
+        printf("\nAuto-selecting the only receiver...\n");
+        return 0;
+    }
+
+    printf("\nSelect receiver (1-%d): ", response_count);
+    fflush(stdout);
+    char line[32];
+    if (!fgets(line, sizeof(line), stdin)) {
+        printf("No selection made.\n");
+        return -1;
+    }
+    int selected = atoi(line) - 1;
+    if (selected < 0 || selected >= response_count) {
+        printf("Invalid selection.\n");
+        return -1;
+    }
+    return selected;
+}
+
+// Find a TV receiver at startup (see discovery_race_t)
+// On success *found_fd is a socket already connected to it, or -1 if the caller has to connect
+static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_addr, int *found_port,
+                                int *found_fd)
+{
+    *found_fd = -1;
+    uint64_t start_us = audio_get_timestamp_us();
+
+    discovery_race_t *race = calloc(1, sizeof(discovery_race_t));
+    if (!race)
+        return -1;
+    pthread_mutex_init(&race->mutex, NULL);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&race->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    race->refs = 1;
+    race->fd = -1;
+    race->tv_port = streamer->tv_port;
+    race->broadcast_timeout_ms = streamer->broadcast_timeout_ms;
+
+    bool have_cached = receiver_cache_load(race->cached_host, sizeof(race->cached_host),
+                                           &race->cached_port) == 0;
+    if (have_cached)
+        printf("Trying last receiver %s:%d alongside discovery...\n", race->cached_host, race->cached_port);
+
+    void *(*probes[3])(void *);
+    int num_probes = 0;
+    if (have_cached)
+        probes[num_probes++] = discovery_cached_probe;
+    probes[num_probes++] = discovery_broadcast_probe;
+    probes[num_probes++] = discovery_adb_probe;
+
+    for (int i = 0; i < num_probes; i++) {
+        pthread_t thread;
+        pthread_mutex_lock(&race->mutex);
+        race->refs++;
+        race->pending++;
+        pthread_mutex_unlock(&race->mutex);
+        if (pthread_create(&thread, NULL, probes[i], race) != 0) {
+            perror("pthread_create");
+            pthread_mutex_lock(&race->mutex);
+            race->refs--;
+            race->pending--;
+            pthread_mutex_unlock(&race->mutex);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // Wait for a winner; a probe stuck in adb past the broadcast timeout is not waited for
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += streamer->broadcast_timeout_ms / 1000 + 1;
+    deadline.tv_nsec += (long)(streamer->broadcast_timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&race->mutex);
+    while (!race->done && race->pending > 0) {
+        if (pthread_cond_timedwait(&race->cond, &race->mutex, &deadline) == ETIMEDOUT)
+            break;
+    }
+    race->done = true;  // Stop the remaining probes
+    const char *method = race->method;
+    struct sockaddr_in addr = race->addr;
+    int fd = race->fd;
+    discovery_response_info_t *responses = race->responses;
+    int response_count = race->response_count;
+    race->fd = -1;
+    race->responses = NULL;
+    if (race->usb_checked) {
+        snprintf(streamer->usb_ip, sizeof(streamer->usb_ip), "%s", race->usb_ip);
+        streamer->usb_ip_checked = true;
+    }
+    pthread_mutex_unlock(&race->mutex);
+    discovery_race_unref(race);
+
+    streamer->discovery_ms = (audio_get_timestamp_us() - start_us) / 1000.0;
 
-    if (response_count == 0) {
+    if (!method) {
         printf("No TV receivers found via broadcast discovery.\n");
 
         // Try to get USB tethering IP and inform the user
-        char usb_ip[INET_ADDRSTRLEN] = {0};
-        if (get_usb_tethering_ip_via_adb(usb_ip, sizeof(usb_ip))) {
+        const char *usb_ip = streamer_usb_tethering_ip(streamer);
+        if (usb_ip) {
             fprintf(stderr, "\nUSB tethering is available. Try connecting directly to: %s:%d\n",
                     usb_ip, streamer->tv_port);
             const char *prog_name = streamer->program_name ? streamer->program_name : "x11-streamer";
@@ -1176,47 +2388,24 @@ static int discover_tv_receiver(x11_streamer_t *streamer, struct in_addr *found_
         return -1;
     }
 
-    // Display found receivers
-    printf("\nFound %d TV receiver(s):\n", response_count);
-    for (int i = 0; i < response_count; i++) {
-        printf("  %d. %s:%d - %s\n",
-               i + 1, responses[i].ip, responses[i].tcp_port,
-               responses[i].display_name[0] ? responses[i].display_name : "Unknown");
-    }
+    printf("Found TV receiver via %s in %.1f ms\n", method, streamer->discovery_ms);
+    streamer->discovery_method = method;
 
-    // Select receiver
-    int selected = 0;
-    if (response_count == 1) {
-        selected = 0;
-        printf("\nAuto-selecting the only receiver...\n");
-    } else {
-        printf("\nSelect receiver (1-%d): ", response_count);
-        fflush(stdout);
-        char line[32];
-        if (fgets(line, sizeof(line), stdin)) {
-            selected = atoi(line) - 1;
-            if (selected < 0 || selected >= response_count) {
-                printf("Invalid selection.\n");
-                free(responses);
-                return -1;
-            }
-        } else {
-            printf("No selection made.\n");
+    // Several TVs answered the broadcast: let the user choose
+    if (responses) {
+        int selected = select_discovered_receiver(responses, response_count);
+        if (selected < 0 || inet_aton(responses[selected].ip, &addr.sin_addr) == 0) {
             free(responses);
             return -1;
         }
-    }
-
-    // Set found address and port
-    if (inet_aton(responses[selected].ip, found_addr) == 0) {
-        printf("Invalid IP address: %s\n", responses[selected].ip);
+        addr.sin_port = htons(responses[selected].tcp_port);
         free(responses);
-        return -1;
     }
-    *found_port = responses[selected].tcp_port;
 
-    printf("Selected: %s:%d\n", responses[selected].ip, *found_port);
-    free(responses);
+    *found_addr = addr.sin_addr;
+    *found_port = ntohs(addr.sin_port);
+    *found_fd = fd;
+    printf("Selected: %s:%d\n", inet_ntoa(addr.sin_addr), *found_port);
     return 0;
 }
 
@@ -1407,57 +2596,78 @@ static bool get_usb_tethering_ip_via_adb(char *ip_buf, size_t ip_buf_size)
     return false;
 }
 
-int x11_streamer_run(x11_streamer_t *streamer)
+// Drop receivers whose connection ended; stop once the last one is gone
+static void streamer_reap_receivers(x11_streamer_t *streamer)
 {
-    if (!streamer)
-        return -1;
-
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(streamer->tv_port);
-
-    // Use broadcast discovery if enabled and no host specified
-    if (streamer->use_broadcast && !streamer->tv_host) {
-        struct in_addr found_addr;
-        int found_port;
-        if (discover_tv_receiver(streamer, &found_addr, &found_port) == 0) {
-            addr.sin_addr = found_addr;
-            addr.sin_port = htons(found_port);
-            streamer->tv_port = found_port;
-            char addr_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &found_addr, addr_str, sizeof(addr_str));
-            if (streamer->tv_host)
-                free(streamer->tv_host);
-            streamer->tv_host = strdup(addr_str);
-        } else {
-            return -1;
+    int kept = 0;
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        if (conn->active) {
+            // A dropped connection being resumed keeps its slot (and the output)
+            if (conn->reconnecting && conn->send_queue)
+                conn_detach(conn);
+            streamer->tv_conns[kept++] = conn;
+            continue;
         }
-    } else if (streamer->tv_host) {
-        // Direct connection to specified host
-        if (inet_aton(streamer->tv_host, &addr.sin_addr) == 0) {
-            // Try to resolve hostname
-            struct hostent *he = gethostbyname(streamer->tv_host);
-            if (!he) {
-                fprintf(stderr, "Failed to resolve host: %s\n", streamer->tv_host);
-                return -1;
-            }
-            memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
+        if (conn->fd >= 0)
+            shutdown(conn->fd, SHUT_RDWR);
+        pthread_join(conn->thread, NULL);
+        printf("TV receiver %s removed\n", conn->peer);
+        tv_connection_free(conn);
+    }
+    streamer->num_tv_conns = kept;
+
+    if (kept == 0 && streamer->running) {
+        // Clean up virtual output if it was created
+        pthread_mutex_lock(&streamer->tv_mutex);
+        streamer_state_t next = *streamer_state(streamer);
+        RROutput output_id = next.output_id;
+        next.output_id = None;
+        streamer_publish_state(streamer, &next);
+        pthread_mutex_unlock(&streamer->tv_mutex);
+        if (output_id != None && streamer->display_mode == STREAMER_DISPLAY_MODE_EXTEND) {
+            pthread_mutex_lock(&streamer->output_mutex);
+            x11_context_delete_virtual_output(streamer->output_manager, output_id);
+            pthread_mutex_unlock(&streamer->output_mutex);
         }
-    } else {
-        fprintf(stderr, "No host specified and broadcast disabled\n");
-        return -1;
+
+        streamer->running = false;
     }
+}
 
-    streamer->tv_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (streamer->tv_fd < 0) {
-        perror("socket");
-        return -1;
+// Give the receiver a ticket for resuming this session after the connection drops.
+// On encrypted sessions it is derived from the Noise handshake hash (plus a nonce, as the
+// hash itself is visible to anyone who saw the handshake) and only travels inside the session.
+static void streamer_issue_ticket(x11_streamer_t *streamer, tv_connection_t *conn)
+{
+    if (streamer->resume_grace_ms <= 0)
+        return;
+
+    uint8_t nonce[SESSION_TICKET_SIZE];
+    if (getrandom(nonce, sizeof(nonce), 0) != (ssize_t)sizeof(nonce)) {
+        perror("getrandom");
+        return;
     }
 
-    char addr_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, addr_str, sizeof(addr_str));
-    printf("Connecting to TV receiver at %s:%d...\n", addr_str, streamer->tv_port);
+    session_ticket_message_t msg;
+    if (conn->noise_ctx) {
+        if (noise_encryption_derive_ticket(conn->noise_ctx, nonce, sizeof(nonce),
+                                           msg.ticket, sizeof(msg.ticket)) < 0)
+            return;
+    } else {
+        memcpy(msg.ticket, nonce, sizeof(msg.ticket));
+    }
+    msg.grace_ms = htonl(streamer->resume_grace_ms);
+
+    if (conn_send_message(conn, MSG_SESSION_TICKET, &msg, sizeof(msg)) < 0)
+        return;
+    memcpy(conn->ticket, msg.ticket, sizeof(conn->ticket));
+    conn->has_ticket = true;
+}
 
+// Print what adb knows about the device after a failed connect (addresses, listening port)
+static void log_adb_connect_diagnostics(const char *addr_str, int port)
+{
     // Check if device is reachable via adb
     char device_ip[INET_ADDRSTRLEN] = {0};
     // Get all device IPs and check if target is reachable
@@ -1518,50 +2728,49 @@ int x11_streamer_run(x11_streamer_t *streamer)
     }
 
     // Check if port is listening via adb
-    bool port_listening = check_tv_receiver_listening(streamer->tv_port);
+    bool port_listening = check_tv_receiver_listening(port);
     if (port_listening) {
-        printf("Debug: Port %d is listening on device (checked via adb)\n", streamer->tv_port);
+        printf("Debug: Port %d is listening on device (checked via adb)\n", port);
     } else {
-        fprintf(stderr, "Debug: Port %d is NOT listening on device (checked via adb)\n", streamer->tv_port);
+        fprintf(stderr, "Debug: Port %d is NOT listening on device (checked via adb)\n", port);
     }
+}
 
+// Connect fd to a receiver, waiting up to 5 seconds
+// Returns 0 on success (fd left in blocking mode), -1 on failure
+static int connect_receiver_socket(int fd, const struct sockaddr_in *addr, const char *addr_str, int port)
+{
     // Set socket to non-blocking temporarily to check connection status
-    int flags = fcntl(streamer->tv_fd, F_GETFL, 0);
+    int flags = fcntl(fd, F_GETFL, 0);
     if (flags < 0) {
         perror("fcntl(F_GETFL)");
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
         return -1;
     }
 
-    if (fcntl(streamer->tv_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
         perror("fcntl(F_SETFL)");
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
         return -1;
     }
 
     // Attempt connection
-    int connect_result = connect(streamer->tv_fd, (struct sockaddr *)&addr, sizeof(addr));
+    int connect_result = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
     if (connect_result < 0) {
         if (errno == EINPROGRESS) {
             // Connection in progress, wait for it
             fd_set write_fds;
             struct timeval timeout;
             FD_ZERO(&write_fds);
-            FD_SET(streamer->tv_fd, &write_fds);
+            FD_SET(fd, &write_fds);
             timeout.tv_sec = 5;  // 5 second timeout
             timeout.tv_usec = 0;
 
-            int select_result = select(streamer->tv_fd + 1, NULL, &write_fds, NULL, &timeout);
+            int select_result = select(fd + 1, NULL, &write_fds, NULL, &timeout);
             if (select_result > 0) {
                 // Check if connection succeeded
                 int so_error;
                 socklen_t len = sizeof(so_error);
-                if (getsockopt(streamer->tv_fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0) {
+                if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0) {
                     perror("getsockopt(SO_ERROR)");
-                    close(streamer->tv_fd);
-                    streamer->tv_fd = -1;
                     return -1;
                 }
                 if (so_error != 0) {
@@ -1570,20 +2779,14 @@ int x11_streamer_run(x11_streamer_t *streamer)
                     perror("connect");
                     fprintf(stderr, "Debug: Error code: %d (EHOSTUNREACH=%d, ECONNREFUSED=%d, ETIMEDOUT=%d)\n",
                            so_error, EHOSTUNREACH, ECONNREFUSED, ETIMEDOUT);
-                    close(streamer->tv_fd);
-                    streamer->tv_fd = -1;
                     return -1;
                 }
                 // Connection succeeded
             } else if (select_result == 0) {
-                fprintf(stderr, "Connection timeout: No response from %s:%d\n", addr_str, streamer->tv_port);
-                close(streamer->tv_fd);
-                streamer->tv_fd = -1;
+                fprintf(stderr, "Connection timeout: No response from %s:%d\n", addr_str, port);
                 return -1;
             } else {
                 perror("select");
-                close(streamer->tv_fd);
-                streamer->tv_fd = -1;
                 return -1;
             }
         } else {
@@ -1591,30 +2794,83 @@ int x11_streamer_run(x11_streamer_t *streamer)
             perror("connect");
             fprintf(stderr, "Debug: Error code: %d (EHOSTUNREACH=%d, ECONNREFUSED=%d, ETIMEDOUT=%d)\n",
                    errno, EHOSTUNREACH, ECONNREFUSED, ETIMEDOUT);
-            close(streamer->tv_fd);
-            streamer->tv_fd = -1;
             return -1;
         }
     }
 
     // Restore blocking mode
-    if (fcntl(streamer->tv_fd, F_SETFL, flags) < 0) {
+    if (fcntl(fd, F_SETFL, flags) < 0) {
         perror("fcntl(F_SETFL restore)");
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
         return -1;
     }
 
-    printf("Connected to TV receiver\n");
+    return 0;
+}
+
+// Connect to one TV receiver and run the handshake (CLIENT_HELLO, Noise/PIN, HELLO)
+// connected_fd: socket discovery already connected to it (-1 = connect here); always consumed
+// Returns the connection with its send queue set up, or NULL on failure
+static tv_connection_t *streamer_connect_receiver(x11_streamer_t *streamer, const char *host, int port,
+                                                  int connected_fd)
+{
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    if (inet_aton(host, &addr.sin_addr) == 0) {
+        // Try to resolve hostname
+        struct hostent *he = gethostbyname(host);
+        if (!he) {
+            fprintf(stderr, "Failed to resolve host: %s\n", host);
+            if (connected_fd >= 0)
+                close(connected_fd);
+            return NULL;
+        }
+        memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
+    }
+
+    tv_connection_t *conn = calloc(1, sizeof(tv_connection_t));
+    if (!conn) {
+        fprintf(stderr, "Failed to allocate TV connection structure\n");
+        if (connected_fd >= 0)
+            close(connected_fd);
+        return NULL;
+    }
+    conn->streamer = streamer;
+    conn->epoll_fd = -1;
+    conn->udp_epoll_fd = -1;
+    conn->join_us = audio_get_timestamp_us();
+    conn->addr = addr;
+    conn->fd = connected_fd >= 0 ? connected_fd : socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd < 0) {
+        perror("socket");
+        free(conn);
+        return NULL;
+    }
+
+    char addr_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, addr_str, sizeof(addr_str));
+    snprintf(conn->peer, sizeof(conn->peer), "%s:%d", addr_str, port);
+
+    if (connected_fd < 0) {
+        printf("Connecting to TV receiver at %s...\n", conn->peer);
+        if (connect_receiver_socket(conn->fd, &addr, addr_str, port) < 0) {
+            log_adb_connect_diagnostics(addr_str, port);
+            tv_connection_free(conn);
+            return NULL;
+        }
+    }
+
+    printf("Connected to TV receiver at %s\n", conn->peer);
+    conn_set_user_timeout(conn->fd);
 
     // Determine encryption policy: CLI override > interface detection
     bool wants_encryption = true;  // Default: encrypt
     bool needs_pin = true;  // Default: PIN required (unless rndis0)
 
     // Check if connecting via USB tethering (rndis0 interface)
-    char usb_ip[INET_ADDRSTRLEN] = {0};
-    bool is_usb_tethering = get_usb_tethering_ip_via_adb(usb_ip, sizeof(usb_ip)) &&
-                            strcmp(addr_str, usb_ip) == 0;
+    const char *usb_ip = streamer_usb_tethering_ip(streamer);
+    bool is_usb_tethering = usb_ip && strcmp(addr_str, usb_ip) == 0;
 
     if (streamer->force_encrypt) {
         wants_encryption = true;
@@ -1632,12 +2888,18 @@ int x11_streamer_run(x11_streamer_t *streamer)
         printf("WiFi/other interface - using encryption with PIN\n");
     }
 
-    streamer->enable_encryption = wants_encryption;
-
     // Send CLIENT_HELLO as first message
     uint8_t client_hello_payload[4];  // version(1) + flags(1) + optional PIN(2)
     client_hello_payload[0] = 1;  // protocol version
-    client_hello_payload[1] = wants_encryption ? 0x01 : 0x00;  // encryption flag
+    client_hello_payload[1] = wants_encryption ? CLIENT_HELLO_FLAG_ENCRYPT : 0x00;  // encryption flag
+
+    // UDP video packets are not covered by the Noise session, so only offer UDP on plaintext links
+    if (streamer->udp_video_requested) {
+        if (wants_encryption)
+            printf("UDP video is only available on unencrypted connections, using TCP\n");
+        else
+            client_hello_payload[1] |= CLIENT_HELLO_FLAG_UDP_VIDEO;
+    }
 
     size_t hello_payload_size = 2;  // version + flags
 
@@ -1647,51 +2909,42 @@ int x11_streamer_run(x11_streamer_t *streamer)
         pin = get_pin(streamer);
         if (pin == 0xFFFF) {
             fprintf(stderr, "No PIN entered or invalid PIN.\n");
-            close(streamer->tv_fd);
-            streamer->tv_fd = -1;
-            return -1;
+            tv_connection_free(conn);
+            return NULL;
         }
-        uint16_t pin_be = htons(pin);
-        client_hello_payload[2] = (pin_be >> 8) & 0xFF;  // High byte first
-        client_hello_payload[3] = pin_be & 0xFF;         // Low byte second
+        client_hello_payload[2] = (pin >> 8) & 0xFF;  // High byte first (big-endian)
+        client_hello_payload[3] = pin & 0xFF;         // Low byte second
         hello_payload_size = 4;
     }
 
-    if (protocol_send_message(streamer->tv_fd, MSG_CLIENT_HELLO, client_hello_payload, hello_payload_size) < 0) {
+    if (protocol_send_message(conn->fd, MSG_CLIENT_HELLO, client_hello_payload, hello_payload_size) < 0) {
         fprintf(stderr, "Failed to send CLIENT_HELLO\n");
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
-        return -1;
+        tv_connection_free(conn);
+        return NULL;
     }
     printf("Sent CLIENT_HELLO (encryption=%s)\n", wants_encryption ? "yes" : "no");
+    conn->encrypted = wants_encryption;
 
     // Perform Noise Protocol handshake if encryption requested
     if (wants_encryption) {
         printf("Starting Noise Protocol handshake...\n");
-        streamer->noise_ctx = noise_encryption_init(true);  // Streamer is initiator
-        if (!streamer->noise_ctx) {
+        conn->noise_ctx = noise_encryption_init(true);  // Streamer is initiator
+        if (!conn->noise_ctx) {
             fprintf(stderr, "Failed to initialize Noise Protocol encryption\n");
-            close(streamer->tv_fd);
-            streamer->tv_fd = -1;
-            return -1;
+            tv_connection_free(conn);
+            return NULL;
         }
 
-        if (noise_encryption_handshake(streamer->noise_ctx, streamer->tv_fd) < 0) {
+        if (noise_encryption_handshake(conn->noise_ctx, conn->fd) < 0) {
             fprintf(stderr, "Noise Protocol handshake failed\n");
-            noise_encryption_cleanup(streamer->noise_ctx);
-            streamer->noise_ctx = NULL;
-            close(streamer->tv_fd);
-            streamer->tv_fd = -1;
-            return -1;
+            tv_connection_free(conn);
+            return NULL;
         }
 
-        if (!noise_encryption_is_ready(streamer->noise_ctx)) {
+        if (!noise_encryption_is_ready(conn->noise_ctx)) {
             fprintf(stderr, "Noise Protocol handshake incomplete\n");
-            noise_encryption_cleanup(streamer->noise_ctx);
-            streamer->noise_ctx = NULL;
-            close(streamer->tv_fd);
-            streamer->tv_fd = -1;
-            return -1;
+            tv_connection_free(conn);
+            return NULL;
         }
 
         printf("Noise Protocol encryption established\n");
@@ -1701,42 +2954,33 @@ int x11_streamer_run(x11_streamer_t *streamer)
             pin = get_pin(streamer);
             if (pin == 0xFFFF) {
                 fprintf(stderr, "No PIN entered or invalid PIN.\n");
-                noise_encryption_cleanup(streamer->noise_ctx);
-                streamer->noise_ctx = NULL;
-                close(streamer->tv_fd);
-                streamer->tv_fd = -1;
-                return -1;
+                tv_connection_free(conn);
+                return NULL;
             }
 
             // Send PIN verification over encrypted channel
             pin_verify_t pin_msg = {.pin = htons(pin)};  // Convert to network byte order
-            if (streamer_send_message(streamer, MSG_PIN_VERIFY, &pin_msg, sizeof(pin_msg)) < 0) {
+            if (conn_send_message(conn, MSG_PIN_VERIFY, &pin_msg, sizeof(pin_msg)) < 0) {
                 fprintf(stderr, "Failed to send PIN verification\n");
-                noise_encryption_cleanup(streamer->noise_ctx);
-                streamer->noise_ctx = NULL;
-                close(streamer->tv_fd);
-                streamer->tv_fd = -1;
-                return -1;
+                tv_connection_free(conn);
+                return NULL;
             }
 
             // Wait for PIN verified response over encrypted channel
             message_header_t header;
             void *payload = NULL;
-            if (streamer_receive_message(streamer, &header, &payload) <= 0 ||
+            if (conn_receive_message(conn, &header, &payload) <= 0 ||
                 header.type != MSG_PIN_VERIFIED) {
                 fprintf(stderr, "PIN verification failed\n");
                 if (payload) free(payload);
-                noise_encryption_cleanup(streamer->noise_ctx);
-                streamer->noise_ctx = NULL;
-                close(streamer->tv_fd);
-                streamer->tv_fd = -1;
-                return -1;
+                tv_connection_free(conn);
+                return NULL;
             }
             if (payload) free(payload);
             printf("PIN verified successfully\n");
         }
     } else {
-        streamer->noise_ctx = NULL;
+        conn->noise_ctx = NULL;
         printf("Using unencrypted connection\n");
     }
 
@@ -1744,130 +2988,324 @@ int x11_streamer_run(x11_streamer_t *streamer)
     printf("Waiting for HELLO message from TV receiver...\n");
     message_header_t hello_header;
     void *hello_payload = NULL;
-    int hello_ret = protocol_receive_message(streamer->tv_fd, &hello_header, &hello_payload);
+    int hello_ret = conn_receive_message(conn, &hello_header, &hello_payload);  // Encrypted if Noise is up
     if (hello_ret <= 0 || hello_header.type != MSG_HELLO) {
         fprintf(stderr, "TV receiver handshake failed: expected HELLO, got type 0x%02x\n",
                 hello_ret > 0 ? hello_header.type : 0);
         if (hello_payload) free(hello_payload);
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
-        return -1;
+        tv_connection_free(conn);
+        return NULL;
     }
 
     // Validate HELLO message structure
     if (!hello_payload || hello_header.length < sizeof(hello_message_t)) {
         fprintf(stderr, "TV receiver handshake failed: invalid HELLO message format\n");
         if (hello_payload) free(hello_payload);
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
-        return -1;
+        tv_connection_free(conn);
+        return NULL;
+    }
+
+    // Open the UDP video channel if the receiver accepted it
+    const hello_transport_t *transport = hello_find_transport(hello_payload, hello_header.length);
+    if (transport && ntohs(transport->udp_port) != 0 &&
+        (client_hello_payload[1] & CLIENT_HELLO_FLAG_UDP_VIDEO)) {
+        struct sockaddr_storage udp_addr;
+        socklen_t udp_addr_len = sizeof(udp_addr);
+        if (getpeername(conn->fd, (struct sockaddr *)&udp_addr, &udp_addr_len) == 0) {
+            if (udp_addr.ss_family == AF_INET)
+                ((struct sockaddr_in *)&udp_addr)->sin_port = transport->udp_port;
+            else if (udp_addr.ss_family == AF_INET6)
+                ((struct sockaddr_in6 *)&udp_addr)->sin6_port = transport->udp_port;
+            conn->udp_video = udp_video_sender_create((struct sockaddr *)&udp_addr, udp_addr_len,
+                                                      0, streamer->fec_group);
+        }
+        if (conn->udp_video)
+            printf("Sending video over UDP port %d\n", ntohs(transport->udp_port));
+        else
+            fprintf(stderr, "Warning: Failed to open UDP video channel, using TCP\n");
     }
 
     // Store HELLO payload for tv_receiver_thread to process
-    streamer->tv_conn = calloc(1, sizeof(tv_connection_t));
-    if (!streamer->tv_conn) {
-        fprintf(stderr, "Failed to allocate TV connection structure\n");
-        if (hello_payload) free(hello_payload);
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
+    conn->hello_payload = hello_payload;
+    conn->hello_header = hello_header;
+    conn->paused = false;
+    conn->resync = true;  // Wait for a self-contained frame
+
+    // All further output goes through the non-blocking send queue
+    conn->send_queue = send_queue_create(conn->fd, conn->noise_ctx, streamer->max_backlog_ms);
+    if (!conn->send_queue) {
+        fprintf(stderr, "Failed to create send queue\n");
+        tv_connection_free(conn);
+        return NULL;
+    }
+
+    streamer_issue_ticket(streamer, conn);
+    return conn;
+}
+
+// Main loop event sources (epoll_event.data.u64); writable TV sockets carry their
+// connection in data.ptr instead, which is never one of these small values
+enum {
+    LOOP_X11,
+    LOOP_AUDIO,
+    LOOP_WAKE,
+    LOOP_FRAME_TIMER,
+    LOOP_KEEPALIVE_TIMER,
+};
+#define LOOP_MAX_EVENTS 16
+
+static void epoll_watch(int epfd, int fd, uint32_t source)
+{
+    if (fd < 0)
+        return;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = source };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        perror("epoll_ctl");
+}
+
+// Arm a periodic timer: first expiry at first_us (CLOCK_MONOTONIC), then every interval_us
+// Absolute deadlines, so ticks do not drift with the time spent handling them
+static void timer_arm(int fd, uint64_t first_us, uint64_t interval_us)
+{
+    struct itimerspec spec = {
+        .it_interval = { .tv_sec = interval_us / 1000000, .tv_nsec = (interval_us % 1000000) * 1000 },
+        .it_value = { .tv_sec = first_us / 1000000, .tv_nsec = (first_us % 1000000) * 1000 },
+    };
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        spec.it_value.tv_nsec = 1;  // Zero would disarm it
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+        perror("timerfd_settime");
+}
+
+// Read a timerfd's expiration count (or an eventfd's counter); 0 if nothing was pending
+static uint64_t timer_ack(int fd)
+{
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) < 0)
+        return 0;
+    return count;
+}
+
+static void streamer_close_fds(int frame_timer, int keepalive_timer, int epfd)
+{
+    int fds[] = { frame_timer, keepalive_timer, epfd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+}
+
+// Make *watched (one of conn's sockets registered for EPOLLOUT, -1 = none) become fd
+static void conn_watch_fd(tv_connection_t *conn, int epfd, int *watched, int fd)
+{
+    if (fd == *watched)
+        return;
+    conn_unwatch(conn, watched);
+    if (fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = conn };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl(TV socket)");
+            return;
+        }
+        *watched = fd;
+    }
+}
+
+// Watch a TV's sockets for EPOLLOUT only while they have queued data (main loop only)
+static void conn_watch_writable(tv_connection_t *conn, int epfd)
+{
+    bool usable = conn_is_usable(conn);
+    conn_watch_fd(conn, epfd, &conn->epoll_fd,
+                  usable && send_queue_has_pending(conn->send_queue) ? conn->fd : -1);
+    conn_watch_fd(conn, epfd, &conn->udp_epoll_fd,
+                  usable && udp_video_sender_has_pending(conn->udp_video) ?
+                  udp_video_sender_get_fd(conn->udp_video) : -1);
+}
+
+int x11_streamer_run(x11_streamer_t *streamer)
+{
+    if (!streamer)
+        return -1;
+
+    // Use broadcast discovery if enabled and no host specified
+    int discovered_fd = -1;  // Discovery may already have connected to the receiver
+    if (streamer->use_broadcast && streamer->num_tv_hosts == 0) {
+        struct in_addr found_addr;
+        int found_port;
+        if (discover_tv_receiver(streamer, &found_addr, &found_port, &discovered_fd) == 0) {
+            streamer->tv_port = found_port;
+            char addr_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &found_addr, addr_str, sizeof(addr_str));
+            streamer->tv_hosts[0] = strdup(addr_str);
+            streamer->tv_ports[0] = found_port;
+            streamer->num_tv_hosts = 1;
+        } else {
+            return -1;
+        }
+    } else if (streamer->num_tv_hosts == 0) {
+        fprintf(stderr, "No host specified and broadcast disabled\n");
         return -1;
     }
-    streamer->tv_conn->hello_payload = hello_payload;
-    streamer->tv_conn->hello_header = hello_header;
-    streamer->tv_conn->paused = false;
 
-    // Start TV receiver thread to handle communication
-    streamer->running = true;
-    if (pthread_create(&streamer->tv_thread, NULL, tv_receiver_thread, streamer) != 0) {
-        perror("pthread_create");
-        close(streamer->tv_fd);
-        streamer->tv_fd = -1;
+    // Connect to every receiver; the ones that fail are skipped
+    for (int i = 0; i < streamer->num_tv_hosts; i++) {
+        tv_connection_t *conn = streamer_connect_receiver(streamer, streamer->tv_hosts[i], streamer->tv_ports[i],
+                                                          i == 0 ? discovered_fd : -1);
+        if (conn) {
+            // Next startup tries the first receiver directly while discovery runs
+            if (streamer->num_tv_conns == 0) {
+                char addr_str[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &conn->addr.sin_addr, addr_str, sizeof(addr_str));
+                receiver_cache_save(addr_str, ntohs(conn->addr.sin_port));
+            }
+            streamer->tv_conns[streamer->num_tv_conns++] = conn;
+        } else if (streamer->num_tv_hosts > 1)
+            fprintf(stderr, "Skipping TV receiver %s:%d\n", streamer->tv_hosts[i], streamer->tv_ports[i]);
+    }
+    if (streamer->num_tv_conns == 0)
         return -1;
+
+    // Start a receiver thread per TV to handle communication
+    streamer->running = true;
+    int started = 0;
+    for (int i = 0; i < streamer->num_tv_conns; i++) {
+        tv_connection_t *conn = streamer->tv_conns[i];
+        conn->active = true;
+        if (pthread_create(&conn->thread, NULL, tv_receiver_thread, conn) != 0) {
+            perror("pthread_create");
+            tv_connection_free(conn);
+            continue;
+        }
+        streamer->tv_conns[started++] = conn;
     }
+    streamer->num_tv_conns = started;
+    if (started == 0)
+        return -1;
 
     // Refresh outputs (needed for X11 event processing, but we don't print local outputs)
-    if (x11_context_refresh_outputs(streamer->x11_ctx) < 0) {
+    if (streamer->x11_ctx && x11_context_refresh_outputs(streamer->x11_ctx) < 0) {
         printf("Failed to refresh outputs\n");
         return -1;
     }
 
-    // Get X11 display file descriptor for polling
-    int x11_fd = x11_context_get_fd(streamer->x11_ctx);
-
-    // Start keep-alive thread (runs independently, doesn't block frame capture)
-    if (pthread_create(&streamer->keepalive_thread, NULL, keepalive_thread_func, streamer) != 0) {
-        printf("Warning: Failed to create keep-alive thread\n");
+    // Event sources of the main loop
+    int x11_fd = streamer->x11_ctx ? x11_context_get_fd(streamer->x11_ctx) : -1;
+    int audio_fd = audio_capture_get_fd(streamer->audio_capture);  // Captured audio is ready
+    int frame_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int keepalive_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (frame_timer < 0 || keepalive_timer < 0 || epfd < 0) {
+        perror("main loop setup");
+        streamer_close_fds(frame_timer, keepalive_timer, epfd);
+        return -1;
     }
+    streamer->loop_epfd = epfd;
+    epoll_watch(epfd, x11_fd, LOOP_X11);
+    epoll_watch(epfd, audio_fd, LOOP_AUDIO);
+    epoll_watch(epfd, streamer->wake_fd, LOOP_WAKE);
+    epoll_watch(epfd, frame_timer, LOOP_FRAME_TIMER);
+    epoll_watch(epfd, keepalive_timer, LOOP_KEEPALIVE_TIMER);
+
+    uint64_t now_us = audio_get_timestamp_us();
+    timer_arm(keepalive_timer, now_us + KEEPALIVE_INTERVAL_US, KEEPALIVE_INTERVAL_US);
+    uint64_t frame_interval_us = 0;  // Period the frame timer is armed with
+    uint32_t output_generation = streamer_state(streamer)->output_generation;
+    bool x11_round_trip = true;  // Since events were last processed (the refresh above)
 
-    // Main streamer loop
+    // Main streamer loop: sleeps until an event or a timer deadline, whichever comes first
     while (streamer->running) {
-        struct pollfd pfds[1];
-        int num_fds = 0;
+        // No snapshot is held here, so the replaced ones can go
+        streamer_reclaim_states(streamer);
+
+        // Frame ticks follow the refresh rate; a (re)configured output gets a frame at once
+        const streamer_state_t *state = streamer_state(streamer);
+        uint64_t interval_us = state->refresh_rate_hz > 0 ? 1000000ULL / state->refresh_rate_hz
+                                                          : FALLBACK_FRAME_INTERVAL_US;
+        if (interval_us != frame_interval_us || state->output_generation != output_generation) {
+            timer_arm(frame_timer, audio_get_timestamp_us(), interval_us);
+            frame_interval_us = interval_us;
+            output_generation = state->output_generation;
+        }
 
-        if (x11_fd >= 0) {
-            pfds[num_fds].fd = x11_fd;
-            pfds[num_fds].events = POLLIN;
-            num_fds++;
+        // Wake up when a TV socket can take more queued data
+        for (int i = 0; i < streamer->num_tv_conns; i++) {
+            conn_take_resume(streamer->tv_conns[i]);
+            conn_watch_writable(streamer->tv_conns[i], epfd);
         }
 
-        int ret = poll(pfds, num_fds, 100);  // 100ms timeout
-        if (ret < 0) {
+        struct epoll_event events[LOOP_MAX_EVENTS];
+        int n = epoll_wait(epfd, events, LOOP_MAX_EVENTS, -1);
+        if (n < 0) {
             if (errno == EINTR)
                 continue;
+            perror("epoll_wait");
             break;
         }
 
-        // Process X11/RandR events
-        if (x11_fd >= 0 && ret > 0 && (pfds[0].revents & POLLIN)) {
-            int changes = x11_context_process_events(streamer->x11_ctx);
-            if (changes > 0) {
-                // Output configuration changed, check for changes and notify TV receiver
-                streamer_check_and_notify_output_changes(streamer);
+        bool x11_ready = false, frame_due = false, keepalive_due = false;
+        for (int i = 0; i < n; i++) {
+            switch (events[i].data.u64) {
+            case LOOP_X11:
+                x11_ready = true;
+                break;
+            case LOOP_WAKE:
+                timer_ack(streamer->wake_fd);
+                break;
+            case LOOP_FRAME_TIMER:
+                frame_due = timer_ack(frame_timer) > 0;  // Missed ticks are dropped, not caught up
+                break;
+            case LOOP_KEEPALIVE_TIMER:
+                keepalive_due = timer_ack(keepalive_timer) > 0;
+                break;
+            default:  // Captured audio and writable TV sockets are served below on every wakeup
+                break;
             }
         }
 
-        // Capture and send frames at display refresh rate
-        static int refresh_counter = 0;
-
-        uint64_t now_us = audio_get_timestamp_us();
-        pthread_mutex_lock(&streamer->tv_mutex);
-        int refresh_rate = streamer->refresh_rate_hz;
-        uint64_t last_frame_time = streamer->last_frame_time_us;
-        pthread_mutex_unlock(&streamer->tv_mutex);
-
-        if (refresh_rate > 0) {
-            // Calculate frame interval in microseconds
-            uint64_t frame_interval_us = 1000000ULL / refresh_rate;
-
-            // Only capture if enough time has passed since last frame
-            if (now_us - last_frame_time >= frame_interval_us) {
-                streamer_capture_and_send_frames(streamer);
-
-                pthread_mutex_lock(&streamer->tv_mutex);
-                streamer->last_frame_time_us = now_us;
-                pthread_mutex_unlock(&streamer->tv_mutex);
+        if (streamer->x11_ctx) {
+            // Keep the virtual output alive (a property read, well under a millisecond)
+            if (keepalive_due) {
+                RROutput virtual_output_id = streamer_state(streamer)->output_id;
+                if (virtual_output_id != None) {
+                    x11_context_keep_alive_output(streamer->x11_ctx, virtual_output_id);
+                    x11_round_trip = true;
+                }
             }
-        } else {
-            // Fallback: capture at ~10 FPS if refresh rate unknown
-            static int frame_counter = 0;
-            frame_counter++;
-            if (frame_counter >= 10) {  // 100ms / 10 = 10 FPS
-                streamer_capture_and_send_frames(streamer);
-                frame_counter = 0;
+
+            // Process X11/RandR events; the output table follows them, so there is no
+            // periodic refresh. Events that arrive while a round trip waits for its reply
+            // are read off the socket into XCB's queue, where epoll does not see them.
+            bool x11_events = x11_ready || x11_round_trip;
+            x11_round_trip = false;
+            if (x11_events &&
+                x11_context_process_events(streamer->x11_ctx) > 0) {
+                // Output configuration changed, check for changes and notify TV receiver
+                streamer_check_and_notify_output_changes(streamer);
             }
         }
 
-        // Capture and send audio (low latency, frequent reads)
+        // Capture and send frames at display refresh rate
+        if (frame_due)
+            streamer_capture_and_send_frames(streamer);
+
+        // Send whatever audio has been captured (10ms chunks)
         streamer_capture_and_send_audio(streamer);
 
-        // Refresh outputs occasionally (every 60 seconds)
-        refresh_counter++;
-        if (refresh_counter >= 60) {
-            x11_context_refresh_outputs(streamer->x11_ctx);
-            refresh_counter = 0;
+        // Push out whatever each socket will take without blocking
+        for (int i = 0; i < streamer->num_tv_conns; i++) {
+            tv_connection_t *conn = streamer->tv_conns[i];
+            if (conn_is_usable(conn) && send_queue_flush(conn->send_queue) < 0)
+                conn_fail(conn, "queued data");
+            else if (conn_is_usable(conn) && udp_video_sender_flush(conn->udp_video) < 0)
+                conn_fail(conn, "UDP video");
+            else if (conn_is_usable(conn))
+                conn_report_first_picture(conn);
         }
+
+        streamer_reap_receivers(streamer);
     }
 
+    streamer->loop_epfd = -1;  // Connections freed after this have nothing to unwatch
+    streamer_close_fds(frame_timer, keepalive_timer, epfd);
     return 0;
 }
 
@@ -1875,8 +3313,7 @@ void x11_streamer_stop(x11_streamer_t *streamer)
 {
     if (streamer) {
         streamer->running = false;
-        // Wait for keep-alive thread to finish
-        pthread_join(streamer->keepalive_thread, NULL);
+        streamer_wake(streamer);
     }
 }
 
@@ -0,0 +1,1071 @@
+/*
+ * Network impairment proxy: a bad link between a streamer and a receiver on one box.
+ *
+ * Usage: impair-proxy --target HOST:PORT [OPTIONS]
+ *
+ * Accepts the streamer's TCP connection, connects on to the receiver and relays both
+ * ways through a simulated link: a bandwidth cap with a bounded router queue, delay
+ * plus random jitter, and loss. UDP video is relayed too - the receiver's HELLO is
+ * rewritten to point the streamer at the proxy's own UDP port. Loss drops UDP
+ * datagrams outright; on TCP, where bytes cannot vanish, a lost segment costs a
+ * retransmission stall (max(200 ms, 3 x delay)) that holds up everything behind it.
+ *
+ * Link settings can change over time from a script, one step per line, timed from the
+ * first connection (so runs repeat exactly with the same --seed):
+ *   # seconds  settings (rate kbit/s, 0 = unlimited; delay/jitter ms; loss %; queue KB)
+ *   0   rate=50000 delay=5
+ *   10  rate=8000
+ *   20  rate=3000 loss=1 jitter=20
+ *   40  rate=0 delay=0 jitter=0 loss=0
+ *
+ * On unencrypted sessions the proxy follows the streamer's messages and logs what the
+ * adaptive logic did: encoding mode switches as they happen, and each second the
+ * offered and delivered bitrate, frames per mode and capture-to-delivery latency
+ * (streamer timestamps are CLOCK_MONOTONIC, shared on loopback). --csv writes the
+ * per-second lines for plotting.
+ *
+ * Loopback example:
+ *   reference-receiver --port 4322 --udp &
+ *   impair-proxy --listen 4321 --target 127.0.0.1:4322 --script steps.txt --csv run.csv &
+ *   x11-streamer 127.0.0.1:4321 --nocrypt --udp --source replay:ide.rec
+ */
+#define _GNU_SOURCE
+#include "protocol.h"
+#include "x11_streamer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define REPORT_INTERVAL_US 1000000ULL
+#define READ_CHUNK 16384
+#define TCP_SEGMENT 1448
+#define MIN_RTO_US 200000ULL
+#define MAX_SCRIPT_STEPS 256
+#define MAX_LATENCY_SAMPLES 8192
+#define PREFIX_BYTES 64  // Start of each message kept for inspection
+
+typedef struct {
+    uint32_t rate_kbps;   // 0 = unlimited
+    uint32_t delay_ms;
+    uint32_t jitter_ms;
+    double loss_pct;
+    uint32_t queue_kb;    // Router queue: TCP reads stop / UDP datagrams drop beyond it
+} link_settings_t;
+
+typedef struct {
+    uint64_t at_us;       // Offset from the first connection
+    link_settings_t settings;
+    uint32_t set_mask;    // Which settings the step changes
+} script_step_t;
+
+#define SET_RATE   0x01
+#define SET_DELAY  0x02
+#define SET_JITTER 0x04
+#define SET_LOSS   0x08
+#define SET_QUEUE  0x10
+
+typedef struct chunk {
+    struct chunk *next;
+    uint64_t release_us;
+    size_t len;
+    size_t off;           // Bytes already written (TCP)
+    uint8_t data[];
+} chunk_t;
+
+// Follows the message framing of one TCP direction
+typedef struct {
+    bool enabled;
+    uint8_t header[sizeof(message_header_t)];
+    size_t header_have;
+    uint8_t prefix[PREFIX_BYTES];
+    size_t prefix_have;
+    size_t prefix_want;
+    uint64_t body_left;   // Payload bytes still to come (header.length, then FRAME/AUDIO data)
+    bool extra_done;      // FRAME/AUDIO data length already added
+} msg_parser_t;
+
+// One direction of the simulated link
+typedef struct {
+    const char *name;
+    int in_fd;
+    int out_fd;
+    chunk_t *head;
+    chunk_t *tail;
+    size_t queued;
+    uint64_t link_free_us;     // When the link finishes sending what is queued
+    uint64_t last_release_us;  // TCP keeps order
+    bool in_eof;
+    bool out_shut;
+    msg_parser_t parser;
+} link_dir_t;
+
+typedef struct {
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t frames[3];        // Delivered, per encoding mode
+    uint64_t udp_dropped;
+    uint64_t tcp_stalls;
+    double latency_ms[MAX_LATENCY_SAMPLES];
+    int latency_count;
+} interval_stats_t;
+
+typedef struct {
+    link_settings_t settings;
+    script_step_t script[MAX_SCRIPT_STEPS];
+    int script_len;
+    int script_next;
+    uint64_t script_start_us;  // 0 until the first connection
+    uint64_t rng;
+
+    int listen_fd;
+    struct sockaddr_in target;
+
+    link_dir_t down;           // Streamer -> receiver
+    link_dir_t up;             // Receiver -> streamer
+    bool session_active;
+    bool encrypted;
+    bool hello_seen;
+    uint8_t up_pending[65536]; // Receiver messages held until the HELLO has gone by
+    size_t up_pending_len;
+
+    // UDP video relay
+    int udp_fd;
+    uint16_t udp_target_port;  // Receiver's real UDP port (network order)
+    struct sockaddr_in udp_streamer;
+    bool udp_streamer_known;
+    chunk_t *udp_head;
+    chunk_t *udp_tail;
+    size_t udp_queued;
+    uint64_t udp_link_free_us;
+    uint32_t udp_frame_seq;    // Frame whose first packet was delivered last
+    uint64_t udp_frame_ts;
+    uint8_t udp_frame_mode;
+
+    int last_mode;             // -1 until the first frame
+    interval_stats_t stats;
+    interval_stats_t total;
+    FILE *csv;
+} proxy_t;
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double random_unit(proxy_t *proxy)
+{
+    return (xorshift64(&proxy->rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static const char *mode_name(int mode)
+{
+    switch (mode) {
+    case ENCODING_MODE_FULL_FRAME: return "full";
+    case ENCODING_MODE_DIRTY_RECTS: return "dirty";
+    case ENCODING_MODE_H264: return "h264";
+    default: return "?";
+    }
+}
+
+static double elapsed_s(proxy_t *proxy)
+{
+    return proxy->script_start_us ? (now_us() - proxy->script_start_us) / 1e6 : 0;
+}
+
+// Parse "key=value ..." into settings; returns -1 on an unknown key
+static int parse_settings(char *text, link_settings_t *settings, uint32_t *mask)
+{
+    for (char *tok = strtok(text, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+            return -1;
+        *eq = '\0';
+        double value = atof(eq + 1);
+        if (value < 0)
+            return -1;
+        if (strcmp(tok, "rate") == 0) {
+            settings->rate_kbps = (uint32_t)value;
+            *mask |= SET_RATE;
+        } else if (strcmp(tok, "delay") == 0) {
+            settings->delay_ms = (uint32_t)value;
+            *mask |= SET_DELAY;
+        } else if (strcmp(tok, "jitter") == 0) {
+            settings->jitter_ms = (uint32_t)value;
+            *mask |= SET_JITTER;
+        } else if (strcmp(tok, "loss") == 0) {
+            if (value > 100)
+                return -1;
+            settings->loss_pct = value;
+            *mask |= SET_LOSS;
+        } else if (strcmp(tok, "queue") == 0) {
+            if (value < 1)
+                return -1;
+            settings->queue_kb = (uint32_t)value;
+            *mask |= SET_QUEUE;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int load_script(proxy_t *proxy, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+
+        char *end;
+        double at = strtod(p, &end);
+        script_step_t step = { 0 };
+        if (end == p || at < 0 || proxy->script_len == MAX_SCRIPT_STEPS ||
+            parse_settings(end, &step.settings, &step.set_mask) < 0) {
+            fprintf(stderr, "%s:%d: invalid step\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+        step.at_us = (uint64_t)(at * 1e6);
+        if (proxy->script_len > 0 && step.at_us < proxy->script[proxy->script_len - 1].at_us) {
+            fprintf(stderr, "%s:%d: steps must be in time order\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+        proxy->script[proxy->script_len++] = step;
+    }
+    fclose(f);
+    return 0;
+}
+
+static void print_settings(proxy_t *proxy)
+{
+    const link_settings_t *s = &proxy->settings;
+    char rate[32];
+    if (s->rate_kbps)
+        snprintf(rate, sizeof(rate), "%u kbit/s", s->rate_kbps);
+    else
+        snprintf(rate, sizeof(rate), "unlimited");
+    printf("[%7.2f] link: %s, delay %u ms, jitter %u ms, loss %.2f%%, queue %u KB\n",
+           elapsed_s(proxy), rate, s->delay_ms, s->jitter_ms, s->loss_pct, s->queue_kb);
+}
+
+static void run_script(proxy_t *proxy, uint64_t now)
+{
+    bool changed = false;
+    while (proxy->script_start_us && proxy->script_next < proxy->script_len &&
+           now - proxy->script_start_us >= proxy->script[proxy->script_next].at_us) {
+        const script_step_t *step = &proxy->script[proxy->script_next++];
+        link_settings_t *s = &proxy->settings;
+        if (step->set_mask & SET_RATE)
+            s->rate_kbps = step->settings.rate_kbps;
+        if (step->set_mask & SET_DELAY)
+            s->delay_ms = step->settings.delay_ms;
+        if (step->set_mask & SET_JITTER)
+            s->jitter_ms = step->settings.jitter_ms;
+        if (step->set_mask & SET_LOSS)
+            s->loss_pct = step->settings.loss_pct;
+        if (step->set_mask & SET_QUEUE)
+            s->queue_kb = step->settings.queue_kb;
+        changed = true;
+    }
+    if (changed)
+        print_settings(proxy);
+}
+
+// When a packet of len bytes that arrives now leaves the far end of the link
+static uint64_t link_schedule(proxy_t *proxy, uint64_t *link_free_us, size_t len, uint64_t now)
+{
+    const link_settings_t *s = &proxy->settings;
+    uint64_t start = *link_free_us > now ? *link_free_us : now;
+    uint64_t serialize_us = s->rate_kbps ? (uint64_t)len * 8000 / s->rate_kbps : 0;
+    *link_free_us = start + serialize_us;
+
+    uint64_t release = *link_free_us + (uint64_t)s->delay_ms * 1000;
+    if (s->jitter_ms)
+        release += (uint64_t)(random_unit(proxy) * s->jitter_ms * 1000);
+    return release;
+}
+
+static chunk_t *chunk_new(const void *data, size_t len)
+{
+    chunk_t *chunk = malloc(sizeof(chunk_t) + len);
+    if (!chunk)
+        return NULL;
+    chunk->next = NULL;
+    chunk->len = len;
+    chunk->off = 0;
+    memcpy(chunk->data, data, len);
+    return chunk;
+}
+
+static void queue_free(chunk_t **head, chunk_t **tail, size_t *queued)
+{
+    while (*head) {
+        chunk_t *next = (*head)->next;
+        free(*head);
+        *head = next;
+    }
+    *tail = NULL;
+    *queued = 0;
+}
+
+static void tcp_enqueue(proxy_t *proxy, link_dir_t *dir, const uint8_t *data, size_t len, uint64_t now)
+{
+    if (len == 0)
+        return;
+    chunk_t *chunk = chunk_new(data, len);
+    if (!chunk)
+        return;
+
+    uint64_t release = link_schedule(proxy, &dir->link_free_us, len, now);
+
+    // A lost segment is resent after a retransmission timeout
+    double loss = proxy->settings.loss_pct / 100.0;
+    if (loss > 0) {
+        size_t segments = (len + TCP_SEGMENT - 1) / TCP_SEGMENT;
+        for (size_t i = 0; i < segments; i++) {
+            if (random_unit(proxy) < loss) {
+                uint64_t rto = proxy->settings.delay_ms * 3000ULL;
+                release += rto > MIN_RTO_US ? rto : MIN_RTO_US;
+                proxy->stats.tcp_stalls++;
+                break;
+            }
+        }
+    }
+
+    // TCP delivers in order, so nothing overtakes a delayed chunk
+    if (release < dir->last_release_us)
+        release = dir->last_release_us;
+    dir->last_release_us = release;
+    chunk->release_us = release;
+
+    if (dir->tail)
+        dir->tail->next = chunk;
+    else
+        dir->head = chunk;
+    dir->tail = chunk;
+    dir->queued += len;
+}
+
+static void record_frame(proxy_t *proxy, uint8_t mode, uint64_t timestamp_us, uint64_t now)
+{
+    if (mode <= ENCODING_MODE_H264)
+        proxy->stats.frames[mode]++;
+
+    if (proxy->last_mode != mode) {
+        if (proxy->last_mode >= 0)
+            printf("[%7.2f] mode switch: %s -> %s\n", elapsed_s(proxy), mode_name(proxy->last_mode), mode_name(mode));
+        if (proxy->csv && proxy->last_mode >= 0)
+            fprintf(proxy->csv, "# %.3f mode %s -> %s\n", elapsed_s(proxy), mode_name(proxy->last_mode), mode_name(mode));
+        proxy->last_mode = mode;
+    }
+
+    if (timestamp_us && now >= timestamp_us && proxy->stats.latency_count < MAX_LATENCY_SAMPLES)
+        proxy->stats.latency_ms[proxy->stats.latency_count++] = (now - timestamp_us) / 1000.0;
+}
+
+static uint64_t decode_timestamp(uint64_t raw)
+{
+    return ((uint64_t)ntohl((uint32_t)(raw >> 32)) << 32) | ntohl((uint32_t)raw);
+}
+
+// A whole message went through (prefix holds the start of its payload)
+static void downstream_message(proxy_t *proxy, const msg_parser_t *parser, uint64_t now)
+{
+    const message_header_t *header = (const message_header_t *)parser->header;
+
+    if (header->type == MSG_CLIENT_HELLO && parser->prefix_have >= sizeof(client_hello_t)) {
+        const client_hello_t *hello = (const client_hello_t *)parser->prefix;
+        proxy->encrypted = hello->flags & CLIENT_HELLO_FLAG_ENCRYPT;
+        if (proxy->encrypted) {
+            // Records from here on are ciphertext
+            proxy->down.parser.enabled = false;
+            proxy->up.parser.enabled = false;
+            printf("[%7.2f] encrypted session: relaying without inspection\n", elapsed_s(proxy));
+        }
+        return;
+    }
+
+    if (header->type == MSG_FRAME && parser->prefix_have >= sizeof(frame_message_t)) {
+        frame_message_t frame;
+        memcpy(&frame, parser->prefix, sizeof(frame));
+        record_frame(proxy, frame.encoding_mode, decode_timestamp(frame.timestamp_us), now);
+    }
+}
+
+// Follow the streamer's message framing over bytes as they are delivered
+static void parser_feed(proxy_t *proxy, msg_parser_t *parser, const uint8_t *data, size_t len, uint64_t now)
+{
+    while (len > 0 && parser->enabled) {
+        if (parser->header_have < sizeof(message_header_t)) {
+            size_t n = sizeof(message_header_t) - parser->header_have;
+            if (n > len)
+                n = len;
+            memcpy(parser->header + parser->header_have, data, n);
+            parser->header_have += n;
+            data += n;
+            len -= n;
+            if (parser->header_have < sizeof(message_header_t))
+                return;
+
+            const message_header_t *header = (const message_header_t *)parser->header;
+            parser->body_left = ntohl(header->length);
+            parser->prefix_have = 0;
+            parser->prefix_want = parser->body_left < PREFIX_BYTES ? parser->body_left : PREFIX_BYTES;
+            parser->extra_done = false;
+        }
+
+        if (parser->prefix_have < parser->prefix_want) {
+            size_t n = parser->prefix_want - parser->prefix_have;
+            if (n > len)
+                n = len;
+            memcpy(parser->prefix + parser->prefix_have, data, n);
+            parser->prefix_have += n;
+            parser->body_left -= n;
+            data += n;
+            len -= n;
+        }
+
+        size_t n = parser->body_left < len ? parser->body_left : len;
+        parser->body_left -= n;
+        data += n;
+        len -= n;
+
+        if (parser->body_left == 0 && parser->prefix_have == parser->prefix_want) {
+            // FRAME and AUDIO data follows the struct without being counted in the header
+            const message_header_t *header = (const message_header_t *)parser->header;
+            if (!parser->extra_done) {
+                parser->extra_done = true;
+                if (header->type == MSG_FRAME && parser->prefix_have >= sizeof(frame_message_t)) {
+                    frame_message_t frame;
+                    memcpy(&frame, parser->prefix, sizeof(frame));
+                    parser->body_left = ntohl(frame.size);
+                } else if (header->type == MSG_AUDIO && parser->prefix_have >= sizeof(audio_message_t)) {
+                    audio_message_t audio;
+                    memcpy(&audio, parser->prefix, sizeof(audio));
+                    parser->body_left = ntohl(audio.data_size);
+                }
+                if (parser->body_left > 0)
+                    continue;
+            }
+            downstream_message(proxy, parser, now);
+            parser->header_have = 0;
+        }
+    }
+}
+
+static int open_udp_relay(proxy_t *proxy)
+{
+    if (proxy->udp_fd >= 0)
+        return 0;
+
+    proxy->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    int size = 4 * 1024 * 1024;
+    if (proxy->udp_fd < 0 || bind(proxy->udp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("UDP relay");
+        if (proxy->udp_fd >= 0)
+            close(proxy->udp_fd);
+        proxy->udp_fd = -1;
+        return -1;
+    }
+    setsockopt(proxy->udp_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(proxy->udp_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    return 0;
+}
+
+static uint16_t udp_relay_port(proxy_t *proxy)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(proxy->udp_fd, (struct sockaddr *)&addr, &len) < 0)
+        return 0;
+    return addr.sin_port;
+}
+
+// Receiver -> streamer. Until the HELLO has gone by, whole messages are collected so the
+// HELLO's UDP port can be pointed at the relay (receiver messages carry no data beyond
+// header.length, and UDP video only runs on unencrypted sessions)
+static void upstream_read(proxy_t *proxy, const uint8_t *data, size_t len, uint64_t now)
+{
+    link_dir_t *dir = &proxy->up;
+    uint8_t *pending = proxy->up_pending;
+
+    if (!dir->parser.enabled || proxy->hello_seen) {
+        if (proxy->up_pending_len) {
+            tcp_enqueue(proxy, dir, pending, proxy->up_pending_len, now);
+            proxy->up_pending_len = 0;
+        }
+        tcp_enqueue(proxy, dir, data, len, now);
+        return;
+    }
+
+    if (proxy->up_pending_len + len > sizeof(proxy->up_pending)) {
+        dir->parser.enabled = false;  // Not the protocol we know; just relay
+        upstream_read(proxy, data, len, now);
+        return;
+    }
+    memcpy(pending + proxy->up_pending_len, data, len);
+    proxy->up_pending_len += len;
+
+    while (proxy->up_pending_len >= sizeof(message_header_t)) {
+        message_header_t header;
+        memcpy(&header, pending, sizeof(header));
+        size_t msg_len = sizeof(header) + ntohl(header.length);
+        if (msg_len > sizeof(proxy->up_pending)) {
+            dir->parser.enabled = false;
+            upstream_read(proxy, NULL, 0, now);
+            return;
+        }
+        if (proxy->up_pending_len < msg_len)
+            return;
+
+        if (header.type == MSG_HELLO && msg_len >= sizeof(header) + sizeof(hello_message_t)) {
+            proxy->hello_seen = true;
+            uint8_t *payload = pending + sizeof(header);
+            hello_message_t hello;
+            memcpy(&hello, payload, sizeof(hello));
+            size_t offset = sizeof(hello) + ntohs(hello.display_name_len) +
+                            ntohs(hello.num_modes) * sizeof(display_mode_t);
+            hello_transport_t transport;
+            if (offset + sizeof(transport) <= msg_len - sizeof(header)) {
+                memcpy(&transport, payload + offset, sizeof(transport));
+                if (transport.udp_port != 0 && open_udp_relay(proxy) == 0) {
+                    proxy->udp_target_port = transport.udp_port;
+                    transport.udp_port = udp_relay_port(proxy);
+                    memcpy(payload + offset, &transport, sizeof(transport));
+                    printf("[%7.2f] UDP video: streamer -> proxy port %u -> receiver port %u\n", elapsed_s(proxy),
+                           ntohs(transport.udp_port), ntohs(proxy->udp_target_port));
+                }
+            }
+        }
+
+        tcp_enqueue(proxy, dir, pending, msg_len, now);
+        memmove(pending, pending + msg_len, proxy->up_pending_len - msg_len);
+        proxy->up_pending_len -= msg_len;
+
+        if (proxy->hello_seen && proxy->up_pending_len) {
+            tcp_enqueue(proxy, dir, pending, proxy->up_pending_len, now);
+            proxy->up_pending_len = 0;
+        }
+    }
+}
+
+// Write what is due; returns -1 if the connection failed
+static int tcp_flush(proxy_t *proxy, link_dir_t *dir, uint64_t now)
+{
+    while (dir->head && dir->head->release_us <= now) {
+        chunk_t *chunk = dir->head;
+        ssize_t n = write(dir->out_fd, chunk->data + chunk->off, chunk->len - chunk->off);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                return 0;
+            fprintf(stderr, "%s: write: %s\n", dir->name, strerror(errno));
+            return -1;
+        }
+        if (dir == &proxy->down) {
+            proxy->stats.bytes_out += n;
+            parser_feed(proxy, &dir->parser, chunk->data + chunk->off, n, now);
+        }
+        chunk->off += n;
+        if (chunk->off < chunk->len)
+            return 0;
+
+        dir->head = chunk->next;
+        if (!dir->head)
+            dir->tail = NULL;
+        dir->queued -= chunk->len;
+        free(chunk);
+    }
+
+    if (!dir->head && dir->in_eof && !dir->out_shut) {
+        shutdown(dir->out_fd, SHUT_WR);
+        dir->out_shut = true;
+    }
+    return 0;
+}
+
+// Returns -1 if the connection failed
+static int tcp_read(proxy_t *proxy, link_dir_t *dir, uint64_t now)
+{
+    uint8_t buf[READ_CHUNK];
+    ssize_t n = read(dir->in_fd, buf, sizeof(buf));
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return 0;
+        if (errno == ECONNRESET) {
+            dir->in_eof = true;
+            return 0;
+        }
+        fprintf(stderr, "%s: read: %s\n", dir->name, strerror(errno));
+        return -1;
+    }
+    if (n == 0) {
+        dir->in_eof = true;
+        return 0;
+    }
+
+    if (dir == &proxy->down) {
+        proxy->stats.bytes_in += n;
+        tcp_enqueue(proxy, dir, buf, n, now);
+    } else {
+        upstream_read(proxy, buf, n, now);
+    }
+    return 0;
+}
+
+static void udp_deliver_stats(proxy_t *proxy, const uint8_t *data, size_t len, uint64_t now)
+{
+    udp_video_header_t header;
+    if (len < sizeof(header))
+        return;
+    memcpy(&header, data, sizeof(header));
+
+    uint32_t seq = ntohl(header.frame_seq);
+    uint16_t index = ntohs(header.packet_index);
+    uint16_t count = ntohs(header.packet_count);
+    if (index >= count)
+        return;  // Parity
+
+    if (header.offset == 0 && len >= sizeof(header) + sizeof(frame_message_t)) {
+        frame_message_t frame;
+        memcpy(&frame, data + sizeof(header), sizeof(frame));
+        proxy->udp_frame_seq = seq;
+        proxy->udp_frame_ts = decode_timestamp(frame.timestamp_us);
+        proxy->udp_frame_mode = frame.encoding_mode;
+    }
+    if (index == count - 1 && seq == proxy->udp_frame_seq && proxy->udp_frame_ts)
+        record_frame(proxy, proxy->udp_frame_mode, proxy->udp_frame_ts, now);
+}
+
+static void udp_read(proxy_t *proxy, uint64_t now)
+{
+    uint8_t buf[65536];
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(proxy->udp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0)
+            return;
+
+        struct sockaddr_in target = proxy->target;
+        target.sin_port = proxy->udp_target_port;
+        if (from.sin_addr.s_addr == target.sin_addr.s_addr && from.sin_port == target.sin_port) {
+            // Receiver -> streamer (nothing uses this today); passed straight back
+            if (proxy->udp_streamer_known)
+                sendto(proxy->udp_fd, buf, n, 0, (struct sockaddr *)&proxy->udp_streamer, sizeof(proxy->udp_streamer));
+            continue;
+        }
+
+        proxy->udp_streamer = from;
+        proxy->udp_streamer_known = true;
+        proxy->stats.bytes_in += n;
+
+        if ((proxy->settings.loss_pct > 0 && random_unit(proxy) * 100 < proxy->settings.loss_pct) ||
+            proxy->udp_queued + n > (size_t)proxy->settings.queue_kb * 1024) {
+            proxy->stats.udp_dropped++;
+            continue;
+        }
+
+        chunk_t *chunk = chunk_new(buf, n);
+        if (!chunk)
+            continue;
+        chunk->release_us = link_schedule(proxy, &proxy->udp_link_free_us, n, now);
+
+        // Datagrams are released in time order, so jitter may reorder them like a real link
+        chunk_t **pos = &proxy->udp_head;
+        while (*pos && (*pos)->release_us <= chunk->release_us)
+            pos = &(*pos)->next;
+        chunk->next = *pos;
+        *pos = chunk;
+        if (!chunk->next)
+            proxy->udp_tail = chunk;
+        proxy->udp_queued += n;
+    }
+}
+
+static void udp_flush(proxy_t *proxy, uint64_t now)
+{
+    struct sockaddr_in target = proxy->target;
+    target.sin_port = proxy->udp_target_port;
+
+    while (proxy->udp_head && proxy->udp_head->release_us <= now) {
+        chunk_t *chunk = proxy->udp_head;
+        if (sendto(proxy->udp_fd, chunk->data, chunk->len, 0, (struct sockaddr *)&target, sizeof(target)) < 0 &&
+            errno == EAGAIN)
+            return;
+        proxy->stats.bytes_out += chunk->len;
+        udp_deliver_stats(proxy, chunk->data, chunk->len, now);
+
+        proxy->udp_head = chunk->next;
+        if (!proxy->udp_head)
+            proxy->udp_tail = NULL;
+        proxy->udp_queued -= chunk->len;
+        free(chunk);
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p)
+{
+    if (count == 0)
+        return 0;
+    int index = (int)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void report(proxy_t *proxy, double seconds)
+{
+    interval_stats_t *s = &proxy->stats;
+    qsort(s->latency_ms, s->latency_count, sizeof(double), compare_double);
+    double p50 = percentile(s->latency_ms, s->latency_count, 50);
+    double p95 = percentile(s->latency_ms, s->latency_count, 95);
+    double max = s->latency_count ? s->latency_ms[s->latency_count - 1] : 0;
+    double offered = s->bytes_in * 8 / seconds / 1e6;
+    double delivered = s->bytes_out * 8 / seconds / 1e6;
+
+    printf("[%7.2f] in %6.2f Mbit/s, out %6.2f Mbit/s, frames full/dirty/h264 %3llu/%3llu/%3llu, "
+           "latency p50 %6.1f p95 %6.1f max %6.1f ms, queued %zu KB, UDP drops %llu, TCP stalls %llu\n",
+           elapsed_s(proxy), offered, delivered,
+           (unsigned long long)s->frames[0], (unsigned long long)s->frames[1], (unsigned long long)s->frames[2],
+           p50, p95, max, (proxy->down.queued + proxy->udp_queued) / 1024,
+           (unsigned long long)s->udp_dropped, (unsigned long long)s->tcp_stalls);
+
+    if (proxy->csv) {
+        const link_settings_t *l = &proxy->settings;
+        fprintf(proxy->csv, "%.3f,%u,%u,%u,%.2f,%.3f,%.3f,%llu,%llu,%llu,%.2f,%.2f,%.2f,%llu,%llu,%s\n",
+                elapsed_s(proxy), l->rate_kbps, l->delay_ms, l->jitter_ms, l->loss_pct, offered, delivered,
+                (unsigned long long)s->frames[0], (unsigned long long)s->frames[1], (unsigned long long)s->frames[2],
+                p50, p95, max, (unsigned long long)s->udp_dropped, (unsigned long long)s->tcp_stalls,
+                proxy->last_mode >= 0 ? mode_name(proxy->last_mode) : "");
+        fflush(proxy->csv);
+    }
+
+    interval_stats_t *t = &proxy->total;
+    t->bytes_in += s->bytes_in;
+    t->bytes_out += s->bytes_out;
+    for (int i = 0; i < 3; i++)
+        t->frames[i] += s->frames[i];
+    t->udp_dropped += s->udp_dropped;
+    t->tcp_stalls += s->tcp_stalls;
+    for (int i = 0; i < s->latency_count && t->latency_count < MAX_LATENCY_SAMPLES; i++)
+        t->latency_ms[t->latency_count++] = s->latency_ms[i];
+    memset(s, 0, sizeof(*s));
+}
+
+static void end_session(proxy_t *proxy)
+{
+    close(proxy->down.in_fd);
+    close(proxy->down.out_fd);
+    queue_free(&proxy->down.head, &proxy->down.tail, &proxy->down.queued);
+    queue_free(&proxy->up.head, &proxy->up.tail, &proxy->up.queued);
+    proxy->up_pending_len = 0;
+    proxy->session_active = false;
+    printf("[%7.2f] session closed\n", elapsed_s(proxy));
+}
+
+static int start_session(proxy_t *proxy, int streamer_fd)
+{
+    int receiver_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (receiver_fd < 0 || connect(receiver_fd, (struct sockaddr *)&proxy->target, sizeof(proxy->target)) < 0) {
+        perror("connect to receiver");
+        if (receiver_fd >= 0)
+            close(receiver_fd);
+        close(streamer_fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(streamer_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(receiver_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(streamer_fd, F_SETFL, fcntl(streamer_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(receiver_fd, F_SETFL, fcntl(receiver_fd, F_GETFL) | O_NONBLOCK);
+
+    link_dir_t *down = &proxy->down, *up = &proxy->up;
+    memset(down, 0, sizeof(*down));
+    memset(up, 0, sizeof(*up));
+    down->name = "streamer->receiver";
+    down->in_fd = streamer_fd;
+    down->out_fd = receiver_fd;
+    down->parser.enabled = true;
+    up->name = "receiver->streamer";
+    up->in_fd = receiver_fd;
+    up->out_fd = streamer_fd;
+    up->parser.enabled = true;
+    proxy->encrypted = false;
+    proxy->hello_seen = false;
+    proxy->session_active = true;
+
+    if (!proxy->script_start_us) {
+        proxy->script_start_us = now_us();
+        run_script(proxy, proxy->script_start_us);
+    }
+    printf("[%7.2f] session started\n", elapsed_s(proxy));
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s --target HOST:PORT [OPTIONS]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --listen PORT     Port the streamer connects to (default: %d)\n", DEFAULT_TV_PORT);
+    fprintf(stderr, "  --target HOST:PORT  Receiver to relay to\n");
+    fprintf(stderr, "  --rate KBIT       Bandwidth cap in kbit/s, 0 = unlimited (default: 0)\n");
+    fprintf(stderr, "  --delay MS        One-way delay (default: 0)\n");
+    fprintf(stderr, "  --jitter MS       Random extra delay, 0 to MS (default: 0)\n");
+    fprintf(stderr, "  --loss PCT        Packet loss (default: 0)\n");
+    fprintf(stderr, "  --queue KB        Router queue before TCP backs up / UDP drops (default: 1024)\n");
+    fprintf(stderr, "  --script FILE     Change the settings over time (see the top of impair_proxy.c)\n");
+    fprintf(stderr, "  --csv FILE        Write per-second statistics as CSV\n");
+    fprintf(stderr, "  --seed N          Random seed for jitter and loss (default: 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+    static proxy_t proxy;
+    int listen_port = DEFAULT_TV_PORT;
+    const char *target = NULL;
+    const char *script = NULL;
+    const char *csv = NULL;
+    uint64_t seed = 1;
+
+    proxy.settings.queue_kb = 1024;
+    proxy.udp_fd = -1;
+    proxy.last_mode = -1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        char settings[64];
+        uint32_t mask = 0;
+        if (!value) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+        if (strcmp(arg, "--listen") == 0) {
+            listen_port = atoi(value);
+        } else if (strcmp(arg, "--target") == 0) {
+            target = value;
+        } else if (strcmp(arg, "--script") == 0) {
+            script = value;
+        } else if (strcmp(arg, "--csv") == 0) {
+            csv = value;
+        } else if (strcmp(arg, "--seed") == 0) {
+            seed = strtoull(value, NULL, 0);
+        } else if (strncmp(arg, "--", 2) == 0 &&
+                   snprintf(settings, sizeof(settings), "%s=%s", arg + 2, value) < (int)sizeof(settings) &&
+                   parse_settings(settings, &proxy.settings, &mask) == 0 && mask) {
+            // --rate, --delay, --jitter, --loss, --queue
+        } else {
+            fprintf(stderr, "Invalid option: %s %s\n", arg, value);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    proxy.rng = seed ? seed : 1;
+
+    if (!target || listen_port <= 0 || listen_port > 65535) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (script && load_script(&proxy, script) < 0)
+        return 1;
+
+    // Resolve the receiver
+    char host[256];
+    const char *colon = strrchr(target, ':');
+    if (!colon || (size_t)(colon - target) >= sizeof(host)) {
+        fprintf(stderr, "Target must be HOST:PORT: %s\n", target);
+        return 1;
+    }
+    memcpy(host, target, colon - target);
+    host[colon - target] = '\0';
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *res;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", target);
+        return 1;
+    }
+    memcpy(&proxy.target, res->ai_addr, sizeof(proxy.target));
+    freeaddrinfo(res);
+
+    proxy.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(proxy.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(listen_port),
+                                .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (proxy.listen_fd < 0 || bind(proxy.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(proxy.listen_fd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    if (csv) {
+        proxy.csv = fopen(csv, "w");
+        if (!proxy.csv) {
+            perror(csv);
+            return 1;
+        }
+        fprintf(proxy.csv, "time_s,rate_kbps,delay_ms,jitter_ms,loss_pct,in_mbps,out_mbps,"
+                           "frames_full,frames_dirty,frames_h264,latency_p50_ms,latency_p95_ms,latency_max_ms,"
+                           "udp_drops,tcp_stalls,mode\n");
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Relaying port %d to %s\n", listen_port, target);
+    print_settings(&proxy);
+
+    uint64_t next_report_us = now_us() + REPORT_INTERVAL_US;
+    uint64_t last_report_us = now_us();
+
+    while (!stop_requested) {
+        uint64_t now = now_us();
+        run_script(&proxy, now);
+
+        if (proxy.session_active) {
+            if (tcp_flush(&proxy, &proxy.down, now) < 0 || tcp_flush(&proxy, &proxy.up, now) < 0 ||
+                (proxy.down.out_shut && proxy.up.out_shut)) {
+                end_session(&proxy);
+            }
+        }
+        if (proxy.udp_fd >= 0)
+            udp_flush(&proxy, now);
+
+        if (now >= next_report_us) {
+            if (proxy.script_start_us)
+                report(&proxy, (now - last_report_us) / 1e6);
+            last_report_us = now;
+            next_report_us = now + REPORT_INTERVAL_US;
+        }
+
+        // Sleep until something is due
+        uint64_t wake = next_report_us;
+        if (proxy.session_active && proxy.down.head && proxy.down.head->release_us < wake)
+            wake = proxy.down.head->release_us;
+        if (proxy.session_active && proxy.up.head && proxy.up.head->release_us < wake)
+            wake = proxy.up.head->release_us;
+        if (proxy.udp_head && proxy.udp_head->release_us < wake)
+            wake = proxy.udp_head->release_us;
+        if (proxy.script_start_us && proxy.script_next < proxy.script_len &&
+            proxy.script_start_us + proxy.script[proxy.script_next].at_us < wake)
+            wake = proxy.script_start_us + proxy.script[proxy.script_next].at_us;
+        int timeout_ms = wake > now ? (int)((wake - now + 999) / 1000) : 0;
+
+        struct pollfd fds[4];
+        int nfds = 0;
+        int listen_idx = -1, down_idx = -1, up_idx = -1, udp_idx = -1;
+        if (!proxy.session_active) {
+            listen_idx = nfds;
+            fds[nfds++] = (struct pollfd){ .fd = proxy.listen_fd, .events = POLLIN };
+        } else {
+            // A full router queue stops reading, so TCP backs up to the sender
+            size_t limit = (size_t)proxy.settings.queue_kb * 1024;
+            down_idx = nfds;
+            fds[nfds++] = (struct pollfd){
+                .fd = proxy.down.in_fd,
+                .events = (!proxy.down.in_eof && proxy.down.queued < limit ? POLLIN : 0) |
+                          (proxy.up.head && proxy.up.head->release_us <= now ? POLLOUT : 0) };
+            up_idx = nfds;
+            fds[nfds++] = (struct pollfd){
+                .fd = proxy.up.in_fd,
+                .events = (!proxy.up.in_eof && proxy.up.queued < limit ? POLLIN : 0) |
+                          (proxy.down.head && proxy.down.head->release_us <= now ? POLLOUT : 0) };
+        }
+        if (proxy.udp_fd >= 0) {
+            udp_idx = nfds;
+            fds[nfds++] = (struct pollfd){ .fd = proxy.udp_fd, .events = POLLIN };
+        }
+
+        if (poll(fds, nfds, timeout_ms) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+        now = now_us();
+
+        if (listen_idx >= 0 && (fds[listen_idx].revents & POLLIN)) {
+            int fd = accept4(proxy.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0)
+                start_session(&proxy, fd);
+        }
+        if (down_idx >= 0 && (fds[down_idx].revents & (POLLIN | POLLHUP | POLLERR)) && !proxy.down.in_eof &&
+            tcp_read(&proxy, &proxy.down, now) < 0) {
+            end_session(&proxy);
+        } else if (up_idx >= 0 && (fds[up_idx].revents & (POLLIN | POLLHUP | POLLERR)) && !proxy.up.in_eof &&
+                   tcp_read(&proxy, &proxy.up, now) < 0) {
+            end_session(&proxy);
+        }
+        if (udp_idx >= 0 && (fds[udp_idx].revents & POLLIN))
+            udp_read(&proxy, now);
+    }
+
+    if (proxy.session_active)
+        end_session(&proxy);
+
+    // Summary
+    interval_stats_t *t = &proxy.total;
+    qsort(t->latency_ms, t->latency_count, sizeof(double), compare_double);
+    printf("\nTotal: %.1f MB in, %.1f MB out, frames full/dirty/h264 %llu/%llu/%llu, "
+           "latency p50 %.1f p95 %.1f p99 %.1f ms, UDP drops %llu, TCP stalls %llu\n",
+           t->bytes_in / 1e6, t->bytes_out / 1e6,
+           (unsigned long long)t->frames[0], (unsigned long long)t->frames[1], (unsigned long long)t->frames[2],
+           percentile(t->latency_ms, t->latency_count, 50), percentile(t->latency_ms, t->latency_count, 95),
+           percentile(t->latency_ms, t->latency_count, 99),
+           (unsigned long long)t->udp_dropped, (unsigned long long)t->tcp_stalls);
+
+    if (proxy.csv)
+        fclose(proxy.csv);
+    if (proxy.udp_fd >= 0)
+        close(proxy.udp_fd);
+    close(proxy.listen_fd);
+    return 0;
+}
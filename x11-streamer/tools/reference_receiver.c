@@ -0,0 +1,1224 @@
+/*
+ * Headless reference receiver: the Android app's side of the protocol in plain C.
+ *
+ * Usage: reference-receiver [OPTIONS]
+ *
+ * Listens for one streamer connection, answers CLIENT_HELLO (Noise responder and PIN
+ * included) with a HELLO, then rebuilds every FRAME into a local picture the way the
+ * app draws it: full frames, dirty rectangles, and frames arriving over the UDP video
+ * channel. H.264 frames are counted, and decoded only when built with libavcodec.
+ * Reports receive throughput, per-frame latency (streamer capture timestamp to picture
+ * rebuilt, valid on loopback where both share CLOCK_MONOTONIC) and PING round trips.
+ *
+ * With --latency-stamp (and the streamer's --latency-stamp) the capture time is also
+ * read back from the pixels of every rebuilt or decoded picture, giving glass-to-glass
+ * latency percentiles per encoding mode that include encode, queueing and decode.
+ *
+ * With --verify the receiver runs the same frame source as the streamer and checks
+ * each rebuilt picture is bit-identical to one of the source's next frames (frames the
+ * streamer skipped for a congested receiver are allowed for).
+ *
+ * Loopback example:
+ *   reference-receiver --pin 1234 --verify synthetic:moving-windows:1280x720 &
+ *   x11-streamer 127.0.0.1 --nocrypt --pin 1234 --source synthetic:moving-windows:1280x720
+ *
+ * Glass-to-glass latency:
+ *   reference-receiver --latency-stamp &
+ *   x11-streamer 127.0.0.1 --nocrypt --source synthetic:moving-windows:1920x1080 --latency-stamp
+ *
+ * With --av-sync the app's A/V sync controller (tv-receiver/.../cpp/av_sync.c) plays
+ * the audio into a simulated DAC running at its nominal rate on this machine's clock,
+ * schedules every frame against it and reports the lip-sync error the app would show,
+ * with the resampling correction it needed for the streamer's sound card clock.
+ */
+#define _GNU_SOURCE
+#include "protocol.h"
+#include "audio_capture.h"
+#include "noise_encryption.h"
+#include "udp_video.h"
+#include "frame_source.h"
+#include "latency_stamp.h"
+#include "x11_streamer.h"
+#include "av_sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_LIBAVCODEC
+#include <libavcodec/avcodec.h>
+#endif
+
+#define REPORT_INTERVAL_US 1000000ULL
+#define PING_INTERVAL_US 1000000ULL
+#define FEEDBACK_INTERVAL_US 500000ULL   // VIDEO_FEEDBACK cadence, as in the app
+#define MAX_FRAME_PAYLOAD (256u * 1024 * 1024)
+#define VERIFY_WINDOW 64                 // Source frames a rebuilt picture may be ahead by
+#define UDP_RECV_BUFFER (8 * 1024 * 1024)
+
+typedef struct {
+    uint32_t *us;
+    size_t count;
+    size_t cap;
+} latency_list_t;
+
+typedef struct {
+    uint64_t frames[3];         // Per encoding mode (full, dirty rects, H.264)
+    uint64_t frames_udp;
+    uint64_t bytes;             // Everything received, headers included
+    uint64_t audio_packets;
+    uint64_t audio_opus_packets;
+    uint64_t audio_bytes;
+    latency_list_t latency;     // FRAME timestamp to picture rebuilt, one entry per frame
+    latency_list_t glass[3];    // Stamped capture time to picture, per encoding mode
+    uint64_t unstamped;         // Pictures with no readable stamp (--latency-stamp)
+    latency_list_t lipsync;     // |lip-sync error| per scheduled frame (--av-sync)
+} receiver_stats_t;
+
+typedef struct {
+    int fd;
+    noise_encryption_context_t *noise;
+    uint16_t pin;               // 0xFFFF = no PIN required
+    bool accept_udp;
+    bool accept_opus;           // Announce Opus audio in CAPABILITIES
+    uint32_t native_audio_rate; // Native output format announced in CAPABILITIES (0 = none)
+    uint16_t native_audio_channels;
+    uint32_t last_audio_rate;   // Format of the latest AUDIO message
+    uint16_t last_audio_channels;
+    const char *display_name;
+    display_mode_t mode;
+
+    // UDP video channel
+    int udp_fd;
+    udp_video_reassembler_t *reasm;
+    uint8_t udp_packet[UDP_VIDEO_MAX_DATAGRAM + 64];
+
+    // Rebuilt picture
+    uint8_t *picture;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    bool picture_valid;         // Holds a complete image (not just patches over black)
+    bool latency_stamp;         // Read capture stamps back from the pictures
+
+    // A/V sync against a simulated DAC (--av-sync)
+    bool av_sync_enabled;
+    av_sync_t *av_sync;
+    uint32_t audio_rate;        // Format av_sync was created for
+    uint16_t audio_channels;
+    uint64_t dac_queued;        // Output frames handed to the DAC
+    double dac_played;
+    uint64_t dac_last_us;       // When dac_played was last advanced
+    bool dac_dry;
+    int16_t *sync_out;
+    size_t sync_out_cap;        // In frames
+
+#ifdef HAVE_LIBAVCODEC
+    AVCodecContext *h264;
+    AVPacket *h264_packet;
+    AVFrame *h264_frame;
+    bool h264_unavailable;
+#endif
+
+    uint8_t *payload;           // TCP frame payload buffer
+    size_t payload_cap;
+
+    // Pixel-exactness check
+    frame_source_t *verify_source;
+    uint64_t *source_hashes;    // Hash of each source frame generated so far
+    size_t num_source_hashes;
+    size_t source_hash_cap;
+    size_t source_pos;          // Oldest source frame still expected
+    uint64_t verified;
+    uint64_t mismatched;
+    uint64_t unverifiable;      // H.264, or dirty rectangles before the first complete picture
+
+    uint64_t ping_sent_us;
+    double rtt_ms;
+    double rtt_sum_ms;
+    uint64_t rtt_count;
+    uint64_t decode_errors;
+
+    receiver_stats_t total;
+    receiver_stats_t interval;
+} receiver_t;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void signal_handler(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+// Same clock as audio_get_timestamp_us(), which stamps the streamer's frames
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+// The streamer sends 64-bit timestamps as two big-endian halves (low half first)
+static uint64_t timestamp_from_net(uint64_t raw)
+{
+    return ((uint64_t)ntohl((uint32_t)(raw >> 32)) << 32) | ntohl((uint32_t)raw);
+}
+
+static void latency_add(latency_list_t *list, uint32_t latency_us)
+{
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 1024;
+        uint32_t *us = realloc(list->us, cap * sizeof(uint32_t));
+        if (!us)
+            return;
+        list->us = us;
+        list->cap = cap;
+    }
+    list->us[list->count++] = latency_us;
+}
+
+// Clears the counters but keeps the latency buffers for reuse
+static void stats_reset(receiver_stats_t *stats)
+{
+    receiver_stats_t kept = *stats;
+    memset(stats, 0, sizeof(*stats));
+    stats->latency = kept.latency;
+    stats->latency.count = 0;
+    stats->lipsync = kept.lipsync;
+    stats->lipsync.count = 0;
+    for (int i = 0; i < 3; i++) {
+        stats->glass[i] = kept.glass[i];
+        stats->glass[i].count = 0;
+    }
+}
+
+static void stats_free(receiver_stats_t *stats)
+{
+    free(stats->latency.us);
+    free(stats->lipsync.us);
+    for (int i = 0; i < 3; i++)
+        free(stats->glass[i].us);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void latency_sort(latency_list_t *list)
+{
+    if (list->count > 1)
+        qsort(list->us, list->count, sizeof(uint32_t), compare_u32);
+}
+
+// List must be sorted; p in [0, 1]
+static double latency_percentile_ms(const latency_list_t *list, double p)
+{
+    if (list->count == 0)
+        return 0.0;
+    size_t index = (size_t)(p * (list->count - 1) + 0.5);
+    return list->us[index] / 1000.0;
+}
+
+static double latency_average_ms(const latency_list_t *list)
+{
+    if (list->count == 0)
+        return 0.0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < list->count; i++)
+        sum += list->us[i];
+    return (double)sum / list->count / 1000.0;
+}
+
+static const char *const encoding_mode_names[3] = { "full", "dirty", "h264" };
+
+static uint64_t stats_frames(const receiver_stats_t *stats)
+{
+    return stats->frames[0] + stats->frames[1] + stats->frames[2];
+}
+
+// Read exactly len bytes of the stream (decrypting Noise records if the session is encrypted)
+// Returns 1 on success, 0 on close, -1 on error
+static int rx_read(receiver_t *rx, void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n;
+        if (rx->noise)
+            n = noise_encryption_recv(rx->noise, rx->fd, (uint8_t *)buf + got, len - got);
+        else
+            n = recv(rx->fd, (uint8_t *)buf + got, len - got, MSG_WAITALL);
+        if (n == 0 || (n < 0 && errno == ECONNRESET))
+            return 0;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        got += n;
+    }
+    rx->total.bytes += len;
+    rx->interval.bytes += len;
+    return 1;
+}
+
+static int rx_skip(receiver_t *rx, size_t len)
+{
+    static uint8_t scratch[65536];  // Holds a whole Noise record
+    while (len > 0) {
+        size_t chunk = len < sizeof(scratch) ? len : sizeof(scratch);
+        int ret = rx_read(rx, scratch, chunk);
+        if (ret <= 0)
+            return ret;
+        len -= chunk;
+    }
+    return 1;
+}
+
+static int rx_send(receiver_t *rx, message_type_t type, const void *data, size_t len)
+{
+    if (rx->noise)
+        return protocol_send_message_encrypted(rx->noise, rx->fd, type, data, len);
+    return protocol_send_message(rx->fd, type, data, len);
+}
+
+// skip_stamp leaves out the latency stamp corner, which differs between streamer and verify source
+static uint64_t hash_picture(const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t pitch,
+                             bool skip_stamp)
+{
+    // FNV-1a over 64-bit words, row by row so padding is ignored
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t row_bytes = (size_t)width * 4;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *row = pixels + (size_t)y * pitch;
+        size_t x = skip_stamp && y < LATENCY_STAMP_HEIGHT && width >= LATENCY_STAMP_WIDTH ?
+                   LATENCY_STAMP_WIDTH * 4 : 0;
+        for (; x + 8 <= row_bytes; x += 8) {
+            uint64_t word;
+            memcpy(&word, row + x, sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        for (; x < row_bytes; x++)
+            hash = (hash ^ row[x]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Hash of source frame index, generating frames up to it
+static int source_hash_at(receiver_t *rx, size_t index, uint64_t *hash)
+{
+    while (rx->num_source_hashes <= index) {
+        if (rx->num_source_hashes == rx->source_hash_cap) {
+            size_t cap = rx->source_hash_cap ? rx->source_hash_cap * 2 : 1024;
+            uint64_t *hashes = realloc(rx->source_hashes, cap * sizeof(uint64_t));
+            if (!hashes)
+                return -1;
+            rx->source_hashes = hashes;
+            rx->source_hash_cap = cap;
+        }
+        frame_buffer_t frame;
+        if (frame_source_acquire(rx->verify_source, &frame) < 0)
+            return -1;
+        rx->source_hashes[rx->num_source_hashes++] =
+            hash_picture(frame.data, frame.width, frame.height, frame.pitch, rx->latency_stamp);
+        frame_source_release(rx->verify_source, &frame);
+    }
+    *hash = rx->source_hashes[index];
+    return 0;
+}
+
+static void verify_picture(receiver_t *rx)
+{
+    if (!rx->picture_valid) {
+        rx->unverifiable++;
+        return;
+    }
+    if (rx->width != frame_source_get_width(rx->verify_source) ||
+        rx->height != frame_source_get_height(rx->verify_source)) {
+        rx->mismatched++;
+        return;
+    }
+
+    uint64_t hash = hash_picture(rx->picture, rx->width, rx->height, rx->pitch, rx->latency_stamp);
+    for (size_t i = rx->source_pos; i < rx->source_pos + VERIFY_WINDOW; i++) {
+        uint64_t expected;
+        if (source_hash_at(rx, i, &expected) < 0)
+            break;
+        if (expected == hash) {
+            // The same picture may come again (idle screen), so stay on this frame
+            rx->source_pos = i;
+            rx->verified++;
+            return;
+        }
+    }
+    rx->mismatched++;
+    if (rx->mismatched <= 5)
+        fprintf(stderr, "Picture does not match any of source frames %zu-%zu\n",
+                rx->source_pos, rx->source_pos + VERIFY_WINDOW - 1);
+}
+
+static int ensure_picture(receiver_t *rx, uint32_t width, uint32_t height, uint32_t pitch)
+{
+    if (rx->picture && rx->width == width && rx->height == height && rx->pitch == pitch)
+        return 0;
+
+    free(rx->picture);
+    rx->picture = calloc(height, pitch);  // Black, as the app starts its bitmap
+    rx->width = width;
+    rx->height = height;
+    rx->pitch = pitch;
+    rx->picture_valid = false;
+    return rx->picture ? 0 : -1;
+}
+
+#ifdef HAVE_LIBAVCODEC
+// Decode one H.264 access unit and read the stamp from its luma plane
+// Returns 0 with the stamp, -1 if no picture came out or it carried no stamp
+static int h264_decode_stamp(receiver_t *rx, const uint8_t *data, size_t len, uint64_t *stamp_us)
+{
+    if (!rx->h264) {
+        if (rx->h264_unavailable)
+            return -1;
+        const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+        rx->h264 = codec ? avcodec_alloc_context3(codec) : NULL;
+        if (rx->h264) {
+            rx->h264->thread_count = 1;  // Frame threading would add latency
+            rx->h264->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        }
+        rx->h264_packet = av_packet_alloc();
+        rx->h264_frame = av_frame_alloc();
+        if (!rx->h264 || !rx->h264_packet || !rx->h264_frame || avcodec_open2(rx->h264, codec, NULL) < 0) {
+            fprintf(stderr, "H.264 decoder unavailable, H.264 frames will not be decoded\n");
+            avcodec_free_context(&rx->h264);
+            rx->h264_unavailable = true;
+            return -1;
+        }
+    }
+
+    rx->h264_packet->data = (uint8_t *)data;
+    rx->h264_packet->size = (int)len;
+    if (avcodec_send_packet(rx->h264, rx->h264_packet) < 0) {
+        rx->decode_errors++;
+        return -1;
+    }
+
+    int result = -1;
+    while (avcodec_receive_frame(rx->h264, rx->h264_frame) == 0) {
+        AVFrame *picture = rx->h264_frame;
+        result = latency_stamp_read_luma(picture->data[0], picture->width, picture->height,
+                                         picture->linesize[0], stamp_us);
+        av_frame_unref(picture);
+    }
+    return result;
+}
+#endif
+
+// Rebuild the picture from one FRAME (frame in host byte order, data = its payload)
+static void apply_frame(receiver_t *rx, const frame_message_t *frame, const uint8_t *data, size_t len,
+                        bool udp)
+{
+    uint8_t mode = frame->encoding_mode;
+
+    if (mode > ENCODING_MODE_H264) {
+        rx->decode_errors++;
+        return;
+    }
+    if (frame->width == 0 || frame->height == 0 || frame->pitch < frame->width)
+        return;
+
+    uint32_t bpp = frame->pitch / frame->width;
+    if (bpp == 0 || bpp > 4 || ensure_picture(rx, frame->width, frame->height, frame->pitch) < 0) {
+        rx->decode_errors++;
+        return;
+    }
+
+    int stamped = -1;
+    uint64_t stamp_us = 0;
+
+    if (mode == ENCODING_MODE_H264) {
+        rx->picture_valid = false;  // Not rebuilt into the RGB picture
+#ifdef HAVE_LIBAVCODEC
+        if (rx->latency_stamp)
+            stamped = h264_decode_stamp(rx, data, len, &stamp_us);
+#endif
+    } else if (mode == ENCODING_MODE_DIRTY_RECTS && frame->num_regions > 0) {
+        // Each rectangle header is followed by its pixels
+        size_t offset = 0;
+        for (int i = 0; i < frame->num_regions; i++) {
+            dirty_rectangle_t rect;
+            if (offset + sizeof(rect) > len) {
+                rx->decode_errors++;
+                rx->picture_valid = false;
+                return;
+            }
+            memcpy(&rect, data + offset, sizeof(rect));
+            offset += sizeof(rect);
+            uint32_t x = ntohl(rect.x), y = ntohl(rect.y);
+            uint32_t w = ntohl(rect.width), h = ntohl(rect.height);
+            uint32_t size = ntohl(rect.data_size);
+            if (x > frame->width || w > frame->width - x || y > frame->height || h > frame->height - y ||
+                size != (uint64_t)w * h * bpp || offset + size > len) {
+                rx->decode_errors++;
+                rx->picture_valid = false;
+                return;
+            }
+            size_t row_bytes = (size_t)w * bpp;
+            for (uint32_t row = 0; row < h; row++)
+                memcpy(rx->picture + (size_t)(y + row) * rx->pitch + (size_t)x * bpp,
+                       data + offset + row * row_bytes, row_bytes);
+            offset += size;
+        }
+    } else {
+        // Full frame (dirty rectangle mode with no rectangles carries one too)
+        size_t size = (size_t)frame->height * frame->pitch;
+        if (len < size) {
+            rx->decode_errors++;
+            return;
+        }
+        memcpy(rx->picture, data, size);
+        rx->picture_valid = true;
+    }
+
+    if (rx->latency_stamp && mode != ENCODING_MODE_H264)
+        stamped = latency_stamp_read(rx->picture, rx->width, rx->height, rx->pitch, &stamp_us);
+
+    uint64_t done_us = now_us();
+    uint32_t latency_us = done_us > frame->timestamp_us ? (uint32_t)(done_us - frame->timestamp_us) : 0;
+
+    if (rx->latency_stamp) {
+        if (stamped == 0) {
+            // The stamp carries the low 48 bits of the capture clock
+            uint64_t glass_us = (done_us - stamp_us) & LATENCY_STAMP_MASK;
+            latency_add(&rx->total.glass[mode], (uint32_t)glass_us);
+            latency_add(&rx->interval.glass[mode], (uint32_t)glass_us);
+        } else {
+            rx->total.unstamped++;
+            rx->interval.unstamped++;
+        }
+    }
+
+    rx->total.frames[mode]++;
+    rx->interval.frames[mode]++;
+    if (udp) {
+        rx->total.frames_udp++;
+        rx->interval.frames_udp++;
+    }
+    latency_add(&rx->total.latency, latency_us);
+    latency_add(&rx->interval.latency, latency_us);
+
+    if (rx->av_sync) {
+        // Shown when the audio reaches it, as the app's decoder does
+        uint64_t present_us;
+        int64_t error_us;
+        av_sync_schedule_frame(rx->av_sync, frame->timestamp_us, done_us, &present_us);
+        if (av_sync_frame_presented(rx->av_sync, frame->timestamp_us, present_us, &error_us) == 0) {
+            uint32_t error_abs = (uint32_t)(error_us < 0 ? -error_us : error_us);
+            latency_add(&rx->total.lipsync, error_abs);
+            latency_add(&rx->interval.lipsync, error_abs);
+        }
+    }
+
+    if (rx->verify_source)
+        verify_picture(rx);
+}
+
+// Play the simulated DAC up to now and report its position to the sync controller
+static void dac_advance(receiver_t *rx, uint64_t now)
+{
+    if (!rx->av_sync || rx->dac_queued == 0)
+        return;
+    rx->dac_played += (now - rx->dac_last_us) * (double)rx->audio_rate / 1e6;
+    rx->dac_last_us = now;
+    if (rx->dac_played > rx->dac_queued) {
+        rx->dac_played = (double)rx->dac_queued;
+        if (!rx->dac_dry)
+            av_sync_underrun(rx->av_sync);
+        rx->dac_dry = true;
+    } else {
+        rx->dac_dry = false;
+    }
+    av_sync_audio_position(rx->av_sync, (uint64_t)rx->dac_played, now);
+}
+
+// Queue one AUDIO message's samples on the simulated DAC (PCM is resampled like the app does)
+static void av_sync_audio(receiver_t *rx, uint64_t timestamp_us, uint32_t rate, uint16_t channels,
+                          uint16_t format, const uint8_t *data, uint32_t size)
+{
+    if (rate == 0 || channels == 0)
+        return;
+    if (!rx->av_sync || rate != rx->audio_rate || channels != rx->audio_channels) {
+        av_sync_destroy(rx->av_sync);
+        rx->av_sync = av_sync_create(rate, channels, 0);
+        if (!rx->av_sync)
+            return;
+        rx->audio_rate = rate;
+        rx->audio_channels = channels;
+        rx->dac_queued = 0;
+        rx->dac_played = 0;
+    }
+
+    uint64_t now = now_us();
+    dac_advance(rx, now);
+    if (rx->dac_queued == 0)
+        rx->dac_last_us = now;  // Starts playing now
+
+    if (format == AUDIO_FORMAT_PCM_S16LE) {
+        uint32_t frames = size / (2 * channels);
+        uint32_t needed = av_sync_max_output_frames(rx->av_sync, frames);
+        if (needed > rx->sync_out_cap) {
+            int16_t *out = realloc(rx->sync_out, (size_t)needed * channels * sizeof(int16_t));
+            if (!out)
+                return;
+            rx->sync_out = out;
+            rx->sync_out_cap = needed;
+        }
+        int n = av_sync_push_audio(rx->av_sync, timestamp_us, (const int16_t *)data, frames, rx->sync_out,
+                                   needed);
+        if (n > 0)
+            rx->dac_queued += (uint64_t)n;
+    } else if (format == AUDIO_FORMAT_OPUS) {
+        // Not decoded here: 10 ms per packet, played as is
+        rx->dac_queued += av_sync_queue_audio(rx->av_sync, timestamp_us, rate / 100);
+    }
+}
+
+static void frame_from_net(const frame_message_t *net, frame_message_t *frame)
+{
+    frame->timestamp_us = timestamp_from_net(net->timestamp_us);
+    frame->output_id = ntohl(net->output_id);
+    frame->width = ntohl(net->width);
+    frame->height = ntohl(net->height);
+    frame->format = ntohl(net->format);
+    frame->pitch = ntohl(net->pitch);
+    frame->size = ntohl(net->size);
+    frame->encoding_mode = net->encoding_mode;
+    frame->num_regions = net->num_regions;
+}
+
+static int handle_tcp_frame(receiver_t *rx, uint32_t length)
+{
+    frame_message_t net;
+    if (length < sizeof(net))
+        return -1;
+    int ret = rx_read(rx, &net, sizeof(net));
+    if (ret <= 0)
+        return ret;
+    if (length > sizeof(net) && (ret = rx_skip(rx, length - sizeof(net))) <= 0)
+        return ret;
+
+    frame_message_t frame;
+    frame_from_net(&net, &frame);
+    if (frame.size > MAX_FRAME_PAYLOAD) {
+        fprintf(stderr, "Frame payload too large: %u bytes\n", frame.size);
+        return -1;
+    }
+
+    if (frame.size > rx->payload_cap) {
+        uint8_t *payload = realloc(rx->payload, frame.size);
+        if (!payload)
+            return -1;
+        rx->payload = payload;
+        rx->payload_cap = frame.size;
+    }
+    if (frame.size > 0 && (ret = rx_read(rx, rx->payload, frame.size)) <= 0)
+        return ret;
+
+    apply_frame(rx, &frame, rx->payload, frame.size, false);
+    return 1;
+}
+
+static void handle_udp(receiver_t *rx)
+{
+    for (;;) {
+        ssize_t n = recv(rx->udp_fd, rx->udp_packet, sizeof(rx->udp_packet), MSG_DONTWAIT);
+        if (n <= 0)
+            return;
+        rx->total.bytes += n;
+        rx->interval.bytes += n;
+
+        const void *data;
+        size_t len;
+        if (udp_video_reassembler_push(rx->reasm, rx->udp_packet, n, &data, &len) != 1)
+            continue;
+        if (len < sizeof(frame_message_t))
+            continue;
+
+        frame_message_t net, frame;
+        memcpy(&net, data, sizeof(net));
+        frame_from_net(&net, &frame);
+        apply_frame(rx, &frame, (const uint8_t *)data + sizeof(net), len - sizeof(net), true);
+    }
+}
+
+// One message from the TCP stream
+// Returns 1 on success, 0 on close, -1 on error
+static int handle_message(receiver_t *rx)
+{
+    message_header_t header;
+    int ret = rx_read(rx, &header, sizeof(header));
+    if (ret <= 0)
+        return ret;
+    header.length = ntohl(header.length);
+
+    switch (header.type) {
+    case MSG_FRAME:
+        return handle_tcp_frame(rx, header.length);
+
+    case MSG_AUDIO: {
+        audio_message_t audio;
+        if (header.length < sizeof(audio))
+            return -1;
+        if ((ret = rx_read(rx, &audio, sizeof(audio))) <= 0)
+            return ret;
+        if (header.length > sizeof(audio) && (ret = rx_skip(rx, header.length - sizeof(audio))) <= 0)
+            return ret;
+        uint32_t data_size = ntohl(audio.data_size);
+        if (rx->av_sync_enabled) {
+            if (data_size > MAX_FRAME_PAYLOAD)
+                return -1;
+            if (data_size > rx->payload_cap) {
+                uint8_t *payload = realloc(rx->payload, data_size);
+                if (!payload)
+                    return -1;
+                rx->payload = payload;
+                rx->payload_cap = data_size;
+            }
+            if (data_size > 0 && (ret = rx_read(rx, rx->payload, data_size)) <= 0)
+                return ret;
+            av_sync_audio(rx, timestamp_from_net(audio.timestamp_us), ntohl(audio.sample_rate),
+                          ntohs(audio.channels), ntohs(audio.format), rx->payload, data_size);
+        } else if ((ret = rx_skip(rx, data_size)) <= 0) {
+            return ret;
+        }
+        bool opus = ntohs(audio.format) == AUDIO_FORMAT_OPUS;
+        rx->last_audio_rate = ntohl(audio.sample_rate);
+        rx->last_audio_channels = ntohs(audio.channels);
+        rx->total.audio_packets++;
+        rx->total.audio_opus_packets += opus;
+        rx->total.audio_bytes += data_size;
+        rx->interval.audio_packets++;
+        rx->interval.audio_opus_packets += opus;
+        rx->interval.audio_bytes += data_size;
+        return 1;
+    }
+
+    case MSG_CONFIG: {
+        config_message_t config;
+        if (header.length < sizeof(config))
+            return -1;
+        if ((ret = rx_read(rx, &config, sizeof(config))) <= 0)
+            return ret;
+        if (header.length > sizeof(config) && (ret = rx_skip(rx, header.length - sizeof(config))) <= 0)
+            return ret;
+        printf("CONFIG: %ux%u@%uHz\n", ntohl(config.width), ntohl(config.height), ntohl(config.refresh_rate));
+        return 1;
+    }
+
+    case MSG_PING:
+        if (header.length > 0 && (ret = rx_skip(rx, header.length)) <= 0)
+            return ret;
+        return rx_send(rx, MSG_PONG, NULL, 0) < 0 ? -1 : 1;
+
+    case MSG_PONG:
+        if (header.length > 0 && (ret = rx_skip(rx, header.length)) <= 0)
+            return ret;
+        if (rx->ping_sent_us) {
+            rx->rtt_ms = (now_us() - rx->ping_sent_us) / 1000.0;
+            rx->rtt_sum_ms += rx->rtt_ms;
+            rx->rtt_count++;
+            rx->ping_sent_us = 0;
+        }
+        return 1;
+
+    case MSG_SESSION_TICKET: {
+        session_ticket_message_t ticket;
+        if (header.length < sizeof(ticket))
+            return rx_skip(rx, header.length);
+        if ((ret = rx_read(rx, &ticket, sizeof(ticket))) <= 0)
+            return ret;
+        if (header.length > sizeof(ticket) && (ret = rx_skip(rx, header.length - sizeof(ticket))) <= 0)
+            return ret;
+        printf("Session ticket received (resume grace %u ms, not used here)\n", ntohl(ticket.grace_ms));
+        return 1;
+    }
+
+    default:
+        printf("Ignoring message type 0x%02x (%u bytes)\n", header.type, header.length);
+        return header.length > 0 ? rx_skip(rx, header.length) : 1;
+    }
+}
+
+static int open_udp_channel(receiver_t *rx, uint16_t *port)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(rx->fd, (struct sockaddr *)&addr, &addr_len) < 0)
+        return -1;
+    addr.sin_port = 0;
+
+    rx->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (rx->udp_fd < 0)
+        return -1;
+    int rcvbuf = UDP_RECV_BUFFER;
+    setsockopt(rx->udp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(rx->udp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(rx->udp_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        close(rx->udp_fd);
+        rx->udp_fd = -1;
+        return -1;
+    }
+
+    rx->reasm = udp_video_reassembler_create(MAX_FRAME_PAYLOAD);
+    if (!rx->reasm) {
+        close(rx->udp_fd);
+        rx->udp_fd = -1;
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return 0;
+}
+
+// Receiver side of the connection setup: CLIENT_HELLO, Noise/PIN, HELLO
+static int handshake(receiver_t *rx)
+{
+    message_header_t header;
+    void *payload = NULL;
+    if (protocol_receive_message(rx->fd, &header, &payload) <= 0 || header.type != MSG_CLIENT_HELLO ||
+        header.length < sizeof(client_hello_t)) {
+        fprintf(stderr, "Expected CLIENT_HELLO as first message from streamer\n");
+        free(payload);
+        return -1;
+    }
+    const uint8_t *hello = payload;
+    uint8_t version = hello[0];
+    uint8_t flags = hello[1];
+    uint16_t plaintext_pin = header.length >= 4 ? (uint16_t)((hello[2] << 8) | hello[3]) : 0xFFFF;  // Big-endian
+    free(payload);
+    printf("CLIENT_HELLO: version=%u encrypt=%s udp=%s resume=%s\n", version,
+           flags & CLIENT_HELLO_FLAG_ENCRYPT ? "yes" : "no",
+           flags & CLIENT_HELLO_FLAG_UDP_VIDEO ? "yes" : "no",
+           flags & CLIENT_HELLO_FLAG_RESUME ? "yes" : "no");
+
+    if (flags & CLIENT_HELLO_FLAG_ENCRYPT) {
+        rx->noise = noise_encryption_init(false);  // Receiver is responder
+        if (!rx->noise || noise_encryption_handshake(rx->noise, rx->fd) < 0 ||
+            !noise_encryption_is_ready(rx->noise)) {
+            fprintf(stderr, "Noise Protocol handshake failed\n");
+            return -1;
+        }
+        printf("Noise Protocol encryption established\n");
+    }
+
+    // No suspended session to go back to
+    if (flags & CLIENT_HELLO_FLAG_RESUME) {
+        fprintf(stderr, "Streamer asked to resume a session, which this receiver does not keep\n");
+        rx_send(rx, MSG_ERROR, NULL, 0);
+        return -1;
+    }
+
+    if (rx->pin != 0xFFFF) {
+        uint16_t pin = plaintext_pin;
+        if (rx->noise) {
+            message_header_t pin_header;
+            void *pin_payload = NULL;
+            if (protocol_receive_message_encrypted(rx->noise, rx->fd, &pin_header, &pin_payload) <= 0 ||
+                pin_header.type != MSG_PIN_VERIFY || pin_header.length < sizeof(pin_verify_t)) {
+                fprintf(stderr, "Expected PIN_VERIFY\n");
+                free(pin_payload);
+                return -1;
+            }
+            pin = ntohs(((pin_verify_t *)pin_payload)->pin);
+            free(pin_payload);
+        }
+        if (pin != rx->pin) {
+            fprintf(stderr, "Incorrect PIN from streamer\n");
+            if (rx->noise)
+                rx_send(rx, MSG_ERROR, NULL, 0);
+            return -1;
+        }
+        if (rx->noise && rx_send(rx, MSG_PIN_VERIFIED, NULL, 0) < 0)
+            return -1;
+        printf("PIN verified\n");
+    }
+
+    // UDP video packets are not covered by Noise, so the channel is only taken on plaintext sessions
+    uint16_t udp_port = 0;
+    if ((flags & CLIENT_HELLO_FLAG_UDP_VIDEO) && rx->accept_udp && !rx->noise) {
+        if (open_udp_channel(rx, &udp_port) == 0)
+            printf("UDP video channel on port %u\n", udp_port);
+        else
+            fprintf(stderr, "Warning: Failed to open UDP video socket, using TCP\n");
+    }
+
+    // HELLO: name (null-terminated), one mode, optional transport extension
+    size_t name_len = strlen(rx->display_name) + 1;
+    size_t hello_len = sizeof(hello_message_t) + name_len + sizeof(display_mode_t) +
+                       (udp_port ? sizeof(hello_transport_t) : 0);
+    uint8_t *out = calloc(1, hello_len);
+    if (!out)
+        return -1;
+    hello_message_t msg = {
+        .protocol_version = htons(1),
+        .num_modes = htons(1),
+        .display_name_len = htons((uint16_t)name_len)
+    };
+    display_mode_t mode = {
+        .width = htonl(rx->mode.width),
+        .height = htonl(rx->mode.height),
+        .refresh_rate = htonl(rx->mode.refresh_rate)
+    };
+    size_t offset = 0;
+    memcpy(out + offset, &msg, sizeof(msg));
+    offset += sizeof(msg);
+    memcpy(out + offset, rx->display_name, name_len);
+    offset += name_len;
+    memcpy(out + offset, &mode, sizeof(mode));
+    offset += sizeof(mode);
+    if (udp_port) {
+        hello_transport_t transport = { .udp_port = htons(udp_port), .reserved = 0 };
+        memcpy(out + offset, &transport, sizeof(transport));
+    }
+    int ret = rx_send(rx, MSG_HELLO, out, hello_len);
+    free(out);
+    if (ret < 0)
+        return -1;
+
+    printf("Sent HELLO: '%s' %ux%u@%uHz\n", rx->display_name, rx->mode.width, rx->mode.height,
+           rx->mode.refresh_rate / 100);
+
+    capabilities_message_t caps = {
+        .requires_encryption = rx->noise != NULL,
+        .audio_codecs = rx->accept_opus ? CAPABILITY_AUDIO_OPUS : 0,
+        .audio_sample_rate = htonl(rx->native_audio_rate),
+        .audio_channels = htons(rx->native_audio_channels)
+    };
+    if (rx_send(rx, MSG_CAPABILITIES, &caps, sizeof(caps)) < 0)
+        return -1;
+    return 0;
+}
+
+static void print_interval(receiver_t *rx, double seconds)
+{
+    receiver_stats_t *s = &rx->interval;
+    double avg = latency_average_ms(&s->latency);
+    latency_sort(&s->latency);
+    printf("%5.1f fps  %7.1f MB/s  (full %llu, dirty %llu, h264 %llu)  latency avg %.2f p95 %.2f ms  rtt %.2f ms",
+           stats_frames(s) / seconds, s->bytes / seconds / 1e6,
+           (unsigned long long)s->frames[ENCODING_MODE_FULL_FRAME],
+           (unsigned long long)s->frames[ENCODING_MODE_DIRTY_RECTS],
+           (unsigned long long)s->frames[ENCODING_MODE_H264],
+           avg, latency_percentile_ms(&s->latency, 0.95), rx->rtt_ms);
+    if (rx->verify_source)
+        printf("  verified %llu/%llu", (unsigned long long)rx->verified,
+               (unsigned long long)(rx->verified + rx->mismatched));
+    if (rx->latency_stamp) {
+        printf("  glass p50");
+        for (int mode = 0; mode < 3; mode++) {
+            latency_sort(&s->glass[mode]);
+            if (s->glass[mode].count)
+                printf(" %s %.2f", encoding_mode_names[mode], latency_percentile_ms(&s->glass[mode], 0.5));
+        }
+        printf(" ms");
+    }
+    if (rx->av_sync_enabled) {
+        latency_sort(&s->lipsync);
+        printf("  lip-sync p95 %.2f ms", latency_percentile_ms(&s->lipsync, 0.95));
+    }
+    printf("\n");
+}
+
+static void print_summary(receiver_t *rx, double seconds)
+{
+    receiver_stats_t *s = &rx->total;
+    uint64_t frames = stats_frames(s);
+    double avg = latency_average_ms(&s->latency);
+    latency_sort(&s->latency);
+
+    printf("\n=== Reference receiver summary ===\n");
+    printf("Duration:    %.2f s\n", seconds);
+    printf("Frames:      %llu (full %llu, dirty rects %llu, H.264 %llu; %llu over UDP)\n",
+           (unsigned long long)frames,
+           (unsigned long long)s->frames[ENCODING_MODE_FULL_FRAME],
+           (unsigned long long)s->frames[ENCODING_MODE_DIRTY_RECTS],
+           (unsigned long long)s->frames[ENCODING_MODE_H264],
+           (unsigned long long)s->frames_udp);
+    printf("Throughput:  %.1f fps, %.1f MB/s (%.1f MB total)\n",
+           seconds > 0 ? frames / seconds : 0.0, seconds > 0 ? s->bytes / seconds / 1e6 : 0.0, s->bytes / 1e6);
+    printf("Latency:     avg %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms\n",
+           avg, latency_percentile_ms(&s->latency, 0.5), latency_percentile_ms(&s->latency, 0.95),
+           latency_percentile_ms(&s->latency, 0.99), latency_percentile_ms(&s->latency, 1.0));
+    if (rx->latency_stamp) {
+        // Capture to picture as read back from the pixels, per encoding mode
+        for (int mode = 0; mode < 3; mode++) {
+            latency_list_t *glass = &s->glass[mode];
+            if (glass->count == 0)
+                continue;
+            latency_sort(glass);
+            printf("Glass %-5s  avg %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms (%zu frames)\n",
+                   encoding_mode_names[mode], latency_average_ms(glass),
+                   latency_percentile_ms(glass, 0.5), latency_percentile_ms(glass, 0.95),
+                   latency_percentile_ms(glass, 0.99), latency_percentile_ms(glass, 1.0), glass->count);
+        }
+        if (s->unstamped)
+            printf("Unstamped:   %llu pictures without a readable stamp%s\n", (unsigned long long)s->unstamped,
+#ifdef HAVE_LIBAVCODEC
+                   ""
+#else
+                   " (H.264 needs libavcodec)"
+#endif
+                   );
+    }
+    printf("Round trip:  %.2f ms avg over %llu pings\n",
+           rx->rtt_count ? rx->rtt_sum_ms / rx->rtt_count : 0.0, (unsigned long long)rx->rtt_count);
+    printf("Audio:       %llu packets (%llu Opus), %.1f KB, %.1f kbit/s, last at %u Hz, %u channels\n",
+           (unsigned long long)s->audio_packets, (unsigned long long)s->audio_opus_packets,
+           s->audio_bytes / 1024.0, seconds > 0 ? s->audio_bytes * 8 / seconds / 1000 : 0.0,
+           rx->last_audio_rate, rx->last_audio_channels);
+    if (rx->av_sync_enabled) {
+        av_sync_stats_t sync;
+        av_sync_get_stats(rx->av_sync, &sync);
+        latency_sort(&s->lipsync);
+        printf("A/V sync:    lip-sync avg %+.2f ms, |error| p50 %.2f p95 %.2f max %.2f ms (%zu frames, %llu late)\n",
+               sync.error_avg_us / 1000.0, latency_percentile_ms(&s->lipsync, 0.5),
+               latency_percentile_ms(&s->lipsync, 0.95), latency_percentile_ms(&s->lipsync, 1.0),
+               s->lipsync.count, (unsigned long long)sync.late_frames);
+        printf("             audio queue %.1f/%.1f ms, correction %+d ppm, %llu chunks dropped, %llu underruns\n",
+               sync.queue_us / 1000.0, sync.target_us / 1000.0, sync.correction_ppm,
+               (unsigned long long)sync.dropped_chunks, (unsigned long long)sync.underruns);
+    }
+    if (rx->reasm)
+        printf("UDP frames:  %llu lost, %llu recovered by FEC\n",
+               (unsigned long long)udp_video_reassembler_get_lost_frames(rx->reasm),
+               (unsigned long long)udp_video_reassembler_get_recovered_frames(rx->reasm));
+    if (rx->decode_errors)
+        printf("Errors:      %llu malformed frames\n", (unsigned long long)rx->decode_errors);
+    if (rx->verify_source)
+        printf("Verify:      %llu pixel-exact, %llu mismatched, %llu not checked (H.264 or no base picture)\n",
+               (unsigned long long)rx->verified, (unsigned long long)rx->mismatched,
+               (unsigned long long)rx->unverifiable);
+}
+
+static int parse_mode(const char *text, display_mode_t *mode)
+{
+    unsigned int w, h, hz = 60;
+    if (sscanf(text, "%ux%u@%u", &w, &h, &hz) < 2 || w == 0 || h == 0 || hz == 0)
+        return -1;
+    mode->width = w;
+    mode->height = h;
+    mode->refresh_rate = hz * 100;  // Hz * 100
+    return 0;
+}
+
+static void print_usage(const char *prog_name)
+{
+    fprintf(stderr, "Usage: %s [OPTIONS]\n", prog_name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --port PORT          TCP port to listen on (default: %d)\n", DEFAULT_TV_PORT);
+    fprintf(stderr, "  --pin PIN            Require this PIN from the streamer (default: none)\n");
+    fprintf(stderr, "  --name NAME          Display name sent in HELLO (default: Reference Receiver)\n");
+    fprintf(stderr, "  --mode WxH[@HZ]      Display mode sent in HELLO (default: 1920x1080@60)\n");
+    fprintf(stderr, "  --udp                Accept the UDP video channel when offered\n");
+    fprintf(stderr, "  --opus               Ask for Opus audio (CAPABILITIES) instead of PCM\n");
+    fprintf(stderr, "  --audio-format HZ:CH Native audio output to announce; PCM arrives resampled to it\n");
+    fprintf(stderr, "  --verify SPEC        Check pictures against this frame source (as --source on the streamer)\n");
+    fprintf(stderr, "  --latency-stamp      Read capture stamps from pictures (streamer --latency-stamp)\n");
+    fprintf(stderr, "  --av-sync            Play audio into a simulated DAC and report lip-sync error\n");
+    fprintf(stderr, "  --duration SEC       Stop after this long (default: until the streamer disconnects)\n");
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int port = DEFAULT_TV_PORT;
+    double duration = 0;
+    const char *verify_spec = NULL;
+    receiver_t rx = {
+        .fd = -1,
+        .udp_fd = -1,
+        .pin = 0xFFFF,
+        .display_name = "Reference Receiver",
+        .mode = { .width = 1920, .height = 1080, .refresh_rate = 6000 }
+    };
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--port") == 0 && has_value) {
+            port = atoi(argv[++i]);
+            if (port <= 0 || port > 65535) {
+                fprintf(stderr, "Error: Invalid port: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pin") == 0 && has_value) {
+            int pin = atoi(argv[++i]);
+            if (pin < 0 || pin > 9999) {
+                fprintf(stderr, "Error: PIN must be 4 digits\n");
+                return 1;
+            }
+            rx.pin = (uint16_t)pin;
+        } else if (strcmp(argv[i], "--name") == 0 && has_value) {
+            rx.display_name = argv[++i];
+        } else if (strcmp(argv[i], "--mode") == 0 && has_value) {
+            if (parse_mode(argv[++i], &rx.mode) < 0) {
+                fprintf(stderr, "Error: Invalid mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--udp") == 0) {
+            rx.accept_udp = true;
+        } else if (strcmp(argv[i], "--verify") == 0 && has_value) {
+            verify_spec = argv[++i];
+        } else if (strcmp(argv[i], "--opus") == 0) {
+            rx.accept_opus = true;
+        } else if (strcmp(argv[i], "--audio-format") == 0 && has_value) {
+            unsigned rate = 0, channels = 2;
+            if (sscanf(argv[++i], "%u:%u", &rate, &channels) < 1 || rate < 8000 || rate > 192000 ||
+                channels < 1 || channels > 2) {
+                fprintf(stderr, "Error: Invalid audio format: %s\n", argv[i]);
+                return 1;
+            }
+            rx.native_audio_rate = rate;
+            rx.native_audio_channels = (uint16_t)channels;
+        } else if (strcmp(argv[i], "--latency-stamp") == 0) {
+            rx.latency_stamp = true;
+        } else if (strcmp(argv[i], "--av-sync") == 0) {
+            rx.av_sync_enabled = true;
+        } else if (strcmp(argv[i], "--duration") == 0 && has_value) {
+            duration = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (verify_spec) {
+        rx.verify_source = frame_source_create_from_spec(verify_spec);
+        if (!rx.verify_source)
+            return 1;
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+    printf("Reference receiver listening on port %d\n", port);
+
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    rx.fd = accept(listen_fd, (struct sockaddr *)&peer, &peer_len);
+    close(listen_fd);
+    if (rx.fd < 0) {
+        perror("accept");
+        return 1;
+    }
+    char peer_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &peer.sin_addr, peer_str, sizeof(peer_str));
+    printf("Connection from %s:%d\n", peer_str, ntohs(peer.sin_port));
+
+    int ret = 1;
+    if (handshake(&rx) < 0)
+        goto out;
+
+    uint64_t start_us = now_us();
+    uint64_t last_report_us = start_us;
+    uint64_t last_ping_us = start_us;
+    uint64_t last_feedback_us = start_us;
+    ret = 0;
+
+    while (!g_stop) {
+        struct pollfd pfds[2] = {
+            { .fd = rx.fd, .events = POLLIN },
+            { .fd = rx.udp_fd, .events = POLLIN }
+        };
+        int n = poll(pfds, rx.udp_fd >= 0 ? 2 : 1, 100);
+        if (n < 0 && errno != EINTR) {
+            perror("poll");
+            ret = 1;
+            break;
+        }
+
+        if (n > 0 && (pfds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            int result = handle_message(&rx);
+            if (result <= 0) {
+                if (result < 0) {
+                    fprintf(stderr, "Stream error\n");
+                    ret = 1;
+                } else {
+                    printf("Streamer disconnected\n");
+                }
+                break;
+            }
+        }
+        if (n > 0 && rx.udp_fd >= 0 && (pfds[1].revents & POLLIN))
+            handle_udp(&rx);
+
+        uint64_t now = now_us();
+        dac_advance(&rx, now);
+        if (rx.reasm && now - last_feedback_us >= FEEDBACK_INTERVAL_US) {
+            video_feedback_message_t feedback;
+            udp_video_reassembler_take_feedback(rx.reasm, &feedback);
+            feedback.packets_expected = htonl(feedback.packets_expected);
+            feedback.packets_lost = htonl(feedback.packets_lost);
+            feedback.frames_completed = htonl(feedback.frames_completed);
+            feedback.frames_lost = htonl(feedback.frames_lost);
+            feedback.frames_recovered = htonl(feedback.frames_recovered);
+            rx_send(&rx, MSG_VIDEO_FEEDBACK, &feedback, sizeof(feedback));
+            last_feedback_us = now;
+        }
+        if (now - last_ping_us >= PING_INTERVAL_US && !rx.ping_sent_us) {
+            rx.ping_sent_us = now;
+            rx_send(&rx, MSG_PING, NULL, 0);
+            last_ping_us = now;
+        }
+        if (now - last_report_us >= REPORT_INTERVAL_US) {
+            print_interval(&rx, (now - last_report_us) / 1e6);
+            stats_reset(&rx.interval);
+            last_report_us = now;
+        }
+        if (duration > 0 && now - start_us >= (uint64_t)(duration * 1e6))
+            break;
+    }
+
+    print_summary(&rx, (now_us() - start_us) / 1e6);
+    if (rx.verify_source && (rx.mismatched > 0 || rx.decode_errors > 0))
+        ret = 2;
+
+out:
+    if (rx.noise)
+        noise_encryption_cleanup(rx.noise);
+    if (rx.fd >= 0)
+        close(rx.fd);
+    if (rx.udp_fd >= 0)
+        close(rx.udp_fd);
+    udp_video_reassembler_destroy(rx.reasm);
+    frame_source_destroy(rx.verify_source);
+    free(rx.picture);
+    free(rx.payload);
+    free(rx.source_hashes);
+    av_sync_destroy(rx.av_sync);
+    free(rx.sync_out);
+    stats_free(&rx.total);
+    stats_free(&rx.interval);
+#ifdef HAVE_LIBAVCODEC
+    avcodec_free_context(&rx.h264);
+    av_packet_free(&rx.h264_packet);
+    av_frame_free(&rx.h264_frame);
+#endif
+    return ret;
+}